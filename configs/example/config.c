@@ -34,14 +34,55 @@ struct config config = {
      */
     CONFIG_HEADER
 
+    /**
+     * Optionally, each cluster gets its own copy of the hypervisor's code
+     * and read-only data.
+     */
+    .hyp_replication = {
+        .enable = false,
+    },
+
     /**
      * This defines an array of shared memory objects that may be associated
      * with inter-partition communication objects in the VM platform definition
      * below using the shared memory object ID, ie, its index in the list.
      */
-    .shmemlist_size = 1,
+    .shmemlist_size = 2,
     .shmemlist = (struct shmem[]) {
-        [0] = {.size = 0x1000,}
+        [0] = {.size = 0x1000,},
+        /* Core dump of the first VM */
+        [1] = {.size = 0x200000,}
+    },
+
+    /**
+     * Optionally, a VM connected to a shared memory object can be made the
+     * manager of all other VMs. It is then notified through that object's
+     * IPC interrupts, indexed by VM id, whenever a VM halts, crashes or is
+     * reset.
+     */
+    .vm_manager = {
+        .enable = false,
+        .shmem_id = 0,
+    },
+
+    /**
+     * Optionally, the hypervisor measures every VM's image and
+     * configuration at load time. A VM can then request a report on itself
+     * or on a VM it created, authenticated with HMAC-SHA256 under this key.
+     */
+    .attestation = {
+        .enable = false,
+        .key = {0},
+    },
+
+    /**
+     * Optionally, the manager VM can hand the hypervisor a new image of
+     * itself, built for this same configuration, and have it take over the
+     * running VMs (HC_LIVE_UPDATE). The image is only accepted along with
+     * its HMAC-SHA256 under the attestation key above.
+     */
+    .live_update = {
+        .enable = false,
     },
 
     /**
@@ -64,6 +105,104 @@ struct config config = {
             .cpu_affinity = 0x3,
             .colors = 0x0F0F0F0F,
 
+            /**
+             * Faults the hypervisor can not handle are reflected back into
+             * the guest. After 32 of them, the VM is reset.
+             */
+            .fault = {
+                .policy = VM_FAULT_RESET,
+                .limit = 32,
+            },
+
+            /**
+             * A virtual watchdog. On Arm it is an SBSA generic watchdog
+             * whose control and refresh frames are mapped at base_addr and
+             * base_addr + 0x1000. On RISC-V it is driven through an SBI
+             * extension. The interrupt is injected on the first expiry and
+             * the action taken on the second one.
+             */
+            .watchdog = {
+                .enable = true,
+                .timeout_us = 1000000,
+                .action = VM_WATCHDOG_RESET,
+                .base_addr = 0x2a440000,
+                .interrupt = 59,
+            },
+
+            /**
+             * A console multiplexed with the other VMs' on the hypervisor's
+             * uart, reachable both through a ring in the last page of the
+             * VM's memory and through an emulated PL011. Interrupt 37
+             * signals input on either.
+             */
+            .console = {
+                .enable = true,
+                .ring = 0x800ff000,
+                .uart_base = 0x1c0a0000,
+                .interrupt = 37,
+            },
+
+            /**
+             * Let the GDB stub attach to this VM, by typing Ctrl-A and 'g'
+             * on the uart while the VM has the console input focus.
+             */
+            .debug = {
+                .enable = true,
+            },
+
+            /**
+             * Set the mode to VM_REPLAY_RECORD to record this VM's
+             * interrupts, emulated register reads and call results, and to
+             * VM_REPLAY_REPLAY to run it again with the same inputs. The log
+             * goes to shared memory object shmem_id, which must then be
+             * added to shmemlist, e.g. with a size of 0x100000. Needs
+             * cpu_num to be 1 and the platform's PMU interrupt.
+             */
+            .replay = {
+                .mode = VM_REPLAY_NONE,
+            },
+
+            /**
+             * Sample this VM's working set every 500ms. The report is read
+             * with the HC_WSS hypercall.
+             */
+            .working_set = {
+                .enable = true,
+                .interval_us = 500000,
+            },
+
+            /**
+             * Write an ELF core dump of this VM to shared memory object 1
+             * if it crashes.
+             */
+            .coredump = {
+                .enable = true,
+                .shmem_id = 1,
+                .mapped_only = false,
+            },
+
+            /**
+             * Let this VM use SVE, or RVV, with vectors of up to 256 bits.
+             */
+            .vector = {
+                .enable = true,
+                .max_vl = 32,
+            },
+
+            /**
+             * Let this VM use memory tagging. Its memory is then mapped
+             * Normal-Tagged at stage 2.
+             */
+            .mte = {
+                .enable = true,
+            },
+
+            /**
+             * The cpus this VM runs on will not enter idle states with a
+             * wake-up latency above 100us.
+             */
+            .idle_latency_us = 100,
+
             .platform = {
 
                 .cpu_num = 2,
@@ -99,6 +238,25 @@ struct config config = {
                     }
                 },
 
+                /**
+                 * PCIe functions assigned from the platform's host bridge.
+                 * The VM finds them behind an emulated host bridge with its
+                 * ECAM window at ecam_base. Here, physical function 01:00.0
+                 * shows up as 00:01.0 with its INTx routed to interrupt 35.
+                 */
+                .pci = {
+                    .ecam_base = 0x40000000,
+                    .bus_num = 1,
+                    .func_num = 1,
+                    .funcs = (struct pci_func_config[]) {
+                        {
+                            .bdf = PCI_BDF(1, 0, 0),
+                            .vbdf = PCI_BDF(0, 1, 0),
+                            .intx = 35,
+                        }
+                    }
+                },
+
                 .arch = {
                     .gic = {
                         .gicc_addr = 0x2C000000,
@@ -43,15 +43,25 @@ void internal_abort_handler(uint64_t gprs[]) {
 
 void aborts_data_lower(uint64_t iss, uint64_t far, uint64_t il)
 {
-    if (!(iss & ESR_ISS_DA_ISV_BIT) || (iss & ESR_ISS_DA_FnV_BIT)) {
-        ERROR("no information to handle data abort (0x%x)", far);
-    }
-
+    bool write = iss & ESR_ISS_DA_WnR_BIT ? true : false;
     uint64_t DSFC =
         bit64_extract(iss, ESR_ISS_DA_DSFC_OFF, ESR_ISS_DA_DSFC_LEN) & (0xf << 2);
 
+    /* Access flags cleared by the working-set estimator, ISV may be clear */
+    if (DSFC == ESR_ISS_DA_DSFC_ACCESS && wss_access_fault(cpu.vcpu->vm, far)) {
+        return;
+    }
+
+    if (!(iss & ESR_ISS_DA_ISV_BIT) || (iss & ESR_ISS_DA_FnV_BIT)) {
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, far, write,
+                   "no information to handle data abort");
+        return;
+    }
+
     if (DSFC != ESR_ISS_DA_DSFC_TRNSLT) {
-        ERROR("data abort is not translation fault - cant deal with it");
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, far, write,
+                   "data abort is not translation fault");
+        return;
     }
 
     vaddr_t addr = far;
@@ -61,32 +71,70 @@ void aborts_data_lower(uint64_t iss, uint64_t far, uint64_t il)
         emul.addr = addr;
         emul.width =
             (1 << bit64_extract(iss, ESR_ISS_DA_SAS_OFF, ESR_ISS_DA_SAS_LEN));
-        emul.write = iss & ESR_ISS_DA_WnR_BIT ? true : false;
+        emul.write = write;
         emul.reg = bit64_extract(iss, ESR_ISS_DA_SRT_OFF, ESR_ISS_DA_SRT_LEN);
         emul.reg_width =
             4 + (4 * bit64_extract(iss, ESR_ISS_DA_SF_OFF, ESR_ISS_DA_SF_LEN));
         emul.sign_ext =
             bit64_extract(iss, ESR_ISS_DA_SSE_OFF, ESR_ISS_DA_SSE_LEN);
 
-        // TODO: check if the access is aligned. If not, inject an exception in
-        // the vm
-        if (handler(&emul)) {
+        if (emul.addr & (emul.width - 1)) {
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_ALIGN, far, write,
+                       "unaligned emulated access");
+        } else if (handler(&emul)) {
+            if (!write && cpu.vcpu->vm->vrr.mode != VM_REPLAY_NONE) {
+                vrr_reg(cpu.vcpu, VRR_EV_MMIO, addr, emul.reg);
+            }
             uint64_t pc_step = 2 + (2 * il);
             vcpu_writepc(cpu.vcpu, vcpu_readpc(cpu.vcpu) + pc_step);
         } else {
-            ERROR("data abort emulation failed (0x%x)", far);
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, far, write,
+                       "data abort emulation failed");
         }
     } else {
         struct vcpu* vcpu = cpu.vcpu;
+        bool handled = false;
         list_foreach(vcpu->vm->mem_abort_list, struct hndl_mem_abort_node, node)
         {
             mem_abort_handler_t handler = node->hndl_mem_abort.handler;
             if (handler != NULL) {
                 if (handler(vcpu, addr)) {
-                    ERROR("handler abort failed (0x%x)", far);
+                    vcpu_fault(vcpu, VCPU_FAULT_DATA, far, write,
+                               "handler abort failed");
+                    return;
                 }
+                handled = true;
             }
         }
+
+        if (!handled) {
+            vcpu_fault(vcpu, VCPU_FAULT_DATA, far, write,
+                       "no handler for data abort");
+        }
+    }
+}
+
+void aborts_inst_lower(uint64_t iss, uint64_t far, uint64_t il)
+{
+    uint64_t IFSC =
+        bit64_extract(iss, ESR_ISS_DA_DSFC_OFF, ESR_ISS_DA_DSFC_LEN) & (0xf << 2);
+
+    if (IFSC == ESR_ISS_DA_DSFC_ACCESS && wss_access_fault(cpu.vcpu->vm, far)) {
+        return;
+    }
+
+    vcpu_fault(cpu.vcpu, VCPU_FAULT_INSTR, far, false,
+               "instruction abort");
+}
+
+/* SMCCC calls return their results in x0 to x3 */
+#define CALL_RESULT_REGS (4)
+
+/* Records, or replays, the results of the call fid the vcpu just made */
+static void call_vrr(struct vcpu* vcpu, uint64_t fid)
+{
+    for (size_t i = 0; i < CALL_RESULT_REGS; i++) {
+        vrr_reg(vcpu, VRR_EV_CALL, fid, i);
     }
 }
 
@@ -107,6 +155,10 @@ void smc64_handler(uint64_t iss, uint64_t far, uint64_t il)
             }
         }
     }
+
+    if (vcpu->vm->vrr.mode != VM_REPLAY_NONE) {
+        call_vrr(vcpu, smc_fid);
+    }
 }
 
 void hvc64_handler(uint64_t iss, uint64_t far, uint64_t il)
@@ -125,13 +177,30 @@ void hvc64_handler(uint64_t iss, uint64_t far, uint64_t il)
             }
         }
     }
+
+    if (vcpu->vm->vrr.mode != VM_REPLAY_NONE) {
+        call_vrr(vcpu, x0);
+    }
 }
 
 void sysreg_handler(uint64_t iss, uint64_t far, uint64_t il)
 {
     vaddr_t reg_addr = iss & ESR_ISS_SYSREG_ADDR;
     emul_handler_t handler = vm_emul_get_reg(cpu.vcpu->vm, reg_addr);
-    if(handler != NULL){
+    if (handler == NULL && lazyregs_sysreg_trap(cpu.vcpu, reg_addr)) {
+        /* The vcpu now owns the keys, the access is retried */
+    } else if (handler == NULL && cpu.vcpu->arch.dbg.active &&
+        bit64_extract(iss, ESR_ISS_SYSREG_OP0_OFF, ESR_ISS_SYSREG_OP0_LEN) ==
+            ESR_ISS_SYSREG_OP0_DEBUG) {
+        /* The debug registers are RAZ/WI while the GDB stub holds them */
+        if (iss & ESR_ISS_SYSREG_DIR) {
+            vcpu_writereg(cpu.vcpu,
+                          bit64_extract(iss, ESR_ISS_SYSREG_REG_OFF,
+                                        ESR_ISS_SYSREG_REG_LEN),
+                          0);
+        }
+        vcpu_writepc(cpu.vcpu, vcpu_readpc(cpu.vcpu) + 2 + (2 * il));
+    } else if(handler != NULL){
         struct emul_access emul;
         emul.addr = reg_addr;
         emul.width = 8;
@@ -141,21 +210,90 @@ void sysreg_handler(uint64_t iss, uint64_t far, uint64_t il)
         emul.sign_ext = false;
 
         if (handler(&emul)) {
+            if (!emul.write && cpu.vcpu->vm->vrr.mode != VM_REPLAY_NONE) {
+                vrr_reg(cpu.vcpu, VRR_EV_SYSREG, reg_addr, emul.reg);
+            }
             uint64_t pc_step = 2 + (2 * il);
             vcpu_writepc(cpu.vcpu, vcpu_readpc(cpu.vcpu) + pc_step);
         } else {
-            ERROR("register access emulation failed (0x%x)", reg_addr);
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_UNDEF, reg_addr, emul.write,
+                       "register access emulation failed");
         }
     } else {
-        ERROR("no emulation handler for register access (0x%x at 0x%x)",
-              reg_addr, vcpu_readpc(cpu.vcpu));
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_UNDEF, reg_addr,
+                   !(iss & ESR_ISS_SYSREG_DIR),
+                   "no emulation handler for register access");
+    }
+}
+
+void aborts_debug_lower(uint64_t iss, uint64_t far, uint64_t il)
+{
+    vdbg_trap(cpu.vcpu, false, 0);
+}
+
+void aborts_step_lower(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /* Replay steps up to the next interrupt, otherwise it is the stub's */
+    if (!vrr_step(cpu.vcpu)) {
+        vdbg_trap(cpu.vcpu, false, 0);
+    }
+}
+
+void wfi_handler(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /* Only trapped while the VM is recorded or replayed */
+    vrr_wfi(cpu.vcpu);
+    vcpu_writepc(cpu.vcpu, vcpu_readpc(cpu.vcpu) + 2 + (2 * il));
+}
+
+void vec_handler(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /* Loads the vcpu's vector registers, the instruction is then retried */
+    if (!vec_trap(cpu.vcpu)) {
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_UNDEF, 0, false,
+                   "vector instruction not available");
     }
 }
 
-abort_handler_t abort_handlers[64] = {[ESR_EC_DALEL] = aborts_data_lower,
+void pauth_handler(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /* Loads the vcpu's keys, the instruction is then retried */
+    if (!lazyregs_pauth_trap(cpu.vcpu)) {
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_UNDEF, 0, false,
+                   "pointer authentication not available");
+    }
+}
+
+void aborts_watch_lower(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /* far only holds the page offset of the ipa, the va is in FAR_EL2 */
+    vdbg_trap(cpu.vcpu, true, MRS(FAR_EL2));
+}
+
+void brk64_handler(uint64_t iss, uint64_t far, uint64_t il)
+{
+    /**
+     * Breakpoint instructions only trap while the GDB stub routes debug
+     * exceptions here. The stub uses hardware breakpoints, so these belong
+     * to the guest, which gets them back as if nothing was in between.
+     */
+    vcpu_arch_inject_sync(cpu.vcpu,
+                          (ESR_EC_BRK64 << ESR_EC_OFF) | ESR_IL_BIT | iss);
+}
+
+abort_handler_t abort_handlers[64] = {[ESR_EC_WFIE] = wfi_handler,
+                                      [ESR_EC_FP] = vec_handler,
+                                      [ESR_EC_PAC] = pauth_handler,
+                                      [ESR_EC_SVE] = vec_handler,
+                                      [ESR_EC_DALEL] = aborts_data_lower,
+                                      [ESR_EC_IALEL] = aborts_inst_lower,
                                       [ESR_EC_SMC64] = smc64_handler,
                                       [ESR_EC_SYSRG] = sysreg_handler,
-                                      [ESR_EC_HVC64] = hvc64_handler};
+                                      [ESR_EC_HVC64] = hvc64_handler,
+                                      [ESR_EC_BKPTL] = aborts_debug_lower,
+                                      [ESR_EC_SSTPL] = aborts_step_lower,
+                                      [ESR_EC_WTCHL] = aborts_watch_lower,
+                                      [ESR_EC_BRK64] = brk64_handler};
 
 void aborts_sync_handler()
 {
@@ -171,8 +309,13 @@ void aborts_sync_handler()
     uint64_t iss = bit64_extract(esr, ESR_ISS_OFF, ESR_ISS_LEN);
 
     abort_handler_t handler = abort_handlers[ec];
-    if (handler)
+    if (handler) {
         handler(iss, ipa_fault_addr, il);
-    else
-        ERROR("no handler for abort ec = 0x%x iss: 0x%x", ec, iss);  // unknown guest exception
+    } else {
+        /* unknown guest exception */
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_UNDEF, ec, false,
+                   "no handler for synchronous exception class");
+    }
+
+    cpu_trap_exit();
 }
@@ -27,6 +27,7 @@ void cache_arch_enumerate(struct cache *dscrp)
          * in the platform descrption.
          */
         *dscrp = platform.cache;
+        return;
     }
 
     uint64_t clidr = 0;
@@ -124,3 +125,21 @@ void cache_flush_range(vaddr_t base, size_t size)
 
     DMB(ish);
 }
+
+void cache_clean_range(vaddr_t base, size_t size)
+{
+    uint64_t ctr = MRS(CTR_EL0);
+    /* DminLine is the log2 of the number of words in the smallest line */
+    size_t min_line_size = 4UL << bit64_extract(ctr, CTR_DMINLINE_OFF,
+        CTR_DMINLINE_LEN);
+    vaddr_t cache_addr = base & ~(min_line_size - 1);
+
+    while(cache_addr < (base + size)){
+        asm volatile (
+            "dc cvac, %0\n\t"
+            :: "r"(cache_addr));
+        cache_addr += min_line_size;
+    }
+
+    DSB(sy);
+}
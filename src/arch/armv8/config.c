@@ -19,3 +19,8 @@ void config_arch_vm_adjust_to_va(struct vm_config *vm_config, struct config* con
 {
     adjust_ptr(vm_config->platform.arch.smmu.smmu_groups, config);
 }
+
+void config_arch_vm_adjust_from_va(struct vm_config *vm_config, struct config* config, paddr_t phys)
+{
+    unadjust_ptr(vm_config->platform.arch.smmu.smmu_groups, config);
+}
@@ -0,0 +1,55 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <coredump.h>
+#include <vm.h>
+#include <lu.h>
+
+#define SPSR_M_MSK (0xf)
+#define SPSR_M_EL1H (0x5)
+
+void coredump_arch_gregs(struct vcpu* vcpu, uint64_t* gregs)
+{
+    struct arch_regs* regs = vcpu->regs;
+
+    for (size_t i = 0; i < 31; i++) {
+        gregs[i] = regs->x[i];
+    }
+    gregs[31] = (regs->spsr_el2 & SPSR_M_MSK) == SPSR_M_EL1H
+                    ? vcpu->arch.sysregs.vm.sp_el1
+                    : vcpu->arch.sysregs.vm.sp_el0;
+    gregs[32] = regs->elr_el2;
+    gregs[33] = regs->spsr_el2;
+}
+
+/**
+ * The hypervisor's own notes hold the same vcpu and vGIC state, in the same
+ * layout, as a live update record.
+ */
+size_t coredump_arch_vcpu_size()
+{
+    return lu_arch_vcpu_size();
+}
+
+void coredump_arch_vcpu(struct vcpu* vcpu, void* buf)
+{
+    lu_arch_vcpu_save(vcpu, buf);
+}
+
+size_t coredump_arch_vm_size(struct vm* vm)
+{
+    return lu_arch_vm_size(vm);
+}
+
+void coredump_arch_vm(struct vm* vm, void* buf)
+{
+    lu_arch_vm_save(vm, buf);
+}
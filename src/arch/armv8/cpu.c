@@ -54,9 +54,37 @@ cpuid_t cpu_mpidr_to_id(unsigned long mpidr)
 }
 
 
-void cpu_arch_idle()
+/**
+ * Without a description of the platform idle states keep powering down the
+ * core, which is what the firmware most likely supports.
+ */
+static const struct idle_state cpu_arch_default_idle_states[] = {
+    {
+        .arch_state = PSCI_POWER_STATE_LVL_0 | PSCI_STATE_TYPE_POWERDOWN,
+        .powerdown = true,
+    },
+};
+
+const struct idle_state* idle_arch_default_states(size_t* num)
 {
-    int64_t err = psci_power_down(PSCI_WAKEUP_IDLE);
+    *num = sizeof(cpu_arch_default_idle_states) /
+           sizeof(cpu_arch_default_idle_states[0]);
+    return cpu_arch_default_idle_states;
+}
+
+void cpu_arch_idle(size_t state)
+{
+    const struct idle_state* idle_state = idle_get_state(state);
+    int64_t err = 0;
+
+    if (idle_state == NULL) {
+        asm volatile("wfi");
+    } else if (!idle_state->powerdown) {
+        err = psci_cpu_suspend(idle_state->arch_state, 0, 0);
+    } else {
+        err = psci_power_down(PSCI_WAKEUP_IDLE, idle_state->arch_state);
+    }
+
     if(err) {
         switch (err) {
             case PSCI_E_NOT_SUPPORTED:
@@ -97,14 +97,23 @@ void gic_init()
 
 void gic_handle()
 {
-    uint32_t ack = gicc_iar();
-    irqid_t id = bit32_extract(ack, GICC_IAR_ID_OFF, GICC_IAR_ID_LEN);
+    /**
+     * Keep acknowledging until the cpu interface reports a spurious id, so
+     * that interrupts pending at the same time are serviced in a single
+     * exit instead of paying a full guest entry/exit for each of them.
+     */
+    for (size_t i = 0; i < GIC_MAX_IRQS_PER_ENTRY; i++) {
+        uint32_t ack = gicc_iar();
+        irqid_t id = bit32_extract(ack, GICC_IAR_ID_OFF, GICC_IAR_ID_LEN);
+
+        if (id >= GIC_FIRST_SPECIAL_INTID) break;
 
-    if (id < GIC_FIRST_SPECIAL_INTID) {
         enum irq_res res = interrupts_handle(id);
         gicc_eoir(ack);
         if (res == HANDLED_BY_HYP) gicc_dir(ack);
     }
+
+    cpu_irq_exit();
 }
 
 uint8_t gicd_get_prio(irqid_t int_id)
@@ -232,9 +232,13 @@ void gic_send_sgi(cpuid_t cpu_target, irqid_t sgi_num)
 {
     if (sgi_num < GIC_MAX_SGIS) {
         unsigned long mpidr = cpu_id_to_mpidr(cpu_target) & MPIDR_AFF_MSK;
-        /* We only support two affinity levels */
-        uint64_t sgi = (MPIDR_AFF_LVL(mpidr, 1) << ICC_SGIR_AFF1_OFFSET) |
-                       (1UL << MPIDR_AFF_LVL(mpidr, 0)) |
+        /* Aff0 is selected in ranges of 16 through the range selector */
+        uint64_t sgi = (MPIDR_AFF_LVL(mpidr, 3) << ICC_SGIR_AFF3_OFFSET) |
+                       (MPIDR_AFF_LVL(mpidr, 2) << ICC_SGIR_AFF2_OFFSET) |
+                       (MPIDR_AFF_LVL(mpidr, 1) << ICC_SGIR_AFF1_OFFSET) |
+                       ((MPIDR_AFF_LVL(mpidr, 0) / ICC_SGIR_TRGLSTFLT_LEN)
+                        << ICC_SGIR_RS_OFF) |
+                       (1UL << (MPIDR_AFF_LVL(mpidr, 0) % ICC_SGIR_TRGLSTFLT_LEN)) |
                        (sgi_num << ICC_SGIR_SGIINTID_OFF);
         MSR(ICC_SGI1R_EL1, sgi);
     }
@@ -29,6 +29,13 @@ struct cpu_arch {
         struct vcpu * next_vcpu;
         struct list event_list;
     } vtimer;
+    /* The vcpus the keys and tagging registers belong to, see lazyregs.c */
+    struct {
+        struct vcpu* pauth_owner;
+        struct vcpu* mte_owner;
+    } lazyregs;
+    /* The vcpu the record/replay counter is counting for, see vrr.c */
+    struct vcpu* vrr_vcpu;
 };
 
 unsigned long cpu_id_to_mpidr(cpuid_t id);
@@ -17,6 +17,8 @@
 #define __ARCH_CROSSCONHYP_H__
 
 #define CROSSCONHYP_VAS_BASE    (0xba0000000000)
+/* Devices and global dynamic memory, off the image's root table entry */
+#define CROSSCONHYP_DMEM_BASE   (0xba8000000000)
 #define CROSSCONHYP_CPU_BASE    (0xbb0000000000)
 #define CROSSCONHYP_VM_BASE     (0xbc0000000000)
 #define CROSSCONHYP_VAS_TOP     (0xbf0000000000)
@@ -39,7 +39,8 @@
 #define GIC_CONFIG_BITS 2
 #define GIC_SEC_BITS 2
 #define GIC_SGI_BITS 8
-#define GICD_IROUTER_INV (~MPIDR_AFF_MSK)
+/* Points to an unexisting Aff2 so the interrupt is not delivered anywhere */
+#define GICD_IROUTER_INV (~MPIDR_AFF_MSK | (0xffUL << 16))
 #define GIC_LOWEST_PRIO (0xff)
 
 #define GIC_INT_REG(NINT) (NINT / (sizeof(uint32_t) * 8))
@@ -69,6 +70,15 @@
 #define GIC_NUM_APR_REGS ((1UL << (GIC_PRIO_BITS - 1)) / (sizeof(uint32_t) * 8))
 #define GIC_NUM_LIST_REGS (64)
 
+/**
+ * Maximum number of interrupts acknowledged in a single hypervisor IRQ entry
+ * before returning to the guest. Bounds the time spent in the handler under
+ * interrupt storms. Can be overridden at build time.
+ */
+#ifndef GIC_MAX_IRQS_PER_ENTRY
+#define GIC_MAX_IRQS_PER_ENTRY (16)
+#endif
+
 /* Distributor Control Register, GICD_CTLR */
 
 #define GICD_CTLR_EN_BIT (0x1)
@@ -240,6 +250,15 @@ struct gicr_hw {
 #define ICC_SGIR_TRGLSTFLT(sgir) \
     bit64_extract(sgir, ICC_SGIR_TRGLSTFLT_OFF, ICC_SGIR_TRGLSTFLT_LEN)
 #define ICC_SGIR_AFF1_OFFSET    (16)
+#define ICC_SGIR_AFF2_OFFSET    (32)
+#define ICC_SGIR_AFF3_OFFSET    (48)
+#define ICC_SGIR_AFF(sgir, lvl) \
+    bit64_extract(sgir, ((lvl) == 1 ? ICC_SGIR_AFF1_OFFSET :\
+        (lvl) == 2 ? ICC_SGIR_AFF2_OFFSET : ICC_SGIR_AFF3_OFFSET), 8)
+#define ICC_SGIR_RS_OFF         (44)
+#define ICC_SGIR_RS_LEN         (4)
+#define ICC_SGIR_RS(sgir) \
+    bit64_extract(sgir, ICC_SGIR_RS_OFF, ICC_SGIR_RS_LEN)
 
 #define ICC_SRE_ENB_BIT  (0x8UL)
 #define ICC_SRE_DIB_BIT  (0x4UL)
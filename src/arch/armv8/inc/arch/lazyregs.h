@@ -0,0 +1,43 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __ARCH_LAZYREGS_H__
+#define __ARCH_LAZYREGS_H__
+
+#include <crossconhyp.h>
+
+#define LAZYREGS_APKEYS (10)
+
+/* Pointer authentication keys and memory tagging state of a vcpu */
+struct lazyregs {
+    /* APIAKey, APIBKey, APDAKey, APDBKey and APGAKey, Lo then Hi */
+    uint64_t apkeys[LAZYREGS_APKEYS];
+    uint64_t gcr_el1;
+    uint64_t rgsr_el1;
+    uint64_t tfsr_el1;
+    uint64_t tfsre0_el1;
+};
+
+struct vm;
+struct vcpu;
+struct vm_config;
+
+void lazyregs_init();
+void lazyregs_vm_init(struct vm* vm, const struct vm_config* config);
+void lazyregs_vcpu_reset(struct vcpu* vcpu);
+void lazyregs_resume(struct vcpu* vcpu);
+void lazyregs_save(struct vcpu* vcpu);
+void lazyregs_release(struct vcpu* vcpu);
+void lazyregs_flush();
+bool lazyregs_pauth_trap(struct vcpu* vcpu);
+bool lazyregs_sysreg_trap(struct vcpu* vcpu, unsigned long reg_addr);
+
+#endif /* __ARCH_LAZYREGS_H__ */
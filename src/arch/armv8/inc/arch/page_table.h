@@ -35,6 +35,9 @@
 
 #define HYP_ROOT_PT_SIZE PAGE_SIZE
 
+#define PT_GRANULE_16K (0x4000)
+#define PT_GRANULE_64K (0x10000)
+
 #define ADDR_MSK(MSB, LSB) (((1UL << (MSB + 1)) - 1) & ~((1UL << (LSB)) - 1))
 #define PTE_ADDR_MSK ADDR_MSK(47, 12)
 #define PTE_FLAGS_MSK (~PTE_ADDR_MSK)
@@ -93,6 +96,9 @@
 #define PTE_MEMATTR_NRML_INC ((0x01 << 0) << PTE_MEMATTR_OFF)
 #define PTE_MEMATTR_NRML_IWTC ((0x02 << 0) << PTE_MEMATTR_OFF)
 #define PTE_MEMATTR_NRML_IWBC ((0x03 << 0) << PTE_MEMATTR_OFF)
+#define PTE_MEMATTR_MSK ((0xf << 0) << PTE_MEMATTR_OFF)
+/* Normal write-back, without tag access, with FEAT_MTE_PERM */
+#define PTE_MEMATTR_NRML_NOTAG ((0x04 << 0) << PTE_MEMATTR_OFF)
 
 #define PTE_S2AP_RO (0x1 << PTE_AP_OFF)
 #define PTE_S2AP_WO (0x2 << PTE_AP_OFF)
@@ -143,6 +149,12 @@ struct page_table;
 
 void pt_set_recursive(struct page_table* pt, size_t index);
 
+struct page_table_dscr;
+
+size_t pt_s2_granules(uint64_t id_aa64mmfr0);
+void pt_s2_granules_init(size_t granules);
+uint64_t pt_s2_vtcr(struct page_table_dscr* dscr);
+
 static inline void pte_set(pte_t* pte, paddr_t addr, pte_type_t type, pte_flags_t flags)
 {
     *pte = (addr & PTE_ADDR_MSK) | ((type | flags) & PTE_FLAGS_MSK);
@@ -52,6 +52,17 @@ struct arch_platform {
         } irqs;
     } generic_timer;
 
+    /* PMU overflow interrupt, needed to record or replay a VM */
+    struct {
+        irqid_t interrupt;
+    } pmu;
+
+    /**
+     * Cores per cluster. Cluster i is identified by Aff1 = i and its cores
+     * by Aff0. In a VM's platform this is the virtual topology exposed to the
+     * guest through MPIDR_EL1 and the vGIC. If empty, a single cluster is
+     * assumed.
+     */
     struct clusters {
         size_t num;
         size_t* core_num;
@@ -30,6 +30,8 @@
 #define PSCI_CPU_ON_AARCH64 (0xc4000003)
 #define PSCI_AFFINITY_INFO_AARCH32 (0x84000004)
 #define PSCI_AFFINITY_INFO_AARCH64 (0xc4000004)
+#define PSCI_SYSTEM_OFF (0x84000008)
+#define PSCI_SYSTEM_RESET (0x84000009)
 #define PSCI_FEATURES (0x8400000A)
 #define PSCI_MIG_INFO_TYPE (0x84000006)
 
@@ -80,6 +82,28 @@ struct psci_ctx {
     enum { ON, OFF, ON_PENDING } state;
 };
 
+/**
+ * A VM may register hooks to take part in the power management of the cpus it
+ * shares with the VMs stacked on it, e.g. a TEE that must be brought up before
+ * or taken down after its normal world. They are called on the cpu the event
+ * happens on, with the VM's vcpu in that cpu.
+ */
+enum psci_event {
+    PSCI_EVENT_CPU_ON,
+    PSCI_EVENT_CPU_OFF,
+};
+
+struct vm;
+struct vcpu;
+typedef void (*psci_hook_t)(struct vcpu* vcpu, enum psci_event event);
+
+#define PSCI_HOOKS_MAX (4)
+
+struct psci_hooks {
+    size_t num;
+    psci_hook_t hook[PSCI_HOOKS_MAX];
+};
+
 struct psci_off_state {
     uint64_t tcr_el2;
     uint64_t ttbr0_el2;
@@ -108,8 +132,9 @@ enum wakeup_reason {
 int32_t psci_smc_handler(uint32_t smc_fid, unsigned long x1, unsigned long x2,
                          unsigned long x3);
 
-int32_t psci_standby();
-int32_t psci_power_down(enum wakeup_reason reason);
+int32_t psci_power_down(enum wakeup_reason reason, uint32_t power_state);
+
+void psci_hook_add(struct vm* vm, psci_hook_t hook);
 
 /* --------------------------------
         SMC PSCI interface
@@ -388,9 +388,11 @@ struct smmu_cntxt_hw {
 
 void smmu_init();
 
+bool smmu_ptw_coherent();
 ssize_t smmu_alloc_ctxbnk();
 ssize_t smmu_alloc_sme();
-void smmu_write_ctxbnk(size_t ctx_id, paddr_t root_pt, asid_t vm_id);
+void smmu_write_ctxbnk(size_t ctx_id, paddr_t root_pt, asid_t vm_id,
+                       uint64_t tg_sl0);
 void smmu_write_sme(size_t sme, streamid_t mask, streamid_t id, bool group);
 void smmu_write_s2c(size_t sme, size_t ctx_id);
 size_t smmu_sme_get_ctx(size_t sme);
@@ -24,6 +24,61 @@
 #define ID_AA64MMFR0_PAR_LEN 4
 #define ID_AA64MMFR0_PAR_MSK \
     BIT64_MASK(ID_AA64MMFR0_PAR_OFF, ID_AA64MMFR0_PAR_LEN)
+#define ID_AA64MMFR0_TGRAN16_OFF 20
+#define ID_AA64MMFR0_TGRAN64_OFF 24
+#define ID_AA64MMFR0_TGRAN16_2_OFF 32
+#define ID_AA64MMFR0_TGRAN64_2_OFF 36
+#define ID_AA64MMFR0_TGRAN_LEN 4
+
+/* ID_AA64MMFR1_EL1, AArch64 Memory Model Feature Register 1 */
+#define ID_AA64MMFR1_HAFDBS_OFF 0
+#define ID_AA64MMFR1_HAFDBS_LEN 4
+
+/* ID_AA64PFR0_EL1, AArch64 Processor Feature Register 0 */
+#define ID_AA64PFR0_SVE_OFF 32
+#define ID_AA64PFR0_SVE_LEN 4
+
+/* ID_AA64ISAR0_EL1, AArch64 Instruction Set Attribute Register 0 */
+#define ID_AA64ISAR0_SHA2_OFF 12
+#define ID_AA64ISAR0_SHA2_LEN 4
+
+/* ID_AA64ISAR1_EL1 and ID_AA64ISAR2_EL1, pointer authentication fields */
+#define ID_AA64ISAR2_EL1 S3_0_C0_C6_2
+#define ID_AA64ISAR1_APA_OFF 4
+#define ID_AA64ISAR1_API_OFF 8
+#define ID_AA64ISAR1_GPA_OFF 24
+#define ID_AA64ISAR1_GPI_OFF 28
+#define ID_AA64ISAR2_GPA3_OFF 8
+#define ID_AA64ISAR2_APA3_OFF 12
+#define ID_AA64ISAR_PAUTH_LEN 4
+
+/* ID_AA64PFR1_EL1 and ID_AA64PFR2_EL1, memory tagging fields */
+#define ID_AA64PFR1_EL1 S3_0_C0_C4_1
+#define ID_AA64PFR2_EL1 S3_0_C0_C4_2
+#define ID_AA64PFR1_MTE_OFF 8
+#define ID_AA64PFR1_MTE_LEN 4
+/* FEAT_MTE2, allocation tags in memory */
+#define ID_AA64PFR1_MTE_MTE2 2
+#define ID_AA64PFR2_MTEPERM_OFF 0
+#define ID_AA64PFR2_MTEPERM_LEN 4
+
+/* Pointer authentication keys, each a Lo and Hi pair */
+#define APIAKEYLO_EL1 S3_0_C2_C1_0
+#define APIAKEYHI_EL1 S3_0_C2_C1_1
+#define APIBKEYLO_EL1 S3_0_C2_C1_2
+#define APIBKEYHI_EL1 S3_0_C2_C1_3
+#define APDAKEYLO_EL1 S3_0_C2_C2_0
+#define APDAKEYHI_EL1 S3_0_C2_C2_1
+#define APDBKEYLO_EL1 S3_0_C2_C2_2
+#define APDBKEYHI_EL1 S3_0_C2_C2_3
+#define APGAKEYLO_EL1 S3_0_C2_C3_0
+#define APGAKEYHI_EL1 S3_0_C2_C3_1
+
+/* Memory tagging control and status */
+#define RGSR_EL1 S3_0_C1_C0_5
+#define GCR_EL1 S3_0_C1_C0_6
+#define TFSR_EL1 S3_0_C5_C6_0
+#define TFSRE0_EL1 S3_0_C5_C6_1
 
 #define SPSel_SP (1 << 0)
 
@@ -37,8 +92,12 @@
 #define MPIDR_RES0_MSK  ~((0xffffffull << 49) | (0x1full << 25))
 #define MPIDR_AFFINITY_BITS (8)
 #define MPIDR_U_BIT (1UL << 30)
-#define MPIDR_AFF_MSK (0xffff) //we are only supporting 2 affinity levels
-#define MPIDR_AFF_LVL(MPIDR, LVL)  (((MPIDR) >> (8*(LVL))) & 0xff)
+#define MPIDR_AFF_MSK (0xff00ffffffUL)
+#define MPIDR_AFF_LVL_OFF(LVL) ((LVL) < 3 ? (8 * (LVL)) : 32)
+#define MPIDR_AFF_LVL(MPIDR, LVL) (((MPIDR) >> MPIDR_AFF_LVL_OFF(LVL)) & 0xff)
+/* Packed Aff3.Aff2.Aff1.Aff0 value as used in GICR_TYPER */
+#define MPIDR_AFF_VAL32(MPIDR) \
+    ((MPIDR_AFF_LVL(MPIDR, 3) << 24) | ((MPIDR) & 0xffffff))
 
 /* SPSR - Saved Program Status Register */
 
@@ -50,6 +109,7 @@
 #define SPSR_EL2h (0x9)
 #define SPSR_EL3t (0xc)
 #define SPSR_EL3h (0xd)
+#define SPSR_AARCH32 (1 << 4)
 
 #define SPSR_F (1 << 6)
 #define SPSR_I (1 << 7)
@@ -158,6 +218,7 @@
 #define VTCR_PS_48B (5 << 16)
 #define VTCR_PS_52B (6 << 16)
 #define VTCR_TBI (1 << 20)
+#define VTCR_HA (1UL << 21)
 
 /**
  * Default stage-2 translation control
@@ -288,6 +349,30 @@
 #define ACTLR_L2ECTLR_BIT (1UL << 5)
 #define ACTLR_L2ACTLR_BIT (1UL << 6)
 
+/* CNTV_CTL_EL0 - Virtual Timer Control Register */
+
+#define CNTV_CTL_ENABLE (1UL << 0)
+#define CNTV_CTL_IMASK (1UL << 1)
+
+/* CNTHP_CTL_EL2 - Hypervisor Physical Timer Control Register */
+
+#define CNTHP_CTL_ENABLE (1UL << 0)
+#define CNTHP_CTL_IMASK (1UL << 1)
+#define CNTHP_CTL_ISTATUS (1UL << 2)
+
+/* CPTR_EL2 - Architectural Feature Trap Register */
+#define CPTR_RES1 (0x22ffUL)
+#define CPTR_TZ (1UL << 8)
+#define CPTR_TFP (1UL << 10)
+#define CPTR_TSM (1UL << 12)
+
+/* ZCR_ELx - SVE Control Register */
+#define ZCR_EL1 S3_0_C1_C2_0
+#define ZCR_EL2 S3_4_C1_C2_0
+#define ZCR_LEN_MSK (0x1ffUL)
+/* Vector lengths are multiples of 16 bytes, set as LEN + 1 */
+#define ZCR_VL_GRANULE (16)
+
 /* HCR_EL2 - Hypervisor Configuration Register */
 
 #define HCR_VM_BIT (1UL << 0)
@@ -326,6 +411,50 @@
 #define HCR_TERR_BIT (1UL << 36)
 #define HCR_TEA_BIT (1UL << 37)
 #define HCR_MIOCNCE_BIT (1UL << 38)
+#define HCR_APK_BIT (1UL << 40)
+#define HCR_API_BIT (1UL << 41)
+#define HCR_ATA_BIT (1UL << 56)
+
+/* MDCR_EL2 - Monitor Debug Configuration Register */
+
+#define MDCR_HPMN_OFF (0)
+#define MDCR_HPMN_LEN (5)
+#define MDCR_HPMN_MSK BIT64_MASK(MDCR_HPMN_OFF, MDCR_HPMN_LEN)
+#define MDCR_HPME_BIT (1UL << 7)
+#define MDCR_TDE_BIT (1UL << 8)
+
+/* PMCR_EL0 - Performance Monitors Control Register */
+
+#define PMCR_N_OFF (11)
+#define PMCR_N_LEN (5)
+
+/* PMEVTYPER<n>_EL0 - Performance Monitors Event Type Register */
+
+#define PMU_EVT_INST_RETIRED (0x08)
+
+/* MDSCR_EL1 - Monitor Debug System Control Register */
+
+#define MDSCR_SS_BIT (1UL << 0)
+#define MDSCR_MDE_BIT (1UL << 15)
+
+/* ID_AA64DFR0_EL1 - AArch64 Debug Feature Register 0 */
+
+#define ID_AA64DFR0_BRPS_OFF (12)
+#define ID_AA64DFR0_BRPS_LEN (4)
+#define ID_AA64DFR0_WRPS_OFF (20)
+#define ID_AA64DFR0_WRPS_LEN (4)
+
+/* DBGBCR<n>_EL1, DBGWCR<n>_EL1 - Breakpoint and Watchpoint Control */
+
+#define DBGBCR_E_BIT (1UL << 0)
+#define DBGBCR_PMC_EL1_EL0 (0x3UL << 1)
+#define DBGBCR_BAS_A64 (0xfUL << 5)
+
+#define DBGWCR_E_BIT (1UL << 0)
+#define DBGWCR_PAC_EL1_EL0 (0x3UL << 1)
+#define DBGWCR_LSC_LOAD (0x1UL << 3)
+#define DBGWCR_LSC_STORE (0x2UL << 3)
+#define DBGWCR_BAS_OFF (5)
 
 /* ESR_ELx, Exception Syndrome Register (ELx) */
 
@@ -333,11 +462,14 @@
 #define ESR_ISS_LEN (25)
 #define ESR_IL_OFF (25)
 #define ESR_IL_LEN (1)
+#define ESR_IL_BIT (1UL << 25)
 #define ESR_EC_OFF (26)
 #define ESR_EC_LEN (6)
 
 #define ESR_EC_UNKWN (0x00)
 #define ESR_EC_WFIE (0x01)
+#define ESR_EC_FP (0x07)
+#define ESR_EC_PAC (0x09)
 #define ESR_EC_SVC32 (0x11)
 #define ESR_EC_HVC32 (0x12)
 #define ESR_EC_SMC32 (0x13)
@@ -345,12 +477,17 @@
 #define ESR_EC_HVC64 (0x16)
 #define ESR_EC_SMC64 (0x17)
 #define ESR_EC_SYSRG (0x18)
+#define ESR_EC_SVE (0x19)
 #define ESR_EC_IALEL (0x20)
 #define ESR_EC_IASEL (0x21)
 #define ESR_EC_PCALG (0x22)
 #define ESR_EC_DALEL (0x24)
 #define ESR_EC_DASEL (0x25)
 #define ESR_EC_SPALG (0x26)
+#define ESR_EC_BKPTL (0x30)
+#define ESR_EC_SSTPL (0x32)
+#define ESR_EC_WTCHL (0x34)
+#define ESR_EC_BRK64 (0x3C)
 
 #define ESR_ISS_DA_DSFC_OFF (0)
 #define ESR_ISS_DA_DSFC_LEN (6)
@@ -387,11 +524,16 @@
 #define ESR_ISS_DA_DSFC_TRNSLT (0x4)
 #define ESR_ISS_DA_DSFC_ACCESS (0x8)
 #define ESR_ISS_DA_DSFC_PERMIS (0xC)
+#define ESR_ISS_DA_DSFC_SEA (0x10)
+#define ESR_ISS_DA_DSFC_ALIGN (0x21)
 
 #define ESR_ISS_SYSREG_ADDR ((0xfff << 10) | (0xf << 1))
 #define ESR_ISS_SYSREG_DIR (0x1)
 #define ESR_ISS_SYSREG_REG_OFF (5)
 #define ESR_ISS_SYSREG_REG_LEN (5)
+#define ESR_ISS_SYSREG_OP0_OFF (20)
+#define ESR_ISS_SYSREG_OP0_LEN (2)
+#define ESR_ISS_SYSREG_OP0_DEBUG (2)
 
 /* VTTBR_EL2, Virtualization Translation Table Base Register */
 
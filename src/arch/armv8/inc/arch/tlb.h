@@ -29,6 +29,16 @@ static inline void tlb_hyp_inv_va(vaddr_t va)
         "isb\n\t" ::"r"(va >> 12));
 }
 
+static inline void tlb_hyp_inv_range(vaddr_t va, size_t size, size_t step)
+{
+    DSB(ish);
+    for (vaddr_t addr = va; addr < va + size; addr += step) {
+        asm volatile("tlbi vae2is, %0\n\t" ::"r"(addr >> 12));
+    }
+    DSB(ish);
+    ISB();
+}
+
 static inline void tlb_hyp_inv_all()
 {
     asm volatile(
@@ -38,7 +48,11 @@ static inline void tlb_hyp_inv_all()
         "isb\n\t");
 }
 
-static inline void tlb_vm_inv_va(asid_t vmid, vaddr_t va)
+/**
+ * The VM invalidations broadcast their TLBIs to the inner shareable domain,
+ * whatever cpus is.
+ */
+static inline void tlb_vm_inv_va(asid_t vmid, cpumap_t cpus, vaddr_t va)
 {
     uint64_t vttbr = 0;
     vttbr = MRS(VTTBR_EL2);
@@ -55,11 +69,36 @@ static inline void tlb_vm_inv_va(asid_t vmid, vaddr_t va)
 
     if (switch_vmid) {
         DSB(ish);
+        MSR(VTTBR_EL2, vttbr);
+    }
+}
+
+static inline void tlb_vm_inv_range(asid_t vmid, cpumap_t cpus, vaddr_t va,
+                                    size_t size, size_t step)
+{
+    uint64_t vttbr = 0;
+    vttbr = MRS(VTTBR_EL2);
+    bool switch_vmid =
+        bit64_extract(vttbr, VTTBR_VMID_OFF, VTTBR_VMID_LEN) != vmid;
+
+    if (switch_vmid) {
         MSR(VTTBR_EL2, ((vmid << VTTBR_VMID_OFF) & VTTBR_VMID_MSK));
+        DSB(ish);
+        ISB();
+    }
+
+    for (vaddr_t addr = va; addr < va + size; addr += step) {
+        asm volatile("tlbi ipas2e1is, %0\n\t" ::"r"(addr >> 12));
+    }
+    DSB(ish);
+
+    if (switch_vmid) {
+        MSR(VTTBR_EL2, vttbr);
+        ISB();
     }
 }
 
-static inline void tlb_vm_inv_all(asid_t vmid)
+static inline void tlb_vm_inv_all(asid_t vmid, cpumap_t cpus)
 {
     uint64_t vttbr = 0;
     vttbr = MRS(VTTBR_EL2);
@@ -76,7 +115,7 @@ static inline void tlb_vm_inv_all(asid_t vmid)
 
     if (switch_vmid) {
         DSB(ish);
-        MSR(VTTBR_EL2, ((vmid << VTTBR_VMID_OFF) & VTTBR_VMID_MSK));
+        MSR(VTTBR_EL2, vttbr);
     }
 
     /* TODO */
@@ -93,6 +93,27 @@ void vgic_cpu_init(struct vcpu *vcpu);
 void vgic_set_hw(struct vm *vm, irqid_t id);
 void vgic_inject(struct vcpu *vcpu, irqid_t id, vcpuid_t source);
 void vgic_inject_hw(struct vcpu *vcpu, irqid_t id);
+bool vgic_has_pending(struct vcpu *vcpu);
+
+/* Interrupt state carried over a live update */
+struct vgic_lu_int {
+    uint64_t route;
+    vcpuid_t owner;
+    uint8_t state;
+    uint8_t prio;
+    uint8_t cfg;
+    uint8_t lr;
+    uint8_t sgi_act;
+    uint8_t sgi_pend;
+    bool owned;
+    bool in_lr;
+    bool enabled;
+    bool spilled;
+};
+
+void vgic_lu_save(struct vcpu *vcpu, irqid_t int_id, struct vgic_lu_int *lu);
+void vgic_lu_restore(struct vcpu *vcpu, irqid_t int_id,
+                     const struct vgic_lu_int *lu);
 
 /* VGIC INTERNALS */
 
@@ -137,7 +158,7 @@ size_t vgic_get_itln(const struct gic_dscrp *gic_dscrp);
 
 /* interface for version specific vgic */
 bool vgic_int_has_other_target(struct vcpu *vcpu, struct vgic_int *interrupt);
-uint8_t vgic_int_ptarget_mask(struct vcpu *vcpu, struct vgic_int *interrupt);
+cpumap_t vgic_int_ptarget_mask(struct vcpu *vcpu, struct vgic_int *interrupt);
 void vgic_inject_sgi(struct vcpu *vcpu, struct vgic_int *interrupt, vcpuid_t source);
 
 void vgic_save_state(struct vcpu *vcpu);
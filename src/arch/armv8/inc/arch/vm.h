@@ -19,6 +19,7 @@
 #include <crossconhyp.h>
 #include <arch/vgic.h>
 #include <arch/psci.h>
+#include <arch/lazyregs.h>
 #include <list.h>
 
 struct vm_arch {
@@ -26,6 +27,51 @@ struct vm_arch {
     vaddr_t vgicr_addr;
     struct list vgic_spilled;
     spinlock_t vgic_spilled_lock;
+    struct psci_hooks psci_hooks;
+    /* Memory tagging enabled, see lazyregs.c */
+    bool mte;
+};
+
+/* EL1 and EL2 registers of a vcpu, saved while it is not running */
+struct vcpu_sysregs {
+    struct {
+        uint64_t elr_el2;
+        uint64_t spsr_el2;
+        uint64_t vttbr_el2;
+        /* The stage-2 granule is per VM */
+        uint64_t vtcr_el2;
+        uint64_t vmpidr_el2;
+        uint64_t cntvoff_el2;
+    } hyp;
+
+    struct {
+        uint64_t vbar_el1;
+        uint64_t tpidr_el1;
+        uint64_t mair_el1;
+        uint64_t amair_el1;
+        uint64_t tcr_el1;
+        uint64_t ttbr0_el1;
+        uint64_t ttbr1_el1;
+        uint64_t sp_el0;
+        uint64_t sp_el1;
+        uint64_t spsr_el1;
+        uint64_t sctlr_el1;
+        uint64_t actlr_el1;
+        uint64_t par_el1;
+        uint64_t far_el1;
+        uint64_t esr_el1;
+        uint64_t elr_el1;
+        uint64_t afsr0_el1;
+        uint64_t afsr1_el1;
+        uint64_t tpidrro_el0;
+        uint64_t tpidr_el0;
+        uint64_t cntv_ctl_el0;
+        uint64_t cntv_cval_el0;
+        uint64_t cntkctl_el1;
+    } vm;
+
+    /* Only up to date while the cpu does not own them, see lazyregs.c */
+    struct lazyregs lazy;
 };
 
 struct vcpu_arch {
@@ -33,43 +79,33 @@ struct vcpu_arch {
     struct vgic_priv vgic_priv;
     struct list vgic_spilled;
     struct psci_ctx psci_ctx;
+    /* Debug hardware held by the GDB stub and the guest's MDSCR_EL1 */
     struct {
+        bool active;
+        uint64_t mdscr_el1;
+    } dbg;
+    /**
+     * PMU counter counting the vcpu's instructions for record/replay. While
+     * the vcpu does not run, the counter is stopped and its value is kept in
+     * saved. overflow is set while an overflow already added to base is yet
+     * to be handled.
+     */
+    struct {
+        bool active;
+        size_t counter;
+        uint64_t base;
+        uint64_t saved;
+        bool overflow;
+    } vrr;
+    struct vcpu_sysregs sysregs;
+};
 
-        struct {
-            uint64_t elr_el2;
-            uint64_t spsr_el2;
-            uint64_t vttbr_el2;
-            uint64_t vmpidr_el2;
-            uint64_t cntvoff_el2;
-        } hyp;
-
-        struct {
-            uint64_t vbar_el1;
-            uint64_t tpidr_el1;
-            uint64_t mair_el1;
-            uint64_t amair_el1;
-            uint64_t tcr_el1;
-            uint64_t ttbr0_el1;
-            uint64_t ttbr1_el1;
-            uint64_t sp_el0;
-            uint64_t sp_el1;
-            uint64_t spsr_el1;
-            uint64_t sctlr_el1;
-            uint64_t actlr_el1;
-            uint64_t par_el1;
-            uint64_t far_el1;
-            uint64_t esr_el1;
-            uint64_t elr_el1;
-            uint64_t afsr0_el1;
-            uint64_t afsr1_el1;
-            uint64_t tpidrro_el0;
-            uint64_t tpidr_el0;
-            uint64_t cntv_ctl_el0;
-            uint64_t cntv_cval_el0;
-            uint64_t cntkctl_el1;
-        } vm;
-
-    } sysregs;
+/**
+ * Context of a vcpu activation not in struct arch_regs, saved by the VM stack
+ * while the vcpu runs again above its stacked activation.
+ */
+struct vcpu_arch_ctx {
+    struct vcpu_sysregs sysregs;
 };
 
 struct arch_regs {
@@ -81,6 +117,7 @@ struct arch_regs {
 
 struct vcpu* vm_get_vcpu_by_mpidr(struct vm* vm, unsigned long mpidr);
 void vcpu_arch_entry();
+void vcpu_arch_inject_sync(struct vcpu* vcpu, uint64_t esr);
 
 
 static inline void vcpu_arch_inject_hw_irq(struct vcpu* vcpu, uint64_t id)
@@ -38,7 +38,8 @@ static ssize_t iommu_vm_arch_init_ctx(struct vm *vm)
         if (ctx_id >= 0) {
             paddr_t rootpt;
             mem_translate(&cpu.as, (vaddr_t)vm->as.pt.root, &rootpt);
-            smmu_write_ctxbnk(ctx_id, rootpt, vm->id);
+            smmu_write_ctxbnk(ctx_id, rootpt, vm->id,
+                              pt_s2_vtcr(vm->as.pt.dscr));
             vm->iommu.arch.ctx_id = ctx_id;
         } else {
             INFO("iommu: smmuv2 could not allocate ctx for vm: %d", vm->id);
@@ -85,6 +86,10 @@ bool iommu_arch_vm_init(struct vm *vm, const struct vm_config *config)
         config->platform.arch.smmu.global_mask | platform.arch.smmu.global_mask;
     vm->iommu.arch.ctx_id = -1;
 
+    if (!smmu_ptw_coherent()) {
+        mem_pt_clean_enable(&vm->as);
+    }
+
     /* This section relates only to arm's iommu so we parse it here. */
     for (size_t i = 0; i < config->platform.arch.smmu.group_num; i++) {
         /* Register each group. */
@@ -0,0 +1,277 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <arch/lazyregs.h>
+#include <vm.h>
+#include <cpu.h>
+#include <config.h>
+#include <string.h>
+#include <arch/sysregs.h>
+#include <arch/fences.h>
+#include <arch/page_table.h>
+
+/**
+ * The pointer authentication keys and the memory tagging registers are
+ * switched lazily. Each set belongs to one vcpu of the cpu, its owner, and
+ * stays loaded while other vcpus run. Those run with the pointer
+ * authentication instructions and key accesses trapped (HCR_EL2.API and APK
+ * clear) and take the keys over on the first trap. Tag accesses do not trap,
+ * so the tagging registers are instead loaded as a vcpu of a VM with memory
+ * tagging resumes, if another vcpu used them since. Vcpus of other VMs run
+ * with HCR_EL2.ATA clear, which traps the tagging registers, so they never
+ * see or change the owner's.
+ */
+
+static bool lazyregs_pauth;
+static bool lazyregs_mte;
+static bool lazyregs_mte_perm;
+static const struct lazyregs lazyregs_zero;
+
+static void lazyregs_pauth_save(struct lazyregs* regs)
+{
+    regs->apkeys[0] = MRS(APIAKEYLO_EL1);
+    regs->apkeys[1] = MRS(APIAKEYHI_EL1);
+    regs->apkeys[2] = MRS(APIBKEYLO_EL1);
+    regs->apkeys[3] = MRS(APIBKEYHI_EL1);
+    regs->apkeys[4] = MRS(APDAKEYLO_EL1);
+    regs->apkeys[5] = MRS(APDAKEYHI_EL1);
+    regs->apkeys[6] = MRS(APDBKEYLO_EL1);
+    regs->apkeys[7] = MRS(APDBKEYHI_EL1);
+    regs->apkeys[8] = MRS(APGAKEYLO_EL1);
+    regs->apkeys[9] = MRS(APGAKEYHI_EL1);
+}
+
+static void lazyregs_pauth_restore(const struct lazyregs* regs)
+{
+    MSR(APIAKEYLO_EL1, regs->apkeys[0]);
+    MSR(APIAKEYHI_EL1, regs->apkeys[1]);
+    MSR(APIBKEYLO_EL1, regs->apkeys[2]);
+    MSR(APIBKEYHI_EL1, regs->apkeys[3]);
+    MSR(APDAKEYLO_EL1, regs->apkeys[4]);
+    MSR(APDAKEYHI_EL1, regs->apkeys[5]);
+    MSR(APDBKEYLO_EL1, regs->apkeys[6]);
+    MSR(APDBKEYHI_EL1, regs->apkeys[7]);
+    MSR(APGAKEYLO_EL1, regs->apkeys[8]);
+    MSR(APGAKEYHI_EL1, regs->apkeys[9]);
+}
+
+static void lazyregs_mte_save(struct lazyregs* regs)
+{
+    /* Asynchronous tag check faults must have reached TFSR */
+    DSB(nsh);
+    ISB();
+    regs->gcr_el1 = MRS(GCR_EL1);
+    regs->rgsr_el1 = MRS(RGSR_EL1);
+    regs->tfsr_el1 = MRS(TFSR_EL1);
+    regs->tfsre0_el1 = MRS(TFSRE0_EL1);
+}
+
+static void lazyregs_mte_restore(const struct lazyregs* regs)
+{
+    MSR(GCR_EL1, regs->gcr_el1);
+    MSR(RGSR_EL1, regs->rgsr_el1);
+    MSR(TFSR_EL1, regs->tfsr_el1);
+    MSR(TFSRE0_EL1, regs->tfsre0_el1);
+}
+
+void lazyregs_init()
+{
+    uint64_t isar1 = MRS(ID_AA64ISAR1_EL1);
+    uint64_t isar2 = MRS(ID_AA64ISAR2_EL1);
+    size_t isar1_fields[] = {ID_AA64ISAR1_APA_OFF, ID_AA64ISAR1_API_OFF,
+                             ID_AA64ISAR1_GPA_OFF, ID_AA64ISAR1_GPI_OFF};
+    size_t isar2_fields[] = {ID_AA64ISAR2_APA3_OFF, ID_AA64ISAR2_GPA3_OFF};
+
+    for (size_t i = 0; i < sizeof(isar1_fields) / sizeof(size_t); i++) {
+        if (bit64_extract(isar1, isar1_fields[i], ID_AA64ISAR_PAUTH_LEN)) {
+            lazyregs_pauth = true;
+        }
+    }
+    for (size_t i = 0; i < sizeof(isar2_fields) / sizeof(size_t); i++) {
+        if (bit64_extract(isar2, isar2_fields[i], ID_AA64ISAR_PAUTH_LEN)) {
+            lazyregs_pauth = true;
+        }
+    }
+
+    lazyregs_mte = bit64_extract(MRS(ID_AA64PFR1_EL1), ID_AA64PFR1_MTE_OFF,
+                                 ID_AA64PFR1_MTE_LEN) >= ID_AA64PFR1_MTE_MTE2;
+    lazyregs_mte_perm =
+        lazyregs_mte && bit64_extract(MRS(ID_AA64PFR2_EL1),
+                                      ID_AA64PFR2_MTEPERM_OFF,
+                                      ID_AA64PFR2_MTEPERM_LEN) != 0;
+
+    /**
+     * No vcpu owns the registers yet. They start out zeroed, so that nothing
+     * left by firmware or a previous image leaks to their first owner.
+     */
+    MSR(HCR_EL2, MRS(HCR_EL2) & ~(HCR_API_BIT | HCR_APK_BIT | HCR_ATA_BIT));
+    ISB();
+    if (lazyregs_pauth) {
+        lazyregs_pauth_restore(&lazyregs_zero);
+    }
+    if (lazyregs_mte) {
+        lazyregs_mte_restore(&lazyregs_zero);
+    }
+}
+
+/**
+ * A VM with memory tagging gets its memory mapped Normal write-back, the
+ * only stage-2 attributes that keep the stage-1 Tagged type. Other VMs get
+ * theirs mapped without tag access where the cpus allow it, so their
+ * accesses are never tag checked.
+ */
+void lazyregs_vm_init(struct vm* vm, const struct vm_config* config)
+{
+    vm->arch.mte = config->mte.enable && lazyregs_mte;
+
+    if (config->mte.enable && !lazyregs_mte) {
+        WARNING("VM %d memory tagging disabled, not supported by the cpus",
+                vm->id);
+    }
+
+    if (vm->arch.mte) {
+        vm->as.vm_flags = (PTE_VM_FLAGS & ~PTE_MEMATTR_MSK) |
+                          PTE_MEMATTR_NRML_OWBC | PTE_MEMATTR_NRML_IWBC;
+    } else if (lazyregs_mte_perm) {
+        vm->as.vm_flags =
+            (PTE_VM_FLAGS & ~PTE_MEMATTR_MSK) | PTE_MEMATTR_NRML_NOTAG;
+    }
+}
+
+/* Leaves the cpu without a pauth owner, saving its keys if save is set */
+static void lazyregs_pauth_put(bool save)
+{
+    struct vcpu* owner = cpu.arch.lazyregs.pauth_owner;
+
+    if (owner == NULL) return;
+
+    if (save) {
+        lazyregs_pauth_save(&owner->arch.sysregs.lazy);
+    }
+    cpu.arch.lazyregs.pauth_owner = NULL;
+    MSR(HCR_EL2, MRS(HCR_EL2) & ~(HCR_API_BIT | HCR_APK_BIT));
+    ISB();
+}
+
+/* Leaves the cpu without a tagging owner, saving its state if save is set */
+static void lazyregs_mte_put(bool save)
+{
+    struct vcpu* owner = cpu.arch.lazyregs.mte_owner;
+
+    if (owner == NULL) return;
+
+    if (save) {
+        lazyregs_mte_save(&owner->arch.sysregs.lazy);
+    }
+    cpu.arch.lazyregs.mte_owner = NULL;
+    MSR(HCR_EL2, MRS(HCR_EL2) & ~HCR_ATA_BIT);
+    ISB();
+}
+
+/**
+ * The running vcpu takes the registers right back, as it may be reset after
+ * it resumed, e.g. as it wakes up from a powerdown, and would otherwise run
+ * with tagging trapped.
+ */
+void lazyregs_vcpu_reset(struct vcpu* vcpu)
+{
+    lazyregs_release(vcpu);
+    memset(&vcpu->arch.sysregs.lazy, 0, sizeof(struct lazyregs));
+
+    if (vcpu == cpu.vcpu) {
+        lazyregs_resume(vcpu);
+    }
+}
+
+/* Must be called whenever vcpu becomes the cpu's running vcpu */
+void lazyregs_resume(struct vcpu* vcpu)
+{
+    uint64_t hcr = MRS(HCR_EL2) & ~(HCR_API_BIT | HCR_APK_BIT | HCR_ATA_BIT);
+
+    if (lazyregs_mte && vcpu->vm->arch.mte &&
+        cpu.arch.lazyregs.mte_owner != vcpu) {
+        lazyregs_mte_put(true);
+        lazyregs_mte_restore(&vcpu->arch.sysregs.lazy);
+        cpu.arch.lazyregs.mte_owner = vcpu;
+    }
+
+    if (cpu.arch.lazyregs.pauth_owner == vcpu) {
+        hcr |= HCR_API_BIT | HCR_APK_BIT;
+    }
+    if (cpu.arch.lazyregs.mte_owner == vcpu) {
+        hcr |= HCR_ATA_BIT;
+    }
+
+    MSR(HCR_EL2, hcr);
+    ISB();
+}
+
+/* Saves vcpu's registers to memory if it owns them, leaving them unowned */
+void lazyregs_save(struct vcpu* vcpu)
+{
+    if (cpu.arch.lazyregs.pauth_owner == vcpu) {
+        lazyregs_pauth_put(true);
+    }
+    if (cpu.arch.lazyregs.mte_owner == vcpu) {
+        lazyregs_mte_put(true);
+    }
+}
+
+/* Drops vcpu's ownership of the registers, whose contents are discarded */
+void lazyregs_release(struct vcpu* vcpu)
+{
+    if (cpu.arch.lazyregs.pauth_owner == vcpu) {
+        lazyregs_pauth_put(false);
+    }
+    if (cpu.arch.lazyregs.mte_owner == vcpu) {
+        lazyregs_mte_put(false);
+    }
+}
+
+/* Saves the owners' registers to memory, leaving the cpu without owners */
+void lazyregs_flush()
+{
+    lazyregs_pauth_put(true);
+    lazyregs_mte_put(true);
+}
+
+/**
+ * Handles vcpu trapping on a pointer authentication instruction or key
+ * access. Returns false if the trap was not due to the lazy switch.
+ */
+bool lazyregs_pauth_trap(struct vcpu* vcpu)
+{
+    if (!lazyregs_pauth || cpu.arch.lazyregs.pauth_owner == vcpu) {
+        return false;
+    }
+
+    lazyregs_pauth_put(true);
+    lazyregs_pauth_restore(&vcpu->arch.sysregs.lazy);
+    cpu.arch.lazyregs.pauth_owner = vcpu;
+
+    MSR(HCR_EL2, MRS(HCR_EL2) | HCR_API_BIT | HCR_APK_BIT);
+    ISB();
+
+    return true;
+}
+
+/* Key registers are op0 3, op1 0, CRn 2 and CRm 1 to 3 */
+bool lazyregs_sysreg_trap(struct vcpu* vcpu, unsigned long reg_addr)
+{
+    unsigned long crm = bit64_extract(reg_addr, 1, 4);
+    unsigned long base = reg_addr & ~SYSREG_ENC_ADDR(0, 0, 0, 0xf, 0x7);
+
+    if (base != SYSREG_ENC_ADDR(3, 0, 2, 0, 0) || crm < 1 || crm > 3) {
+        return false;
+    }
+
+    return lazyregs_pauth_trap(vcpu);
+}
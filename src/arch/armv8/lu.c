@@ -0,0 +1,156 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#include <lu.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <string.h>
+#include <arch/psci.h>
+#include <arch/tlb.h>
+
+/**
+ * Live update state of a vcpu. The GIC's active priority registers are not
+ * carried over, as they are not saved on a vcpu switch either.
+ */
+struct lu_vcpu_arch {
+    struct arch_regs regs;
+    typeof(((struct vcpu_arch*)0)->sysregs) sysregs;
+    typeof(((struct vgic_priv*)0)->gich) gich;
+    irqid_t curr_lrs[GIC_NUM_LIST_REGS];
+    struct vgic_lu_int priv[GIC_CPU_PRIV];
+    uint64_t psci_state;
+    uint64_t psci_entrypoint;
+    uint64_t psci_context_id;
+};
+
+struct lu_vm_arch {
+    uint64_t ctlr;
+    uint64_t int_num;
+    struct vgic_lu_int spi[];
+};
+
+extern uint8_t root_l1_flat_pt;
+
+void lu_jump(paddr_t entry, paddr_t config_addr, paddr_t load_addr);
+
+bool lu_arch_supported()
+{
+    return true;
+}
+
+size_t lu_arch_vm_size(struct vm* vm)
+{
+    return sizeof(struct lu_vm_arch) +
+           (vm->arch.vgicd.int_num - GIC_CPU_PRIV) * sizeof(struct vgic_lu_int);
+}
+
+void lu_arch_vm_save(struct vm* vm, void* buf)
+{
+    struct lu_vm_arch* lu = buf;
+    struct vcpu* vcpu = vm_get_vcpu(vm, 0);
+
+    lu->ctlr = vm->arch.vgicd.CTLR;
+    lu->int_num = vm->arch.vgicd.int_num;
+    for (size_t i = GIC_CPU_PRIV; i < lu->int_num; i++) {
+        vgic_lu_save(vcpu, i, &lu->spi[i - GIC_CPU_PRIV]);
+    }
+}
+
+void lu_arch_vm_restore(struct vm* vm, const void* buf)
+{
+    const struct lu_vm_arch* lu = buf;
+    struct vcpu* vcpu = vm_get_vcpu(vm, 0);
+
+    vm->arch.vgicd.CTLR = lu->ctlr;
+    for (size_t i = GIC_CPU_PRIV; i < lu->int_num; i++) {
+        vgic_lu_restore(vcpu, i, &lu->spi[i - GIC_CPU_PRIV]);
+    }
+}
+
+size_t lu_arch_vcpu_size()
+{
+    return sizeof(struct lu_vcpu_arch);
+}
+
+void lu_arch_vcpu_save(struct vcpu* vcpu, void* buf)
+{
+    struct lu_vcpu_arch* lu = buf;
+
+    lu->regs = *vcpu->regs;
+    memcpy(&lu->sysregs, &vcpu->arch.sysregs, sizeof(lu->sysregs));
+    memcpy(&lu->gich, &vcpu->arch.vgic_priv.gich, sizeof(lu->gich));
+    memcpy(lu->curr_lrs, vcpu->arch.vgic_priv.curr_lrs, sizeof(lu->curr_lrs));
+    for (size_t i = 0; i < GIC_CPU_PRIV; i++) {
+        vgic_lu_save(vcpu, i, &lu->priv[i]);
+    }
+    lu->psci_state = vcpu->arch.psci_ctx.state;
+    lu->psci_entrypoint = vcpu->arch.psci_ctx.entrypoint;
+    lu->psci_context_id = vcpu->arch.psci_ctx.context_id;
+}
+
+void lu_arch_vcpu_restore(struct vcpu* vcpu, const void* buf)
+{
+    const struct lu_vcpu_arch* lu = buf;
+
+    /* The VM's id and the vcpu's affinity are this image's own */
+    uint64_t vttbr_el2 = vcpu->arch.sysregs.hyp.vttbr_el2;
+    uint64_t vtcr_el2 = vcpu->arch.sysregs.hyp.vtcr_el2;
+    uint64_t vmpidr_el2 = vcpu->arch.sysregs.hyp.vmpidr_el2;
+
+    *vcpu->regs = lu->regs;
+    memcpy(&vcpu->arch.sysregs, &lu->sysregs, sizeof(lu->sysregs));
+    vcpu->arch.sysregs.hyp.vttbr_el2 = vttbr_el2;
+    vcpu->arch.sysregs.hyp.vtcr_el2 = vtcr_el2;
+    vcpu->arch.sysregs.hyp.vmpidr_el2 = vmpidr_el2;
+    memcpy(&vcpu->arch.vgic_priv.gich, &lu->gich, sizeof(lu->gich));
+    memcpy(vcpu->arch.vgic_priv.curr_lrs, lu->curr_lrs, sizeof(lu->curr_lrs));
+    for (size_t i = 0; i < GIC_CPU_PRIV; i++) {
+        vgic_lu_restore(vcpu, i, &lu->priv[i]);
+    }
+    spin_lock(&vcpu->arch.psci_ctx.lock);
+    vcpu->arch.psci_ctx.state = lu->psci_state;
+    vcpu->arch.psci_ctx.entrypoint = lu->psci_entrypoint;
+    vcpu->arch.psci_ctx.context_id = lu->psci_context_id;
+    spin_unlock(&vcpu->arch.psci_ctx.lock);
+}
+
+/* The keys and tags go with the vcpus' saved state, not the registers */
+void lu_arch_cpu_quiesce()
+{
+    lazyregs_flush();
+}
+
+void lu_arch_cpu_off()
+{
+    psci_cpu_off();
+    ERROR("failed to power off cpu %d for live update", cpu.id);
+}
+
+void lu_arch_jump(paddr_t load_addr, paddr_t entry, paddr_t config_addr)
+{
+    /* The new image brings the other cpus up again once they are off */
+    for (cpuid_t id = 0; id < platform.cpu_num; id++) {
+        if (id == cpu.id) continue;
+        while (psci_affinity_info(cpu_id_to_mpidr(id), 0) != PSCI_CPU_IS_OFF);
+    }
+
+    /* Restore the flat mapping of this image the boot code set up */
+    paddr_t flat_pt;
+    mem_translate(&cpu.as, (vaddr_t)&root_l1_flat_pt, &flat_pt);
+    pte_set(pt_get_pte(&cpu.as.pt, 0, load_addr), flat_pt, PTE_TABLE,
+            PTE_HYP_FLAGS);
+    fence_sync_write();
+    tlb_hyp_inv_all();
+
+    lu_jump(entry, config_addr, load_addr);
+}
@@ -22,6 +22,9 @@ void as_arch_init(struct addr_space* as)
 {
     size_t index;
 
+    /* Pooled tables are found by physical address, not recursively */
+    if (as->pt.pool != NULL) return;
+
     /*
      * If the address space is a copy of an existing hypervisor space it's not
      * possible to use the PT_CPU_REC index to navigate it, so we have to use
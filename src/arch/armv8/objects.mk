@@ -33,6 +33,19 @@ cpu-objs-y+=smmuv2.o
 cpu-objs-y+=gic.o
 cpu-objs-y+=vgic.o
 cpu-objs-y+=config.o
+cpu-objs-y+=timer.o
+cpu-objs-y+=vwdt.o
+cpu-objs-y+=vcons.o
+cpu-objs-y+=vdbg.o
+cpu-objs-y+=vrr.o
+cpu-objs-y+=lu.o
+cpu-objs-y+=wss.o
+cpu-objs-y+=coredump.o
+cpu-objs-y+=vec.o
+cpu-objs-y+=vec_regs.o
+cpu-objs-y+=lazyregs.o
+cpu-objs-y+=sha256.o
+cpu-objs-y+=sha256_ce.o
 
 ifeq ($(GIC_VERSION), GICV2)
 	cpu-objs-y+=vgicv2.o
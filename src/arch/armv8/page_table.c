@@ -56,6 +56,11 @@ void pt_set_recursive(struct page_table* pt, size_t index)
 
 pte_t* pt_get_pte(struct page_table* pt, size_t lvl, vaddr_t va)
 {
+    if (pt->pool != NULL) {
+        pte_t* tbl = pt_pool_get(pt, lvl, va);
+        return tbl != NULL ? &tbl[pt_getpteindex_by_va(pt, va, lvl)] : NULL;
+    }
+
     struct page_table* cpu_pt = &cpu.as.pt;
 
     size_t rec_ind_off = cpu_pt->dscr->lvl_off[cpu_pt->dscr->lvls - lvl - 1];
@@ -76,6 +81,7 @@ pte_t* pt_get_pte(struct page_table* pt, size_t lvl, vaddr_t va)
 pte_t* pt_get(struct page_table* pt, size_t lvl, vaddr_t va)
 {
     if (lvl == 0) return pt->root;
+    if (pt->pool != NULL) return pt_pool_get(pt, lvl, va);
 
     uintptr_t pte = (uintptr_t)pt_get_pte(pt, lvl, va);
     pte &= ~(pt_size(pt, lvl) - 1);
@@ -108,3 +114,119 @@ bool pte_table(struct page_table* pt, pte_t* pte, size_t lvl)
 
     return (*pte & PTE_TYPE_MSK) == PTE_TABLE;
 }
+
+/* Stage-2 descriptors for the larger granules, see pt_s2_granules_init */
+static struct {
+    size_t shift;
+    size_t off[4];
+    size_t wdt[4];
+    bool term[4];
+    struct page_table_dscr dscr;
+} armv8_pt_s2_gran_dscrs[] = {
+    {.shift = 14},
+    {.shift = 16},
+};
+
+static size_t s2_granules = PAGE_SIZE;
+
+/**
+ * Granules usable at stage 2 by a cpu with the given ID_AA64MMFR0_EL1, as a
+ * mask of their sizes. A TGranX_2 field of 0 defers to the stage 1 field.
+ */
+size_t pt_s2_granules(uint64_t id_aa64mmfr0)
+{
+    size_t granules = PAGE_SIZE;
+    uint64_t tgran16 = bit64_extract(id_aa64mmfr0, ID_AA64MMFR0_TGRAN16_OFF,
+                                     ID_AA64MMFR0_TGRAN_LEN);
+    uint64_t tgran64 = bit64_extract(id_aa64mmfr0, ID_AA64MMFR0_TGRAN64_OFF,
+                                     ID_AA64MMFR0_TGRAN_LEN);
+    uint64_t tgran16_2 = bit64_extract(
+        id_aa64mmfr0, ID_AA64MMFR0_TGRAN16_2_OFF, ID_AA64MMFR0_TGRAN_LEN);
+    uint64_t tgran64_2 = bit64_extract(
+        id_aa64mmfr0, ID_AA64MMFR0_TGRAN64_2_OFF, ID_AA64MMFR0_TGRAN_LEN);
+
+    if (tgran16_2 >= 2 || (tgran16_2 == 0 && tgran16 != 0)) {
+        granules |= PT_GRANULE_16K;
+    }
+    if (tgran64_2 >= 2 || (tgran64_2 == 0 && tgran64 != 0xf)) {
+        granules |= PT_GRANULE_64K;
+    }
+
+    return granules;
+}
+
+/**
+ * Builds the descriptors of the supported larger granules for the IPA size
+ * set by parange. Levels are counted from the last one up, the lookup
+ * starting at the first level that covers the IPA size. A root of at most 16
+ * tables is concatenated at the next level instead, as stage 2 allows.
+ */
+void pt_s2_granules_init(size_t granules)
+{
+    size_t ipa = parange_table[parange];
+
+    s2_granules = granules;
+
+    for (size_t i = 0; i < sizeof(armv8_pt_s2_gran_dscrs) /
+                               sizeof(armv8_pt_s2_gran_dscrs[0]); i++) {
+        size_t shift = armv8_pt_s2_gran_dscrs[i].shift;
+        size_t stride = shift - 3;
+        size_t lvls = (ipa - shift + stride - 1) / stride;
+        struct page_table_dscr* dscr = &armv8_pt_s2_gran_dscrs[i].dscr;
+
+        if (lvls > 2 && (ipa - shift - (lvls - 1) * stride) <= 4) {
+            lvls--;
+        }
+
+        for (size_t lvl = 0; lvl < lvls; lvl++) {
+            size_t off = shift + (lvls - 1 - lvl) * stride;
+            armv8_pt_s2_gran_dscrs[i].off[lvl] = off;
+            armv8_pt_s2_gran_dscrs[i].wdt[lvl] = lvl == 0 ? ipa : off + stride;
+            /* Only levels 2 and 3 hold blocks and pages */
+            armv8_pt_s2_gran_dscrs[i].term[lvl] = (4 - lvls + lvl) >= 2;
+        }
+
+        dscr->lvls = lvls;
+        dscr->lvl_off = armv8_pt_s2_gran_dscrs[i].off;
+        dscr->lvl_wdt = armv8_pt_s2_gran_dscrs[i].wdt;
+        dscr->lvl_term = armv8_pt_s2_gran_dscrs[i].term;
+    }
+}
+
+struct page_table_dscr* pt_vm_dscr(size_t granule, size_t ipa_bits)
+{
+    switch (granule) {
+        case 0:
+        case PAGE_SIZE:
+            return vm_pt_dscr;
+        case PT_GRANULE_16K:
+            return (s2_granules & granule) ? &armv8_pt_s2_gran_dscrs[0].dscr
+                                           : NULL;
+        case PT_GRANULE_64K:
+            return (s2_granules & granule) ? &armv8_pt_s2_gran_dscrs[1].dscr
+                                           : NULL;
+        default:
+            return NULL;
+    }
+}
+
+/* VTCR_EL2 TG0 and SL0 fields for a stage-2 table of descriptor dscr */
+uint64_t pt_s2_vtcr(struct page_table_dscr* dscr)
+{
+    size_t start_lvl = 4 - dscr->lvls;
+    uint64_t tg0 = VTCR_TG0_4K;
+    uint64_t sl0 = 2 - start_lvl;
+
+    switch (dscr->lvl_off[dscr->lvls - 1]) {
+        case 14:
+            tg0 = VTCR_TG0_16K;
+            sl0 = 3 - start_lvl;
+            break;
+        case 16:
+            tg0 = VTCR_TG0_64K;
+            sl0 = 3 - start_lvl;
+            break;
+    }
+
+    return tg0 | ((sl0 << VTCR_SL0_OFF) & VTCR_SL0_MSK);
+}
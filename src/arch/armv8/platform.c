@@ -19,7 +19,7 @@
 unsigned long platform_arch_cpuid_to_mpdir(const struct platform_desc* plat,
                                       cpuid_t cpuid)
 {
-    if (cpuid > plat->cpu_num) {
+    if (cpuid >= plat->cpu_num) {
         return ~(~MPIDR_RES1 & MPIDR_RES0_MSK); //return an invlid mpidr by inverting res bits
     }
 
@@ -55,18 +55,38 @@ unsigned long platform_arch_cpuid_to_mpdir(const struct platform_desc* plat,
 }
 
 cpuid_t platform_arch_mpidr_to_cpuid(const struct platform_desc* plat,
-                                      uint64_t mpidr){
-    int64_t cpuid = 0;
-    int i = 0;
-    for(i = 0; i < ((mpidr >> 8) & 0xff) && i < plat->arch.clusters.num; i++){
-        cpuid = plat->arch.clusters.core_num[i];
+                                      uint64_t mpidr)
+{
+    size_t cluster = MPIDR_AFF_LVL(mpidr, 1);
+    size_t core = MPIDR_AFF_LVL(mpidr, 0);
+
+    if (MPIDR_AFF_LVL(mpidr, 2) != 0 || MPIDR_AFF_LVL(mpidr, 3) != 0) {
+        return INVALID_CPUID;
+    }
+
+    if (plat->arch.clusters.num == 0) {
+        return (cluster == 0 && core < plat->cpu_num) ? core : INVALID_CPUID;
+    }
+
+    if (cluster >= plat->arch.clusters.num ||
+        core >= plat->arch.clusters.core_num[cluster]) {
+        return INVALID_CPUID;
     }
 
-    if(i < plat->arch.clusters.num){
+    cpuid_t cpuid = core;
+    for (size_t i = 0; i < cluster; i++) {
         cpuid += plat->arch.clusters.core_num[i];
-    } else {
-        cpuid = -1;
     }
 
     return cpuid;
 }
+
+size_t platform_arch_cpu_cluster(const struct platform_desc* plat,
+                                 cpuid_t cpuid)
+{
+    if (plat->arch.clusters.num == 0 || cpuid >= plat->cpu_num) {
+        return 0;
+    }
+
+    return MPIDR_AFF_LVL(platform_arch_cpuid_to_mpdir(plat, cpuid), 1);
+}
@@ -25,6 +25,8 @@
 #include <mem.h>
 #include <cache.h>
 #include <vmstack.h>
+#include <idle.h>
+#include <timer.h>
 
 enum {PSCI_MSG_ON};
 
@@ -47,6 +49,26 @@ static void update_vcpu_psci_ctx(struct vcpu* vcpu)
     spin_unlock(&vcpu->arch.psci_ctx.lock);
 }
 
+void psci_hook_add(struct vm* vm, psci_hook_t hook)
+{
+    struct psci_hooks* hooks = &vm->arch.psci_hooks;
+
+    if (hooks->num >= PSCI_HOOKS_MAX) {
+        ERROR("too many psci hooks for vm %d", vm->id);
+    }
+
+    hooks->hook[hooks->num++] = hook;
+}
+
+static void psci_run_hooks(struct vcpu* vcpu, enum psci_event event)
+{
+    struct psci_hooks* hooks = &vcpu->vm->arch.psci_hooks;
+
+    for (size_t i = 0; i < hooks->num; i++) {
+        hooks->hook[i](vcpu, event);
+    }
+}
+
 void psci_wake_from_off(uint64_t vmid){
 
     struct vcpu *vcpu = cpu_get_vcpu(vmid);
@@ -55,35 +77,14 @@ void psci_wake_from_off(uint64_t vmid){
         return;
     }
 
-    /* whether are note we are waking this vcpu, our current vcpu is off so
-     * wake it up */
-    if(cpu.vcpu->arch.psci_ctx.state == OFF){
-        spin_lock(&cpu.vcpu->arch.psci_ctx.lock);
-        if(cpu.vcpu->vm->type == 1 ){
-            /* Secure World VM */
-            /* TODO identify VM type */
-            if(cpu.vcpu != vcpu){
-                /* we wouldn't be here otherwise, but whatever */
-                /* TODO register optee hooks */
-                if(cpu.vcpu->vm->type == 1){
-                    vcpu_arch_reset(cpu.vcpu, 0x101017ec);
-                    list_foreach(cpu.vcpu->vmstack_children, struct node_data, node){
-                        struct vcpu* child = node->data;
-                        if(child->vm->type == 2){
-                            vcpu_arch_reset(child, 0x201017ec);
-                        }
-                    }
-
-                    cpu.vcpu->arch.psci_ctx.state = ON;
-                    vcpu_restore_state(cpu.vcpu);
-                }
-            }
-            cpu.vcpu->arch.psci_ctx.state = ON;
-            spin_unlock(&cpu.vcpu->arch.psci_ctx.lock);
-        }
+    /**
+     * If we are waking a vcpu stacked on the one at the bottom of this cpu's
+     * vmstack, the latter is off too. Its VM must bring it up first.
+     */
+    if(cpu.vcpu != vcpu && cpu.vcpu->arch.psci_ctx.state == OFF){
+        psci_run_hooks(cpu.vcpu, PSCI_EVENT_CPU_ON);
     }
 
-
     /* finally update the state of the vm that asked to wake up */
     update_vcpu_psci_ctx(vcpu);
 
@@ -100,44 +101,65 @@ void psci_cpumsg_handler(uint32_t event, uint64_t data){
 
 CPU_MSG_HANDLER(psci_cpumsg_handler, PSCI_CPUSMG_ID);
 
+/**
+ * The wake-up time, in physical counter ticks, of the running vcpu's virtual
+ * timer, whose state is still live in the cpu.
+ */
+static uint64_t psci_vtimer_deadline()
+{
+    uint64_t ctl = MRS(CNTV_CTL_EL0);
+
+    if (!(ctl & CNTV_CTL_ENABLE) || (ctl & CNTV_CTL_IMASK)) {
+        return TIMER_DEADLINE_NONE;
+    }
+
+    return MRS(CNTV_CVAL_EL0) + MRS(CNTVOFF_EL2);
+}
+
 int32_t psci_cpu_suspend_handler(uint32_t power_state, unsigned long entrypoint,
                                                     unsigned long context_id)
 {
     /**
-     * !! Ignoring the rest of the requested  powerstate for now.
-     * This might be a problem howwver since powerlevel and stateid are
-     * implementation defined.
+     * The guest's power level and state id are implementation defined and
+     * meaningless to the physical platform. Only the state type is honored:
+     * it bounds the physical state the idle governor may pick. A powerdown
+     * request may be served by a shallower state, in which case the call
+     * returns as allowed by PSCI.
      */
-    uint32_t state_type = power_state & PSCI_STATE_TYPE_BIT;
-    int32_t ret;
-    /* struct vcpu* vcpu = cpu.vcpu; */
+    bool powerdown = power_state & PSCI_STATE_TYPE_BIT;
+    int32_t ret = PSCI_E_SUCCESS;
 
-    if(state_type){
-        //PSCI_STATE_TYPE_POWERDOWN:
+    if(powerdown){
         spin_lock(&cpu.vcpu->arch.psci_ctx.lock);
         cpu.vcpu->arch.psci_ctx.entrypoint = entrypoint;
         cpu.vcpu->arch.psci_ctx.context_id = context_id;
         spin_unlock(&cpu.vcpu->arch.psci_ctx.lock);
-        if(vmstack_pop() == NULL){
-            ret = psci_power_down(PSCI_WAKEUP_POWERDOWN);
-        } else {
-            ret = PSCI_E_SUCCESS;
-        }
+    }
+
+    if(vmstack_pop() != NULL){
+        return PSCI_E_SUCCESS;
+    }
+
+    size_t state = idle_select(powerdown, psci_vtimer_deadline());
+    const struct idle_state* idle_state = idle_get_state(state);
+
+    idle_enter(state);
+    if(idle_state == NULL){
+        asm volatile("wfi\n\r");
+    } else if(idle_state->powerdown){
+        ret = psci_power_down(PSCI_WAKEUP_POWERDOWN, idle_state->arch_state);
     } else {
-        //PSCI_STATE_TYPE_STANDBY:
         /**
-         *  TODO: ideally we would emmit a standby request to PSCI
-         * (currently, ATF), but when we do, we do not wake up on interrupts
-         * on the current development target zcu104.
-         * We should understand why. To circunvent this, we directly emmit a
-         * wfi
+         * On some platforms (e.g. zcu104) the firmware standby does not wake
+         * up on interrupts. Those should not describe retention states.
          */
-        //ret = psci_standby();
-        if(vmstack_pop() == NULL){
+        ret = psci_cpu_suspend(idle_state->arch_state, 0, 0);
+        if (ret == PSCI_E_NOT_SUPPORTED) {
             asm volatile("wfi\n\r");
+            ret = PSCI_E_SUCCESS;
         }
-        ret = PSCI_E_SUCCESS;
     }
+    idle_exit();
 
     return ret;
 }
@@ -151,10 +173,16 @@ int32_t psci_cpu_off_handler(void)
      *  call cpu_on on this vcpu.
      */
 
-    spin_lock(&cpu.vcpu->arch.psci_ctx.lock);
-    cpu.vcpu->arch.psci_ctx.state = OFF;
-    cpu.vcpu->state = VCPU_OFF;
-    spin_unlock(&cpu.vcpu->arch.psci_ctx.lock);
+    struct vcpu* vcpu = cpu.vcpu;
+
+    spin_lock(&vcpu->arch.psci_ctx.lock);
+    vcpu->arch.psci_ctx.state = OFF;
+    vcpu->state = VCPU_OFF;
+    spin_unlock(&vcpu->arch.psci_ctx.lock);
+
+    list_foreach(vcpu->vmstack_children, struct node_data, node){
+        psci_run_hooks(node->data, PSCI_EVENT_CPU_OFF);
+    }
 
     if(vmstack_pop() == NULL){
         cpu_idle();
@@ -166,6 +194,9 @@ int32_t psci_cpu_off_handler(void)
 
         return PSCI_E_DENIED;
     }
+
+    psci_run_hooks(cpu.vcpu, PSCI_EVENT_CPU_OFF);
+
     return PSCI_E_SUCCESS;
 }
 
@@ -240,6 +271,8 @@ int32_t psci_features_handler(uint32_t feature_id){
         case PSCI_CPU_SUSPEND_AARCH64:
         case PSCI_CPU_ON_AARCH64:
         case PSCI_AFFINITY_INFO_AARCH32:
+        case PSCI_SYSTEM_OFF:
+        case PSCI_SYSTEM_RESET:
         case PSCI_FEATURES:
             ret = PSCI_E_SUCCESS;
             break;
@@ -279,6 +312,20 @@ int32_t psci_smc_handler(uint32_t smc_fid, unsigned long x1, unsigned long x2,
 			ret = psci_features_handler(x1);
 			break;
 
+        /**
+         * The system is the VM. These only return if the VM is already
+         * halted, crashed or being reset.
+         */
+        case PSCI_SYSTEM_OFF:
+            vm_halt(cpu.vcpu->vm);
+            ret = PSCI_E_DENIED;
+            break;
+
+        case PSCI_SYSTEM_RESET:
+            vm_reset(cpu.vcpu->vm);
+            ret = PSCI_E_DENIED;
+            break;
+
         case PSCI_MIG_INFO_TYPE:
             ret = PSCI_TOS_NOT_PRESENT_MP;
             break;
@@ -294,6 +341,13 @@ extern uint8_t root_l1_flat_pt;
 
 static void psci_save_state(enum wakeup_reason wakeup_reason){
 
+    /**
+     * The vector, pointer authentication and tagging registers do not
+     * survive the cpu powering down
+     */
+    vec_flush();
+    lazyregs_flush();
+
     cpu.arch.psci_off_state.tcr_el2 = MRS(TCR_EL2);
     cpu.arch.psci_off_state.ttbr0_el2 = MRS(TTBR0_EL2);
     cpu.arch.psci_off_state.mair_el2 = MRS(MAIR_EL2);
@@ -328,6 +382,9 @@ static void psci_restore_state(){
 
     gicc_restore_state(&cpu.arch.psci_off_state.gicc_state);
     vcpu_restore_state(cpu.vcpu);
+
+    /* The hypervisor timer did not retain its state */
+    timer_restore();
 }
 
 void psci_wake_from_powerdown(uint64_t vmid){
@@ -357,6 +414,7 @@ void psci_wake(uint32_t handler_id)
 {
 
     psci_restore_state();
+    idle_exit();
 
     if(handler_id < PSCI_WAKEUP_NUM){
         psci_wake_handlers[handler_id](0U);
@@ -366,16 +424,9 @@ void psci_wake(uint32_t handler_id)
 
 }
 
-int32_t psci_standby(){
-    /* only apply request to core level */
-    uint32_t pwr_state_aux = PSCI_POWER_STATE_LVL_0 | PSCI_STATE_TYPE_STANDBY;
-
-    return psci_cpu_suspend(pwr_state_aux, 0, 0);
-}
-
-int32_t psci_power_down(enum wakeup_reason reason){
+int32_t psci_power_down(enum wakeup_reason reason, uint32_t power_state){
 
-    uint32_t pwr_state_aux = PSCI_POWER_STATE_LVL_0 | PSCI_STATE_TYPE_POWERDOWN;
+    uint32_t pwr_state_aux = power_state | PSCI_STATE_TYPE_POWERDOWN;
 
     psci_save_state(reason);
     paddr_t cntxt_paddr;
@@ -0,0 +1,33 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <sha256.h>
+#include <vec.h>
+#include <arch/sysregs.h>
+
+extern void sha256_ce_blocks(uint32_t state[8], const uint8_t* data,
+                             size_t nblocks);
+
+void sha256_blocks(uint32_t state[8], const uint8_t* data, size_t nblocks)
+{
+    uint64_t isar0 = MRS(ID_AA64ISAR0_EL1);
+
+    if (bit64_extract(isar0, ID_AA64ISAR0_SHA2_OFF, ID_AA64ISAR0_SHA2_LEN)) {
+        /* The instructions work on the FP/SIMD registers, trapped at EL2 */
+        vec_hyp_get();
+        sha256_ce_blocks(state, data, nblocks);
+        vec_hyp_put();
+    } else {
+        sha256_blocks_generic(state, data, nblocks);
+    }
+}
@@ -39,6 +39,9 @@ struct smmu_priv {
     BITMAP_ALLOC(sme_bitmap, SME_MAX_NUM);
     BITMAP_ALLOC(grp_bitmap, SME_MAX_NUM);
 
+    /* Page table walks do not snoop the cpu caches */
+    bool ptw_noncoherent;
+
     spinlock_t ctx_lock;
     size_t ctx_num;
     BITMAP_ALLOC(ctxbank_bitmap, CTX_MAX_NUM);
@@ -98,13 +101,13 @@ static void smmu_check_features()
     }
 
     /**
-     * TODO: the most common smmuv2 implementation (mmu-500) does not provide
-     * ptw coherency. So we must add some mechanism software-managed
-     * coherency mechanism for the vms using the smmu according to the
-     * result of this feature test.
+     * The most common smmuv2 implementation (mmu-500) does not provide
+     * ptw coherency. Page table updates for the vms using the smmu are then
+     * cleaned to the point of coherency by software (see iommu_arch_vm_init).
      */
-    if (!(smmu.hw.glbl_rs0->IDR0 & SMMUV2_IDR0_CTTW_BIT)) {
-        WARNING("smmuv2 does not support coherent page table walks");
+    smmu.ptw_noncoherent = !(smmu.hw.glbl_rs0->IDR0 & SMMUV2_IDR0_CTTW_BIT);
+    if (smmu.ptw_noncoherent) {
+        INFO("smmuv2 page table walks are not coherent");
     }
 
     if (!(smmu.hw.glbl_rs0->IDR0 & SMMUV2_IDR0_BTM_BIT)) {
@@ -202,6 +205,11 @@ void smmu_init()
     smmu.hw.glbl_rs0->CR0 = cr0;
 }
 
+bool smmu_ptw_coherent()
+{
+    return !smmu.ptw_noncoherent;
+}
+
 ssize_t smmu_alloc_ctxbnk()
 {
     spin_lock(&smmu.ctx_lock);
@@ -234,7 +242,9 @@ static size_t smmu_cb_ttba_offset(size_t t0sz)
     return offset;
 }
 
-void smmu_write_ctxbnk(size_t ctx_id, paddr_t root_pt, asid_t vm_id)
+/* tg_sl0 holds the TG0 and SL0 fields of the VM's VTCR_EL2, see pt_s2_vtcr */
+void smmu_write_ctxbnk(size_t ctx_id, paddr_t root_pt, asid_t vm_id,
+                       uint64_t tg_sl0)
 {
     spin_lock(&smmu.ctx_lock);
     if (!bitmap_get(smmu.ctxbank_bitmap, ctx_id)) {
@@ -251,13 +261,18 @@ void smmu_write_ctxbnk(size_t ctx_id, paddr_t root_pt, asid_t vm_id)
          */
         uint32_t tcr = ((parange << SMMUV2_TCR_PS_OFF) & SMMUV2_TCR_PS_MSK);
         size_t t0sz = 64 - parange_table[parange];
-        tcr |= SMMUV2_TCR_TG0_4K;
-        tcr |= SMMUV2_TCR_ORGN0_WB_RA_WA;
-        tcr |= SMMUV2_TCR_IRGN0_WB_RA_WA;
+        tcr |= tg_sl0 & (SMMUV2_TCR_TG0_MSK | SMMUV2_TCR_SL0_MSK);
         tcr |= SMMUV2_TCR_T0SZ(t0sz);
-        tcr |= SMMUV2_TCR_SH0_IS;
-        tcr |= ((parange_table[parange] < 44) ? SMMUV2_TCR_SL0_1
-                                              : SMMUV2_TCR_SL0_0);
+        if (smmu.ptw_noncoherent) {
+            /* Walks must fetch from memory where updates are cleaned to */
+            tcr |= SMMUV2_TCR_ORGN0_NC;
+            tcr |= SMMUV2_TCR_IRGN0_NC;
+            tcr |= SMMUV2_TCR_SH0_OS;
+        } else {
+            tcr |= SMMUV2_TCR_ORGN0_WB_RA_WA;
+            tcr |= SMMUV2_TCR_IRGN0_WB_RA_WA;
+            tcr |= SMMUV2_TCR_SH0_IS;
+        }
         smmu.hw.cntxt[ctx_id].TCR = tcr;
         smmu.hw.cntxt[ctx_id].TTBR0 =
             root_pt & SMMUV2_CB_TTBA(smmu_cb_ttba_offset(t0sz));
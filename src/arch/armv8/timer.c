@@ -0,0 +1,66 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <timer.h>
+#include <cpu.h>
+#include <interrupts.h>
+#include <platform.h>
+#include <arch/sysregs.h>
+#include <fences.h>
+
+/* The architecturally recommended PPI for the EL2 physical timer */
+#define TIMER_HYP_DEFAULT_IRQ (26)
+
+static irqid_t timer_arch_irq()
+{
+    irqid_t irq = platform.arch.generic_timer.irqs.hyp;
+    return irq != 0 ? irq : TIMER_HYP_DEFAULT_IRQ;
+}
+
+static void timer_arch_irq_handler(irqid_t int_id)
+{
+    /* The hyp timer is level triggered, mask it before completion */
+    MSR(CNTHP_CTL_EL2, CNTHP_CTL_IMASK);
+    timer_handle();
+}
+
+void timer_arch_init()
+{
+    MSR(CNTHP_CTL_EL2, CNTHP_CTL_IMASK);
+
+    if (cpu.id == CPU_MASTER) {
+        interrupts_reserve(timer_arch_irq(), timer_arch_irq_handler);
+    }
+
+    interrupts_cpu_enable(timer_arch_irq(), true);
+}
+
+void timer_arch_set(uint64_t deadline)
+{
+    if (deadline == TIMER_DEADLINE_NONE) {
+        MSR(CNTHP_CTL_EL2, CNTHP_CTL_IMASK);
+    } else {
+        MSR(CNTHP_CVAL_EL2, deadline);
+        MSR(CNTHP_CTL_EL2, CNTHP_CTL_ENABLE);
+        ISB();
+    }
+}
+
+uint64_t timer_arch_get_counter()
+{
+    ISB();
+    return MRS(CNTPCT_EL0);
+}
+
+uint64_t timer_arch_get_freq()
+{
+    return MRS(CNTFRQ_EL0);
+}
@@ -0,0 +1,148 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vcons.h>
+#include <vm.h>
+#include <emul.h>
+#include <platform.h>
+
+/**
+ * PL011 model, which also covers the SBSA generic UART subset. The line
+ * settings are only stored. The transmit FIFO is the VM's console buffer and
+ * is never full while the physical uart keeps up.
+ */
+
+#define PL011_SIZE (0x1000)
+
+#define PL011_DR (0x000)
+#define PL011_RSR (0x004)
+#define PL011_FR (0x018)
+#define PL011_IMSC (0x038)
+#define PL011_RIS (0x03c)
+#define PL011_MIS (0x040)
+#define PL011_ICR (0x044)
+#define PL011_DMACR (0x048)
+#define PL011_PERIPHID0 (0xfe0)
+#define PL011_CELLID3 (0xffc)
+
+#define PL011_FR_RXFE (1U << 4)
+#define PL011_FR_TXFF (1U << 5)
+#define PL011_FR_TXFE (1U << 7)
+
+#define PL011_INT_RX (1U << 4)
+#define PL011_INT_TX (1U << 5)
+#define PL011_INT_RT (1U << 6)
+
+/* PeriphID0-3 then CellID0-3, one byte per register */
+static const uint8_t pl011_ids[] = {0x11, 0x10, 0x34, 0x00,
+                                    0x0d, 0xf0, 0x05, 0xb1};
+
+static uint32_t vcons_pl011_ris(struct vm* vm)
+{
+    uint32_t ris = 0;
+
+    if (!vcons_rx_empty(vm)) {
+        ris |= PL011_INT_RX | PL011_INT_RT;
+    }
+    if (!vcons_tx_full(vm)) {
+        ris |= PL011_INT_TX;
+    }
+
+    return ris;
+}
+
+void vcons_arch_update(struct vcpu* vcpu)
+{
+    struct vm* vm = vcpu->vm;
+    struct vcons* vc = &vm->vcons;
+
+    if (vm->config->console.uart_base == 0) return;
+
+    /* The interrupt is level sensitive, inject it on every rising edge */
+    bool level = (vcons_pl011_ris(vm) & vc->uart_regs[PL011_IMSC / 4]) != 0;
+    if (level && !vc->uart_irq && vm->config->console.interrupt != 0) {
+        vcpu_inject_irq(vcpu, vm->config->console.interrupt);
+    }
+    vc->uart_irq = level;
+}
+
+static bool vcons_pl011_emul_handler(struct emul_access* acc)
+{
+    struct vm* vm = cpu.vcpu->vm;
+    struct vcons* vc = &vm->vcons;
+    size_t off = acc->addr - vm->config->console.uart_base;
+    unsigned long val = 0;
+    char c;
+
+    if (acc->write) {
+        val = vcpu_readreg(cpu.vcpu, acc->reg);
+        switch (off) {
+            case PL011_DR:
+                vcons_putc(vm, (char)val);
+                break;
+            case PL011_RSR:
+            case PL011_ICR:
+            case PL011_DMACR:
+                break;
+            default:
+                if (off < PL011_DMACR) {
+                    vc->uart_regs[off / 4] = val;
+                }
+                break;
+        }
+    } else {
+        switch (off) {
+            case PL011_DR:
+                if (vcons_getc(vm, &c)) {
+                    val = (uint8_t)c;
+                }
+                break;
+            case PL011_FR:
+                if (vcons_rx_empty(vm)) {
+                    vcons_poll();
+                }
+                val = vcons_rx_empty(vm) ? PL011_FR_RXFE : 0;
+                val |= vcons_tx_full(vm) ? PL011_FR_TXFF : PL011_FR_TXFE;
+                break;
+            case PL011_RIS:
+                val = vcons_pl011_ris(vm);
+                break;
+            case PL011_MIS:
+                val = vcons_pl011_ris(vm) & vc->uart_regs[PL011_IMSC / 4];
+                break;
+            case PL011_PERIPHID0 ... PL011_CELLID3:
+                val = pl011_ids[(off - PL011_PERIPHID0) / 4];
+                break;
+            default:
+                if (off < PL011_DMACR) {
+                    val = vc->uart_regs[off / 4];
+                }
+                break;
+        }
+        vcpu_writereg(cpu.vcpu, acc->reg, val);
+    }
+
+    vcons_arch_update(cpu.vcpu);
+
+    return true;
+}
+
+void vcons_arch_init(struct vm* vm)
+{
+    if (vm->config->console.uart_base == 0) return;
+
+    struct emul_mem emu = {
+        .va_base = vm->config->console.uart_base,
+        .size = PL011_SIZE,
+        .handler = vcons_pl011_emul_handler,
+    };
+    vm_emul_add_mem(vm, &emu);
+}
@@ -0,0 +1,269 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#include <vdbg.h>
+#include <vm.h>
+#include <arch/sysregs.h>
+#include <fences.h>
+
+/**
+ * While the stub is attached, MDCR_EL2.TDE routes the VM's debug exceptions
+ * to the hypervisor and traps its accesses to the debug registers, which the
+ * stub then owns. Registers are numbered as in GDB's aarch64 description:
+ * x0-x30, sp, pc and cpsr. AArch32 guests are not supported.
+ */
+
+#define VDBG_REG_SP (31)
+#define VDBG_REG_PC (32)
+#define VDBG_REG_CPSR (33)
+
+#define VDBG_SET_BP(n)                   \
+    case n:                              \
+        MSR(DBGBVR##n##_EL1, vr);        \
+        MSR(DBGBCR##n##_EL1, cr);        \
+        break
+
+#define VDBG_SET_WP(n)                   \
+    case n:                              \
+        MSR(DBGWVR##n##_EL1, vr);        \
+        MSR(DBGWCR##n##_EL1, cr);        \
+        break
+
+static void vdbg_set_bp(size_t i, uint64_t vr, uint64_t cr)
+{
+    switch (i) {
+        VDBG_SET_BP(0); VDBG_SET_BP(1); VDBG_SET_BP(2); VDBG_SET_BP(3);
+        VDBG_SET_BP(4); VDBG_SET_BP(5); VDBG_SET_BP(6); VDBG_SET_BP(7);
+        VDBG_SET_BP(8); VDBG_SET_BP(9); VDBG_SET_BP(10); VDBG_SET_BP(11);
+        VDBG_SET_BP(12); VDBG_SET_BP(13); VDBG_SET_BP(14); VDBG_SET_BP(15);
+    }
+}
+
+static void vdbg_set_wp(size_t i, uint64_t vr, uint64_t cr)
+{
+    switch (i) {
+        VDBG_SET_WP(0); VDBG_SET_WP(1); VDBG_SET_WP(2); VDBG_SET_WP(3);
+        VDBG_SET_WP(4); VDBG_SET_WP(5); VDBG_SET_WP(6); VDBG_SET_WP(7);
+        VDBG_SET_WP(8); VDBG_SET_WP(9); VDBG_SET_WP(10); VDBG_SET_WP(11);
+        VDBG_SET_WP(12); VDBG_SET_WP(13); VDBG_SET_WP(14); VDBG_SET_WP(15);
+    }
+}
+
+size_t vdbg_arch_bp_num()
+{
+    return bit64_extract(MRS(ID_AA64DFR0_EL1), ID_AA64DFR0_BRPS_OFF,
+                         ID_AA64DFR0_BRPS_LEN) + 1;
+}
+
+size_t vdbg_arch_wp_num()
+{
+    return bit64_extract(MRS(ID_AA64DFR0_EL1), ID_AA64DFR0_WRPS_OFF,
+                         ID_AA64DFR0_WRPS_LEN) + 1;
+}
+
+/* A watchpoint covers up to the eight bytes of an aligned doubleword */
+bool vdbg_arch_wp_fits(vaddr_t addr, size_t len)
+{
+    return len > 0 && (addr & 0x7) + len <= 8;
+}
+
+static uint64_t* vdbg_sp(struct vcpu* vcpu)
+{
+    if ((vcpu->arch.sysregs.hyp.spsr_el2 & SPSR_EL_MSK) == SPSR_EL1h) {
+        return &vcpu->arch.sysregs.vm.sp_el1;
+    } else {
+        return &vcpu->arch.sysregs.vm.sp_el0;
+    }
+}
+
+bool vdbg_arch_get_reg(struct vcpu* vcpu, size_t reg, uint64_t* val,
+                       size_t* size)
+{
+    *size = 8;
+    if (reg < VDBG_REG_SP) {
+        *val = vcpu->regs->x[reg];
+    } else if (reg == VDBG_REG_SP) {
+        *val = *vdbg_sp(vcpu);
+    } else if (reg == VDBG_REG_PC) {
+        *val = vcpu->arch.sysregs.hyp.elr_el2;
+    } else if (reg == VDBG_REG_CPSR) {
+        *val = vcpu->arch.sysregs.hyp.spsr_el2 & 0xffffffff;
+        *size = 4;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool vdbg_arch_set_reg(struct vcpu* vcpu, size_t reg, uint64_t val)
+{
+    if (reg < VDBG_REG_SP) {
+        vcpu->regs->x[reg] = val;
+    } else if (reg == VDBG_REG_SP) {
+        *vdbg_sp(vcpu) = val;
+    } else if (reg == VDBG_REG_PC) {
+        vcpu->arch.sysregs.hyp.elr_el2 = val;
+    } else if (reg == VDBG_REG_CPSR) {
+        /* The guest may not be moved to the hypervisor's exception level */
+        if ((val & SPSR_EL_MSK) >= SPSR_EL2t) return false;
+        vcpu->arch.sysregs.hyp.spsr_el2 = val & 0xffffffff;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Translates va as the paused vcpu would, by loading its stage 1 translation
+ * registers and the VM's stage 2 on the local cpu just for the translation.
+ */
+bool vdbg_arch_translate(struct vcpu* vcpu, vaddr_t va, bool write,
+                         paddr_t* pa)
+{
+    uint64_t sctlr = MRS(SCTLR_EL1);
+    uint64_t tcr = MRS(TCR_EL1);
+    uint64_t ttbr0 = MRS(TTBR0_EL1);
+    uint64_t ttbr1 = MRS(TTBR1_EL1);
+    uint64_t mair = MRS(MAIR_EL1);
+    uint64_t vttbr = MRS(VTTBR_EL2);
+    uint64_t vtcr = MRS(VTCR_EL2);
+    uint64_t par_saved = MRS(PAR_EL1);
+    uint64_t par;
+
+    MSR(SCTLR_EL1, vcpu->arch.sysregs.vm.sctlr_el1);
+    MSR(TCR_EL1, vcpu->arch.sysregs.vm.tcr_el1);
+    MSR(TTBR0_EL1, vcpu->arch.sysregs.vm.ttbr0_el1);
+    MSR(TTBR1_EL1, vcpu->arch.sysregs.vm.ttbr1_el1);
+    MSR(MAIR_EL1, vcpu->arch.sysregs.vm.mair_el1);
+    MSR(VTCR_EL2, vcpu->arch.sysregs.hyp.vtcr_el2);
+    MSR(VTTBR_EL2, vcpu->arch.sysregs.hyp.vttbr_el2);
+    ISB();
+
+    if (write) {
+        asm volatile("AT S12E1W, %0" ::"r"(va));
+    } else {
+        asm volatile("AT S12E1R, %0" ::"r"(va));
+    }
+    ISB();
+    par = MRS(PAR_EL1);
+
+    MSR(SCTLR_EL1, sctlr);
+    MSR(TCR_EL1, tcr);
+    MSR(TTBR0_EL1, ttbr0);
+    MSR(TTBR1_EL1, ttbr1);
+    MSR(MAIR_EL1, mair);
+    MSR(VTCR_EL2, vtcr);
+    MSR(VTTBR_EL2, vttbr);
+    MSR(PAR_EL1, par_saved);
+    ISB();
+
+    if (par & PAR_F) return false;
+    *pa = (par & PAR_PA_MSK) | (va & (PAGE_SIZE - 1));
+    return true;
+}
+
+void vdbg_arch_sync_icache()
+{
+    asm volatile("ic ialluis\n\t"
+                 "dsb ish\n\t"
+                 "isb\n\t" ::: "memory");
+}
+
+void vdbg_arch_pause(struct vcpu* vcpu)
+{
+    vcpu->arch.sysregs.hyp.spsr_el2 &= ~SPSR_SS;
+    if (vcpu == cpu.vcpu && vcpu->arch.dbg.active) {
+        MSR(MDSCR_EL1, MRS(MDSCR_EL1) & ~MDSCR_SS_BIT);
+    }
+}
+
+/**
+ * Programs the local cpu's debug hardware with the VM's breakpoints,
+ * watchpoints and single step, or hands it back to the guest once the stub
+ * is detached. Must be called on the cpu running vcpu.
+ */
+void vdbg_arch_load(struct vcpu* vcpu)
+{
+    struct vdbg* dbg = &vcpu->vm->dbg;
+    size_t bp_num = vdbg_arch_bp_num();
+    size_t wp_num = vdbg_arch_wp_num();
+    uint64_t mdscr;
+
+    if (vcpu != cpu.vcpu || (!dbg->attached && !vcpu->arch.dbg.active)) {
+        return;
+    }
+
+    for (size_t i = 0; i < bp_num; i++) {
+        if (dbg->attached && i < dbg->bp_num) {
+            vdbg_set_bp(i, dbg->bps[i] & ~0x3UL,
+                        DBGBCR_E_BIT | DBGBCR_PMC_EL1_EL0 | DBGBCR_BAS_A64);
+        } else {
+            vdbg_set_bp(i, 0, 0);
+        }
+    }
+
+    for (size_t i = 0; i < wp_num; i++) {
+        if (dbg->attached && i < dbg->wp_num) {
+            struct vdbg_wp* wp = &dbg->wps[i];
+            uint64_t bas = ((1UL << wp->len) - 1) << (wp->addr & 0x7);
+            uint64_t lsc = wp->type == VDBG_WP_WRITE  ? DBGWCR_LSC_STORE
+                           : wp->type == VDBG_WP_READ ? DBGWCR_LSC_LOAD
+                                                      : DBGWCR_LSC_LOAD |
+                                                            DBGWCR_LSC_STORE;
+            vdbg_set_wp(i, wp->addr & ~0x7UL,
+                        DBGWCR_E_BIT | DBGWCR_PAC_EL1_EL0 | lsc |
+                            (bas << DBGWCR_BAS_OFF));
+        } else {
+            vdbg_set_wp(i, 0, 0);
+        }
+    }
+
+    if (dbg->attached) {
+        if (!vcpu->arch.dbg.active) {
+            vcpu->arch.dbg.mdscr_el1 = MRS(MDSCR_EL1);
+            vcpu->arch.dbg.active = true;
+        }
+        mdscr = MDSCR_MDE_BIT;
+        if (dbg->step_vcpu == vcpu->id) mdscr |= MDSCR_SS_BIT;
+        /* Debug exceptions are not generated while the OS lock is set */
+        MSR(OSLAR_EL1, 0);
+        MSR(MDSCR_EL1, mdscr);
+        MSR(MDCR_EL2, MRS(MDCR_EL2) | MDCR_TDE_BIT);
+    } else {
+        MSR(MDSCR_EL1, vcpu->arch.dbg.mdscr_el1);
+        MSR(MDCR_EL2, MRS(MDCR_EL2) & ~MDCR_TDE_BIT);
+        vcpu->arch.dbg.active = false;
+    }
+    ISB();
+}
+
+/**
+ * Puts the state the debugger might have changed back in the live registers
+ * and reloads the debug hardware before the vcpu runs again.
+ */
+void vdbg_arch_resume(struct vcpu* vcpu)
+{
+    struct vdbg* dbg = &vcpu->vm->dbg;
+    uint64_t spsr = vcpu->arch.sysregs.hyp.spsr_el2 & ~SPSR_SS;
+
+    if (dbg->attached && dbg->step_vcpu == vcpu->id) spsr |= SPSR_SS;
+    vcpu->arch.sysregs.hyp.spsr_el2 = spsr;
+
+    if (vcpu != cpu.vcpu) return;
+
+    MSR(ELR_EL2, vcpu->arch.sysregs.hyp.elr_el2);
+    MSR(SPSR_EL2, spsr);
+    MSR(SP_EL0, vcpu->arch.sysregs.vm.sp_el0);
+    MSR(SP_EL1, vcpu->arch.sysregs.vm.sp_el1);
+
+    vdbg_arch_load(vcpu);
+}
@@ -0,0 +1,150 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vec.h>
+#include <vm.h>
+#include <cpu.h>
+#include <arch/sysregs.h>
+#include <arch/fences.h>
+
+/**
+ * The FP/SIMD registers are switched with the vector ones, as SVE extends
+ * them, for every VM. A VM without vectors has SVE instructions trapped, and
+ * undefined, even while it owns the registers. SME is never available.
+ */
+struct vec_arch_regs {
+    uint64_t fpsr;
+    uint64_t fpcr;
+    uint64_t zcr_el1;
+    uint64_t res;
+    /* Z0-Z31, P0-P15 and FFR with SVE, V0-V31 otherwise */
+    uint8_t regs[];
+};
+
+#define VEC_FPSIMD_SIZE (32 * 16)
+
+size_t vec_arch_sve_vl();
+void vec_arch_sve_save(void* regs);
+void vec_arch_sve_restore(const void* regs);
+void vec_arch_fpsimd_save(void* regs);
+void vec_arch_fpsimd_restore(const void* regs);
+
+static size_t vec_sve_vl_max;
+
+void vec_arch_init()
+{
+    if (bit64_extract(MRS(ID_AA64PFR0_EL1), ID_AA64PFR0_SVE_OFF,
+                      ID_AA64PFR0_SVE_LEN) != 0) {
+        MSR(CPTR_EL2, CPTR_RES1);
+        ISB();
+        MSR(ZCR_EL2, ZCR_LEN_MSK);
+        ISB();
+        vec_sve_vl_max = vec_arch_sve_vl();
+    }
+
+    /* No vcpu owns the registers yet */
+    MSR(CPTR_EL2, CPTR_RES1 | CPTR_TSM | CPTR_TFP | CPTR_TZ);
+    ISB();
+}
+
+size_t vec_arch_vl(size_t max_vl)
+{
+    if (max_vl == 0 || max_vl > vec_sve_vl_max) {
+        return vec_sve_vl_max;
+    } else if (max_vl < ZCR_VL_GRANULE) {
+        return ZCR_VL_GRANULE;
+    }
+
+    return ALIGN_FLOOR(max_vl, ZCR_VL_GRANULE);
+}
+
+size_t vec_arch_size(size_t vl)
+{
+    size_t size = vl == 0 ? VEC_FPSIMD_SIZE : 32 * vl + 17 * (vl / 8);
+    return sizeof(struct vec_arch_regs) + size;
+}
+
+/* Gives EL2 access to the registers at the vector length of vcpu's VM */
+static void vec_arch_access(struct vcpu* vcpu)
+{
+    MSR(CPTR_EL2, CPTR_RES1 | CPTR_TSM);
+    ISB();
+    if (vcpu->vm->vec.vl != 0) {
+        MSR(ZCR_EL2, vcpu->vm->vec.vl / ZCR_VL_GRANULE - 1);
+        ISB();
+    }
+}
+
+void vec_arch_save(struct vcpu* vcpu, void* regs)
+{
+    struct vec_arch_regs* vec = regs;
+
+    vec_arch_access(vcpu);
+    vec->fpsr = MRS(FPSR);
+    vec->fpcr = MRS(FPCR);
+    if (vcpu->vm->vec.vl != 0) {
+        vec->zcr_el1 = MRS(ZCR_EL1);
+        vec_arch_sve_save(vec->regs);
+    } else {
+        vec_arch_fpsimd_save(vec->regs);
+    }
+}
+
+void vec_arch_restore(struct vcpu* vcpu, const void* regs)
+{
+    const struct vec_arch_regs* vec = regs;
+
+    vec_arch_access(vcpu);
+    MSR(FPSR, vec->fpsr);
+    MSR(FPCR, vec->fpcr);
+    if (vcpu->vm->vec.vl != 0) {
+        MSR(ZCR_EL1, vec->zcr_el1);
+        vec_arch_sve_restore(vec->regs);
+    } else {
+        vec_arch_fpsimd_restore(vec->regs);
+    }
+}
+
+bool vec_arch_dirty(struct vcpu* vcpu)
+{
+    /* There is no telling whether the registers changed */
+    return true;
+}
+
+/* With no owner, the running vcpu goes back to having all of them trapped */
+void vec_arch_hyp_access(bool enable)
+{
+    uint64_t cptr = CPTR_RES1 | CPTR_TSM;
+
+    if (!enable) {
+        cptr |= CPTR_TFP | CPTR_TZ;
+    }
+
+    MSR(CPTR_EL2, cptr);
+    ISB();
+}
+
+void vec_arch_enable(struct vcpu* vcpu, bool owner)
+{
+    uint64_t cptr = CPTR_RES1 | CPTR_TSM;
+
+    /* The traps are set up for the running vcpu only */
+    if (vcpu != cpu.vcpu) return;
+
+    if (!owner) {
+        cptr |= CPTR_TFP | CPTR_TZ;
+    } else if (vcpu->vm->vec.vl == 0) {
+        cptr |= CPTR_TZ;
+    }
+
+    MSR(CPTR_EL2, cptr);
+    ISB();
+}
@@ -87,6 +87,21 @@ static inline bool vgic_lr_empty(struct vcpu* vcpu, uint64_t lr){
     }
 }
 
+/**
+ * Whether vcpu has an interrupt pending in its list registers, which would
+ * make a wfi it executes complete immediately.
+ */
+bool vgic_has_pending(struct vcpu* vcpu)
+{
+    for (size_t i = 0; i < NUM_LRS; i++) {
+        if (!vgic_lr_empty(vcpu, i) &&
+            (vgic_lr_rd(vcpu, i) & GICH_LR_STATE_PND)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 static inline void vgic_hcr_set(struct vcpu* vcpu, uint64_t mask){
     if(vcpu->state == VCPU_ACTIVE){
@@ -1011,15 +1026,21 @@ void vgic_ipi_handler(uint32_t event, uint64_t data)
         // is not active
         list_foreach(cpu.vcpu->vmstack_children, struct node_data, node)
         {
-            child = node->data;
-            if (child->vm->id == vm_id) {
-                vmstack_push(child);
+            struct vcpu* vcpu = node->data;
+            if (vcpu->vm->id == vm_id) {
+                child = vcpu;
                 break;
             }
         }
 
         if(child == NULL)
             ERROR("received vgic3 msg target to another vcpu");
+
+        if(!vmstack_push(child)){
+            WARNING("VM %d vgic message dropped, its vcpu can not be stacked",
+                    vm_id);
+            return;
+        }
     }
 
     switch (event) {
@@ -1264,6 +1285,98 @@ void vgic_hw_commit(struct vcpu* vcpu, uint64_t int_id) {
     }
 }
 
+#if (GIC_VERSION == GICV2)
+#define VGIC_ROUTE_INFO (itargetr_info)
+#else
+#define VGIC_ROUTE_INFO (irouter_info)
+#endif
+
+static bool vgic_int_is_spilled(struct vcpu *vcpu, struct vgic_int *interrupt)
+{
+    struct list *spilled_list = gic_is_priv(interrupt->id)
+                                    ? &vcpu->arch.vgic_spilled
+                                    : &vcpu->vm->arch.vgic_spilled;
+    bool spilled = false;
+
+    spin_lock(&vcpu->vm->arch.vgic_spilled_lock);
+    list_foreach((*spilled_list), struct vgic_int, node)
+    {
+        if (node == interrupt) {
+            spilled = true;
+            break;
+        }
+    }
+    spin_unlock(&vcpu->vm->arch.vgic_spilled_lock);
+
+    return spilled;
+}
+
+/**
+ * Live update. The virtual state of an interrupt is carried over as is and
+ * its physical routing is worked out again, as the vcpus may have moved to
+ * other cpus.
+ */
+void vgic_lu_save(struct vcpu *vcpu, irqid_t int_id, struct vgic_lu_int *lu)
+{
+    struct vgic_int *interrupt = vgic_get_int(vcpu, int_id, vcpu->id);
+
+    *lu = (struct vgic_lu_int){0};
+    if (interrupt == NULL) return;
+
+    lu->owned = interrupt->owner != NULL;
+    lu->owner = lu->owned ? interrupt->owner->id : 0;
+    lu->state = interrupt->state;
+    lu->prio = interrupt->prio;
+    lu->cfg = interrupt->cfg;
+    lu->lr = interrupt->lr;
+    lu->in_lr = interrupt->in_lr;
+    lu->enabled = interrupt->enabled;
+    if (!gic_is_priv(int_id)) {
+        lu->route = VGIC_ROUTE_INFO.read_field(vcpu, interrupt);
+    }
+#if (GIC_VERSION == GICV2)
+    else {
+        lu->sgi_act = interrupt->sgi.act;
+        lu->sgi_pend = interrupt->sgi.pend;
+    }
+#endif
+    lu->spilled = vgic_int_is_spilled(vcpu, interrupt);
+}
+
+void vgic_lu_restore(struct vcpu *vcpu, irqid_t int_id,
+                     const struct vgic_lu_int *lu)
+{
+    struct vgic_int *interrupt = vgic_get_int(vcpu, int_id, vcpu->id);
+    if (interrupt == NULL) return;
+
+    spin_lock(&interrupt->lock);
+    interrupt->owner = lu->owned ? vm_get_vcpu(vcpu->vm, lu->owner) : NULL;
+    interrupt->state = lu->state;
+    interrupt->prio = lu->prio;
+    interrupt->cfg = lu->cfg;
+    interrupt->lr = lu->lr;
+    interrupt->in_lr = lu->in_lr;
+    interrupt->enabled = lu->enabled;
+    if (!gic_is_priv(int_id)) {
+        VGIC_ROUTE_INFO.update_field(vcpu, interrupt, lu->route);
+        if (vgic_int_is_hw(interrupt) && VGIC_ROUTE_INFO.update_hw != NULL) {
+            VGIC_ROUTE_INFO.update_hw(vcpu, interrupt);
+        }
+    }
+#if (GIC_VERSION == GICV2)
+    else {
+        interrupt->sgi.act = lu->sgi_act;
+        interrupt->sgi.pend = lu->sgi_pend;
+    }
+#endif
+    if (lu->spilled) {
+        vgic_add_spilled(vcpu, interrupt);
+    }
+    spin_unlock(&interrupt->lock);
+
+    vgic_hw_commit(vcpu, int_id);
+}
+
 /**
  * TODO: Should we save and restore GIC.APR state too?
  * If so, fix the commented out loops below
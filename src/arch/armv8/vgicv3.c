@@ -39,12 +39,13 @@ bool vgic_int_has_other_target(struct vcpu *vcpu, struct vgic_int *interrupt)
     return any || (!routed_here && route_valid);
 }
 
-uint8_t vgic_int_ptarget_mask(struct vcpu *vcpu, struct vgic_int *interrupt)
+cpumap_t vgic_int_ptarget_mask(struct vcpu *vcpu, struct vgic_int *interrupt)
 {
     if (vgic_broadcast(vcpu, interrupt)) {
         return vcpu->vm->cpus & ~(1U << vcpu->phys_id);
     } else {
-        return (1 << interrupt->phys.route);
+        cpuid_t pcpuid = cpu_mpidr_to_id(interrupt->phys.route);
+        return pcpuid != INVALID_CPUID ? (1ULL << pcpuid) : 0;
     }
 }
 
@@ -225,11 +226,24 @@ bool vgic_icc_sgir_handler(struct emul_access *acc)
             trgtlist = cpu.vcpu->vm->cpus & ~(1U << cpu.vcpu->phys_id);
         } else {
             /**
-             * TODO: we are assuming the vm has a single cluster. Change this
-             * when adding virtual cluster support.
+             * The target list selects Aff0 values within the range given by
+             * RS, in the cluster identified by Aff3.Aff2.Aff1.
              */
-            trgtlist = vm_translate_to_pcpu_mask(
-                cpu.vcpu->vm, ICC_SGIR_TRGLSTFLT(sgir), cpu.vcpu->vm->cpu_num);
+            unsigned long trglst = ICC_SGIR_TRGLSTFLT(sgir);
+            unsigned long mpidr =
+                (ICC_SGIR_AFF(sgir, 3) << MPIDR_AFF_LVL_OFF(3)) |
+                (ICC_SGIR_AFF(sgir, 2) << MPIDR_AFF_LVL_OFF(2)) |
+                (ICC_SGIR_AFF(sgir, 1) << MPIDR_AFF_LVL_OFF(1)) |
+                (ICC_SGIR_RS(sgir) * ICC_SGIR_TRGLSTFLT_LEN);
+            trgtlist = 0;
+            for (size_t i = 0; i < ICC_SGIR_TRGLSTFLT_LEN; i++) {
+                if (!(trglst & (1UL << i))) continue;
+                struct vcpu *tvcpu =
+                    vm_get_vcpu_by_mpidr(cpu.vcpu->vm, mpidr + i);
+                if (tvcpu != NULL) {
+                    trgtlist |= (1ULL << tvcpu->phys_id);
+                }
+            }
         }
         vgic_send_sgi_msg(cpu.vcpu, trgtlist, int_id);
     }
@@ -294,7 +308,8 @@ void vgic_init(struct vm *vm, const struct gic_dscrp *gic_dscrp)
         vcpu->arch.vgic_priv.vgicr.CTLR = 0;
 
         uint64_t typer = (uint64_t)vcpu->id << GICR_TYPER_PRCNUM_OFF;
-        typer |= (vcpu->arch.sysregs.hyp.vmpidr_el2 & MPIDR_AFF_MSK) << GICR_TYPER_AFFVAL_OFF;
+        typer |= (uint64_t)MPIDR_AFF_VAL32(vcpu->arch.sysregs.hyp.vmpidr_el2)
+                 << GICR_TYPER_AFFVAL_OFF;
         typer |= !!(vcpu->id == vcpu->vm->cpu_num - 1) << GICR_TYPER_LAST_OFF;
         vcpu->arch.vgic_priv.vgicr.TYPER = typer;
 
@@ -23,7 +23,22 @@
 void vm_arch_init(struct vm* vm, const struct vm_config* config)
 {
     if (vm->master == cpu.id) {
+        const struct clusters* clusters = &config->platform.arch.clusters;
+        if (clusters->num > 0) {
+            size_t core_num = 0;
+            for (size_t i = 0; i < clusters->num; i++) {
+                if (clusters->core_num[i] > (1UL << MPIDR_AFFINITY_BITS)) {
+                    ERROR("vm %d cluster %d has too many cores", vm->id, i);
+                }
+                core_num += clusters->core_num[i];
+            }
+            if (core_num != config->platform.cpu_num) {
+                ERROR("vm %d cluster topology does not match its cpu_num",
+                      vm->id);
+            }
+        }
         vgic_init(vm, &config->platform.arch.gic);
+        lazyregs_vm_init(vm, config);
     }
     /* TODO */
     as_arch_init(&vm->as);
@@ -33,8 +48,6 @@ struct vcpu* vm_get_vcpu_by_mpidr(struct vm* vm, unsigned long mpidr)
 {
     list_foreach(vm->vcpu_list, struct node_data, node){
 	struct vcpu* vcpu = node->data;
-        //if ((vcpu->arch.vmpidr & MPIDR_AFF_MSK) == (mpidr & MPIDR_AFF_MSK))  {
-        /* TODO */
         if ((vcpu->arch.sysregs.hyp.vmpidr_el2 & MPIDR_AFF_MSK) == (mpidr & MPIDR_AFF_MSK))  {
             return vcpu;
         }
@@ -65,9 +78,12 @@ void vcpu_arch_init(struct vcpu* vcpu, struct vm* vm)
     vcpu->arch.sysregs.hyp.vttbr_el2 =
         ((vcpu->vm->id << VTTBR_VMID_OFF) & VTTBR_VMID_MSK) |
         (root_pt_pa & ~VTTBR_VMID_MSK);
+    vcpu->arch.sysregs.hyp.vtcr_el2 =
+        (MRS(VTCR_EL2) & ~(VTCR_TG0_MSK | VTCR_SL0_MSK)) |
+        pt_s2_vtcr(vm->as.pt.dscr);
 
     ISB();  // make sure vmid is commited befor tlbi
-    tlb_vm_inv_all(vm->id);
+    tlb_vm_inv_all(vm->id, vm->as.cpus);
 
     vgic_cpu_init(vcpu);
 }
@@ -85,6 +101,9 @@ void vcpu_arch_reset(struct vcpu* vcpu, vaddr_t entry)
 
     MSR(CNTVOFF_EL2, 0);
 
+    vec_vcpu_reset(vcpu);
+    lazyregs_vcpu_reset(vcpu);
+
     /**
      *  See ARMv8-A ARM section D1.9.1 for registers that must be in a known
      * state at reset.
@@ -133,6 +152,71 @@ void vcpu_writepc(struct vcpu* vcpu, unsigned long pc)
     }
 }
 
+void vcpu_arch_set_power(struct vcpu* vcpu, bool on)
+{
+    spin_lock(&vcpu->arch.psci_ctx.lock);
+    vcpu->arch.psci_ctx.state = on ? ON : OFF;
+    spin_unlock(&vcpu->arch.psci_ctx.lock);
+}
+
+static inline bool vcpu_arch_from_lower_el(uint64_t spsr)
+{
+    return (spsr & SPSR_AARCH32) || ((spsr & SPSR_EL_MSK) == SPSR_EL0t);
+}
+
+/**
+ * Emulates taking a synchronous exception with syndrome esr to the guest's
+ * EL1. The vcpu must be the one currently running and trapped to the
+ * hypervisor, as the exception state is taken from and written to the live
+ * registers.
+ */
+void vcpu_arch_inject_sync(struct vcpu* vcpu, uint64_t esr)
+{
+    uint64_t spsr = MRS(SPSR_EL2);
+    uint64_t vector = MRS(VBAR_EL1);
+
+    if (spsr & SPSR_AARCH32) {
+        vector += 0x600;
+    } else if (vcpu_arch_from_lower_el(spsr)) {
+        vector += 0x400;
+    } else if ((spsr & SPSR_EL_MSK) == SPSR_EL1h) {
+        vector += 0x200;
+    }
+
+    MSR(ESR_EL1, esr);
+    MSR(ELR_EL1, MRS(ELR_EL2));
+    MSR(SPSR_EL1, spsr);
+    MSR(ELR_EL2, vector);
+    MSR(SPSR_EL2, SPSR_EL1h | SPSR_F | SPSR_I | SPSR_A | SPSR_D);
+}
+
+void vcpu_arch_inject_fault(struct vcpu* vcpu, enum vcpu_fault fault, bool write)
+{
+    bool lower_el = vcpu_arch_from_lower_el(MRS(SPSR_EL2));
+    uint64_t ec = ESR_EC_UNKWN;
+    uint64_t iss = 0;
+
+    switch (fault) {
+        case VCPU_FAULT_DATA:
+        case VCPU_FAULT_ALIGN:
+            ec = lower_el ? ESR_EC_DALEL : ESR_EC_DASEL;
+            iss = (fault == VCPU_FAULT_DATA) ? ESR_ISS_DA_DSFC_SEA
+                                             : ESR_ISS_DA_DSFC_ALIGN;
+            iss |= write ? ESR_ISS_DA_WnR_BIT : 0;
+            MSR(FAR_EL1, MRS(FAR_EL2));
+            break;
+        case VCPU_FAULT_INSTR:
+            ec = lower_el ? ESR_EC_IALEL : ESR_EC_IASEL;
+            iss = ESR_ISS_DA_DSFC_SEA;
+            MSR(FAR_EL1, MRS(FAR_EL2));
+            break;
+        default:
+            break;
+    }
+
+    vcpu_arch_inject_sync(vcpu, (ec << ESR_EC_OFF) | ESR_IL_BIT | iss);
+}
+
 int vcpu_is_off(struct vcpu* vcpu)
 {
     return cpu.vcpu->arch.psci_ctx.state == OFF;
@@ -207,6 +291,7 @@ void vcpu_save_state(struct vcpu* vcpu){
     vcpu->arch.sysregs.hyp.elr_el2      = MRS(ELR_EL2);
     vcpu->arch.sysregs.hyp.spsr_el2     = MRS(SPSR_EL2);
     vcpu->arch.sysregs.hyp.vttbr_el2    = MRS(VTTBR_EL2);
+    vcpu->arch.sysregs.hyp.vtcr_el2     = MRS(VTCR_EL2);
     vcpu->arch.sysregs.hyp.vmpidr_el2   = MRS(VMPIDR_EL2);
     vcpu->arch.sysregs.hyp.cntvoff_el2  = MRS(CNTVOFF_EL2);
     vcpu->arch.sysregs.vm.vbar_el1      = MRS(VBAR_EL1);
@@ -235,12 +320,14 @@ void vcpu_save_state(struct vcpu* vcpu){
 
     vgic_save_state(vcpu);
     vtimer_save_state(vcpu);
+    vrr_arch_suspend(vcpu);
 }
 
 void vcpu_restore_state(struct vcpu* vcpu){                                          //o registo é escrito aqui
     if(vcpu == NULL) return;
     MSR(ELR_EL2,         vcpu->arch.sysregs.hyp.elr_el2);
     MSR(SPSR_EL2,        vcpu->arch.sysregs.hyp.spsr_el2);
+    MSR(VTCR_EL2,        vcpu->arch.sysregs.hyp.vtcr_el2);
     MSR(VTTBR_EL2,       vcpu->arch.sysregs.hyp.vttbr_el2);
     MSR(VMPIDR_EL2,      vcpu->arch.sysregs.hyp.vmpidr_el2);
     MSR(CNTVOFF_EL2,     vcpu->arch.sysregs.hyp.cntvoff_el2);
@@ -269,4 +356,26 @@ void vcpu_restore_state(struct vcpu* vcpu){
     MSR(CNTKCTL_EL1,     vcpu->arch.sysregs.vm.cntkctl_el1);
     vgic_restore_state(vcpu);
     vtimer_restore_state(vcpu);
+    vec_vcpu_resume(vcpu);
+    lazyregs_resume(vcpu);
+    vrr_arch_resume(vcpu);
+}
+
+void vcpu_arch_save_ctx(struct vcpu* vcpu, struct vcpu_arch_ctx* ctx)
+{
+    /* The re-entered activation starts off with the same keys and tags */
+    lazyregs_save(vcpu);
+    ctx->sysregs = vcpu->arch.sysregs;
+}
+
+void vcpu_arch_restore_ctx(struct vcpu* vcpu, const struct vcpu_arch_ctx* ctx)
+{
+    /* The loaded registers are the popped activation's */
+    lazyregs_release(vcpu);
+    vcpu->arch.sysregs = ctx->sysregs;
+}
+
+void vcpu_arch_destroy(struct vcpu* vcpu)
+{
+    lazyregs_release(vcpu);
 }
@@ -48,13 +48,17 @@ void vmm_arch_init()
      */
 
     static size_t min_parange = 0b111;
+    static size_t granules = ~0UL;
     static spinlock_t lock = SPINLOCK_INITVAL;
 
-    size_t temp_parange = MRS(ID_AA64MMFR0_EL1) & ID_AA64MMFR0_PAR_MSK;
+    uint64_t mmfr0 = MRS(ID_AA64MMFR0_EL1);
+    size_t temp_parange = mmfr0 & ID_AA64MMFR0_PAR_MSK;
     spin_lock(&lock);
     if(temp_parange < min_parange) {
         min_parange = temp_parange;
     }
+    /* Only granules all cpus support are given to VMs */
+    granules &= pt_s2_granules(mmfr0);
     spin_unlock(&lock);
 
     cpu_sync_barrier(&cpu_glb_sync);
@@ -70,6 +74,7 @@ void vmm_arch_init()
             vm_pt_dscr->lvl_wdt[0] = parange_table[parange];
             vm_pt_dscr->lvls = vm_pt_dscr->lvls - 1;
         }
+        pt_s2_granules_init(granules);
 	/* TODO */
         /*interrupts_reserve(platform.arch.generic_timer.irqs.hyp,
             vmm_vtimer_irq_handler);*/
@@ -86,12 +91,23 @@ void vmm_arch_init()
                     VTCR_T0SZ(64 - parange_table[parange]) | VTCR_SH0_IS |
                     ((parange_table[parange] < 44) ? VTCR_SL0_12 : VTCR_SL0_01);
 
+    /**
+     * Let cpus implementing FEAT_HAFDBS set stage-2 access flags themselves.
+     * Entries are created with the flag set, so this only spares the
+     * working-set estimator the access flag faults after it clears them.
+     */
+    if (bit64_extract(MRS(ID_AA64MMFR1_EL1), ID_AA64MMFR1_HAFDBS_OFF,
+                      ID_AA64MMFR1_HAFDBS_LEN) != 0) {
+        vtcr |= VTCR_HA;
+    }
+
     MSR(VTCR_EL2, vtcr);
 
     uint64_t hcr = HCR_VM_BIT | HCR_RW_BIT | HCR_IMO_BIT | HCR_FMO_BIT |
                    HCR_TSC_BIT; /* trap smc */
 
     MSR(HCR_EL2, hcr);
+    lazyregs_init();
     MSR(HSTR_EL2, 0);
-    MSR(CPTR_EL2, 0);
+    /* CPTR_EL2 is set up by vec_init */
 }
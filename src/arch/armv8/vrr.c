@@ -0,0 +1,231 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <vrr.h>
+#include <vm.h>
+#include <cpu.h>
+#include <platform.h>
+#include <interrupts.h>
+#include <fences.h>
+#include <arch/sysregs.h>
+#include <arch/vgic.h>
+
+/**
+ * The VM's instructions are counted by the last PMU event counter, which
+ * MDCR_EL2.HPMN takes away from the guest. It counts instructions retired at
+ * EL1 and EL0 and its overflow interrupt extends it to 64 bits or stops the
+ * VM ahead of a replayed interrupt. Single stepping covers the interrupt's
+ * skid up to the exact instruction. The counter only runs while the recorded
+ * vcpu does, so neither other VMs' instructions nor their traps are counted,
+ * and it is saved and restored with the vcpu's state.
+ */
+
+#define VRR_COUNTER_WRAP (1ULL << 32)
+
+static size_t vrr_counter()
+{
+    return bit64_extract(MRS(PMCR_EL0), PMCR_N_OFF, PMCR_N_LEN) - 1;
+}
+
+static uint64_t vrr_counter_read(size_t ctr)
+{
+    uint64_t sel = MRS(PMSELR_EL0);
+    MSR(PMSELR_EL0, ctr);
+    ISB();
+    uint64_t val = MRS(PMXEVCNTR_EL0) & (VRR_COUNTER_WRAP - 1);
+    MSR(PMSELR_EL0, sel);
+    return val;
+}
+
+static void vrr_counter_write(size_t ctr, uint64_t val)
+{
+    uint64_t sel = MRS(PMSELR_EL0);
+    MSR(PMSELR_EL0, ctr);
+    ISB();
+    MSR(PMXEVCNTR_EL0, val);
+    MSR(PMSELR_EL0, sel);
+    ISB();
+}
+
+static void vrr_arch_irq_handler(irqid_t int_id)
+{
+    struct vcpu* vcpu = cpu.arch.vrr_vcpu;
+    uint64_t ovf = MRS(PMOVSCLR_EL0) & (1UL << vrr_counter());
+
+    if (ovf == 0) return;
+    MSR(PMOVSCLR_EL0, ovf);
+
+    /* Otherwise the overflow was accounted when the counter was stopped */
+    if (vcpu == NULL) return;
+
+    if (vcpu->arch.vrr.overflow) {
+        vcpu->arch.vrr.overflow = false;
+    } else {
+        vcpu->arch.vrr.base += VRR_COUNTER_WRAP;
+    }
+    vrr_overflow(vcpu);
+}
+
+bool vrr_arch_init(struct vcpu* vcpu)
+{
+    size_t n = bit64_extract(MRS(PMCR_EL0), PMCR_N_OFF, PMCR_N_LEN);
+    irqid_t irq = platform.arch.pmu.interrupt;
+
+    if (n == 0 || irq == 0) return false;
+
+    size_t ctr = n - 1;
+    vcpu->arch.vrr.counter = ctr;
+    vcpu->arch.vrr.base = 0;
+    vcpu->arch.vrr.saved = 0;
+    vcpu->arch.vrr.overflow = false;
+
+    MSR(MDCR_EL2, (MRS(MDCR_EL2) & ~MDCR_HPMN_MSK) | ctr | MDCR_HPME_BIT);
+    uint64_t sel = MRS(PMSELR_EL0);
+    MSR(PMSELR_EL0, ctr);
+    ISB();
+    MSR(PMXEVTYPER_EL0, PMU_EVT_INST_RETIRED);
+    MSR(PMSELR_EL0, sel);
+    MSR(PMCNTENCLR_EL0, 1UL << ctr);
+    MSR(PMINTENCLR_EL1, 1UL << ctr);
+    MSR(PMOVSCLR_EL0, 1UL << ctr);
+
+    interrupts_reserve(irq, vrr_arch_irq_handler);
+    interrupts_cpu_enable(irq, true);
+
+    /* Waiting for interrupts is itself an input */
+    MSR(HCR_EL2, MRS(HCR_EL2) | HCR_TWI_BIT);
+    ISB();
+
+    vcpu->arch.vrr.active = true;
+    if (vcpu == cpu.vcpu) {
+        vrr_arch_resume(vcpu);
+    }
+
+    return true;
+}
+
+void vrr_arch_suspend(struct vcpu* vcpu)
+{
+    if (cpu.arch.vrr_vcpu != vcpu) return;
+
+    size_t ctr = vcpu->arch.vrr.counter;
+
+    MSR(PMCNTENCLR_EL0, 1UL << ctr);
+    MSR(PMINTENCLR_EL1, 1UL << ctr);
+    ISB();
+    vcpu->arch.vrr.saved = vrr_counter_read(ctr);
+    if (MRS(PMOVSCLR_EL0) & (1UL << ctr)) {
+        MSR(PMOVSCLR_EL0, 1UL << ctr);
+        vcpu->arch.vrr.base += VRR_COUNTER_WRAP;
+        vcpu->arch.vrr.overflow = true;
+    }
+    cpu.arch.vrr_vcpu = NULL;
+}
+
+void vrr_arch_resume(struct vcpu* vcpu)
+{
+    if (!vcpu->arch.vrr.active || cpu.arch.vrr_vcpu == vcpu) return;
+
+    size_t ctr = vcpu->arch.vrr.counter;
+
+    vrr_counter_write(ctr, vcpu->arch.vrr.saved);
+    /**
+     * An overflow left pending as the counter stopped, already accounted in
+     * base, is raised again to be handled once the vcpu runs.
+     */
+    if (vcpu->arch.vrr.overflow) {
+        MSR(PMOVSSET_EL0, 1UL << ctr);
+    } else {
+        MSR(PMOVSCLR_EL0, 1UL << ctr);
+    }
+    cpu.arch.vrr_vcpu = vcpu;
+    MSR(PMINTENSET_EL1, 1UL << ctr);
+    MSR(PMCNTENSET_EL0, 1UL << ctr);
+    ISB();
+}
+
+static uint64_t vrr_arch_counter_get(struct vcpu* vcpu)
+{
+    if (cpu.arch.vrr_vcpu == vcpu) {
+        return vrr_counter_read(vcpu->arch.vrr.counter);
+    }
+    return vcpu->arch.vrr.saved;
+}
+
+static void vrr_arch_counter_set(struct vcpu* vcpu, uint64_t val)
+{
+    if (cpu.arch.vrr_vcpu == vcpu) {
+        vrr_counter_write(vcpu->arch.vrr.counter, val);
+    } else {
+        vcpu->arch.vrr.saved = val;
+    }
+}
+
+uint64_t vrr_arch_icount(struct vcpu* vcpu)
+{
+    return vcpu->arch.vrr.base + vrr_arch_counter_get(vcpu);
+}
+
+void vrr_arch_arm(struct vcpu* vcpu, uint64_t icount)
+{
+    uint64_t now = vrr_arch_icount(vcpu);
+
+    /* Further away than a wrap, the overflow will come back for it */
+    if (icount <= now || icount - now >= VRR_COUNTER_WRAP) return;
+
+    uint64_t val = VRR_COUNTER_WRAP - (icount - now);
+    vcpu->arch.vrr.base = now - val;
+    vrr_arch_counter_set(vcpu, val);
+}
+
+void vrr_arch_step(struct vcpu* vcpu, bool enable)
+{
+    uint64_t spsr = vcpu->state == VCPU_ACTIVE
+                        ? MRS(SPSR_EL2)
+                        : vcpu->arch.sysregs.hyp.spsr_el2;
+
+    if (enable) {
+        if (!vcpu->arch.dbg.active) {
+            vcpu->arch.dbg.mdscr_el1 = MRS(MDSCR_EL1);
+            vcpu->arch.dbg.active = true;
+        }
+        /* Debug exceptions are not generated while the OS lock is set */
+        MSR(OSLAR_EL1, 0);
+        MSR(MDSCR_EL1, MDSCR_SS_BIT);
+        MSR(MDCR_EL2, MRS(MDCR_EL2) | MDCR_TDE_BIT);
+        spsr |= SPSR_SS;
+    } else if (vcpu->arch.dbg.active) {
+        MSR(MDSCR_EL1, vcpu->arch.dbg.mdscr_el1);
+        MSR(MDCR_EL2, MRS(MDCR_EL2) & ~MDCR_TDE_BIT);
+        vcpu->arch.dbg.active = false;
+        spsr &= ~SPSR_SS;
+    }
+
+    if (vcpu->state == VCPU_ACTIVE) {
+        MSR(SPSR_EL2, spsr);
+    } else {
+        vcpu->arch.sysregs.hyp.spsr_el2 = spsr;
+    }
+    ISB();
+}
+
+void vrr_arch_wfi(struct vcpu* vcpu)
+{
+    /**
+     * Wait for the next physical interrupt, which is handled as soon as the
+     * vcpu resumes, unless the guest already has one to take.
+     */
+    if (!vgic_has_pending(vcpu)) {
+        asm volatile("wfi" ::: "memory");
+    }
+}
@@ -0,0 +1,128 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vwdt.h>
+#include <vm.h>
+#include <emul.h>
+
+/**
+ * SBSA generic watchdog model. The control frame is at the configured base
+ * address and the refresh frame right after it.
+ */
+
+#define SBSA_GWDT_FRAME_SIZE (0x1000)
+
+#define SBSA_GWDT_WRR (0x000)
+#define SBSA_GWDT_WCS (0x000)
+#define SBSA_GWDT_WOR (0x008)
+#define SBSA_GWDT_WCV_LO (0x010)
+#define SBSA_GWDT_WCV_HI (0x014)
+#define SBSA_GWDT_W_IIDR (0xfcc)
+
+#define SBSA_GWDT_WCS_EN (1UL << 0)
+#define SBSA_GWDT_WCS_WS0 (1UL << 1)
+#define SBSA_GWDT_WCS_WS1 (1UL << 2)
+
+/* Arm as implementer, architecture version 0 */
+#define SBSA_GWDT_IIDR (0x43b)
+
+static bool vwdt_refresh_emul_handler(struct emul_access* acc)
+{
+    struct vm* vm = cpu.vcpu->vm;
+    size_t off = (acc->addr - vm->config->watchdog.base_addr) -
+                 SBSA_GWDT_FRAME_SIZE;
+    unsigned long val = 0;
+
+    if (acc->write) {
+        /* Any write to WRR is an explicit refresh */
+        if (off == SBSA_GWDT_WRR) {
+            vwdt_refresh(vm);
+        }
+    } else {
+        if (off == SBSA_GWDT_W_IIDR) {
+            val = SBSA_GWDT_IIDR;
+        }
+        vcpu_writereg(cpu.vcpu, acc->reg, val);
+    }
+
+    return true;
+}
+
+static bool vwdt_ctrl_emul_handler(struct emul_access* acc)
+{
+    struct vm* vm = cpu.vcpu->vm;
+    struct vwdt* wdt = &vm->wdt;
+    size_t off = acc->addr - vm->config->watchdog.base_addr;
+
+    if (off >= SBSA_GWDT_FRAME_SIZE) {
+        return vwdt_refresh_emul_handler(acc);
+    }
+
+    if (acc->write) {
+        unsigned long val = vcpu_readreg(cpu.vcpu, acc->reg);
+        uint64_t wcv;
+        switch (off) {
+            case SBSA_GWDT_WCS:
+                vwdt_enable(vm, !!(val & SBSA_GWDT_WCS_EN));
+                break;
+            case SBSA_GWDT_WOR:
+                vwdt_set_offset(vm, (uint32_t)val);
+                break;
+            case SBSA_GWDT_WCV_LO:
+                wcv = acc->width == 8
+                          ? val
+                          : (wdt->deadline & ~0xffffffffUL) | (uint32_t)val;
+                vwdt_set_deadline(vm, wcv);
+                break;
+            case SBSA_GWDT_WCV_HI:
+                wcv = (wdt->deadline & 0xffffffffUL) | ((uint64_t)val << 32);
+                vwdt_set_deadline(vm, wcv);
+                break;
+        }
+    } else {
+        unsigned long val = 0;
+        spin_lock(&wdt->lock);
+        switch (off) {
+            case SBSA_GWDT_WCS:
+                val = (wdt->enabled ? SBSA_GWDT_WCS_EN : 0) |
+                      (wdt->ws0 ? SBSA_GWDT_WCS_WS0 : 0) |
+                      (wdt->ws1 ? SBSA_GWDT_WCS_WS1 : 0);
+                break;
+            case SBSA_GWDT_WOR:
+                val = (uint32_t)wdt->offset;
+                break;
+            case SBSA_GWDT_WCV_LO:
+                val = acc->width == 8 ? wdt->deadline
+                                      : (uint32_t)wdt->deadline;
+                break;
+            case SBSA_GWDT_WCV_HI:
+                val = wdt->deadline >> 32;
+                break;
+            case SBSA_GWDT_W_IIDR:
+                val = SBSA_GWDT_IIDR;
+                break;
+        }
+        spin_unlock(&wdt->lock);
+        vcpu_writereg(cpu.vcpu, acc->reg, val);
+    }
+
+    return true;
+}
+
+void vwdt_arch_init(struct vm* vm)
+{
+    struct emul_mem emu = {
+        .va_base = vm->config->watchdog.base_addr,
+        .size = 2 * SBSA_GWDT_FRAME_SIZE,
+        .handler = vwdt_ctrl_emul_handler,
+    };
+    vm_emul_add_mem(vm, &emu);
+}
@@ -0,0 +1,33 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <wss.h>
+#include <arch/page_table.h>
+
+/**
+ * Only the sweep clears the access flag and only a set flag is cleared, while
+ * the cpus, with VTCR_EL2.HA, or the access flag fault handler only ever set
+ * it. So a cleared flag cannot be lost to a concurrent update.
+ */
+bool wss_arch_test_and_clear(pte_t* pte)
+{
+    if (!(*pte & PTE_AF)) {
+        return false;
+    }
+
+    *pte &= ~PTE_AF;
+    return true;
+}
+
+void wss_arch_set_accessed(pte_t* pte)
+{
+    *pte |= PTE_AF;
+}
@@ -3,4 +3,9 @@ CROSS_COMPILE := riscv64-unknown-elf-
 arch-cppflags = 
 arch-cflags = -mcmodel=medany -march=rv64g
 arch-asflags =
-arch-ldflags = -z common-page-size=0x1000
\ No newline at end of file
+arch-ldflags = -z common-page-size=0x1000
+
+# Platforms whose harts implement the Zknh extension set RISCV_ZKNH := y
+ifeq ($(RISCV_ZKNH), y)
+arch-cppflags += -DRISCV_ZKNH
+endif
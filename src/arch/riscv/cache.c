@@ -43,3 +43,8 @@ __attribute__((weak)) void cache_flush_range(vaddr_t base, size_t size)
     WARNING("trying to flush caches but the operation is not defined for this "
             "platform");
 }
+
+__attribute__((weak)) void cache_clean_range(vaddr_t base, size_t size)
+{
+    cache_flush_range(base, size);
+}
@@ -23,3 +23,8 @@ void config_arch_vm_adjust_to_va(struct vm_config *vm_config, struct config* con
 {
 
 }
+
+void config_arch_vm_adjust_from_va(struct vm_config *vm_config, struct config* config, paddr_t phys)
+{
+
+}
@@ -0,0 +1,70 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <coredump.h>
+#include <vm.h>
+#include <string.h>
+
+struct coredump_vcpu_arch {
+    struct arch_regs regs;
+    uint64_t stime_value;
+};
+
+/* The vPLIC, as seen by the VM, without its lock */
+struct coredump_vm_arch {
+    uint64_t cntxt_num;
+    BITMAP_ALLOC(hw, PLIC_MAX_INTERRUPTS);
+    BITMAP_ALLOC(pend, PLIC_MAX_INTERRUPTS);
+    BITMAP_ALLOC(act, PLIC_MAX_INTERRUPTS);
+    uint32_t prio[PLIC_MAX_INTERRUPTS];
+    BITMAP_ALLOC_ARRAY(enbl, PLIC_MAX_INTERRUPTS, PLIC_PLAT_CNTXT_NUM);
+    uint32_t threshold[PLIC_PLAT_CNTXT_NUM];
+};
+
+void coredump_arch_gregs(struct vcpu* vcpu, uint64_t* gregs)
+{
+    gregs[0] = vcpu->regs->sepc;
+    for (size_t i = 0; i < 31; i++) {
+        gregs[i + 1] = vcpu->regs->x[i];
+    }
+}
+
+size_t coredump_arch_vcpu_size()
+{
+    return sizeof(struct coredump_vcpu_arch);
+}
+
+void coredump_arch_vcpu(struct vcpu* vcpu, void* buf)
+{
+    struct coredump_vcpu_arch* cd = buf;
+
+    cd->regs = *vcpu->regs;
+    cd->stime_value = vcpu->arch.stime_value;
+}
+
+size_t coredump_arch_vm_size(struct vm* vm)
+{
+    return sizeof(struct coredump_vm_arch);
+}
+
+void coredump_arch_vm(struct vm* vm, void* buf)
+{
+    struct coredump_vm_arch* cd = buf;
+    struct vplic* vplic = &vm->arch.vplic;
+
+    cd->cntxt_num = vplic->cntxt_num;
+    memcpy(cd->hw, vplic->hw, sizeof(cd->hw));
+    memcpy(cd->pend, vplic->pend, sizeof(cd->pend));
+    memcpy(cd->act, vplic->act, sizeof(cd->act));
+    memcpy(cd->prio, vplic->prio, sizeof(cd->prio));
+    memcpy(cd->enbl, vplic->enbl, sizeof(cd->enbl));
+    memcpy(cd->threshold, vplic->threshold, sizeof(cd->threshold));
+}
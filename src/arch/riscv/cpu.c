@@ -35,7 +35,7 @@ void cpu_arch_init(cpuid_t cpuid, paddr_t load_addr)
     }
 }
 
-void cpu_arch_idle()
+void cpu_arch_idle(size_t state)
 {
     asm volatile("wfi\n\t" ::: "memory");
     asm volatile("mv sp, %0\n\r"
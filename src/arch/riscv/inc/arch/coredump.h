@@ -0,0 +1,19 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __ARCH_COREDUMP_H__
+#define __ARCH_COREDUMP_H__
+
+/* EM_RISCV, with pc and x1-x31 as general registers */
+#define COREDUMP_ARCH_MACHINE (243)
+#define COREDUMP_ARCH_GREGS (32)
+
+#endif /* __ARCH_COREDUMP_H__ */
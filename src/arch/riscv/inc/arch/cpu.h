@@ -23,6 +23,8 @@ extern cpuid_t CPU_MASTER;
 struct cpu_arch {
     unsigned hart_id;
     unsigned plic_cntxt;
+    /* Hypervisor timer deadline, multiplexed with the guest's on stimecmp */
+    uint64_t timer_deadline;
 };
 
 #endif /* __ARCH_CPU_H__ */
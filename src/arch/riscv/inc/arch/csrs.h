@@ -69,10 +69,12 @@
 #define SATP_MODE_32 (1ULL << SATP_MODE_OFF)
 #define SATP_MODE_39 (8ULL << SATP_MODE_OFF)
 #define SATP_MODE_48 (9ULL << SATP_MODE_OFF)
+#define SATP_MODE_57 (10ULL << SATP_MODE_OFF)
 #define SATP_ASID_MSK BIT_MASK(SATP_ASID_OFF, SATP_ASID_LEN)
 
 #define HGATP_MODE_OFF SATP_MODE_OFF
 #define HGATP_MODE_DFLT SATP_MODE_DFLT
+#define HGATP_MODE_MSK BIT_MASK(HGATP_MODE_OFF, 4)
 #define HGATP_VMID_MSK BIT_MASK(HGATP_VMID_OFF, HGATP_VMID_LEN)
 
 #define SSTATUS_UIE_BIT (1ULL << 0)
@@ -80,6 +82,13 @@
 #define SSTATUS_UPIE_BIT (1ULL << 4)
 #define SSTATUS_SPIE_BIT (1ULL << 5)
 #define SSTATUS_SPP_BIT (1ULL << 8)
+#define SSTATUS_VS_OFF (9)
+#define SSTATUS_VS_LEN (2)
+#define SSTATUS_VS_MSK BIT_MASK(SSTATUS_VS_OFF, SSTATUS_VS_LEN)
+#define SSTATUS_VS_AOFF (0)
+#define SSTATUS_VS_INITIAL (1ULL << SSTATUS_VS_OFF)
+#define SSTATUS_VS_CLEAN (2ULL << SSTATUS_VS_OFF)
+#define SSTATUS_VS_DIRTY (3ULL << SSTATUS_VS_OFF)
 #define SSTATUS_FS_OFF (13)
 #define SSTATUS_FS_LEN (2)
 #define SSTATUS_FS_MSK BIT_MASK(SSTATUS_FS_OFF, SSTATUS_FS_LEN)
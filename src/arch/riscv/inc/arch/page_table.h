@@ -51,6 +51,13 @@
 #define PTE_RSW_LEN 2
 #define PTE_RSW_MSK PTE_MASK(PTE_RSW_OFF, PTE_RSW_LEN)
 
+#if (RV64)
+/* Svnapot: a run of 16 aligned leaf entries maps a 64 KiB range */
+#define PTE_NAPOT (1ULL << 63)
+#define PTE_NAPOT_PTES (16)
+#define PTE_NAPOT_64K (0x8ULL << 10)
+#endif
+
 #define PTE_TABLE (PTE_VALID)
 #define PTE_PAGE (PTE_RWX | PTE_VALID)
 #define PTE_SUPERPAGE (PTE_PAGE)
@@ -82,9 +89,15 @@
 typedef uint64_t pte_t;
 
 struct page_table;
+struct page_table_dscr;
 typedef pte_t pte_type_t;
 typedef pte_t pte_flags_t;
 
+#if (RV64)
+void pt_vm_modes_init(unsigned long modes);
+unsigned long pt_vm_hgatp_mode(struct page_table_dscr* dscr);
+#endif
+
 static inline void pte_set(pte_t* pte, paddr_t addr, pte_type_t type, pte_flags_t flags)
 {
     *pte = ((addr & PTE_ADDR_MSK) >> 2) |
@@ -93,7 +106,16 @@ static inline void pte_set(pte_t* pte, paddr_t addr, pte_type_t type, pte_flags_
 
 static inline paddr_t pte_addr(pte_t* pte)
 {
-    return (*pte << 2) & PTE_ADDR_MSK;
+    paddr_t addr = (*pte << 2) & PTE_ADDR_MSK;
+#if (RV64)
+    if (*pte & PTE_NAPOT) {
+        /* All entries of the run hold its base, each maps its own page */
+        size_t index = ((uintptr_t)pte / sizeof(pte_t)) % PTE_NAPOT_PTES;
+        addr &= ~((PTE_NAPOT_PTES * PAGE_SIZE) - 1);
+        addr |= index * PAGE_SIZE;
+    }
+#endif
+    return addr;
 }
 
 static inline bool pte_valid(pte_t* pte)
@@ -20,6 +20,13 @@
 
 struct arch_platform {
     paddr_t plic_base;
+    /* Frequency of the time counter (the timebase-frequency in the dts) */
+    uint64_t timer_freq;
+    /* ISA extensions all harts implement (from riscv,isa in the dts) */
+    struct {
+        bool svnapot;
+        bool svinval;
+    } ext;
 };
 
 #endif /* __ARCH_PLATFORM_H__ */
@@ -27,6 +27,15 @@
 #define PLIC_ENBL_OFF (0x002000)
 #define PLIC_CLAIMCMPLT_OFF (0x200000)
 
+/**
+ * Maximum number of interrupts claimed in a single hypervisor external
+ * interrupt entry before returning to the guest. Can be overridden at build
+ * time.
+ */
+#ifndef PLIC_MAX_IRQS_PER_ENTRY
+#define PLIC_MAX_IRQS_PER_ENTRY (16)
+#endif
+
 struct plic_global_hw {
     uint32_t prio[PLIC_NUM_PRIO_REGS];
     uint32_t pend[PLIC_NUM_PEND_REGS];
@@ -0,0 +1,22 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __ARCH_TIMER_H__
+#define __ARCH_TIMER_H__
+
+#include <crossconhyp.h>
+
+struct vcpu;
+
+void timer_arch_sync(struct vcpu* vcpu);
+void timer_arch_irq_handler(irqid_t int_id);
+
+#endif /* __ARCH_TIMER_H__ */
@@ -30,24 +30,22 @@ static inline void tlb_hyp_inv_va(vaddr_t va)
                           PAGE_SIZE);
 }
 
-static inline void tlb_hyp_inv_all()
+static inline void tlb_hyp_inv_range(vaddr_t va, size_t size, size_t step)
 {
-    sbi_remote_sfence_vma((1 << platform.cpu_num) - 1, 0, 0, 0);
+    sbi_remote_sfence_vma((1 << platform.cpu_num) - 1, 0, (unsigned long)va,
+                          size);
 }
 
-/**
- * TODO: change hart_mask to only take into account the vm physical cpus.
- */
-
-static inline void tlb_vm_inv_va(asid_t vmid, vaddr_t va)
+static inline void tlb_hyp_inv_all()
 {
-    sbi_remote_hfence_gvma_vmid((1 << platform.cpu_num)- 1, 0, (unsigned long)va,
-                                PAGE_SIZE, vmid);
+    sbi_remote_sfence_vma((1 << platform.cpu_num) - 1, 0, 0, 0);
 }
 
-static inline void tlb_vm_inv_all(asid_t vmid)
-{
-    sbi_remote_hfence_gvma_vmid((1 << platform.cpu_num) - 1, 0, 0, 0, vmid);
-}
+void tlb_vm_inv_va(asid_t vmid, cpumap_t cpus, vaddr_t va);
+void tlb_vm_inv_range(asid_t vmid, cpumap_t cpus, vaddr_t va, size_t size,
+                      size_t step);
+void tlb_vm_inv_all(asid_t vmid, cpumap_t cpus);
+
+void tlb_init();
 
 #endif /* __ARCH_TLB_H__ */
@@ -63,6 +63,14 @@ struct vcpu_arch {
     unsigned long stime_value;
 };
 
+/**
+ * Context of a vcpu activation not in struct arch_regs, saved by the VM stack
+ * while the vcpu runs again above its stacked activation.
+ */
+struct vcpu_arch_ctx {
+    unsigned long stime_value;
+};
+
 struct arch_regs {
     union {
         unsigned long x[31];
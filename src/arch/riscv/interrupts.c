@@ -109,6 +109,8 @@ void interrupts_arch_handle()
             // WARNING("unkown interrupt");
             break;
     }
+
+    cpu_irq_exit();
 }
 
 bool interrupts_arch_check(irqid_t int_id)
@@ -15,3 +15,10 @@ cpu-objs-y+=cache.o
 cpu-objs-y+=config.o
 cpu-objs-y+=iommu.o
 cpu-objs-y+=relocate.o
+cpu-objs-y+=timer.o
+cpu-objs-y+=wss.o
+cpu-objs-y+=tlb.o
+cpu-objs-y+=coredump.o
+cpu-objs-y+=sha256.o
+cpu-objs-y+=vec.o
+cpu-objs-y+=vec_regs.o
@@ -15,6 +15,8 @@
 
 #include <crossconhyp.h>
 #include <page_table.h>
+#include <platform.h>
+#include <arch/csrs.h>
 
 #if (SV32)
 struct page_table_dscr sv32_pt_dscr = {.lvls = 2,
@@ -36,8 +38,29 @@ struct page_table_dscr sv39x4_pt_dscr = {.lvls = 3,
                                     .lvl_wdt = (size_t[]){41, 30, 21},
                                     .lvl_off = (size_t[]){30, 21, 12},
                                     .lvl_term = (bool[]){true, true, true}};
+struct page_table_dscr sv48x4_pt_dscr = {.lvls = 4,
+                                    .lvl_wdt = (size_t[]){50, 39, 30, 21},
+                                    .lvl_off = (size_t[]){39, 30, 21, 12},
+                                    .lvl_term = (bool[]){true, true, true, true}};
+struct page_table_dscr sv57x4_pt_dscr = {.lvls = 5,
+                                    .lvl_wdt = (size_t[]){59, 48, 39, 30, 21},
+                                    .lvl_off = (size_t[]){48, 39, 30, 21, 12},
+                                    .lvl_term = (bool[]){true, true, true, true, true}};
 struct page_table_dscr* hyp_pt_dscr = &sv39_pt_dscr;
 struct page_table_dscr* vm_pt_dscr = &sv39x4_pt_dscr;
+
+/* G-stage modes by number of levels, from the shortest walk up */
+static struct {
+    struct page_table_dscr* dscr;
+    unsigned long mode;
+} vm_pt_modes[] = {
+    {&sv39x4_pt_dscr, SATP_MODE_39},
+    {&sv48x4_pt_dscr, SATP_MODE_48},
+    {&sv57x4_pt_dscr, SATP_MODE_57},
+};
+
+/* Mask of the hgatp MODE values all harts implement */
+static unsigned long hgatp_modes = 1UL << (SATP_MODE_39 >> HGATP_MODE_OFF);
 #endif
 
 pte_t* pt_get_pte(struct page_table* pt, size_t lvl, vaddr_t va)
@@ -65,3 +88,67 @@ bool pte_page(struct page_table* pt, pte_t* pte, size_t lvl)
 {
     return ((*pte & PTE_VALID) != 0) && ((*pte & PTE_RWX) != 0);
 }
+
+#if (RV64)
+void pt_vm_modes_init(unsigned long modes)
+{
+    hgatp_modes = modes;
+}
+
+/* The G-stage mode with the shortest walk that covers ipa_bits */
+struct page_table_dscr* pt_vm_dscr(size_t granule, size_t ipa_bits)
+{
+    if (granule != 0 && granule != PAGE_SIZE) return NULL;
+
+    for (size_t i = 0; i < sizeof(vm_pt_modes) / sizeof(vm_pt_modes[0]); i++) {
+        unsigned long bit = 1UL << (vm_pt_modes[i].mode >> HGATP_MODE_OFF);
+        if ((hgatp_modes & bit) &&
+            ipa_bits <= vm_pt_modes[i].dscr->lvl_wdt[0]) {
+            return vm_pt_modes[i].dscr;
+        }
+    }
+
+    return NULL;
+}
+
+unsigned long pt_vm_hgatp_mode(struct page_table_dscr* dscr)
+{
+    for (size_t i = 0; i < sizeof(vm_pt_modes) / sizeof(vm_pt_modes[0]); i++) {
+        if (vm_pt_modes[i].dscr == dscr) return vm_pt_modes[i].mode;
+    }
+
+    return HGATP_MODE_DFLT;
+}
+
+/* Only G-stage leaves use Svnapot, in runs of 16 pages */
+size_t pt_contig_ptes(struct page_table* pt, size_t lvl)
+{
+    bool napot = platform.arch.ext.svnapot && pt->dscr != hyp_pt_dscr &&
+                 lvl == pt->dscr->lvls - 1;
+    return napot ? PTE_NAPOT_PTES : 1;
+}
+
+bool pte_contig(pte_t* pte)
+{
+    return (*pte & PTE_NAPOT) != 0;
+}
+
+void pte_set_contig(struct page_table* pt, pte_t* pte, size_t lvl,
+                    paddr_t addr, pte_type_t type, pte_flags_t flags)
+{
+    pte_t napot;
+    pte_set(&napot, addr, type, flags);
+    napot |= PTE_NAPOT | PTE_NAPOT_64K;
+
+    for (size_t i = 0; i < PTE_NAPOT_PTES; i++) {
+        pte[i] = napot;
+    }
+}
+
+void pte_uncontig(pte_t* pte)
+{
+    paddr_t addr = pte_addr(pte);
+    pte_t flags = *pte & ~(PTE_NAPOT | (PTE_ADDR_MSK >> 2));
+    *pte = ((addr & PTE_ADDR_MSK) >> 2) | flags;
+}
+#endif
@@ -135,9 +135,15 @@ uint32_t plic_get_thrshold(unsigned cntxt)
 
 void plic_handle()
 {
-    uint32_t id = plic_hart[cpu.arch.plic_cntxt].claim;
+    /**
+     * Claim until the context has nothing left pending (claim reads 0) so
+     * that simultaneous interrupts are handled in a single trap.
+     */
+    for (size_t i = 0; i < PLIC_MAX_IRQS_PER_ENTRY; i++) {
+        uint32_t id = plic_hart[cpu.arch.plic_cntxt].claim;
+
+        if (id == 0) break;
 
-    if (id != 0) {
         enum irq_res res = interrupts_handle(id);
         if (res == HANDLED_BY_HYP) plic_hart[cpu.arch.plic_cntxt].complete = id;
     }
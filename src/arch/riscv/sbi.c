@@ -21,6 +21,8 @@
 #include <fences.h>
 #include <hypercall.h>
 #include <vmstack.h>
+#include <arch/timer.h>
+#include <timer.h>
 
 #define SBI_EXTID_BASE (0x10)
 #define SBI_GET_SBI_SPEC_VERSION_FID (0)
@@ -42,6 +44,12 @@
 #define SBI_HART_STOP_FID   (1)
 #define SBI_HART_STATUS_FID   (2)
 
+#define SBI_EXTID_SRST (0x53525354)
+#define SBI_SYSTEM_RESET_FID (0)
+#define SBI_RESET_TYPE_SHUTDOWN (0)
+#define SBI_RESET_TYPE_COLD_REBOOT (1)
+#define SBI_RESET_TYPE_WARM_REBOOT (2)
+
 #define SBI_EXTID_RFNC (0x52464E43)
 #define SBI_REMOTE_FENCE_I_FID (0)
 #define SBI_REMOTE_SFENCE_VMA_FID (1)
@@ -57,6 +65,18 @@
  */
 #define SBI_EXTID_CROSSCONHYP (0x08000ba0)
 
+/**
+ * Per-VM virtual watchdog. A guest starts it with the period in microseconds
+ * in a0 (zero keeps the configured one) and must refresh it within each
+ * period. Status returns bit 0 set if enabled and bit 1 set after a first
+ * expiry.
+ */
+#define SBI_EXTID_VWDT (0x08000ba1)
+#define SBI_VWDT_START_FID (0)
+#define SBI_VWDT_REFRESH_FID (1)
+#define SBI_VWDT_STOP_FID (2)
+#define SBI_VWDT_STATUS_FID (3)
+
 static inline struct sbiret sbi_ecall(long eid, long fid, long a0, long a1,
                                       long a2, long a3, long a4, long a5)
 {
@@ -242,19 +262,13 @@ struct sbiret sbi_time_handler(unsigned long fid)
 
     uint64_t stime_value = vcpu_readreg(cpu.vcpu, REG_A0);
 
-    sbi_set_timer(stime_value);  // assumes always success
     cpu.vcpu->arch.stime_value = stime_value;
     CSRC(CSR_HVIP, HIP_VSTIP);
-    CSRS(sie, SIE_STIE);
+    timer_arch_sync(cpu.vcpu);
 
     return (struct sbiret){SBI_SUCCESS};
 }
 
-void sbi_timer_irq_handler()
-{
-    CSRS(CSR_HVIP, HIP_VSTIP);
-    CSRC(sie, SIE_STIE);
-}
 
 #pragma GCC push_options
 #pragma GCC optimize ("O0")
@@ -299,6 +313,14 @@ struct sbiret sbi_base_handler(unsigned long fid)
                     ret.value = extid;
                 }
             }
+            /* Emulated for the VM only, not required from the firmware */
+            if (extid == SBI_EXTID_SRST) {
+                ret.value = extid;
+            }
+            if (extid == SBI_EXTID_VWDT &&
+                cpu.vcpu->vm->config->watchdog.enable) {
+                ret.value = extid;
+            }
             break;
         default:
             break;
@@ -427,6 +449,68 @@ struct sbiret sbi_hsm_handler(unsigned long fid){
 }
 
 
+/**
+ * The system is the VM. On success, the calling hart does not return.
+ */
+struct sbiret sbi_srst_handler(unsigned long fid)
+{
+    struct sbiret ret = {.error = SBI_ERR_FAILURE};
+    unsigned long reset_type = vcpu_readreg(cpu.vcpu, REG_A0);
+
+    if (fid != SBI_SYSTEM_RESET_FID) {
+        ret.error = SBI_ERR_NOT_SUPPORTED;
+        return ret;
+    }
+
+    switch (reset_type) {
+        case SBI_RESET_TYPE_SHUTDOWN:
+            vm_halt(cpu.vcpu->vm);
+            break;
+        case SBI_RESET_TYPE_COLD_REBOOT:
+        case SBI_RESET_TYPE_WARM_REBOOT:
+            vm_reset(cpu.vcpu->vm);
+            break;
+        default:
+            ret.error = SBI_ERR_INVALID_PARAM;
+    }
+
+    return ret;
+}
+
+struct sbiret sbi_vwdt_handler(unsigned long fid)
+{
+    struct sbiret ret = {.error = SBI_SUCCESS};
+    struct vm* vm = cpu.vcpu->vm;
+    unsigned long timeout_us = vcpu_readreg(cpu.vcpu, REG_A0);
+
+    if (!vm->config->watchdog.enable) {
+        ret.error = SBI_ERR_NOT_SUPPORTED;
+        return ret;
+    }
+
+    switch (fid) {
+        case SBI_VWDT_START_FID:
+            if (timeout_us != 0) {
+                vwdt_set_offset(vm, timer_us_to_ticks(timeout_us));
+            }
+            vwdt_enable(vm, true);
+            break;
+        case SBI_VWDT_REFRESH_FID:
+            vwdt_refresh(vm);
+            break;
+        case SBI_VWDT_STOP_FID:
+            vwdt_enable(vm, false);
+            break;
+        case SBI_VWDT_STATUS_FID:
+            ret.value = (vm->wdt.enabled ? 0x1 : 0) | (vm->wdt.ws0 ? 0x2 : 0);
+            break;
+        default:
+            ret.error = SBI_ERR_NOT_SUPPORTED;
+    }
+
+    return ret;
+}
+
 struct sbiret sbi_crossconhyp_handler(unsigned long fid){
 
     struct sbiret ret;
@@ -475,6 +559,12 @@ size_t sbi_vs_handler()
         case SBI_EXTID_HSM:
             ret = sbi_hsm_handler(fid);
             break;
+        case SBI_EXTID_SRST:
+            ret = sbi_srst_handler(fid);
+            break;
+        case SBI_EXTID_VWDT:
+            ret = sbi_vwdt_handler(fid);
+            break;
         case SBI_EXTID_CROSSCONHYP:
             ret = sbi_crossconhyp_handler(fid);
 	    goto out;
@@ -523,5 +613,5 @@ void sbi_init()
         }
     }
 
-    interrupts_reserve(TIMR_INT_ID, sbi_timer_irq_handler);
+    interrupts_reserve(TIMR_INT_ID, timer_arch_irq_handler);
 }
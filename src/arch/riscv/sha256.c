@@ -0,0 +1,88 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <sha256.h>
+
+#ifdef RISCV_ZKNH
+
+/**
+ * Zknh scalar SHA-256 instructions, encoded with .insn so that toolchains
+ * without the extension can still build them.
+ */
+#define SHA256_INSN(NAME, FUNCT12)                                  \
+    static inline uint32_t NAME(uint32_t x)                         \
+    {                                                               \
+        unsigned long rd;                                           \
+        asm("\t.insn i 0x13, 1, %0, %1, " #FUNCT12 "\n"            \
+            : "=r"(rd) : "r"((unsigned long)x));                    \
+        return rd;                                                  \
+    }
+
+SHA256_INSN(sha256sum0, 0x100)
+SHA256_INSN(sha256sum1, 0x101)
+SHA256_INSN(sha256sig0, 0x102)
+SHA256_INSN(sha256sig1, 0x103)
+
+extern const uint32_t sha256_k[64];
+
+static inline uint32_t load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+void sha256_blocks(uint32_t state[8], const uint8_t* data, size_t nblocks)
+{
+    uint32_t w[64];
+
+    while (nblocks-- > 0) {
+        for (size_t i = 0; i < 16; i++) {
+            w[i] = load_be32(&data[i * 4]);
+        }
+        for (size_t i = 16; i < 64; i++) {
+            w[i] = w[i - 16] + sha256sig0(w[i - 15]) + w[i - 7] +
+                   sha256sig1(w[i - 2]);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (size_t i = 0; i < 64; i++) {
+            uint32_t t1 = h + sha256sum1(e) + ((e & f) ^ (~e & g)) +
+                          sha256_k[i] + w[i];
+            uint32_t t2 = sha256sum0(a) + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += SHA256_BLOCK_SIZE;
+    }
+}
+
+#endif /* RISCV_ZKNH */
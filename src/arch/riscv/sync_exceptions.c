@@ -93,6 +93,12 @@ static inline bool is_pseudo_ins(uint32_t ins) {
 size_t guest_page_fault_handler()
 {
     vaddr_t addr = CSRR(CSR_HTVAL) << 2;
+    bool write = CSRR(scause) == SCAUSE_CODE_SGPF;
+
+    /* A fault on a page whose A bit the working-set estimator cleared */
+    if (wss_access_fault(cpu.vcpu->vm, addr)) {
+        return 0;
+    }
 
     emul_handler_t handler = vm_emul_get_mem(cpu.vcpu->vm, addr);
     if (handler != NULL) {
@@ -109,8 +115,13 @@ size_t guest_page_fault_handler()
             ins = read_ins(ins_addr);
             ins_size = INS_SIZE(ins);
         } else if (is_pseudo_ins(ins)) {
-            //TODO: we should reinject this in the guest as a fault access
-            ERROR("fault on 1st stage page table walk");
+            /**
+             * The guest's first stage page table lies in an emulated region.
+             * Reflect it as an access fault on the original access.
+             */
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, addr, write,
+                       "fault on 1st stage page table walk");
+            return 0;
         } else {
             /**
              * If htinst is valid and is not a pseudo isntruction make sure
@@ -123,40 +134,72 @@ size_t guest_page_fault_handler()
 
         struct emul_access emul;
         if (!ins_ldst_decode(ins, &emul)) {
-            ERROR("cant decode ld/st instruction");
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, addr, write,
+                       "cant decode ld/st instruction");
+            return 0;
         }
         emul.addr = addr;
 
-        /**
-         * TODO: check if the access is aligned.
-         * If not, inject an exception in the vm.
-         */
+        if (emul.addr & (emul.width - 1)) {
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_ALIGN, addr, emul.write,
+                       "unaligned emulated access");
+            return 0;
+        }
 
         if (handler(&emul)) {
+            if (!emul.write && cpu.vcpu->vm->vrr.mode != VM_REPLAY_NONE) {
+                vrr_reg(cpu.vcpu, VRR_EV_MMIO, addr, emul.reg);
+            }
             return ins_size;
         } else {
-            ERROR("emulation handler failed (0x%x at 0x%x)", addr, CSRR(sepc));
+            vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, addr, emul.write,
+                       "emulation handler failed");
         }
     } else {
         struct vcpu* vcpu = cpu.vcpu;
-        WARNING("no emulation handler for abort(0x%x at 0x%x)", addr, CSRR(sepc));
+        bool handled = false;
         list_foreach(vcpu->vm->mem_abort_list, struct hndl_mem_abort_node, node)
         {
             mem_abort_handler_t handler = node->hndl_mem_abort.handler;
             if (handler != NULL) {
                 if (handler(vcpu, addr)) {
-                    ERROR("handler abort failed (0x%x)", addr);
+                    vcpu_fault(vcpu, VCPU_FAULT_DATA, addr, write,
+                               "handler abort failed");
+                    return 0;
                 }
+                handled = true;
             }
         }
+
+        if (!handled) {
+            vcpu_fault(vcpu, VCPU_FAULT_DATA, addr, write,
+                       "no emulation handler for abort");
+        }
     }
     return 0;
 }
 
+size_t guest_inst_page_fault_handler()
+{
+    if (wss_access_fault(cpu.vcpu->vm, CSRR(CSR_HTVAL) << 2)) {
+        return 0;
+    }
+
+    vcpu_fault(cpu.vcpu, VCPU_FAULT_INSTR, CSRR(CSR_HTVAL) << 2, false,
+               "instruction guest page fault");
+    return 0;
+}
+
 size_t guest_illegal_instr_handler()
 {
     unsigned long ins = CSRR(CSR_HTINST);
     size_t ins_size;
+
+    /* A vector instruction with the registers owned by another vcpu */
+    if (vec_trap(cpu.vcpu)) {
+        return 0;
+    }
+
     if(ins == 0) {
         /**
          * If htinst does not provide information about the trap,
@@ -167,8 +210,10 @@ size_t guest_illegal_instr_handler()
         ins = read_ins(ins_addr);
         ins_size = INS_SIZE(ins);
     } else if (is_pseudo_ins(ins)) {
-        //TODO: we should reinject this in the guest as a fault access
-        ERROR("fault on 1st stage page table walk");
+        vcpu_fault(cpu.vcpu, VCPU_FAULT_DATA, CSRR(stval),
+                   ins == TINST_PSEUDO_STORE,
+                   "fault on 1st stage page table walk");
+        return 0;
     } else {
         /**
          * If htinst is valid and is not a pseudo isntruction make sure
@@ -182,6 +227,7 @@ size_t guest_illegal_instr_handler()
 
 sync_handler_t sync_handler_table[] = {
     [SCAUSE_CODE_ECV] = sbi_vs_handler,
+    [SCAUSE_CODE_IGPF] = guest_inst_page_fault_handler,
     [SCAUSE_CODE_LGPF] = guest_page_fault_handler,
     [SCAUSE_CODE_SGPF] = guest_page_fault_handler,
     [SCAUSE_CODE_ILI] = guest_illegal_instr_handler,
@@ -206,8 +252,11 @@ void sync_exception_handler()
     if (_scause < sync_handler_table_size && sync_handler_table[_scause]) {
         pc_step = sync_handler_table[_scause]();
     } else {
-        ERROR("unkown synchronous exception (%d) at 0x%lx", _scause, CSRR(sepc));
+        vcpu_fault(calling_cpu, VCPU_FAULT_UNDEF, _scause, false,
+                   "unknown synchronous exception");
     }
 
     calling_cpu->regs->sepc += pc_step;
+
+    cpu_trap_exit();
 }
@@ -0,0 +1,77 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <timer.h>
+#include <arch/timer.h>
+#include <arch/sbi.h>
+#include <arch/csrs.h>
+#include <cpu.h>
+#include <vm.h>
+#include <platform.h>
+
+void timer_arch_init()
+{
+    cpu.arch.timer_deadline = TIMER_DEADLINE_NONE;
+}
+
+/**
+ * There is a single supervisor timer per hart, shared between the vcpu about
+ * to run and the hypervisor. Program it with the earliest of both deadlines.
+ * A guest deadline that already passed is signaled right away through
+ * hvip, as it can't be told apart from the hypervisor's on expiry.
+ */
+void timer_arch_sync(struct vcpu* vcpu)
+{
+    uint64_t now = timer_arch_get_counter();
+    uint64_t next = cpu.arch.timer_deadline;
+
+    if (vcpu != NULL) {
+        uint64_t stime_value = vcpu->arch.stime_value;
+        if (stime_value <= now) {
+            CSRS(CSR_HVIP, HIP_VSTIP);
+        } else if (stime_value < next) {
+            next = stime_value;
+        }
+    }
+
+    sbi_set_timer(next);  // assumes always success
+    if (next != TIMER_DEADLINE_NONE) {
+        CSRS(sie, SIE_STIE);
+    } else {
+        CSRC(sie, SIE_STIE);
+    }
+}
+
+void timer_arch_irq_handler(irqid_t int_id)
+{
+    if (cpu.arch.timer_deadline <= timer_arch_get_counter()) {
+        cpu.arch.timer_deadline = TIMER_DEADLINE_NONE;
+        timer_handle();
+    }
+
+    timer_arch_sync(cpu.vcpu);
+}
+
+void timer_arch_set(uint64_t deadline)
+{
+    cpu.arch.timer_deadline = deadline;
+    timer_arch_sync(cpu.vcpu);
+}
+
+uint64_t timer_arch_get_counter()
+{
+    return CSRR(time);
+}
+
+uint64_t timer_arch_get_freq()
+{
+    return platform.arch.timer_freq;
+}
@@ -0,0 +1,217 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <tlb.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <timer.h>
+#include <platform.h>
+
+#define TLB_MAX_HARTS (sizeof(cpumap_t) * 8)
+/* How long a hart waits for the others before handing their part to the SBI */
+#define TLB_IPI_TIMEOUT_US (100)
+
+/**
+ * The G-stage invalidations a hart asked the others to perform. Each hart has
+ * at most one batch in flight, protected by its lock. waiting holds the harts
+ * still to perform it and gen changes with each batch, so a hart that read a
+ * batch the sender has since given up on does not mark the next one done.
+ */
+struct tlb_batch {
+    spinlock_t lock;
+    asid_t vmid;
+    vaddr_t va;
+    size_t size;
+    size_t step;
+    unsigned long gen;
+    cpumap_t waiting;
+};
+
+static struct tlb_batch tlb_batches[TLB_MAX_HARTS];
+
+/* For each hart, the harts whose batch it was asked to perform */
+static struct {
+    spinlock_t lock;
+    cpumap_t senders;
+} tlb_requests[TLB_MAX_HARTS];
+
+/* Harts that perform the batches sent to them */
+static spinlock_t tlb_lock = SPINLOCK_INITVAL;
+static cpumap_t tlb_harts;
+
+enum { TLB_MSG_INVAL };
+
+static void tlb_msg_handler(uint32_t event, uint64_t data);
+CPU_MSG_HANDLER(tlb_msg_handler, TLB_CPUMSG_ID);
+
+/**
+ * Svinval splits hfence.gvma in its ordering and invalidation parts: a single
+ * sfence.w.inval/sfence.inval.ir pair orders the whole batch of hinval.gvma
+ * against the preceding page table updates and the following accesses.
+ */
+static void tlb_gvma_inval(asid_t vmid, vaddr_t va, size_t size, size_t step)
+{
+    /* sfence.w.inval */
+    asm volatile(".insn i 0x73, 0, x0, x0, 0x180\n\t" ::: "memory");
+    for (vaddr_t addr = va; addr < va + size; addr += step) {
+        /* hinval.gvma addr, vmid */
+        asm volatile(".insn r 0x73, 0, 0x33, x0, %0, %1\n\t" ::"r"(addr >> 2),
+                     "r"(vmid)
+                     : "memory");
+    }
+    /* sfence.inval.ir */
+    asm volatile(".insn i 0x73, 0, x0, x0, 0x181\n\t" ::: "memory");
+}
+
+static void tlb_serve()
+{
+    cpumap_t senders;
+    cpumap_t self = 1UL << cpu.id;
+
+    spin_lock(&tlb_requests[cpu.id].lock);
+    senders = tlb_requests[cpu.id].senders;
+    tlb_requests[cpu.id].senders = 0;
+    spin_unlock(&tlb_requests[cpu.id].lock);
+
+    for (size_t i = 0; i < TLB_MAX_HARTS && senders != 0; i++) {
+        if (!(senders & (1UL << i))) continue;
+        senders &= ~(1UL << i);
+
+        struct tlb_batch* batch = &tlb_batches[i];
+        spin_lock(&batch->lock);
+        bool wanted = (batch->waiting & self) != 0;
+        asid_t vmid = batch->vmid;
+        vaddr_t va = batch->va;
+        size_t size = batch->size;
+        size_t step = batch->step;
+        unsigned long gen = batch->gen;
+        spin_unlock(&batch->lock);
+
+        if (!wanted) continue;
+
+        tlb_gvma_inval(vmid, va, size, step);
+
+        spin_lock(&batch->lock);
+        if (batch->gen == gen) {
+            batch->waiting &= ~self;
+        }
+        spin_unlock(&batch->lock);
+    }
+}
+
+static void tlb_msg_handler(uint32_t event, uint64_t data)
+{
+    if (event == TLB_MSG_INVAL) {
+        tlb_serve();
+    }
+}
+
+void tlb_init()
+{
+    spin_lock(&tlb_lock);
+    tlb_harts |= 1UL << cpu.id;
+    spin_unlock(&tlb_lock);
+}
+
+/* The harts in cpus, the VM's, and the local one */
+static inline cpumap_t tlb_vm_harts(cpumap_t cpus)
+{
+    return (cpus | (1UL << cpu.id)) & ((1UL << platform.cpu_num) - 1);
+}
+
+void tlb_vm_inv_va(asid_t vmid, cpumap_t cpus, vaddr_t va)
+{
+    sbi_remote_hfence_gvma_vmid(tlb_vm_harts(cpus), 0, (unsigned long)va,
+                                PAGE_SIZE, vmid);
+}
+
+void tlb_vm_inv_all(asid_t vmid, cpumap_t cpus)
+{
+    sbi_remote_hfence_gvma_vmid(tlb_vm_harts(cpus), 0, 0, 0, vmid);
+}
+
+/**
+ * The batch is performed locally and by the other harts in cpus, the VM's.
+ * With Svinval, they get it through a cpu message. While waiting for them,
+ * this hart serves the batches sent to it, as their senders may in turn be
+ * waiting on it. Harts that are not serving batches or do not answer in
+ * time get a single SBI remote fence for the whole range, as do all harts
+ * without Svinval.
+ */
+void tlb_vm_inv_range(asid_t vmid, cpumap_t cpus, vaddr_t va, size_t size,
+                      size_t step)
+{
+    cpumap_t self = 1UL << cpu.id;
+    cpumap_t harts = tlb_vm_harts(cpus);
+
+    if (!platform.arch.ext.svinval) {
+        sbi_remote_hfence_gvma_vmid(harts, 0, va, size, vmid);
+        return;
+    }
+
+    spin_lock(&tlb_lock);
+    cpumap_t targets = tlb_harts & harts & ~self;
+    spin_unlock(&tlb_lock);
+
+    /* E.g. while the VM is set up, no other hart needs to be asked */
+    if (targets == 0) {
+        tlb_gvma_inval(vmid, va, size, step);
+        if (harts & ~self) {
+            sbi_remote_hfence_gvma_vmid(harts & ~self, 0, va, size, vmid);
+        }
+        return;
+    }
+
+    struct tlb_batch* batch = &tlb_batches[cpu.id];
+    spin_lock(&batch->lock);
+    batch->vmid = vmid;
+    batch->va = va;
+    batch->size = size;
+    batch->step = step;
+    batch->gen++;
+    batch->waiting = targets;
+    spin_unlock(&batch->lock);
+
+    for (size_t i = 0; i < platform.cpu_num; i++) {
+        if (!(targets & (1UL << i))) continue;
+        spin_lock(&tlb_requests[i].lock);
+        tlb_requests[i].senders |= self;
+        spin_unlock(&tlb_requests[i].lock);
+
+        struct cpu_msg msg = {TLB_CPUMSG_ID, TLB_MSG_INVAL, 0};
+        cpu_send_msg(i, &msg);
+    }
+
+    tlb_gvma_inval(vmid, va, size, step);
+
+    cpumap_t left = harts & ~targets & ~self;
+    uint64_t deadline =
+        timer_get_counter() + timer_us_to_ticks(TLB_IPI_TIMEOUT_US);
+    while (true) {
+        tlb_serve();
+
+        spin_lock(&batch->lock);
+        bool expired =
+            batch->waiting != 0 && timer_get_counter() >= deadline;
+        if (batch->waiting == 0 || expired) {
+            left |= batch->waiting;
+            batch->waiting = 0;
+            batch->gen++;
+            spin_unlock(&batch->lock);
+            break;
+        }
+        spin_unlock(&batch->lock);
+    }
+
+    if (left != 0) {
+        sbi_remote_hfence_gvma_vmid(left, 0, va, size, vmid);
+    }
+}
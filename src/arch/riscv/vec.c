@@ -0,0 +1,116 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vec.h>
+#include <vm.h>
+#include <cpu.h>
+#include <arch/encoding.h>
+#include <arch/csrs.h>
+
+/**
+ * Vector instructions are trapped by turning sstatus.VS off in the
+ * hypervisor's copy of the vcpu's sstatus. The hart tells whether the owner
+ * changed the registers by setting VS to dirty. VLEN can not be limited, so
+ * a VM capped below the hart's length gets no vectors at all.
+ */
+struct vec_arch_regs {
+    unsigned long vstart;
+    unsigned long vl;
+    unsigned long vtype;
+    unsigned long vxsat;
+    unsigned long vxrm;
+    /* v0-v31, vlenb bytes each */
+    uint8_t v[];
+};
+
+void vec_arch_v_save(void* regs);
+void vec_arch_v_restore(const void* regs);
+void vec_arch_v_setvl(unsigned long vl, unsigned long vtype);
+
+static size_t vec_vlenb;
+
+void vec_arch_init()
+{
+    unsigned long sstatus = CSRR(sstatus);
+
+    /* VS is read-only zero if the hart has no vector extension */
+    CSRS(sstatus, SSTATUS_VS_DIRTY);
+    if ((CSRR(sstatus) & SSTATUS_VS_MSK) != 0) {
+        vec_vlenb = CSRR(CSR_VLENB);
+    }
+    CSRW(sstatus, sstatus);
+}
+
+size_t vec_arch_vl(size_t max_vl)
+{
+    if (vec_vlenb == 0 || (max_vl != 0 && max_vl < vec_vlenb)) {
+        return 0;
+    }
+
+    return vec_vlenb;
+}
+
+size_t vec_arch_size(size_t vl)
+{
+    return vl == 0 ? 0 : sizeof(struct vec_arch_regs) + 32 * vl;
+}
+
+void vec_arch_save(struct vcpu* vcpu, void* regs)
+{
+    struct vec_arch_regs* vec = regs;
+    unsigned long sstatus = CSRR(sstatus);
+
+    CSRS(sstatus, SSTATUS_VS_DIRTY);
+    vec->vstart = CSRR(CSR_VSTART);
+    vec->vl = CSRR(CSR_VL);
+    vec->vtype = CSRR(CSR_VTYPE);
+    vec->vxsat = CSRR(CSR_VXSAT);
+    vec->vxrm = CSRR(CSR_VXRM);
+    CSRW(CSR_VSTART, 0);
+    vec_arch_v_save(vec->v);
+    CSRW(sstatus, sstatus);
+
+    /* The registers in memory are now up to date */
+    if ((vcpu->regs->sstatus & SSTATUS_VS_MSK) == SSTATUS_VS_DIRTY) {
+        vcpu->regs->sstatus &= ~SSTATUS_VS_MSK;
+        vcpu->regs->sstatus |= SSTATUS_VS_CLEAN;
+    }
+}
+
+void vec_arch_restore(struct vcpu* vcpu, const void* regs)
+{
+    const struct vec_arch_regs* vec = regs;
+    unsigned long sstatus = CSRR(sstatus);
+
+    CSRS(sstatus, SSTATUS_VS_DIRTY);
+    CSRW(CSR_VSTART, 0);
+    vec_arch_v_restore(vec->v);
+    vec_arch_v_setvl(vec->vl, vec->vtype);
+    CSRW(CSR_VSTART, vec->vstart);
+    CSRW(CSR_VXSAT, vec->vxsat);
+    CSRW(CSR_VXRM, vec->vxrm);
+    CSRW(sstatus, sstatus);
+}
+
+bool vec_arch_dirty(struct vcpu* vcpu)
+{
+    return (vcpu->regs->sstatus & SSTATUS_VS_MSK) == SSTATUS_VS_DIRTY;
+}
+
+void vec_arch_enable(struct vcpu* vcpu, bool owner)
+{
+    /* sstatus is loaded from regs when the vcpu is next entered */
+    if (!owner) {
+        vcpu->regs->sstatus &= ~SSTATUS_VS_MSK;
+    } else if ((vcpu->regs->sstatus & SSTATUS_VS_MSK) == 0) {
+        vcpu->regs->sstatus |= SSTATUS_VS_CLEAN;
+    }
+}
@@ -18,6 +18,7 @@
 #include <arch/csrs.h>
 #include <arch/vplic.h>
 #include <arch/instructions.h>
+#include <arch/timer.h>
 #include <string.h>
 
 void vm_arch_init(struct vm *vm, const struct vm_config *config)
@@ -25,7 +26,12 @@ void vm_arch_init(struct vm *vm, const struct vm_config *config)
     paddr_t root_pt_pa;
     mem_translate(&cpu.as, (vaddr_t)vm->as.pt.root, &root_pt_pa);
 
-    unsigned long hgatp = (root_pt_pa >> PAGE_SHIFT) | (HGATP_MODE_DFLT) |
+#if (RV64)
+    unsigned long mode = pt_vm_hgatp_mode(vm->as.pt.dscr);
+#else
+    unsigned long mode = HGATP_MODE_DFLT;
+#endif
+    unsigned long hgatp = (root_pt_pa >> PAGE_SHIFT) | mode |
                           ((vm->id << HGATP_VMID_OFF) & HGATP_VMID_MSK);
 
     vm->arch.hgatp = hgatp;
@@ -60,6 +66,8 @@ void vcpu_arch_reset(struct vcpu *vcpu, vaddr_t entry)
     CSRW(CSR_VSTVAL, 0);
     CSRW(CSR_HVIP, 0);
     CSRW(CSR_VSATP, 0);
+
+    vec_vcpu_reset(vcpu);
 }
 
 unsigned long vcpu_readreg(struct vcpu *vcpu, unsigned long reg)
@@ -84,6 +92,56 @@ void vcpu_writepc(struct vcpu *vcpu, unsigned long pc)
     vcpu->regs->sepc = pc;
 }
 
+void vcpu_arch_set_power(struct vcpu *vcpu, bool on)
+{
+    spin_lock(&vcpu->arch.sbi_ctx.lock);
+    vcpu->arch.sbi_ctx.state = on ? STARTED : STOPPED;
+    spin_unlock(&vcpu->arch.sbi_ctx.lock);
+}
+
+/**
+ * Emulates taking a synchronous exception to the guest's VS-mode. The vcpu
+ * must be the one currently running and trapped to the hypervisor.
+ */
+void vcpu_arch_inject_fault(struct vcpu *vcpu, enum vcpu_fault fault, bool write)
+{
+    unsigned long cause;
+    unsigned long tval = 0;
+    bool has_va = vcpu->regs->hstatus & HSTATUS_GVA;
+
+    switch (fault) {
+        case VCPU_FAULT_DATA:
+            cause = write ? SCAUSE_CODE_SAF : SCAUSE_CODE_LAF;
+            break;
+        case VCPU_FAULT_INSTR:
+            cause = SCAUSE_CODE_IAF;
+            break;
+        case VCPU_FAULT_ALIGN:
+            cause = write ? SCAUSE_CODE_SAM : SCAUSE_CODE_LAM;
+            break;
+        default:
+            cause = SCAUSE_CODE_ILI;
+            has_va = false;
+            break;
+    }
+
+    if (has_va) tval = CSRR(stval);
+
+    unsigned long vsstatus = CSRR(CSR_VSSTATUS);
+    bool sie = vsstatus & SSTATUS_SIE_BIT;
+    vsstatus &= ~(SSTATUS_SPP_BIT | SSTATUS_SPIE_BIT | SSTATUS_SIE_BIT);
+    vsstatus |= (vcpu->regs->sstatus & SSTATUS_SPP_BIT);
+    vsstatus |= sie ? SSTATUS_SPIE_BIT : 0;
+
+    CSRW(CSR_VSSTATUS, vsstatus);
+    CSRW(CSR_VSCAUSE, cause);
+    CSRW(CSR_VSTVAL, tval);
+    CSRW(CSR_VSEPC, vcpu->regs->sepc);
+
+    vcpu->regs->sepc = CSRR(CSR_VSTVEC) & ~STVEC_MODE_MSK;
+    vcpu->regs->sstatus |= SSTATUS_SPP_BIT;
+}
+
 int vcpu_is_off(struct vcpu* vcpu)
 {
     return cpu.vcpu->arch.sbi_ctx.state == STOPPED;
@@ -142,8 +200,18 @@ void vcpu_restore_state(struct vcpu* vcpu){
 
     CSRW(CSR_HGATP, vcpu->vm->arch.hgatp);
 
-    /* TODO */
-    sbi_set_timer(vcpu->arch.stime_value);  // assumes always success
     CSRC(CSR_HVIP, HIP_VSTIP);
-    CSRS(sie, SIE_STIE);
+    timer_arch_sync(vcpu);
+
+    vec_vcpu_resume(vcpu);
+}
+
+void vcpu_arch_save_ctx(struct vcpu* vcpu, struct vcpu_arch_ctx* ctx)
+{
+    ctx->stime_value = vcpu->arch.stime_value;
+}
+
+void vcpu_arch_restore_ctx(struct vcpu* vcpu, const struct vcpu_arch_ctx* ctx)
+{
+    vcpu->arch.stime_value = ctx->stime_value;
 }
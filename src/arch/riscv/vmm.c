@@ -15,6 +15,9 @@
 
 #include <vmm.h>
 #include <arch/csrs.h>
+#include <page_table.h>
+#include <cpu.h>
+#include <tlb.h>
 
 void vmm_arch_init()
 {
@@ -33,6 +36,39 @@ void vmm_arch_init()
     CSRW(CSR_HIDELEG, HIDELEG_VSSI | HIDELEG_VSTI | HIDELEG_VSEI);
     CSRW(CSR_HEDELEG, HEDELEG_ECU | HEDELEG_IPF | HEDELEG_LPF | HEDELEG_SPF);
 
+    tlb_init();
+
+#if (RV64)
+    /**
+     * Find which G-stage modes the harts implement. Writes of an unsupported
+     * mode to hgatp have no effect. VMs only get the modes all harts have.
+     */
+    static unsigned long hgatp_modes = ~0UL;
+    static spinlock_t lock = SPINLOCK_INITVAL;
+    unsigned long modes = 0;
+    unsigned long probe[] = {SATP_MODE_39, SATP_MODE_48, SATP_MODE_57};
+
+    for (size_t i = 0; i < sizeof(probe) / sizeof(probe[0]); i++) {
+        CSRW(CSR_HGATP, probe[i]);
+        if ((CSRR(CSR_HGATP) & HGATP_MODE_MSK) == probe[i]) {
+            modes |= 1UL << (probe[i] >> HGATP_MODE_OFF);
+        }
+    }
+    CSRW(CSR_HGATP, 0);
+
+    spin_lock(&lock);
+    hgatp_modes &= modes;
+    spin_unlock(&lock);
+
+    cpu_sync_barrier(&cpu_glb_sync);
+
+    if (cpu.id == CPU_MASTER) {
+        pt_vm_modes_init(hgatp_modes);
+    }
+
+    cpu_sync_barrier(&cpu_glb_sync);
+#endif
+
     /**
      * TODO: consider delegating other exceptions e.g. breakpoint or ins
      * misaligned
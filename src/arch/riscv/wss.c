@@ -0,0 +1,66 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <wss.h>
+#include <arch/page_table.h>
+
+/**
+ * The A bit is never updated by hardware, as henvcfg.ADUE is left clear, so
+ * an access to a page whose A bit the sweep cleared raises a guest page
+ * fault, whose handler sets it again.
+ */
+/**
+ * The entries of a Svnapot run must stay identical, so their A bits are
+ * tested and updated together.
+ */
+static size_t wss_run(pte_t** pte)
+{
+    if (!(**pte & PTE_NAPOT)) {
+        return 1;
+    }
+
+    *pte = (pte_t*)ALIGN_FLOOR((uintptr_t)*pte,
+                               PTE_NAPOT_PTES * sizeof(pte_t));
+    return PTE_NAPOT_PTES;
+}
+
+bool wss_arch_test_and_clear(pte_t* pte)
+{
+    size_t n = wss_run(&pte);
+    bool accessed = false;
+
+    for (size_t i = 0; i < n; i++) {
+        accessed |= (pte[i] & PTE_ACCESS) != 0;
+        pte[i] &= ~PTE_ACCESS;
+    }
+
+    return accessed;
+}
+
+void wss_arch_set_accessed(pte_t* pte)
+{
+    size_t n = wss_run(&pte);
+
+    for (size_t i = 0; i < n; i++) {
+        pte[i] |= PTE_ACCESS;
+    }
+}
+
+/**
+ * Guest page faults are also raised for accesses the entry does not permit,
+ * which are not the sweep's. Only a clear A bit makes the fault an access
+ * fault, unless the entry permits any access, in which case no other fault
+ * is possible and another vcpu just set the A bit first.
+ */
+bool wss_arch_access_fault(pte_t* pte)
+{
+    return !(*pte & PTE_ACCESS) || (*pte & PTE_RWX) == PTE_RWX;
+}
@@ -0,0 +1,162 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <attest.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <config.h>
+#include <string.h>
+#include <hypercall.h>
+
+static uint8_t attest_root_config[SHA256_DIGEST_SIZE];
+
+static void attest_print(const char* what, struct vm* vm,
+                         const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    static const char hex[] = "0123456789abcdef";
+    char str[2 * SHA256_DIGEST_SIZE + 1];
+
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        str[2 * i] = hex[digest[i] >> 4];
+        str[2 * i + 1] = hex[digest[i] & 0xf];
+    }
+    str[2 * SHA256_DIGEST_SIZE] = '\0';
+
+    INFO("VM %d %s sha256 %s", vm->id, what, str);
+}
+
+void attest_config_digest(const struct config* config,
+                          uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    static const uint8_t zero_key[sizeof(config->attestation.key)];
+    const uint8_t* base = (const uint8_t*)config;
+    size_t key_off = offsetof(struct config, attestation.key);
+    size_t key_end = key_off + sizeof(config->attestation.key);
+    struct sha256 ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, base, key_off);
+    sha256_update(&ctx, zero_key, sizeof(zero_key));
+    sha256_update(&ctx, base + key_end, config->config_header_size - key_end);
+    sha256_final(&ctx, digest);
+}
+
+void attest_measure_root_config()
+{
+    attest_config_digest(vm_config_ptr, attest_root_config);
+}
+
+void attest_get_root_config(uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    memcpy(digest, attest_root_config, SHA256_DIGEST_SIZE);
+}
+
+void attest_set_config(struct vm* vm, const uint8_t* digest)
+{
+    if (digest == NULL) {
+        digest = attest_root_config;
+    }
+    memcpy(vm->measurement.config, digest, SHA256_DIGEST_SIZE);
+    attest_print("config", vm, digest);
+}
+
+void attest_image_final(struct vm* vm, struct sha256* ctx)
+{
+    sha256_final(ctx, vm->measurement.image);
+    vm->measurement.valid = true;
+    attest_print("image", vm, vm->measurement.image);
+}
+
+void attest_measure_image(struct vm* vm)
+{
+    size_t size = vm->config->image.size;
+    size_t n = NUM_PAGES(size);
+    struct sha256 ctx;
+
+    vaddr_t va =
+        mem_map_cpy(&vm->as, &cpu.as, vm->config->image.base_addr, NULL_VA, n);
+    sha256_init(&ctx);
+    sha256_update(&ctx, (void*)va, size);
+    mem_free_vpage(&cpu.as, va, n, false);
+
+    attest_image_final(vm, &ctx);
+}
+
+static struct vm* attest_get_vm(vmid_t vm_id)
+{
+    struct vcpu* vcpu = cpu.vcpu;
+
+    if (vcpu->vm->id == vm_id) {
+        return vcpu->vm;
+    }
+
+    /* VMs may also attest the ones they host */
+    list_foreach(vcpu->vmstack_children, struct node_data, node)
+    {
+        struct vcpu* child = node->data;
+        if (child->vm->id == vm_id) {
+            return child->vm;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes the attestation report of the calling VM, or of a VM it hosts, to
+ * the caller's memory at report_ipa, which must not cross a page boundary.
+ * Only the nonce is read from there. The report is built and MACed in the
+ * hypervisor's memory, out of reach of the caller's other vcpus, and only
+ * then copied out.
+ */
+unsigned long attest_hypercall(unsigned long vm_id, unsigned long report_ipa,
+                               unsigned long arg2)
+{
+    struct vm* caller = cpu.vcpu->vm;
+    struct vm* vm = attest_get_vm(vm_id);
+    struct attest_report report;
+    size_t off = report_ipa & PAGE_OFFSET_MASK;
+
+    if (!vm_config_ptr->attestation.enable) {
+        return -HC_E_FAILURE;
+    }
+
+    if (vm == NULL || !vm->measurement.valid) {
+        return -HC_E_INVAL_ID;
+    }
+
+    if (off + sizeof(struct attest_report) > PAGE_SIZE ||
+        !vm_ipa_in_mem(caller, report_ipa, sizeof(struct attest_report))) {
+        return -HC_E_INVAL_ARGS;
+    }
+
+    vaddr_t va = mem_map_cpy(&caller->as, &cpu.as,
+                             report_ipa & PAGE_FRAME_MASK, NULL_VA, 1);
+    struct attest_report* dst = (struct attest_report*)(va + off);
+
+    memset(&report, 0, sizeof(report));
+    memcpy(report.nonce, dst->nonce, SHA256_DIGEST_SIZE);
+    report.version = ATTEST_REPORT_VERSION;
+    report.vm_id = vm->id;
+    memcpy(report.config, vm->measurement.config, SHA256_DIGEST_SIZE);
+    memcpy(report.image, vm->measurement.image, SHA256_DIGEST_SIZE);
+    sha256_hmac(vm_config_ptr->attestation.key,
+                sizeof(vm_config_ptr->attestation.key), &report,
+                offsetof(struct attest_report, mac), report.mac);
+    memcpy(dst, &report, sizeof(report));
+
+    mem_free_vpage(&cpu.as, va, 1, false);
+
+    return HC_E_SUCCESS;
+}
@@ -14,27 +14,37 @@
  */
 
 #include <cache.h>
+#include <platform.h>
+#include <config.h>
+#include <bitmap.h>
+
+#define CACHE_CLUSTERS_MAX (16)
 
 static struct cache cache_dscr;
 
 size_t COLOR_NUM = 1;
 size_t COLOR_SIZE = 1;
 
-static void cache_calc_colors(struct cache* dscrp, size_t page_size)
+/* Colors of each cluster's shared caches, each dividing COLOR_NUM */
+static size_t cache_cluster_num = 1;
+static size_t cache_cluster_colors[CACHE_CLUSTERS_MAX] = {1};
+
+/**
+ * Pages of a way of the first level cache, which coloring leaves alone, and
+ * of the largest way of the physically indexed shared levels, whose index
+ * bits above the former make up the colors.
+ */
+static void cache_way_pages(struct cache* dscrp, size_t page_size,
+                            size_t* flc_pages, size_t* shared_pages)
 {
+    *flc_pages = 1;
+    *shared_pages = 0;
+
     if (dscrp->lvls == 0) {
         /* No cache? */
         return;
     }
 
-    size_t llc = dscrp->min_shared_lvl;
-
-    if ((dscrp->type[llc] != UNIFIED) || (dscrp->indexed[llc][0] != PIPT))
-        return;
-
-    size_t llc_way_size =
-        dscrp->numset[llc][UNIFIED] * dscrp->line_size[llc][UNIFIED];
-
     size_t flc_way_size = 0;
     if ((dscrp->type[0] != UNIFIED)) {
         flc_way_size = dscrp->numset[0][0] * dscrp->line_size[0][0];
@@ -45,16 +55,228 @@ static void cache_calc_colors(struct cache* dscrp, size_t page_size)
             flc_way_size = flc_i_way_size;
         }
     }
+    if (flc_way_size / page_size > 1) {
+        *flc_pages = flc_way_size / page_size;
+    }
+
+    for (size_t lvl = dscrp->min_shared_lvl; lvl < dscrp->lvls; lvl++) {
+        if ((dscrp->type[lvl] != UNIFIED) || (dscrp->indexed[lvl][0] != PIPT))
+            continue;
+
+        size_t way_size =
+            dscrp->numset[lvl][UNIFIED] * dscrp->line_size[lvl][UNIFIED];
+        if (way_size / page_size > *shared_pages) {
+            *shared_pages = way_size / page_size;
+        }
+    }
+}
 
-    size_t llc_num_colors = llc_way_size / page_size;
-    size_t flc_num_colors = flc_way_size / page_size;
+/**
+ * Colors are the physical page number bits that index every shared level of
+ * every cluster but not the first level. A cluster whose shared caches have
+ * fewer sets only sees the lower of those bits, so global color c falls on
+ * its color c % cache_cluster_colors[cluster].
+ */
+static void cache_calc_colors(struct cache* dscrps, size_t num,
+                              size_t page_size)
+{
+    size_t flc_pages[CACHE_CLUSTERS_MAX];
+    size_t shared_pages[CACHE_CLUSTERS_MAX];
+    size_t color_size = 1;
+    size_t color_num = 1;
+
+    for (size_t i = 0; i < num; i++) {
+        cache_way_pages(&dscrps[i], page_size, &flc_pages[i],
+                        &shared_pages[i]);
+        color_size = max(color_size, flc_pages[i]);
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        size_t colors = max(shared_pages[i] / color_size, 1UL);
+        if (colors > sizeof(colormap_t) * 8) {
+            WARNING("cluster %d cache has %d colors, only %d are used", i,
+                    colors, sizeof(colormap_t) * 8);
+            colors = sizeof(colormap_t) * 8;
+        }
+        if ((colors & (colors - 1)) != 0) {
+            ERROR("cluster %d cache colors are not a power of two", i);
+        }
+        cache_cluster_colors[i] = colors;
+        color_num = max(color_num, colors);
+    }
 
-    COLOR_SIZE = flc_num_colors;
-    COLOR_NUM = llc_num_colors / COLOR_SIZE;
+    cache_cluster_num = num;
+    COLOR_SIZE = color_size;
+    COLOR_NUM = color_num;
 }
 
 void cache_enumerate()
 {
-    cache_arch_enumerate(&cache_dscr);
-    cache_calc_colors(&cache_dscr, PAGE_SIZE);
+    if (platform.cluster_cache_num > 0) {
+        if (platform.cluster_cache_num > CACHE_CLUSTERS_MAX) {
+            ERROR("too many cluster caches");
+        }
+        cache_calc_colors(platform.cluster_caches, platform.cluster_cache_num,
+                          PAGE_SIZE);
+    } else {
+        cache_arch_enumerate(&cache_dscr);
+        cache_calc_colors(&cache_dscr, 1, PAGE_SIZE);
+    }
+}
+
+static size_t cache_cpu_cluster(cpuid_t cpuid)
+{
+    size_t cluster = platform_arch_cpu_cluster(&platform, cpuid);
+    return cluster < cache_cluster_num ? cluster : 0;
+}
+
+/* Colors of the cluster's cache the given global colors fall on */
+static colormap_t cache_cluster_colormap(size_t cluster, colormap_t colors)
+{
+    size_t num = cache_cluster_colors[cluster];
+    colormap_t folded = 0;
+
+    for (size_t c = 0; c < COLOR_NUM; c++) {
+        if (colors & (1UL << c)) {
+            folded |= 1UL << (c % num);
+        }
+    }
+
+    return folded;
+}
+
+static inline colormap_t cache_colormap_mask(size_t num)
+{
+    return num >= (sizeof(colormap_t) * 8) ? ~0UL : (1UL << num) - 1;
+}
+
+/* Clusters of the cpus the VM prefers, all of them if it prefers none */
+static uint64_t cache_vm_clusters(const struct vm_config* config)
+{
+    uint64_t clusters = 0;
+
+    for (cpuid_t id = 0; id < platform.cpu_num; id++) {
+        if (config->cpu_affinity == 0 || (config->cpu_affinity & (1UL << id))) {
+            clusters |= 1ULL << cache_cpu_cluster(id);
+        }
+    }
+
+    return clusters;
+}
+
+/**
+ * Colors of a VM with a stage-2 granule spanning k > 1 colors name granules:
+ * color g stands for colors g*k to (g+1)*k - 1. Granules larger than a whole
+ * color cycle can not be colored.
+ */
+static colormap_t cache_granule_colors(const struct vm_config* config,
+                                       colormap_t colors)
+{
+    size_t k = (config->stage2_granule / PAGE_SIZE) / COLOR_SIZE;
+
+    if (colors == 0 || k <= 1) {
+        return colors;
+    } else if (k >= COLOR_NUM) {
+        return 0;
+    }
+
+    colormap_t expanded = 0;
+    for (size_t c = 0; c < COLOR_NUM; c++) {
+        if (colors & (1UL << (c / k))) {
+            expanded |= 1UL << c;
+        }
+    }
+
+    return expanded;
+}
+
+/**
+ * Colors of a VM's memory. The colors of a VM whose cpus are all in a
+ * single cluster are that cluster's, and it gets every global color falling
+ * on them.
+ */
+colormap_t cache_vm_colors(const struct vm_config* config)
+{
+    uint64_t clusters = cache_vm_clusters(config);
+    cpumap_t affinity = config->cpu_affinity;
+    size_t cpus = bitmap_count((bitmap_t*)&affinity, 0, platform.cpu_num, true);
+    colormap_t config_colors = cache_granule_colors(config, config->colors);
+
+    if (config_colors == 0 || cpus < config->platform.cpu_num ||
+        (clusters & (clusters - 1)) != 0) {
+        return config_colors;
+    }
+
+    size_t cluster = 0;
+    while (!(clusters & (1ULL << cluster))) cluster++;
+    size_t num = cache_cluster_colors[cluster];
+    colormap_t colors = 0;
+    for (size_t c = 0; c < COLOR_NUM; c++) {
+        if (config_colors & (1UL << (c % num))) {
+            colors |= 1UL << c;
+        }
+    }
+
+    return colors;
+}
+
+/**
+ * Checks the configured colors against the caches found: colors that do not
+ * exist, and VMs whose colors do not keep them apart in a cluster they share,
+ * e.g. because its caches have fewer colors than the others.
+ */
+void cache_check_colors(const struct config* config)
+{
+    colormap_t valid = cache_colormap_mask(COLOR_NUM);
+
+    if (config->hyp_colors & ~valid) {
+        WARNING("hypervisor colors beyond the %d available", COLOR_NUM);
+    }
+
+    for (size_t i = 0; i < config->vmlist_size; i++) {
+        const struct vm_config* vm = config->vmlist[i];
+        colormap_t colors = cache_vm_colors(vm);
+
+        if (vm->colors == 0) continue;
+
+        if ((colors & valid) == 0) {
+            ERROR("VM config %d has none of the %d colors available", i,
+                  COLOR_NUM);
+        } else if (colors & ~valid) {
+            WARNING("VM config %d colors beyond the %d available", i,
+                    COLOR_NUM);
+        }
+
+        uint64_t clusters = cache_vm_clusters(vm);
+        for (size_t k = 0; k < cache_cluster_num; k++) {
+            if (!(clusters & (1ULL << k))) continue;
+
+            colormap_t folded = cache_cluster_colormap(k, colors);
+            if ((colors & valid) != valid &&
+                folded == cache_colormap_mask(cache_cluster_colors[k])) {
+                WARNING("VM config %d colors cover all of cluster %d's cache",
+                        i, k);
+            }
+
+            for (size_t j = i + 1; j < config->vmlist_size; j++) {
+                const struct vm_config* other = config->vmlist[j];
+                colormap_t other_colors = cache_vm_colors(other);
+
+                if (other->colors == 0 || (colors & other_colors) != 0 ||
+                    !(cache_vm_clusters(other) & (1ULL << k))) {
+                    continue;
+                }
+                if (folded & cache_cluster_colormap(k, other_colors)) {
+                    WARNING("VM configs %d and %d share colors of cluster "
+                            "%d's cache", i, j, k);
+                }
+            }
+        }
+    }
+}
+
+__attribute__((weak)) size_t platform_arch_cpu_cluster(
+    const struct platform_desc* plat, cpuid_t cpuid)
+{
+    return 0;
 }
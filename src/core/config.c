@@ -26,6 +26,8 @@ void config_vm_adjust_to_va(struct vm_config *vm_config, struct config *config,
         }
     }
 
+    adjust_ptr(vm_config->platform.pci.funcs, config);
+
     if(adjust_ptr(vm_config->platform.ipcs, config)){
         for (size_t j = 0; j < vm_config->platform.ipc_num; j++) {
             adjust_ptr(vm_config->platform.ipcs[j].interrupts, config);
@@ -41,6 +43,49 @@ void config_vm_adjust_to_va(struct vm_config *vm_config, struct config *config,
     config_arch_vm_adjust_to_va(vm_config, config, phys);
 }
 
+/**
+ * Undoes config_adjust_to_va, leaving the configuration as it was loaded, so
+ * that it can be handed over to another hypervisor image.
+ */
+void config_vm_adjust_from_va(struct vm_config *vm_config, struct config *config, paddr_t phys) {
+    config_arch_vm_adjust_from_va(vm_config, config, phys);
+
+    for (size_t i = 0; i < vm_config->children_num; i++) {
+        config_vm_adjust_from_va(vm_config->children[i], config, phys);
+        unadjust_ptr(vm_config->children[i], config);
+    }
+    unadjust_ptr(vm_config->children, config);
+
+    if (vm_config->platform.ipcs != NULL) {
+        for (size_t j = 0; j < vm_config->platform.ipc_num; j++) {
+            unadjust_ptr(vm_config->platform.ipcs[j].interrupts, config);
+        }
+        unadjust_ptr(vm_config->platform.ipcs, config);
+    }
+
+    unadjust_ptr(vm_config->platform.pci.funcs, config);
+
+    if (vm_config->platform.devs != NULL) {
+        for (size_t j = 0; j < vm_config->platform.dev_num; j++) {
+            unadjust_ptr(vm_config->platform.devs[j].interrupts, config);
+        }
+        unadjust_ptr(vm_config->platform.devs, config);
+    }
+
+    unadjust_ptr(vm_config->platform.regions, config);
+
+    unadjust_ptr(vm_config->image.load_addr, phys);
+}
+
+void config_adjust_from_va(struct config *config, uint64_t phys) {
+    for (int i = 0; i < config->vmlist_size; i++) {
+        config_vm_adjust_from_va(config->vmlist[i], config, phys);
+        unadjust_ptr(config->vmlist[i], config);
+    }
+
+    unadjust_ptr(config->shmemlist, config);
+}
+
 bool config_is_builtin() {
     extern uint8_t _config_start, _config_end;
     return &_config_start != &_config_end;
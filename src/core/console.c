@@ -23,6 +23,31 @@
 #include <fences.h>
 #include <spinlock.h>
 
+/**
+ * Non-blocking uart interface, used to multiplex the console between VMs.
+ * Drivers implementing it declare it in their header, which the platform
+ * header includes. These are the fallbacks for those that do not: they block
+ * on output and never have input or interrupts.
+ */
+__attribute__((weak)) bool uart_try_putc(volatile crossconhyp_uart_t* uart,
+                                         char c)
+{
+    char str[2] = {c, '\0'};
+    uart_puts(uart, str);
+    return true;
+}
+
+__attribute__((weak)) bool uart_try_getc(volatile crossconhyp_uart_t* uart,
+                                         char* c)
+{
+    return false;
+}
+
+__attribute__((weak)) void uart_set_irqs(volatile crossconhyp_uart_t* uart,
+                                         bool rx, bool tx)
+{
+}
+
 volatile crossconhyp_uart_t uart
     __attribute__((section(".devices"), aligned(PAGE_SIZE)));
 bool ready = false;
@@ -52,3 +77,37 @@ void console_write(char const* const str)
     uart_puts(&uart, str);
     spin_unlock(&print_lock);
 }
+
+bool console_putc(char c, bool block)
+{
+    bool done;
+
+    if (!ready) return true;
+    spin_lock(&print_lock);
+    do {
+        done = uart_try_putc(&uart, c);
+    } while (!done && block);
+    spin_unlock(&print_lock);
+
+    return done;
+}
+
+bool console_getc(char* c)
+{
+    bool done;
+
+    if (!ready) return false;
+    spin_lock(&print_lock);
+    done = uart_try_getc(&uart, c);
+    spin_unlock(&print_lock);
+
+    return done;
+}
+
+void console_set_irqs(bool rx, bool tx)
+{
+    if (!ready) return;
+    spin_lock(&print_lock);
+    uart_set_irqs(&uart, rx, tx);
+    spin_unlock(&print_lock);
+}
@@ -0,0 +1,462 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <coredump.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <ipc.h>
+#include <config.h>
+#include <fences.h>
+#include <string.h>
+
+/* Most PT_LOAD segments a dump of only the mapped memory is split in */
+#define COREDUMP_SEGS_MAX (256)
+/* Pages copied per chunk, and how long the cpu runs between chunks */
+#define COREDUMP_CHUNK_PAGES (256)
+#define COREDUMP_CHUNK_US (100)
+
+#define COREDUMP_CORE_NAME "CORE"
+#define COREDUMP_HYP_NAME "CROSSCON"
+
+static inline size_t coredump_note_size(const char* name, size_t descsz)
+{
+    return sizeof(struct elf64_nhdr) + ALIGN(strlen(name) + 1, 4) +
+           ALIGN(descsz, 4);
+}
+
+/* Writes a note header and its name at at, returns where its desc goes */
+static void* coredump_note(uint8_t* at, const char* name, uint32_t type,
+                           size_t descsz)
+{
+    struct elf64_nhdr* nhdr = (struct elf64_nhdr*)at;
+    size_t namesz = strlen(name) + 1;
+
+    nhdr->n_namesz = namesz;
+    nhdr->n_descsz = descsz;
+    nhdr->n_type = type;
+    memset(at + sizeof(*nhdr), 0, ALIGN(namesz, 4));
+    memcpy(at + sizeof(*nhdr), name, namesz);
+
+    return at + sizeof(*nhdr) + ALIGN(namesz, 4);
+}
+
+static pte_t* coredump_leaf(struct page_table* pt, vaddr_t va,
+                            size_t* lvl_size)
+{
+    for (size_t lvl = 0; lvl < pt->dscr->lvls; lvl++) {
+        pte_t* pte = pt_get_pte(pt, lvl, va);
+        *lvl_size = pt_lvlsize(pt, lvl);
+        if (!pte_valid(pte)) break;
+        if (pte_page(pt, pte, lvl)) return pte;
+    }
+
+    return NULL;
+}
+
+static inline struct elf64_phdr* coredump_phdrs(struct vcoredump* cd)
+{
+    return (struct elf64_phdr*)(cd->base + sizeof(struct elf64_ehdr));
+}
+
+static void coredump_add_seg(struct elf64_phdr* phdrs, size_t idx,
+                             vaddr_t base, size_t size)
+{
+    if (phdrs != NULL) {
+        phdrs[idx] = (struct elf64_phdr){
+            .p_type = ELF_PT_LOAD,
+            .p_flags = ELF_PF_R | ELF_PF_W | ELF_PF_X,
+            .p_vaddr = base,
+            .p_paddr = base,
+            .p_memsz = size,
+            .p_align = PAGE_SIZE,
+        };
+    }
+}
+
+/**
+ * Lists the VM's memory as PT_LOAD segments in phdrs, if not NULL, and
+ * returns their number. Each memory region is a segment, unless only the
+ * mapped memory is dumped, in which case each range of it mapped at stage 2
+ * is.
+ */
+static size_t coredump_segments(struct vm* vm, struct elf64_phdr* phdrs)
+{
+    const struct platform_desc* platform = &vm->config->platform;
+    size_t num = 0;
+
+    for (size_t i = 0; i < platform->region_num; i++) {
+        struct mem_region* reg = &platform->regions[i];
+        vaddr_t end = reg->base + ALIGN(reg->size, PAGE_SIZE);
+
+        if (!vm->config->coredump.mapped_only) {
+            coredump_add_seg(phdrs, num++, reg->base, end - reg->base);
+            continue;
+        }
+
+        vaddr_t va = reg->base;
+        vaddr_t ext = 0;
+        bool in_ext = false;
+        while (va < end) {
+            size_t lvl_size;
+            bool mapped = coredump_leaf(&vm->as.pt, va, &lvl_size) != NULL;
+            vaddr_t next = ALIGN_FLOOR(va, lvl_size) + lvl_size;
+            if (next > end || next < va) next = end;
+
+            if (mapped && !in_ext) {
+                ext = va;
+                in_ext = true;
+            } else if (!mapped && in_ext) {
+                if (num < COREDUMP_SEGS_MAX) {
+                    coredump_add_seg(phdrs, num++, ext, va - ext);
+                }
+                in_ext = false;
+            }
+            va = next;
+        }
+        if (in_ext && num < COREDUMP_SEGS_MAX) {
+            coredump_add_seg(phdrs, num++, ext, end - ext);
+        }
+    }
+
+    return num;
+}
+
+static void coredump_vcpu_notes(struct vcpu* vcpu)
+{
+    struct vcoredump* cd = &vcpu->vm->coredump;
+    uint8_t* at = cd->base + cd->notes_off + vcpu->id * cd->vcpu_notes_size;
+
+    struct elf_prstatus* prstatus = coredump_note(
+        at, COREDUMP_CORE_NAME, ELF_NT_PRSTATUS, sizeof(struct elf_prstatus));
+    memset(prstatus, 0, sizeof(*prstatus));
+    /* Debuggers list vcpus as threads, which need a non-zero id */
+    prstatus->pid = vcpu->id + 1;
+    coredump_arch_gregs(vcpu, prstatus->reg);
+    at += coredump_note_size(COREDUMP_CORE_NAME, sizeof(*prstatus));
+
+    size_t size = coredump_arch_vcpu_size();
+    void* desc = coredump_note(at, COREDUMP_HYP_NAME, COREDUMP_NT_VCPU, size);
+    memset(desc, 0, ALIGN(size, 4));
+    coredump_arch_vcpu(vcpu, desc);
+}
+
+static void coredump_vm_note(struct vm* vm)
+{
+    struct vcoredump* cd = &vm->coredump;
+    uint8_t* at = cd->base + cd->notes_off + vm->cpu_num * cd->vcpu_notes_size;
+    size_t size = coredump_arch_vm_size(vm);
+
+    void* desc = coredump_note(at, COREDUMP_HYP_NAME, COREDUMP_NT_VM, size);
+    memset(desc, 0, ALIGN(size, 4));
+    coredump_arch_vm(vm, desc);
+}
+
+/**
+ * Copies up to COREDUMP_CHUNK_PAGES pages of the VM's memory to the dump,
+ * returning true once done. Unmapped pages read as zeros. The VM's pages are
+ * mapped in this cpu's private section, so no other partition's mappings are
+ * touched.
+ */
+static bool coredump_copy_chunk(struct vm* vm)
+{
+    struct vcoredump* cd = &vm->coredump;
+    struct elf64_phdr* phdrs = coredump_phdrs(cd) + 1;
+    size_t budget = COREDUMP_CHUNK_PAGES * PAGE_SIZE;
+
+    while (budget > 0 && cd->seg < cd->seg_num) {
+        struct elf64_phdr* ph = &phdrs[cd->seg];
+        if (cd->seg_done >= ph->p_filesz) {
+            cd->seg++;
+            cd->seg_done = 0;
+            continue;
+        }
+
+        vaddr_t ipa = ph->p_vaddr + cd->seg_done;
+        uint8_t* dst = cd->base + ph->p_offset + cd->seg_done;
+        size_t lvl_size;
+        pte_t* pte = coredump_leaf(&vm->as.pt, ipa, &lvl_size);
+        size_t size = ALIGN_FLOOR(ipa, lvl_size) + lvl_size - ipa;
+        if (size > ph->p_filesz - cd->seg_done) {
+            size = ph->p_filesz - cd->seg_done;
+        }
+        if (size > budget) {
+            size = budget;
+        }
+
+        if (pte != NULL) {
+            size_t n = NUM_PAGES(size);
+            paddr_t pa = pte_addr(pte) + (ipa - ALIGN_FLOOR(ipa, lvl_size));
+            struct ppages pages = mem_ppages_get(pa, n);
+            vaddr_t va = mem_alloc_vpage(&cpu.as, SEC_HYP_PRIVATE, NULL_VA, n);
+            if (va == NULL_VA ||
+                !mem_map(&cpu.as, va, &pages, n, PTE_HYP_FLAGS)) {
+                ERROR("failed mapping VM %d memory for its core dump", vm->id);
+            }
+            memcpy(dst, (void*)va, size);
+            mem_free_vpage(&cpu.as, va, n, false);
+        } else {
+            memset(dst, 0, size);
+        }
+
+        cd->seg_done += size;
+        budget -= size;
+    }
+
+    return cd->seg >= cd->seg_num;
+}
+
+/**
+ * The magic is written last, so an incomplete dump is never taken as one. It
+ * is written under the VM's lock, so a dump cancelled meanwhile stays
+ * incomplete.
+ */
+static void coredump_finish(struct vm* vm)
+{
+    struct vcoredump* cd = &vm->coredump;
+    struct elf64_ehdr* ehdr = (struct elf64_ehdr*)cd->base;
+    bool written;
+
+    spin_lock(&vm->lock);
+    written = cd->active;
+    if (written) {
+        fence_sync_write();
+        ehdr->e_ident[0] = 0x7f;
+        ehdr->e_ident[1] = 'E';
+        ehdr->e_ident[2] = 'L';
+        ehdr->e_ident[3] = 'F';
+        fence_sync_write();
+        cd->active = false;
+    }
+    spin_unlock(&vm->lock);
+
+    if (written) {
+        INFO("VM %d core dump written", vm->id);
+        vm_notify_manager(vm);
+    }
+}
+
+static void coredump_timer_handler(struct timer_event* event)
+{
+    struct vm* vm =
+        (struct vm*)((uint8_t*)event - offsetof(struct vm, coredump.event));
+    bool active;
+
+    spin_lock(&vm->lock);
+    active = vm->coredump.active;
+    spin_unlock(&vm->lock);
+
+    if (!active) {
+        return;
+    } else if (coredump_copy_chunk(vm)) {
+        coredump_finish(vm);
+    } else {
+        uint64_t gap = timer_us_to_ticks(COREDUMP_CHUNK_US);
+        timer_event_start(event, timer_get_counter() + gap, gap / 2, 0);
+    }
+}
+
+static void coredump_msg_handler(uint32_t event, uint64_t data)
+{
+    struct vcpu* vcpu = cpu_get_vcpu(data);
+    if (vcpu == NULL) return;
+
+    struct vm* vm = vcpu->vm;
+    struct vcoredump* cd = &vm->coredump;
+    bool last;
+
+    /* The state of the running vcpu is still in the registers */
+    if (vcpu == cpu.vcpu) {
+        vcpu_save_state(vcpu);
+    }
+    coredump_vcpu_notes(vcpu);
+
+    spin_lock(&vm->lock);
+    last = cd->active && --cd->pending == 0;
+    spin_unlock(&vm->lock);
+
+    if (last) {
+        coredump_vm_note(vm);
+        timer_event_start(&cd->event, timer_get_counter(), 0, 0);
+    }
+}
+CPU_MSG_HANDLER(coredump_msg_handler, COREDUMP_CPUMSG_ID);
+
+void coredump_vm_init(struct vm* vm)
+{
+    const struct vm_config* config = vm->config;
+    struct vcoredump* cd = &vm->coredump;
+
+    cd->enabled = false;
+    cd->active = false;
+    timer_event_init(&cd->event, coredump_timer_handler);
+
+    if (!config->coredump.enable) return;
+
+    struct shmem* shmem = ipc_get_shmem(config->coredump.shmem_id);
+    if (shmem == NULL || shmem->size < PAGE_SIZE) {
+        WARNING("VM %d: invalid core dump shared memory", vm->id);
+        return;
+    }
+
+    /**
+     * Mapped in the VM's section, shared by its cpus. The region is left
+     * as is, so a dump taken before a warm reset can still be read.
+     */
+    size_t n = NUM_PAGES(shmem->size);
+    struct ppages pages = mem_ppages_get(shmem->phys, n);
+    vaddr_t va = mem_alloc_vpage(&cpu.as, SEC_HYP_VM, NULL_VA, n);
+    if (va == NULL_VA || !mem_map(&cpu.as, va, &pages, n, PTE_HYP_FLAGS)) {
+        ERROR("failed mapping VM %d core dump region", vm->id);
+    }
+
+    cd->base = (uint8_t*)va;
+    cd->size = n * PAGE_SIZE;
+    cd->enabled = true;
+}
+
+/**
+ * Starts dumping a VM that just crashed: lays out the core file and asks
+ * each of the VM's cpus to add its vcpu's notes. These messages are queued
+ * before the ones quiescing the VM, so the vcpus are captured as they were
+ * at the crash.
+ */
+void coredump_vm_crashed(struct vm* vm)
+{
+    struct vcoredump* cd = &vm->coredump;
+    bool busy;
+
+    if (!cd->enabled) return;
+
+    spin_lock(&vm->lock);
+    busy = cd->active;
+    if (!busy) {
+        cd->active = true;
+        cd->pending = vm->cpu_num;
+    }
+    spin_unlock(&vm->lock);
+
+    if (busy) {
+        WARNING("VM %d crashed while its core dump was being written",
+                vm->id);
+        return;
+    }
+
+    cd->seg_num = coredump_segments(vm, NULL);
+    cd->notes_off =
+        ALIGN(sizeof(struct elf64_ehdr) +
+                  (cd->seg_num + 1) * sizeof(struct elf64_phdr), 8);
+    cd->vcpu_notes_size =
+        coredump_note_size(COREDUMP_CORE_NAME, sizeof(struct elf_prstatus)) +
+        coredump_note_size(COREDUMP_HYP_NAME, coredump_arch_vcpu_size());
+    size_t notes_size =
+        vm->cpu_num * cd->vcpu_notes_size +
+        coredump_note_size(COREDUMP_HYP_NAME, coredump_arch_vm_size(vm));
+    size_t data_off = ALIGN(cd->notes_off + notes_size, PAGE_SIZE);
+
+    if (data_off > cd->size) {
+        WARNING("VM %d core dump region too small for its notes", vm->id);
+        spin_lock(&vm->lock);
+        cd->active = false;
+        spin_unlock(&vm->lock);
+        return;
+    }
+
+    struct elf64_ehdr* ehdr = (struct elf64_ehdr*)cd->base;
+    memset(ehdr, 0, sizeof(*ehdr));
+    ehdr->e_ident[4] = ELF_CLASS64;
+    ehdr->e_ident[5] = ELF_DATA2LSB;
+    ehdr->e_ident[6] = ELF_VERSION;
+    ehdr->e_type = ELF_ET_CORE;
+    ehdr->e_machine = COREDUMP_ARCH_MACHINE;
+    ehdr->e_version = ELF_VERSION;
+    ehdr->e_entry = vm->config->entry;
+    ehdr->e_phoff = sizeof(struct elf64_ehdr);
+    ehdr->e_ehsize = sizeof(struct elf64_ehdr);
+    ehdr->e_phentsize = sizeof(struct elf64_phdr);
+    ehdr->e_phnum = cd->seg_num + 1;
+
+    struct elf64_phdr* phdrs = coredump_phdrs(cd);
+    phdrs[0] = (struct elf64_phdr){
+        .p_type = ELF_PT_NOTE,
+        .p_offset = cd->notes_off,
+        .p_filesz = notes_size,
+        .p_align = 4,
+    };
+
+    /* Segments past the end of the region are cut short, or left out */
+    coredump_segments(vm, phdrs + 1);
+    size_t off = data_off;
+    for (size_t i = 1; i <= cd->seg_num; i++) {
+        phdrs[i].p_offset = off;
+        phdrs[i].p_filesz = off >= cd->size ? 0 : cd->size - off;
+        if (phdrs[i].p_filesz > phdrs[i].p_memsz) {
+            phdrs[i].p_filesz = phdrs[i].p_memsz;
+        }
+        off += phdrs[i].p_filesz;
+    }
+    if (cd->seg_num > 0 &&
+        phdrs[cd->seg_num].p_filesz < phdrs[cd->seg_num].p_memsz) {
+        WARNING("VM %d core dump region too small, memory truncated", vm->id);
+    }
+
+    cd->seg = 0;
+    cd->seg_done = 0;
+
+    struct cpu_msg msg = {COREDUMP_CPUMSG_ID, 0, vm->id};
+    vm_msg_broadcast(vm, &msg);
+    if (vm->cpus & (1UL << cpu.id)) {
+        cpu_send_msg(cpu.id, &msg);
+    }
+}
+
+/**
+ * Abandons the VM's core dump, if one is being written, leaving the region
+ * without the ELF magic. A chunk being copied on another cpu may still land
+ * in the region, but the dump is never completed.
+ */
+void coredump_vm_cancel(struct vm* vm)
+{
+    struct vcoredump* cd = &vm->coredump;
+    bool active;
+
+    if (!cd->enabled) return;
+
+    spin_lock(&vm->lock);
+    active = cd->active;
+    cd->active = false;
+    spin_unlock(&vm->lock);
+
+    if (active) {
+        timer_event_stop(&cd->event);
+        WARNING("VM %d core dump cancelled", vm->id);
+    }
+}
+
+__attribute__((weak)) void coredump_arch_gregs(struct vcpu* vcpu,
+                                               uint64_t* gregs)
+{
+    memset(gregs, 0, COREDUMP_ARCH_GREGS * sizeof(uint64_t));
+}
+
+__attribute__((weak)) size_t coredump_arch_vcpu_size()
+{
+    return 0;
+}
+
+__attribute__((weak)) void coredump_arch_vcpu(struct vcpu* vcpu, void* buf) {}
+
+__attribute__((weak)) size_t coredump_arch_vm_size(struct vm* vm)
+{
+    return 0;
+}
+
+__attribute__((weak)) void coredump_arch_vm(struct vm* vm, void* buf) {}
@@ -22,6 +22,8 @@
 #include <fences.h>
 #include <vmm.h>
 #include <string.h>
+#include <timer.h>
+#include <lu.h>
 
 struct cpu_msg_node {
     node_t node;
@@ -100,7 +102,11 @@ void cpu_msg_handler()
 
 void cpu_idle()
 {
-    cpu_arch_idle();
+    cpu.idle_pending = false;
+
+    size_t state = idle_select(true, TIMER_DEADLINE_NONE);
+    idle_enter(state);
+    cpu_arch_idle(state);
 
     /**
      * Should not return here.
@@ -110,13 +116,50 @@ void cpu_idle()
     ERROR("Spurious idle wake up");
 }
 
+/**
+ * Idling from an interrupt handler would leave that interrupt active and the
+ * cpu would never be woken up again. Handlers that leave the cpu without a
+ * runnable vcpu request it here instead, and the cpu idles from cpu_irq_exit
+ * once all interrupts are completed.
+ */
+void cpu_defer_idle()
+{
+    cpu.idle_pending = true;
+}
+
+void cpu_irq_exit()
+{
+    lu_cpu_exit();
+
+    if (cpu.idle_pending) {
+        cpu_idle();
+    }
+}
+
+/**
+ * Synchronous traps from a vcpu complete with no interrupt left active, but
+ * their handlers still expect to return, e.g. to step the vcpu's pc. Those
+ * that leave the cpu without a runnable vcpu also use cpu_defer_idle, and the
+ * cpu idles from here once the trap is handled.
+ */
+void cpu_trap_exit()
+{
+    if (cpu.idle_pending) {
+        cpu_idle();
+    }
+}
+
 void cpu_idle_wakeup()
 {
+    idle_exit();
+
     if (interrupts_check(IPI_CPU_MSG)) {
         interrupts_clear(IPI_CPU_MSG);
         cpu_msg_handler();
     }
 
+    lu_cpu_exit();
+
     if (cpu.vcpu != NULL) {
         vcpu_run(cpu.vcpu);
     } else {
@@ -0,0 +1,139 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <idle.h>
+#include <cpu.h>
+#include <vm.h>
+#include <platform.h>
+#include <timer.h>
+#include <hypercall.h>
+
+enum { IDLE_HC_RESIDENCY_US, IDLE_HC_ENTRIES };
+
+static const struct idle_state* idle_states(size_t* num)
+{
+    if (platform.idle_state_num > 0) {
+        *num = platform.idle_state_num;
+        return platform.idle_states;
+    }
+
+    return idle_arch_default_states(num);
+}
+
+const struct idle_state* idle_get_state(size_t state)
+{
+    size_t num = 0;
+    const struct idle_state* states = idle_states(&num);
+
+    if (state == IDLE_STATE_WFI || state > num) {
+        return NULL;
+    }
+
+    return &states[state - 1];
+}
+
+static uint64_t idle_latency_tolerance()
+{
+    uint64_t tolerance = (uint64_t)-1;
+
+    list_foreach(cpu.vcpus, struct node_data, node) {
+        struct vcpu* vcpu = node->data;
+        uint64_t vm_tolerance = vcpu->vm->config->idle_latency_us;
+        if (vm_tolerance != 0 && vm_tolerance < tolerance) {
+            tolerance = vm_tolerance;
+        }
+    }
+
+    return tolerance;
+}
+
+size_t idle_select(bool allow_powerdown, uint64_t next_event)
+{
+    size_t num = 0;
+    const struct idle_state* states = idle_states(&num);
+    uint64_t tolerance = idle_latency_tolerance();
+    uint64_t predicted = (uint64_t)-1;
+    size_t selected = IDLE_STATE_WFI;
+
+    uint64_t deadline = timer_next_deadline();
+    if (deadline < next_event) {
+        next_event = deadline;
+    }
+    if (next_event != TIMER_DEADLINE_NONE) {
+        uint64_t now = timer_get_counter();
+        predicted =
+            next_event > now ? timer_ticks_to_us(next_event - now) : 0;
+    }
+
+    for (size_t i = 0; i < num && (i + 1) < IDLE_STATE_MAX; i++) {
+        if (states[i].exit_latency_us > tolerance ||
+            states[i].min_residency_us > predicted) {
+            break;
+        }
+        if (states[i].powerdown && !allow_powerdown) {
+            continue;
+        }
+        selected = i + 1;
+    }
+
+    return selected;
+}
+
+void idle_enter(size_t state)
+{
+    cpu.idle.state = state;
+    cpu.idle.stats[state].entries++;
+    cpu.idle.entry = timer_get_counter();
+    cpu.idle.active = true;
+}
+
+void idle_exit()
+{
+    if (cpu.idle.active) {
+        cpu.idle.active = false;
+        cpu.idle.stats[cpu.idle.state].ticks +=
+            timer_get_counter() - cpu.idle.entry;
+    }
+}
+
+/**
+ * Reports the residency statistics of the physical cpu the calling vcpu runs
+ * on, for a given idle state: the time spent in it in microseconds, or the
+ * number of times it was entered.
+ */
+unsigned long idle_hypercall(unsigned long state, unsigned long field,
+                             unsigned long arg2)
+{
+    size_t num = 0;
+    idle_states(&num);
+
+    if (state > num || state >= IDLE_STATE_MAX) {
+        return -HC_E_INVAL_ARGS;
+    }
+
+    switch (field) {
+        case IDLE_HC_RESIDENCY_US:
+            return timer_ticks_to_us(cpu.idle.stats[state].ticks);
+        case IDLE_HC_ENTRIES:
+            return cpu.idle.stats[state].entries;
+        default:
+            return -HC_E_INVAL_ARGS;
+    }
+}
+
+__attribute__((weak)) const struct idle_state* idle_arch_default_states(
+    size_t* num)
+{
+    *num = 0;
+    return NULL;
+}
@@ -0,0 +1,69 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#ifndef __ATTEST_H__
+#define __ATTEST_H__
+
+#include <crossconhyp.h>
+#include <sha256.h>
+
+struct vm;
+struct config;
+
+#define ATTEST_REPORT_VERSION   (1)
+
+/**
+ * What the hypervisor loaded into a VM. The config digest covers the whole
+ * configuration binary the VM was created from, as found in memory, with the
+ * attestation key left out.
+ */
+struct vm_measurement {
+    bool valid;
+    uint8_t config[SHA256_DIGEST_SIZE];
+    uint8_t image[SHA256_DIGEST_SIZE];
+};
+
+/**
+ * Attestation report as written to guest memory. The guest places a nonce in
+ * it before the call. The mac is the HMAC-SHA256, keyed with the platform
+ * attestation key, of all the fields before it.
+ */
+struct attest_report {
+    uint32_t version;
+    uint32_t vm_id;
+    uint8_t nonce[SHA256_DIGEST_SIZE];
+    uint8_t config[SHA256_DIGEST_SIZE];
+    uint8_t image[SHA256_DIGEST_SIZE];
+    uint8_t mac[SHA256_DIGEST_SIZE];
+} __attribute__((packed));
+
+void attest_config_digest(const struct config* config,
+                          uint8_t digest[SHA256_DIGEST_SIZE]);
+void attest_measure_root_config();
+void attest_get_root_config(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/* Sets the VM's config digest, that of the root config if digest is NULL */
+void attest_set_config(struct vm* vm, const uint8_t* digest);
+
+/**
+ * Images copied by the hypervisor are hashed along with the copy and
+ * finalized with attest_image_final. Those mapped in place are hashed from
+ * the VM's memory with attest_measure_image.
+ */
+void attest_image_final(struct vm* vm, struct sha256* ctx);
+void attest_measure_image(struct vm* vm);
+
+unsigned long attest_hypercall(unsigned long vm_id, unsigned long report_ipa,
+                               unsigned long arg2);
+
+#endif /* __ATTEST_H__ */
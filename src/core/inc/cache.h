@@ -32,8 +32,14 @@ struct cache {
 extern size_t COLOR_NUM;
 extern size_t COLOR_SIZE;
 
+struct vm_config;
+struct config;
+
 void cache_enumerate();
+colormap_t cache_vm_colors(const struct vm_config* config);
+void cache_check_colors(const struct config* config);
 void cache_flush_range(vaddr_t base, size_t size);
+void cache_clean_range(vaddr_t base, size_t size);
 
 void cache_arch_enumerate(struct cache* dscrp);
 
@@ -54,6 +54,54 @@ extern uint8_t _config_end, _images_end;
     .config_header_size = CONFIG_HEADER_SIZE, \
     .config_size = CONFIG_SIZE,
 
+/**
+ * Action taken when a VM keeps triggering faults the hypervisor can not
+ * handle on its behalf.
+ */
+enum vm_fault_policy {
+    /* Always reflect the fault back into the guest */
+    VM_FAULT_INJECT,
+    /* Power off all the VM's vcpus */
+    VM_FAULT_STOP,
+    /* Restart the VM from its entry point */
+    VM_FAULT_RESET,
+};
+
+/**
+ * Action taken when a VM's virtual watchdog expires twice without being
+ * refreshed.
+ */
+enum vm_watchdog_action {
+    /* Only notify the manager VM, if any */
+    VM_WATCHDOG_NOTIFY,
+    /* Restart the VM from its entry point */
+    VM_WATCHDOG_RESET,
+    /* Power off all the VM's vcpus */
+    VM_WATCHDOG_HALT,
+};
+
+/**
+ * Kind of VM, which selects the secure domain (sdee) that handles its calls.
+ */
+enum vm_type {
+    /* Normal VM, possibly the normal world of a TEE */
+    VM_TYPE_GPOS,
+    /* TEE hosting the normal world VM stacked on top of it */
+    VM_TYPE_TEE_HOST,
+    /* TEE hosted by the normal world VM below it */
+    VM_TYPE_TEE_GUEST,
+    /* SGX-like enclave */
+    VM_TYPE_ENCLAVE,
+};
+
+enum vm_replay_mode {
+    VM_REPLAY_NONE,
+    /* Log the VM's nondeterministic inputs */
+    VM_REPLAY_RECORD,
+    /* Feed the VM the inputs from a log instead of the live ones */
+    VM_REPLAY_REPLAY,
+};
+
 struct vm_config {
     struct {
         /* Image load address in VM's address space */
@@ -81,11 +129,166 @@ struct vm_config {
      */
     colormap_t colors;
 
+    /* One of enum vm_type */
     size_t type;
 
+    /**
+     * Guest faults are reflected back into the VM until their number reaches
+     * fault.limit, after which fault.policy is applied. A zero limit means
+     * faults are always reflected.
+     */
+    struct {
+        enum vm_fault_policy policy;
+        size_t limit;
+    } fault;
+
+    /**
+     * Per-VM virtual watchdog. On Arm it is an SBSA generic watchdog whose
+     * control frame is at base_addr and refresh frame at base_addr + 0x1000.
+     * On RISC-V it is driven through an SBI extension. timeout_us is the
+     * watchdog period until the guest programs its own. If interrupt is not
+     * zero, it is injected on the first expiry.
+     */
+    struct {
+        bool enable;
+        uint64_t timeout_us;
+        enum vm_watchdog_action action;
+        vaddr_t base_addr;
+        irqid_t interrupt;
+    } watchdog;
+
+    /**
+     * Paravirtual console, multiplexed with the other VMs' onto the platform
+     * uart. ring is the address, in the VM, of a page holding a struct
+     * vcons_ring, or zero for none. On Arm, if uart_base is set, an SBSA
+     * UART/PL011 is also emulated there. interrupt signals input on either.
+     * Typing Ctrl-A followed by a VM id on the uart moves the input focus to
+     * that VM, Ctrl-A followed by 'g' hands the uart to the GDB stub and
+     * Ctrl-A followed by any other key moves the focus to the next VM.
+     */
+    struct {
+        bool enable;
+        vaddr_t ring;
+        vaddr_t uart_base;
+        irqid_t interrupt;
+    } console;
+
+    /**
+     * Allow the hypervisor's GDB stub to attach to this VM. Once attached,
+     * the debugger can stop the VM and access its registers and memory.
+     */
+    struct {
+        bool enable;
+    } debug;
+
+    /**
+     * Deterministic record and replay. Recording logs the interrupts
+     * injected into the VM, the values its emulated registers return and
+     * its hypercall results, each with the number of instructions the VM
+     * had executed, to the shared memory region shmem_id. Replaying delivers
+     * the events in the log at the same points instead of the live ones.
+     * Only VMs with a single vcpu are supported. On Arm, it takes the last
+     * PMU counter from the VM and is only exact on targets that count
+     * instructions precisely, such as QEMU with -icount.
+     */
+    struct {
+        enum vm_replay_mode mode;
+        size_t shmem_id;
+    } replay;
+
+    /**
+     * Working-set estimation. Every interval_us, or every second if zero,
+     * the stage-2 access flags of the VM's memory regions are sampled and
+     * cleared, a few pages at a time. The VM itself, the VM hosting it and
+     * the manager VM can read the resulting working-set size and per-region
+     * hotness histograms with the HC_WSS hypercall.
+     */
+    struct {
+        bool enable;
+        uint64_t interval_us;
+    } working_set;
+
+    /**
+     * Post-mortem core dumps. When the VM crashes, an ELF core file with its
+     * vcpus' registers, its virtual interrupt controller state and its
+     * memory is written to the shared memory region shmem_id, or only the
+     * memory mapped at stage 2 if mapped_only is set. The region is not
+     * cleared at boot, so the manager VM can read a dump from it after the
+     * crash or after a warm reset.
+     */
+    struct {
+        bool enable;
+        size_t shmem_id;
+        bool mapped_only;
+    } coredump;
+
+    /**
+     * Scalable vector state: SVE on Arm, the V extension on RISC-V. When
+     * enabled, the VM may use vector instructions with a vector length of
+     * at most max_vl bytes, or the hardware's if zero. The length can not
+     * be lowered on RISC-V, where vectors stay disabled if max_vl is below
+     * it. The registers, and on Arm the FP/SIMD ones of every VM, are only
+     * saved and restored as vcpus sharing a cpu take turns using them.
+     */
+    struct {
+        bool enable;
+        size_t max_vl;
+    } vector;
+
+    /**
+     * Arm memory tagging (FEAT_MTE). When enabled, the VM's memory is mapped
+     * Normal-Tagged at stage 2 and the VM may use allocation tags and the
+     * tagging registers, which are switched along with its vcpus. Otherwise,
+     * cpus with FEAT_MTE_PERM map the VM's memory without tag access.
+     * Pointer authentication is available to every VM. Ignored on RISC-V.
+     */
+    struct {
+        bool enable;
+    } mte;
+
+    /**
+     * Worst-case wake-up latency, in microseconds, this VM tolerates from
+     * the cpus it may run on, which limits how deep they may idle. Zero
+     * means the VM has no latency constraint.
+     */
+    uint64_t idle_latency_us;
+
+    /**
+     * Size of the pages mapping the VM's memory at stage 2, or zero for the
+     * default PAGE_SIZE. Arm also accepts 16 KiB and 64 KiB granules, if all
+     * cpus support them. Memory regions, devices, IPCs and, on GICv2, the
+     * virtual cpu interface must then be aligned to the granule, and colors
+     * are counted in granule-sized pages. The image is copied to the VM's
+     * memory rather than mapped in place, and the VM can not host enclaves.
+     */
+    size_t stage2_granule;
+
+    /**
+     * Boot descriptor of the trusted execution environment (sdTZ) this VM
+     * hosts. The TEE cold boots at entry on the first cpu it runs on and,
+     * following OP-TEE's OPTEE_SMC_RETURN_ENTRY_DONE convention, reports its
+     * vector table once done. Other cpus bring it up and take it down through
+     * that table's cpu_on and cpu_off entries, unless overridden here.
+     */
+    struct {
+        vaddr_t cpu_on_entry;
+        vaddr_t cpu_off_entry;
+    } tee;
+
     size_t children_num;
     struct vm_config **children;
 
+    /**
+     * Bounds on the VM stack of the cpus this VM runs on. The VM's vcpus
+     * only run with at most depth vcpus stacked below them, or
+     * VMSTACK_DEPTH_MAX if zero. A stacked vcpu may be run again, e.g., a
+     * TEE called back by the enclave it runs, up to reentry times at once.
+     */
+    struct {
+        size_t depth;
+        size_t reentry;
+    } vmstack;
+
     /**
      * A description of the virtual platform available to the guest, i.e.,
      * the virtual machine itself.
@@ -123,10 +326,52 @@ extern struct config {
     /* Hypervisor colors */
     colormap_t hyp_colors;
 
+    /**
+     * Give each cluster its own copy of the hypervisor's code and read-only
+     * data, in the hypervisor colors, made at boot. The cpus of a cluster
+     * then fetch it from their copy, instead of contending for the lines
+     * of a single one with the other clusters. Data is still shared.
+     */
+    struct {
+        bool enable;
+    } hyp_replication;
+
     /* Definition of shared memory regions to be used by VMs */
     size_t shmemlist_size;
     struct shmem *shmemlist;
 
+    /**
+     * Optional manager VM. When enabled, every VM state change (see enum
+     * vm_state) raises an event on shared memory region shmem_id towards the
+     * VMs connected to it, with the id of the affected VM as event id.
+     */
+    struct {
+        bool enable;
+        size_t shmem_id;
+    } vm_manager;
+
+    /**
+     * Key for the MAC of VM attestation reports. It is left out of the
+     * configuration's measurement.
+     */
+    struct {
+        bool enable;
+        uint8_t key[32];
+    } attestation;
+
+    /**
+     * Allow the manager VM to replace the running hypervisor with a new image
+     * built for this same configuration, without rebooting the VMs. The VMs
+     * must neither host other VMs, nor be assigned PCIe functions, nor be
+     * set up for debugging or record/replay. The image must come with its
+     * HMAC-SHA256 under the attestation key, so attestation must be enabled,
+     * and be built with room for the handed over state (LU_STATE_SIZE, e.g.
+     * 0x20000). Only supported on Arm.
+     */
+    struct {
+        bool enable;
+    } live_update;
+
     /* The number of VMs specified by this configuration */
     size_t vmlist_size;
 
@@ -138,9 +383,15 @@ extern struct config {
 void config_adjust_to_va(struct config* config, paddr_t phys);
 void config_vm_adjust_to_va(struct vm_config *vm_config, struct config* config, paddr_t phys);
 void config_arch_vm_adjust_to_va(struct vm_config *vm_config, struct config* config, paddr_t phys);
+void config_adjust_from_va(struct config* config, paddr_t phys);
+void config_vm_adjust_from_va(struct vm_config *vm_config, struct config* config, paddr_t phys);
+void config_arch_vm_adjust_from_va(struct vm_config *vm_config, struct config* config, paddr_t phys);
 bool config_is_builtin();
 
 #define adjust_ptr(p, o)\
     ((p) = (p) ? (typeof(p))(  (uintptr_t)(p) + (size_t)(o)) : (p))
 
+#define unadjust_ptr(p, o)\
+    ((p) = (p) ? (typeof(p))(  (uintptr_t)(p) - (size_t)(o)) : (p))
+
 #endif /* __CONFIG_H__ */
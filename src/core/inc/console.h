@@ -20,5 +20,8 @@
 
 void console_init();
 void console_write(char const* const str);
+bool console_putc(char c, bool block);
+bool console_getc(char* c);
+void console_set_irqs(bool rx, bool tx);
 
 #endif /* __CONSOLE_H__ */
\ No newline at end of file
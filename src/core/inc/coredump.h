@@ -0,0 +1,125 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __COREDUMP_H__
+#define __COREDUMP_H__
+
+#include <crossconhyp.h>
+#include <timer.h>
+#include <arch/coredump.h>
+
+#define ELF_CLASS64 (2)
+#define ELF_DATA2LSB (1)
+#define ELF_VERSION (1)
+#define ELF_ET_CORE (4)
+#define ELF_PT_LOAD (1)
+#define ELF_PT_NOTE (4)
+#define ELF_PF_X (1)
+#define ELF_PF_W (2)
+#define ELF_PF_R (4)
+#define ELF_NT_PRSTATUS (1)
+
+/* Notes carrying the state only the hypervisor knows about, named "CROSSCON" */
+#define COREDUMP_NT_VCPU (0x100)
+#define COREDUMP_NT_VM (0x101)
+
+struct elf64_ehdr {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct elf64_phdr {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+};
+
+struct elf64_nhdr {
+    uint32_t n_namesz;
+    uint32_t n_descsz;
+    uint32_t n_type;
+};
+
+/* Layout of Linux's struct elf_prstatus, so debuggers find the registers */
+struct elf_prstatus {
+    int32_t si_signo;
+    int32_t si_code;
+    int32_t si_errno;
+    int16_t cursig;
+    uint16_t pad0;
+    uint64_t sigpend;
+    uint64_t sighold;
+    int32_t pid;
+    int32_t ppid;
+    int32_t pgrp;
+    int32_t sid;
+    uint64_t times[8];
+    uint64_t reg[COREDUMP_ARCH_GREGS];
+    int32_t fpvalid;
+    uint32_t pad1;
+};
+
+/**
+ * Per-VM core dump state. When the VM crashes, each of its cpus writes the
+ * notes of its vcpu to the dump and the last one copies the VM's memory, a
+ * chunk at a time from its timer queue. Only the VM's own lock is taken.
+ */
+struct vcoredump {
+    bool enabled;
+    uint8_t* base;
+    size_t size;
+
+    /* Protected by the VM's lock */
+    bool active;
+    size_t pending;
+
+    size_t seg_num;
+    size_t notes_off;
+    size_t vcpu_notes_size;
+    struct timer_event event;
+    /* Copy position, only touched by the cpu copying the memory */
+    size_t seg;
+    size_t seg_done;
+};
+
+struct vm;
+struct vcpu;
+
+void coredump_vm_init(struct vm* vm);
+void coredump_vm_crashed(struct vm* vm);
+void coredump_vm_cancel(struct vm* vm);
+
+/* Must be implemented by architecture */
+
+void coredump_arch_gregs(struct vcpu* vcpu, uint64_t* gregs);
+size_t coredump_arch_vcpu_size();
+void coredump_arch_vcpu(struct vcpu* vcpu, void* buf);
+size_t coredump_arch_vm_size(struct vm* vm);
+void coredump_arch_vm(struct vm* vm, void* buf);
+
+#endif /* __COREDUMP_H__ */
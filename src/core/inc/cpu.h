@@ -23,6 +23,8 @@
 #include <spinlock.h>
 #include <mem.h>
 #include <list.h>
+#include <idle.h>
+#include <timer.h>
 
 #define STACK_SIZE (PAGE_SIZE)
 
@@ -32,26 +34,35 @@ extern uint8_t _cpu_if_base;
 
 struct cpuif {
     struct list event_list;
+    struct timer_queue timers;
 
 } __attribute__((aligned(PAGE_SIZE))) ;
 
 struct vcpu;
+struct vmstack;
 
 struct cpu {
     cpuid_t id;
     struct addr_space as;
 
     struct vcpu* vcpu;
-    /* this cpus execution stack */
-    /* TODO: vcpus can not be stacked arbitrarily
-     * because we are using the vcpus as nodes in themselves.
-     */
-    struct list vcpu_stack;
+    /* this cpus execution stack, see vmstack.c */
+    struct vmstack* vmstack;
     /* all the vcpus this cpu can run */
     struct list vcpus;
 
+    /* The vcpu the vector registers belong to, see vec.c */
+    struct {
+        struct vcpu* owner;
+        bool used;
+    } vec;
+
     struct cpu_arch arch;
 
+    /* Idle when the interrupt being handled completes, see cpu_defer_idle */
+    bool idle_pending;
+    struct cpu_idle idle;
+
     pte_t root_pt[HYP_ROOT_PT_SIZE/sizeof(pte_t)] __attribute__((aligned(HYP_ROOT_PT_SIZE)));
 
     uint8_t stack[STACK_SIZE] __attribute__((aligned(PAGE_SIZE)));
@@ -71,6 +82,9 @@ struct cpu_msg {
 };
 
 void cpu_send_msg(cpuid_t cpu, struct cpu_msg* msg);
+void cpu_defer_idle();
+void cpu_irq_exit();
+void cpu_trap_exit();
 
 typedef void (*cpu_msg_handler_t)(uint32_t event, uint64_t data);
 
@@ -132,7 +146,7 @@ void cpu_remove_vcpu(struct vcpu * vcpu);
 struct vcpu* cpu_get_vcpu(uint64_t vmid);
 
 void cpu_arch_init(cpuid_t cpu_id, paddr_t load_addr);
-void cpu_arch_idle();
+void cpu_arch_idle(size_t state);
 
 #endif /* __ASSEMBLER__ */
 
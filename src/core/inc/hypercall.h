@@ -25,6 +25,11 @@ enum {
     HC_VMSTACK = 2,
     HC_ENCLAVE = 3,
     HC_TEE = 4,
+    HC_IDLE = 5,
+    HC_ATTEST = 6,
+    HC_CONSOLE = 7,
+    HC_LIVE_UPDATE = 8,
+    HC_WSS = 9,
 };
 
 enum {
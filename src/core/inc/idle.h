@@ -0,0 +1,63 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include <crossconhyp.h>
+
+/* Waiting for interrupt is always available and is idle state 0 */
+#define IDLE_STATE_WFI (0)
+#define IDLE_STATE_MAX (8)
+
+/**
+ * A platform low-power state. The arch_state encoding is architecture
+ * specific, on Arm it is the PSCI power_state parameter for CPU_SUSPEND.
+ * Powerdown states lose the cpu context, which the hypervisor then saves and
+ * restores.
+ */
+struct idle_state {
+    uint32_t arch_state;
+    bool powerdown;
+    uint32_t exit_latency_us;
+    uint32_t min_residency_us;
+};
+
+struct idle_stats {
+    uint64_t entries;
+    uint64_t ticks;
+};
+
+struct cpu_idle {
+    bool active;
+    size_t state;
+    uint64_t entry;
+    struct idle_stats stats[IDLE_STATE_MAX];
+};
+
+/**
+ * Select the deepest idle state whose exit latency is tolerated by all VMs
+ * that may run on this cpu and whose target residency fits before the next
+ * expected event (a counter value, or TIMER_DEADLINE_NONE).
+ */
+size_t idle_select(bool allow_powerdown, uint64_t next_event);
+const struct idle_state* idle_get_state(size_t state);
+void idle_enter(size_t state);
+void idle_exit();
+unsigned long idle_hypercall(unsigned long state, unsigned long field,
+                             unsigned long arg2);
+
+/* Defaults when the platform does not describe its idle states */
+const struct idle_state* idle_arch_default_states(size_t* num);
+
+#endif /* __IDLE_H__ */
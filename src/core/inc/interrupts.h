@@ -40,6 +40,7 @@ enum irq_res interrupts_handle(irqid_t int_id);
 
 void interrupts_vm_assign(struct vm *vm, irqid_t id);
 void interrupts_vm_inject(struct vcpu* vcpu, uint64_t id);
+void interrupts_vm_disable(struct vm *vm);
 
 void interrupts_set_shared(uint64_t id);
 bool interrupts_is_shared(uint64_t id);
@@ -34,5 +34,6 @@ struct vcpu;
 unsigned long ipc_hypercall(struct vcpu *vcpu, unsigned long arg0, unsigned long arg1, unsigned long arg2);
 void ipc_init(const struct vm_config* vm_config, bool vm_master);
 struct shmem* ipc_get_shmem(size_t shmem_id);
+void ipc_notify_event(size_t shmem_id, size_t event_id, cpumap_t exclude);
 
 #endif /* IPC_H */
@@ -0,0 +1,137 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#ifndef __LU_H__
+#define __LU_H__
+
+#define LU_IMAGE_MAGIC (0x5548554c) /* "LUHU" */
+#define LU_STATE_MAGIC (0x5453554c) /* "LUST" */
+/* Bumped on every change to the layout of the handed over state */
+#define LU_VERSION (1)
+/**
+ * Room the image sets aside for the state handed over to it, set with the
+ * LU_STATE_SIZE make variable. Images built without it can start a live
+ * update but cannot be updated to.
+ */
+#ifndef LU_STATE_SIZE
+#define LU_STATE_SIZE (0)
+#endif
+/* Offset of struct lu_image_header in the image */
+#define LU_IMAGE_HEADER_OFF (8)
+
+#ifndef __ASSEMBLER__
+
+#include <crossconhyp.h>
+#include <attest.h>
+
+/**
+ * Header every image carries right after its entry instruction, describing
+ * where the image expects to find the state handed over to it. Addresses are
+ * link addresses.
+ */
+struct lu_image_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t image_start;
+    /* End of the image and the config it carries, in physical memory */
+    uint64_t dmem_phys_beg;
+    /* Physical size of the config, between the image's loaded sections */
+    uint64_t extra;
+    uint64_t state_start;
+    uint64_t state_size;
+    /* Memory the image sets up for each cpu right after itself */
+    uint64_t cpu_size;
+};
+
+/**
+ * State handed over from the running hypervisor to the one replacing it. It
+ * is written to the new image's .lu_state section, which the image's boot
+ * code leaves untouched. The digest covers everything after it, up to size.
+ */
+struct lu_state {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    /* Measurement of the configuration, which must not change */
+    uint8_t config[SHA256_DIGEST_SIZE];
+    /* Counter value at which the VMs were stopped */
+    uint64_t quiesced;
+    uint64_t vm_num;
+    uint64_t shmem_num;
+    /* Each shared memory region, then each VM */
+    uint8_t data[];
+};
+
+/* A shared memory region, size is zero if the configuration places it */
+struct lu_shmem {
+    uint64_t pa;
+    uint64_t size;
+};
+
+/**
+ * Guest physical to physical mapping of part of a VM's memory. Fixed extents
+ * are placed by the configuration and reserved as part of it.
+ */
+struct lu_extent {
+    uint64_t va;
+    uint64_t pa;
+    uint64_t size;
+    uint64_t fixed;
+};
+
+/**
+ * A VM, identified by its index in the configuration. It is followed by its
+ * extents, the architecture's VM state and, for each vcpu, the vcpu's id and
+ * the architecture's vcpu state.
+ */
+struct lu_vm {
+    uint64_t size;
+    uint64_t config_idx;
+    uint64_t state;
+    struct vm_measurement measurement;
+    uint64_t extent_num;
+    uint64_t arch_size;
+    uint64_t vcpu_num;
+    uint64_t vcpu_arch_size;
+    uint8_t data[];
+};
+
+struct vm;
+struct vcpu;
+struct ppages;
+
+void lu_init(paddr_t load_addr, paddr_t config_addr);
+bool lu_reserved_ppages(size_t index, struct ppages* ppages);
+bool lu_shmem_phys(size_t shmem_id, paddr_t* pa);
+bool lu_vm_map(struct vm* vm);
+void lu_vcpu_restore(struct vcpu* vcpu);
+void lu_cpu_exit();
+unsigned long lu_hypercall(unsigned long image_ipa, unsigned long size,
+                           unsigned long mac_ipa);
+
+/* Must be implemented by architecture */
+
+bool lu_arch_supported();
+size_t lu_arch_vm_size(struct vm* vm);
+void lu_arch_vm_save(struct vm* vm, void* buf);
+void lu_arch_vm_restore(struct vm* vm, const void* buf);
+size_t lu_arch_vcpu_size();
+void lu_arch_vcpu_save(struct vcpu* vcpu, void* buf);
+void lu_arch_vcpu_restore(struct vcpu* vcpu, const void* buf);
+void lu_arch_cpu_quiesce();
+void lu_arch_cpu_off();
+void lu_arch_jump(paddr_t load_addr, paddr_t entry, paddr_t config_addr);
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* __LU_H__ */
@@ -39,12 +39,44 @@ enum AS_SEC {
 };
 
 #define HYP_ASID  0
+#define MEM_PT_DIRTY_RANGES (4)
+/* Above this many pages deferred invalidations flush the whole as */
+#define MEM_PT_INV_MAX_PAGES (32)
+/* Discontiguous ranges freed by mem_free_vpage after a single sync */
+#define MEM_FREE_BATCH_MAX (8)
 struct addr_space {
     struct page_table pt;
     enum AS_TYPE type;
     colormap_t colors;
     asid_t id;
     spinlock_t lock;
+
+    /**
+     * Set when the page tables are also walked by an agent that does not
+     * snoop the cpu caches (e.g. a non-coherent iommu). Updates are then
+     * recorded as dirty ranges and cleaned to the point of coherency, before
+     * the deferred tlb invalidations, once per map/unmap operation.
+     * Invalidations are always deferred and issued as a single batch, one
+     * per inv_step, the size of the smallest entry changed.
+     */
+    bool pt_clean;
+    /**
+     * Cpus other than the local one targeted by the tlb invalidations of a
+     * VM address space. None while the VM is set up, as it has not run yet.
+     */
+    cpumap_t cpus;
+    /* Flags normal VM memory is mapped with, PTE_VM_FLAGS by default */
+    pte_flags_t vm_flags;
+    struct {
+        size_t num;
+        struct {
+            vaddr_t base;
+            vaddr_t top;
+        } range[MEM_PT_DIRTY_RANGES];
+        vaddr_t inv_base;
+        vaddr_t inv_top;
+        size_t inv_step;
+    } pt_dirty;
 };
 
 struct ppages {
@@ -92,9 +124,13 @@ static inline bool all_clrs(colormap_t clrs)
 void mem_init(paddr_t load_addr, paddr_t config_addr);
 void as_init(struct addr_space* as, enum AS_TYPE type, asid_t id,
             pte_t* root_pt, colormap_t colors);
+bool as_vm_init(struct addr_space* as, asid_t id, colormap_t colors,
+                size_t granule, size_t ipa_bits);
 void as_destroy(struct addr_space *as);
+void mem_pt_clean_enable(struct addr_space *as);
 void* mem_alloc_page(size_t n, enum AS_SEC sec, bool phys_aligned);
 struct ppages mem_alloc_ppages(colormap_t colors, size_t n, bool aligned);
+struct ppages mem_alloc_ppages_align(colormap_t colors, size_t n, size_t align);
 vaddr_t mem_alloc_vpage(struct addr_space* as, enum AS_SEC section,
                     vaddr_t at, size_t n);
 void mem_free_vpage(struct addr_space* as, vaddr_t at, size_t n,
@@ -28,10 +28,31 @@ struct page_table_dscr {
     bool* lvl_term;
 };
 
+/**
+ * Tables of a granule other than PAGE_SIZE can not be reached through the
+ * hypervisor's recursive mapping. They are handed out from chunks mapped in
+ * the hypervisor's address space instead, and found by physical address.
+ */
+#define PT_POOL_CHUNKS (16)
+#define PT_POOL_CHUNK_TBLS (16)
+
+struct pt_pool {
+    size_t tbl_size;
+    size_t chunk_num;
+    /* Tables handed out from the last chunk */
+    size_t used;
+    struct {
+        vaddr_t va;
+        paddr_t pa;
+    } chunks[PT_POOL_CHUNKS];
+};
+
 struct page_table {
     pte_t* root;
     pte_t root_flags;
     struct page_table_dscr* dscr;
+    /* NULL if the tables are mapped recursively */
+    struct pt_pool* pool;
 };
 
 extern struct page_table_dscr* hyp_pt_dscr;
@@ -68,6 +89,14 @@ static inline bool pt_lvl_terminal(struct page_table* pt, size_t lvl)
     return pt->dscr->lvl_term[lvl];
 }
 
+/* Size of the smallest pages the table maps */
+static inline size_t pt_granule(struct page_table* pt)
+{
+    return pt_lvlsize(pt, pt->dscr->lvls - 1);
+}
+
+pte_t* pt_pool_get(struct page_table* pt, size_t lvl, vaddr_t va);
+
 /* Functions implemented in architecture dependent files */
 
 pte_t* pt_get_pte(struct page_table* pt, size_t lvl, vaddr_t va);
@@ -81,6 +110,18 @@ bool pte_valid(pte_t* pte);
 bool pte_table(struct page_table* pt, pte_t* pte, size_t lvl);
 bool pte_page(struct page_table* pt, pte_t* pte, size_t lvl);
 pte_t pt_pte_type(struct page_table* pt, size_t lvl);
+struct page_table_dscr* pt_vm_dscr(size_t granule, size_t ipa_bits);
+
+/**
+ * Runs of pt_contig_ptes aligned entries at a level can map a naturally
+ * aligned range as a whole, e.g., with Svnapot. Each entry of such a run
+ * still reports its own page through pte_addr.
+ */
+size_t pt_contig_ptes(struct page_table* pt, size_t lvl);
+bool pte_contig(pte_t* pte);
+void pte_set_contig(struct page_table* pt, pte_t* pte, size_t lvl,
+                    paddr_t addr, pte_type_t type, pte_flags_t flags);
+void pte_uncontig(pte_t* pte);
 
 #endif /* __ASSEMBLER__ */
 
@@ -22,6 +22,8 @@
 #include <mem.h>
 #include <cache.h>
 #include <ipc.h>
+#include <idle.h>
+#include <vpci.h>
 
 struct platform_desc {
     size_t cpu_num;
@@ -35,15 +37,55 @@ struct platform_desc {
     size_t dev_num;
     struct dev_region *devs;
 
+    /**
+     * The hypervisor's uart. If interrupt is set, it is used to receive
+     * input and to drain the VMs' console output in the background.
+     */
     struct {
         paddr_t base;
+        irqid_t interrupt;
     } console;
 
+    /**
+     * PCIe host bridge with an ECAM window of bus_num buses at ecam_base.
+     * For the physical platform this is the root complex functions are
+     * assigned from. For a VM it is the emulated host bridge and funcs are
+     * the functions assigned to it, which the VM's device tree must describe
+     * at their virtual addresses, routing their INTx pins through
+     * interrupt-map to the configured interrupts.
+     */
+    struct {
+        paddr_t ecam_base;
+        size_t bus_num;
+        size_t func_num;
+        struct pci_func_config *funcs;
+    } pci;
+
+    /**
+     * The caches of the cpus the hypervisor boots on. If not described, they
+     * are probed. When clusters have caches of different geometries, those
+     * of cluster i are cluster_caches[i] and cache is not used.
+     */
     struct cache cache;
+    size_t cluster_cache_num;
+    struct cache *cluster_caches;
+
+    /**
+     * Low-power states the cpus may enter when idle, ordered from the
+     * shallowest to the deepest. Usually taken from the firmware's device
+     * tree idle-states node.
+     */
+    size_t idle_state_num;
+    struct idle_state *idle_states;
 
     struct arch_platform arch;
 };
 
 extern struct platform_desc platform;
 
+/* Must be implemented by architecture */
+
+size_t platform_arch_cpu_cluster(const struct platform_desc* plat,
+                                 cpuid_t cpuid);
+
 #endif /* __PLATFORM_H__ */
@@ -0,0 +1,78 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <crossconhyp.h>
+
+#include <spinlock.h>
+
+#define TIMER_DEADLINE_NONE ((uint64_t)-1)
+#define TIMER_EVENTS_MAX (32)
+
+struct timer_event;
+typedef void (*timer_event_handler_t)(struct timer_event* event);
+
+/**
+ * A deadline on a cpu's event queue, expressed in ticks of the system counter.
+ * The handler is called, from interrupt context and with no locks held, on
+ * the cpu the event was started on, some time between the deadline and the
+ * deadline plus slack. Events whose windows overlap are run off the same
+ * timer interrupt. Periodic events are restarted a period after their
+ * deadline, unless the handler restarts or stops them itself.
+ */
+struct timer_event {
+    uint64_t deadline;
+    uint64_t slack;
+    uint64_t period;
+    timer_event_handler_t handler;
+    /* Where the event is queued, if it is */
+    cpuid_t cpu;
+    size_t index;
+    bool queued;
+};
+
+/**
+ * Each cpu's pending events, as a binary min-heap ordered by the latest time
+ * they may run, i.e. deadline plus slack. The hardware timer is programmed
+ * for the heap's top. The queue lives in the cpu's public interface so that
+ * events can be stopped from other cpus.
+ */
+struct timer_queue {
+    spinlock_t lock;
+    size_t num;
+    struct timer_event* heap[TIMER_EVENTS_MAX];
+    uint64_t programmed;
+};
+
+void timer_init();
+void timer_event_init(struct timer_event* event, timer_event_handler_t handler);
+bool timer_event_start(struct timer_event* event, uint64_t deadline,
+                       uint64_t slack, uint64_t period);
+void timer_event_stop(struct timer_event* event);
+bool timer_event_pending(struct timer_event* event);
+uint64_t timer_next_deadline();
+void timer_restore();
+uint64_t timer_get_counter();
+uint64_t timer_get_freq();
+uint64_t timer_us_to_ticks(uint64_t us);
+uint64_t timer_ticks_to_us(uint64_t ticks);
+void timer_handle();
+
+/* Must be implemented by architecture */
+
+void timer_arch_init();
+void timer_arch_set(uint64_t deadline);
+uint64_t timer_arch_get_counter();
+uint64_t timer_arch_get_freq();
+
+#endif /* __TIMER_H__ */
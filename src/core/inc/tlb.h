@@ -26,17 +26,31 @@ static inline void tlb_inv_va(struct addr_space *as, vaddr_t va)
     if (as->type == AS_HYP) {
         tlb_hyp_inv_va(va);
     } else if (as->type == AS_VM) {
-        tlb_vm_inv_va(as->id, va);
+        tlb_vm_inv_va(as->id, as->cpus, va);
         // TODO: inval iommu tlbs
     }
 }
 
+/**
+ * Invalidate the entries of size step mapping [va, va + size), as a batch
+ * ordered only as a whole against the page table updates preceding it.
+ */
+static inline void tlb_inv_range(struct addr_space *as, vaddr_t va,
+                                 size_t size, size_t step)
+{
+    if (as->type == AS_HYP) {
+        tlb_hyp_inv_range(va, size, step);
+    } else if (as->type == AS_VM) {
+        tlb_vm_inv_range(as->id, as->cpus, va, size, step);
+    }
+}
+
 static inline void tlb_inv_all(struct addr_space *as)
 {
     if (as->type == AS_HYP) {
         tlb_hyp_inv_all();
     } else if (as->type == AS_VM) {
-        tlb_vm_inv_all(as->id);
+        tlb_vm_inv_all(as->id, as->cpus);
         // TODO: inval iommu tlbs
     }
 }
@@ -0,0 +1,85 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __VCONS_H__
+#define __VCONS_H__
+
+#include <crossconhyp.h>
+
+#define VCONS_RING_OUT_SIZE (2048)
+#define VCONS_RING_IN_SIZE (1024)
+#define VCONS_BUF_SIZE (1024)
+#define VCONS_IN_SIZE (64)
+#define VCONS_UART_REGS (32)
+
+/**
+ * Paravirtual console page, shared with the guest. Indexes are free running
+ * and wrap at the size of their buffer. The guest produces output and
+ * signals it with the HC_CONSOLE hypercall. The hypervisor produces input
+ * and signals it with the VM's console interrupt.
+ */
+struct vcons_ring {
+    volatile uint32_t out_prod;
+    volatile uint32_t out_cons;
+    volatile uint32_t in_prod;
+    volatile uint32_t in_cons;
+    volatile char out[VCONS_RING_OUT_SIZE];
+    volatile char in[VCONS_RING_IN_SIZE];
+};
+
+/**
+ * Per-VM console. Output from either the ring or the emulated uart is staged
+ * in buf and drained to the physical uart a line at a time, prefixed with
+ * the VM's id, interleaved with the other VMs' output.
+ */
+struct vcons {
+    bool enabled;
+    struct vcons_ring* ring;
+    char prefix[16];
+
+    /* Protected by the console lock */
+    char buf[VCONS_BUF_SIZE];
+    size_t buf_head;
+    size_t buf_tail;
+    char in[VCONS_IN_SIZE];
+    size_t in_head;
+    size_t in_tail;
+
+    /* The emulated uart found buf full and waits for it to drain */
+    bool tx_stalled;
+
+    /* Emulated uart registers, interpreted by the architecture */
+    uint32_t uart_regs[VCONS_UART_REGS];
+    bool uart_irq;
+};
+
+struct vm;
+struct vcpu;
+
+void vcons_init();
+void vcons_vm_init(struct vm* vm);
+bool vcons_putc(struct vm* vm, char c);
+bool vcons_getc(struct vm* vm, char* c);
+bool vcons_tx_full(struct vm* vm);
+bool vcons_rx_empty(struct vm* vm);
+void vcons_poll();
+void vcons_service();
+void vcons_dbg_write(const char* buf, size_t len);
+void vcons_dbg_detach();
+unsigned long vcons_hypercall(unsigned long arg0, unsigned long arg1,
+                              unsigned long arg2);
+
+/* Must be implemented by architecture */
+
+void vcons_arch_init(struct vm* vm);
+void vcons_arch_update(struct vcpu* vcpu);
+
+#endif /* __VCONS_H__ */
@@ -0,0 +1,87 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#ifndef __VDBG_H__
+#define __VDBG_H__
+
+#include <crossconhyp.h>
+#include <spinlock.h>
+
+#define VDBG_MAX_BPS (16)
+#define VDBG_MAX_WPS (16)
+
+/* Signals reported to the debugger in stop replies */
+#define VDBG_SIGINT (2)
+#define VDBG_SIGTRAP (5)
+
+enum vdbg_wp_type { VDBG_WP_WRITE, VDBG_WP_READ, VDBG_WP_ACCESS };
+
+struct vdbg_wp {
+    vaddr_t addr;
+    size_t len;
+    enum vdbg_wp_type type;
+};
+
+/**
+ * Debug state of a VM while the GDB stub is attached to it. The VM is either
+ * running, with all of its vcpus resumed, or stopped, with all of them
+ * paused. Breakpoints and watchpoints are hardware ones, loaded on every cpu
+ * the VM runs on when it resumes.
+ */
+struct vdbg {
+    spinlock_t lock;
+    bool attached;
+    enum { VDBG_RUNNING, VDBG_STOPPING, VDBG_STOPPED } state;
+    /* vcpus yet to pause before the VM is stopped */
+    size_t running;
+
+    /* Why the VM last stopped */
+    vcpuid_t stop_vcpu;
+    int stop_signal;
+    bool stop_watch;
+    vaddr_t stop_addr;
+
+    /* vcpu whose registers and address space the debugger accesses */
+    vcpuid_t vcpu;
+    /* vcpu that single steps on the next resume, INVALID_CPUID for none */
+    vcpuid_t step_vcpu;
+
+    size_t bp_num;
+    vaddr_t bps[VDBG_MAX_BPS];
+    size_t wp_num;
+    struct vdbg_wp wps[VDBG_MAX_WPS];
+};
+
+struct vm;
+struct vcpu;
+
+bool vdbg_attach(struct vm* vm);
+void vdbg_input(const char* buf, size_t len);
+void vdbg_trap(struct vcpu* vcpu, bool watch, vaddr_t addr);
+void vdbg_wait(struct vcpu* vcpu);
+
+/* Must be implemented by architecture */
+
+size_t vdbg_arch_bp_num();
+size_t vdbg_arch_wp_num();
+bool vdbg_arch_wp_fits(vaddr_t addr, size_t len);
+bool vdbg_arch_get_reg(struct vcpu* vcpu, size_t reg, uint64_t* val,
+                       size_t* size);
+bool vdbg_arch_set_reg(struct vcpu* vcpu, size_t reg, uint64_t val);
+bool vdbg_arch_translate(struct vcpu* vcpu, vaddr_t va, bool write,
+                         paddr_t* pa);
+void vdbg_arch_sync_icache();
+void vdbg_arch_pause(struct vcpu* vcpu);
+void vdbg_arch_resume(struct vcpu* vcpu);
+void vdbg_arch_load(struct vcpu* vcpu);
+
+#endif /* __VDBG_H__ */
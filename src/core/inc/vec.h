@@ -0,0 +1,60 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __VEC_H__
+#define __VEC_H__
+
+#include <crossconhyp.h>
+
+/**
+ * Vector registers of a vcpu, or of one of its stacked activations. The
+ * buffer is only allocated once they first need to be kept in memory.
+ */
+struct vec_state {
+    void* regs;
+    /* regs holds the registers, otherwise they are all zero */
+    bool valid;
+};
+
+/* Per-VM vector configuration, see vector in struct vm_config */
+struct vvec {
+    bool enable;
+    /* Vector length in bytes, zero if the VM can not use vectors */
+    size_t vl;
+};
+
+struct vm;
+struct vcpu;
+
+void vec_init();
+void vec_vm_init(struct vm* vm);
+void vec_vcpu_reset(struct vcpu* vcpu);
+void vec_vcpu_destroy(struct vcpu* vcpu);
+void vec_vcpu_resume(struct vcpu* vcpu);
+bool vec_trap(struct vcpu* vcpu);
+void vec_flush();
+void vec_save_ctx(struct vcpu* vcpu, struct vec_state* ctx);
+void vec_restore_ctx(struct vcpu* vcpu, struct vec_state* ctx);
+void vec_hyp_get();
+void vec_hyp_put();
+
+/* Must be implemented by architecture */
+
+void vec_arch_init();
+size_t vec_arch_vl(size_t max_vl);
+size_t vec_arch_size(size_t vl);
+void vec_arch_save(struct vcpu* vcpu, void* regs);
+void vec_arch_restore(struct vcpu* vcpu, const void* regs);
+bool vec_arch_dirty(struct vcpu* vcpu);
+void vec_arch_enable(struct vcpu* vcpu, bool owner);
+void vec_arch_hyp_access(bool enable);
+
+#endif /* __VEC_H__ */
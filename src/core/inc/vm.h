@@ -32,6 +32,28 @@
 #include <iommu.h>
 #include <ipc.h>
 #include <vmm.h>
+#include <vwdt.h>
+#include <wss.h>
+#include <coredump.h>
+#include <vec.h>
+#include <vpci.h>
+#include <vcons.h>
+#include <vdbg.h>
+#include <vrr.h>
+#include <attest.h>
+
+/**
+ * Lifecycle of a VM as seen by the hypervisor. A VM leaves VM_RUNNING when it
+ * shuts itself down (VM_HALTED) or when the hypervisor gives up on it
+ * (VM_CRASHED). Halted or crashed VMs hold on to their resources but none of
+ * their vcpus run nor receive interrupts until the VM is reset.
+ */
+enum vm_state {
+    VM_RUNNING,
+    VM_HALTED,
+    VM_CRASHED,
+    VM_RESETTING,
+};
 
 struct vm {
     node_t node;
@@ -80,6 +102,49 @@ struct vm {
 	vaddr_t donor_va;
 	struct config* config;
     } vmdyn_house_keeping;
+
+    /**
+     * count is the VM's total number of faults. reports is the number
+     * reported since window, the system counter tick the current reporting
+     * window started at.
+     */
+    struct {
+        spinlock_t lock;
+        size_t count;
+        size_t reports;
+        uint64_t window;
+    } fault;
+
+    /**
+     * The image was copied from its load address, which is left untouched
+     * and can be copied from again to reset the VM.
+     */
+    bool img_copied;
+
+    /* Protected by lock */
+    enum vm_state state;
+    size_t reset_pending;
+
+    struct vwdt wdt;
+
+    struct vwss wss;
+
+    struct vcoredump coredump;
+
+    struct vvec vec;
+
+    struct vpci vpci;
+
+    struct vcons vcons;
+
+    struct vdbg dbg;
+
+    struct vrr vrr;
+
+    struct vm_measurement measurement;
+
+    /* Vector table a sdTZ TEE reported on ENTRY_DONE */
+    vaddr_t tee_vectors;
 };
 
 struct vcpu {
@@ -96,10 +161,26 @@ struct vcpu {
     struct vm* vm;
     struct list vmstack_children;
     struct vcpu* parent;
+    struct {
+        /* Frames of the cpu's VM stack this vcpu is stacked in */
+        size_t stacked;
+        /* Index of the topmost of those frames, plus one */
+        size_t top;
+    } vmstack;
+    /* Vector registers, while another vcpu owns the cpu's, see vec.c */
+    struct vec_state vec;
     struct {
 	bool initialized;
         size_t id;
     }nclv_data;
+    struct {
+        bool online;
+        bool call_pending;
+    } tee_data;
+    struct {
+        /* Held by the GDB stub, see vdbg.c */
+        bool paused;
+    } dbg;
 
     uint8_t stack[STACK_SIZE] __attribute__((aligned(STACK_SIZE)));
 };
@@ -147,12 +228,30 @@ struct hndl_mem_abort_node {
     struct hndl_mem_abort hndl_mem_abort;
 };
 
+/**
+ * Guest faults the hypervisor can not resolve and that are reflected back
+ * into the guest as the architectural equivalent exception.
+ */
+enum vcpu_fault {
+    VCPU_FAULT_DATA,
+    VCPU_FAULT_INSTR,
+    VCPU_FAULT_ALIGN,
+    VCPU_FAULT_UNDEF,
+};
+
+/**
+ * Number of guest faults reported per VM and per VM_FAULT_REPORT_PERIOD_US
+ * before reports are suppressed until the next period
+ */
+#define VM_FAULT_REPORT_MAX (16)
+#define VM_FAULT_REPORT_PERIOD_US (1000000)
+
 extern struct vm vm;
 extern struct config* vm_config_ptr;
 
 struct vcpu* vm_init(struct vm* vm, const struct vm_config* config, bool master, vmid_t vm_id);
 void vm_init_dynamic(struct vm*, struct config*, uint64_t, vmid_t vmid);
-void vm_destroy_dynamic(struct vm* vm);
+bool vm_destroy_dynamic(struct vm* vm);
 void vm_start(struct vm* vm, vaddr_t entry);
 struct vcpu* vm_get_vcpu(struct vm* vm, vcpuid_t vcpuid);
 void vm_emul_add_mem(struct vm* vm, struct emul_mem* emu);
@@ -164,6 +263,15 @@ void vm_msg_broadcast(struct vm* vm, struct cpu_msg* msg);
 cpumap_t vm_translate_to_pcpu_mask(struct vm* vm, cpumap_t mask, size_t len);
 cpumap_t vm_translate_to_vcpu_mask(struct vm* vm, cpumap_t mask, size_t len);
 struct vcpu* vcpu_get_child(struct vcpu* vcpu, int index);
+void vcpu_fault(struct vcpu* vcpu, enum vcpu_fault fault, vaddr_t addr,
+                bool write, const char* reason);
+bool vm_set_state(struct vm* vm, enum vm_state state);
+void vm_notify_manager(struct vm* vm);
+bool vm_is_manager(struct vm* vm);
+bool vm_ipa_in_mem(struct vm* vm, vaddr_t ipa, size_t size);
+void vm_halt(struct vm* vm);
+void vm_crash(struct vm* vm);
+void vm_reset(struct vm* vm);
 
 static inline cpuid_t vm_translate_to_pcpuid(struct vm* vm, vcpuid_t vcpuid)
 {
@@ -192,11 +300,19 @@ static inline bool vm_has_interrupt(struct vm* vm, irqid_t int_id)
 
 static inline void vcpu_inject_hw_irq(struct vcpu *vcpu, irqid_t id)
 {
+    if (vcpu->vm->vrr.mode != VM_REPLAY_NONE &&
+        !vrr_irq(vcpu, id, VRR_IRQ_HW)) {
+        return;
+    }
     vcpu_arch_inject_hw_irq(vcpu, id);
 }
 
 static inline void vcpu_inject_irq(struct vcpu *vcpu, irqid_t id)
 {
+    if (vcpu->vm->vrr.mode != VM_REPLAY_NONE &&
+        !vrr_irq(vcpu, id, VRR_IRQ_VIRT)) {
+        return;
+    }
     vcpu_arch_inject_irq(vcpu, id);
 }
 
@@ -212,8 +328,13 @@ unsigned long vcpu_readpc(struct vcpu* vcpu);
 void vcpu_writepc(struct vcpu* vcpu, unsigned long pc);
 void vcpu_arch_run(struct vcpu* vcpu);
 void vcpu_arch_reset(struct vcpu* vcpu, vaddr_t entry);
+void vcpu_arch_destroy(struct vcpu* vcpu);
 void vcpu_save_state(struct vcpu* vcpu);
 void vcpu_restore_state(struct vcpu* vcpu);
+void vcpu_arch_save_ctx(struct vcpu* vcpu, struct vcpu_arch_ctx* ctx);
+void vcpu_arch_restore_ctx(struct vcpu* vcpu, const struct vcpu_arch_ctx* ctx);
+void vcpu_arch_inject_fault(struct vcpu* vcpu, enum vcpu_fault fault, bool write);
+void vcpu_arch_set_power(struct vcpu* vcpu, bool on);
 
 void vm_map_img_rgn(struct vm* vm, const struct vm_config* config,
                     struct mem_region* reg);
@@ -21,7 +21,32 @@
 #include <cpu.h>
 #include <vm.h>
 
-void vmstack_push(struct vcpu* vcpu);
+#define VMSTACK_DEPTH_MAX (8)
+
+/**
+ * A vcpu stacked on a cpu's VM stack, below the vcpu pushed over it. If that
+ * vcpu was itself stacked, i.e., it was re-entered, the context of its
+ * stacked activation is kept here until it is popped.
+ */
+struct vmstack_frame {
+    struct vcpu* vcpu;
+    /* Topmost frame vcpu was stacked in before, plus one */
+    size_t prev;
+    /* Parent of the vcpu pushed over this frame before the push */
+    struct vcpu* parent;
+    bool reentry;
+    struct arch_regs regs;
+    struct vcpu_arch_ctx ctx;
+    struct vec_state vec;
+};
+
+struct vmstack {
+    size_t depth;
+    struct vmstack_frame frames[VMSTACK_DEPTH_MAX];
+};
+
+void vmstack_init();
+bool vmstack_push(struct vcpu* vcpu);
 struct vcpu* vmstack_pop();
 void vmstack_unwind(struct vcpu* vcpu);
 int64_t vmstack_hypercall(uint64_t id, uint64_t arg0, uint64_t arg1, uint64_t arg2);
@@ -0,0 +1,98 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __VPCI_H__
+#define __VPCI_H__
+
+#include <crossconhyp.h>
+#include <spinlock.h>
+
+#define PCI_BDF(bus, dev, fn) \
+    ((uint16_t)(((bus) << 8) | (((dev) & 0x1f) << 3) | ((fn) & 0x7)))
+
+#define PCI_ECAM_BUS_SIZE (0x100000)
+#define PCI_CFG_SIZE (0x1000)
+#define PCI_NUM_BARS (6)
+
+/**
+ * A physical PCIe function assigned to a VM.
+ */
+struct pci_func_config {
+    /* Bus/device/function behind the physical host bridge */
+    uint16_t bdf;
+    /* Bus/device/function the VM enumerates it at */
+    uint16_t vbdf;
+    /* Interrupt the host bridge routes the function's INTx pin to */
+    irqid_t intx;
+    /**
+     * Expose the MSI and MSI-X capabilities. Only useful if the interrupt
+     * controller's MSI doorbell is also assigned to the VM and the function's
+     * writes go through the VM's iommu context.
+     */
+    bool msi;
+    /**
+     * Bus master id for iommu effects, only valid if has_stream is set. Any
+     * id, 0 included, may be a function's stream.
+     */
+    bool has_stream;
+    streamid_t id;
+};
+
+struct vpci_bar {
+    paddr_t pa;
+    size_t size;
+    bool is64;
+    /* Where the BAR is currently mapped in the VM, NULL_VA if it is not */
+    vaddr_t mapped;
+};
+
+struct vpci_func {
+    const struct pci_func_config* config;
+    /* The function's physical configuration space, in the hypervisor */
+    volatile uint8_t* cfg;
+    /* BAR registers as the VM sees them */
+    uint32_t vbar[PCI_NUM_BARS];
+    struct vpci_bar bars[PCI_NUM_BARS];
+    uint8_t intline;
+    uint8_t cap_ptr;
+    /* Virtual next pointer of each capability, indexed by offset / 4 */
+    uint8_t cap_next[64];
+    /* Header dwords of capabilities visible to the VM */
+    uint64_t cap_visible;
+    /* Dwords belonging to capabilities hidden from the VM */
+    uint64_t cap_hidden;
+    /* Offset of the PCI Express capability, zero if there is none */
+    uint8_t pcie_cap;
+    /**
+     * The function's stream is in the VM's iommu context, so it may be let
+     * master the bus. Otherwise its DMA would reach all of memory.
+     */
+    bool dma;
+};
+
+/**
+ * Per-VM emulated PCIe host bridge. The VM gets an ECAM window of its own in
+ * which only its assigned functions are present. Their configuration space
+ * accesses are filtered and forwarded to the physical host bridge, while
+ * their BARs are mapped directly in the VM's address space.
+ */
+struct vpci {
+    spinlock_t lock;
+    size_t func_num;
+    struct vpci_func* funcs;
+};
+
+struct vm;
+
+void vpci_init(struct vm* vm, bool iommu);
+void vpci_reset(struct vm* vm);
+
+#endif /* __VPCI_H__ */
@@ -0,0 +1,110 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#ifndef __VRR_H__
+#define __VRR_H__
+
+#include <crossconhyp.h>
+#include <config.h>
+
+#define VRR_LOG_MAGIC (0x31525256) /* "VRR1" */
+
+/**
+ * Instructions before an asynchronous event at which replay switches from
+ * the instruction counter's overflow interrupt to single stepping, to make up
+ * for the interrupt's skid.
+ */
+#define VRR_STEP_MARGIN (64)
+
+enum vrr_event_type {
+    /* An interrupt injected into the VM, value holds how it was injected */
+    VRR_EV_IRQ = 1,
+    /* A value returned by an emulated device register, id is its address */
+    VRR_EV_MMIO,
+    /* A value returned by an emulated system register, id is its encoding */
+    VRR_EV_SYSREG,
+    /**
+     * A result register of a hypercall or secure monitor call, id is its
+     * function. Calls log one event per result register, in order.
+     */
+    VRR_EV_CALL,
+};
+
+enum vrr_irq_kind { VRR_IRQ_VIRT, VRR_IRQ_HW, VRR_IRQ_PASSTHROUGH };
+
+/**
+ * A nondeterministic event delivered to the VM, at the point the VM had
+ * executed icount instructions and was about to execute pc.
+ */
+struct vrr_event {
+    uint64_t icount;
+    uint64_t pc;
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t id;
+    uint64_t value;
+};
+
+/**
+ * Event log, laid out at the start of the shared memory region set in the
+ * VM's config. Recording fills it, replaying expects one in it.
+ */
+struct vrr_log {
+    uint32_t magic;
+    uint32_t vm_id;
+    /* Events in the log */
+    uint64_t num;
+    /* Events recorded after the log filled up, which are lost */
+    uint64_t lost;
+    uint64_t reserved;
+    struct vrr_event events[];
+};
+
+/**
+ * Per-VM record/replay state. Only VMs with a single vcpu are supported, so
+ * this is only touched from the VM's cpu.
+ */
+struct vrr {
+    enum vm_replay_mode mode;
+    struct vcpu* vcpu;
+    struct vrr_log* log;
+    size_t max;
+    /* Next event to replay */
+    size_t next;
+    /* Replay is single stepping up to the next asynchronous event */
+    bool stepping;
+};
+
+struct vm;
+struct vcpu;
+struct emul_access;
+
+void vrr_vm_init(struct vm* vm, struct vcpu* vcpu);
+bool vrr_irq(struct vcpu* vcpu, irqid_t id, enum vrr_irq_kind kind);
+void vrr_reg(struct vcpu* vcpu, enum vrr_event_type type, uint64_t id,
+             unsigned long reg);
+void vrr_wfi(struct vcpu* vcpu);
+void vrr_overflow(struct vcpu* vcpu);
+bool vrr_step(struct vcpu* vcpu);
+
+/* Must be implemented by architecture */
+
+bool vrr_arch_init(struct vcpu* vcpu);
+uint64_t vrr_arch_icount(struct vcpu* vcpu);
+void vrr_arch_arm(struct vcpu* vcpu, uint64_t icount);
+void vrr_arch_step(struct vcpu* vcpu, bool enable);
+void vrr_arch_wfi(struct vcpu* vcpu);
+/* Called as vcpu stops and starts running on the cpu */
+void vrr_arch_suspend(struct vcpu* vcpu);
+void vrr_arch_resume(struct vcpu* vcpu);
+
+#endif /* __VRR_H__ */
@@ -0,0 +1,48 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __VWDT_H__
+#define __VWDT_H__
+
+#include <crossconhyp.h>
+#include <spinlock.h>
+#include <timer.h>
+
+/**
+ * Virtual watchdog, modeled after the SBSA generic watchdog: once enabled it
+ * must be refreshed within offset ticks. The first expiry sets ws0 and starts
+ * a new period, the second sets ws1 and triggers the VM's watchdog action.
+ */
+struct vwdt {
+    spinlock_t lock;
+    bool enabled;
+    bool ws0;
+    bool ws1;
+    uint64_t offset;
+    uint64_t deadline;
+    /* Supervises the watchdog from the cpu that last armed it */
+    struct timer_event event;
+};
+
+struct vm;
+
+void vwdt_init(struct vm* vm);
+void vwdt_reset(struct vm* vm);
+void vwdt_enable(struct vm* vm, bool en);
+void vwdt_refresh(struct vm* vm);
+void vwdt_set_offset(struct vm* vm, uint64_t offset);
+void vwdt_set_deadline(struct vm* vm, uint64_t deadline);
+
+/* Must be implemented by architecture */
+
+void vwdt_arch_init(struct vm* vm);
+
+#endif /* __VWDT_H__ */
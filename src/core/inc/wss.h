@@ -0,0 +1,92 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#ifndef __WSS_H__
+#define __WSS_H__
+
+#include <crossconhyp.h>
+#include <spinlock.h>
+#include <timer.h>
+#include <page_table.h>
+
+/* Number of sweeps each page's access history covers */
+#define WSS_HISTORY (8)
+/* Pages are binned by the number of sweeps, out of the last WSS_HISTORY, that
+ * found them accessed */
+#define WSS_HIST_BUCKETS (WSS_HISTORY + 1)
+#define WSS_REGIONS_MAX (8)
+#define WSS_REPORT_VERSION (1)
+
+struct wss_region_stats {
+    uint64_t base;
+    uint64_t pages;
+    uint64_t hist[WSS_HIST_BUCKETS];
+};
+
+/**
+ * Working-set report, as written to the caller's memory by HC_WSS. wss_pages
+ * counts the pages found accessed by the last sweep, active_pages those found
+ * accessed by any of the last WSS_HISTORY sweeps.
+ */
+struct wss_report {
+    uint32_t version;
+    uint32_t vm_id;
+    uint64_t page_size;
+    uint64_t interval_us;
+    uint64_t sweeps;
+    uint64_t total_pages;
+    uint64_t wss_pages;
+    uint64_t active_pages;
+    uint64_t region_num;
+    struct wss_region_stats regions[WSS_REGIONS_MAX];
+};
+
+/**
+ * Per-VM working-set estimator. A sweep walks the stage-2 mappings of the
+ * VM's memory regions, shifting each page's access flag into its history and
+ * clearing it. Sweeps are split in chunks of at most WSS_SCAN_PAGES pages,
+ * each run from the VM's master cpu timer queue, and start every interval.
+ */
+struct vwss {
+    bool enabled;
+    struct timer_event event;
+    uint64_t interval;
+
+    /* Only touched by the master cpu, while sweeping */
+    uint8_t* history;
+    size_t region;
+    vaddr_t cursor;
+    size_t cursor_page;
+    size_t accessed;
+    struct wss_region_stats acc[WSS_REGIONS_MAX];
+
+    /* Results of the last full sweep, protected by lock */
+    spinlock_t lock;
+    uint64_t sweeps;
+    uint64_t wss_pages;
+    size_t region_num;
+    struct wss_region_stats stats[WSS_REGIONS_MAX];
+};
+
+struct vm;
+
+void wss_init(struct vm* vm);
+bool wss_access_fault(struct vm* vm, vaddr_t addr);
+unsigned long wss_hypercall(unsigned long vm_id, unsigned long report_ipa,
+                            unsigned long arg2);
+
+/* Must be implemented by architecture */
+
+bool wss_arch_test_and_clear(pte_t* pte);
+void wss_arch_set_accessed(pte_t* pte);
+bool wss_arch_access_fault(pte_t* pte);
+
+#endif /* __WSS_H__ */
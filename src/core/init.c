@@ -23,6 +23,9 @@
 #include <printk.h>
 #include <platform.h>
 #include <vmm.h>
+#include <timer.h>
+#include <vcons.h>
+#include <lu.h>
 
 void init(cpuid_t cpu_id, paddr_t load_addr, paddr_t config_addr)
 {
@@ -53,10 +56,18 @@ void init(cpuid_t cpu_id, paddr_t load_addr, paddr_t config_addr)
                "          __/ | |                                      \n\r"
                "         |___/|_| \n\r"
                "\n\r");
+
+        cache_check_colors(vm_config_ptr);
     }
 
     interrupts_init();
 
+    timer_init();
+
+    vcons_init();
+
+    lu_init(load_addr, config_addr);
+
     vmm_init();
 
     /* Should never reach here */
@@ -69,7 +69,17 @@ static inline bool interrupt_is_reserved(irqid_t int_id)
 
 inline void interrupts_vm_inject(struct vcpu* vcpu, uint64_t id)
 {
-   interrupts_arch_vm_inject(vcpu, id);
+    if (vcpu->vm->vrr.mode != VM_REPLAY_NONE &&
+        !vrr_irq(vcpu, id, VRR_IRQ_PASSTHROUGH)) {
+        /**
+         * The live interrupt is dropped while replaying. The guest never
+         * sees it, so it is deactivated here, or it would stay active once
+         * the VM carries on live.
+         */
+        interrupts_arch_clear(id);
+        return;
+    }
+    interrupts_arch_vm_inject(vcpu, id);
 }
 
 static inline uint64_t interrupts_get_vmid(uint64_t int_id)
@@ -126,6 +136,21 @@ void interrupts_vm_assign(struct vm *vm, irqid_t id)
     bitmap_set(global_interrupt_bitmap, id);
 }
 
+/**
+ * Masks, on the local cpu, the interrupts passed through to vm that are not
+ * shared with other VMs. They are enabled again by the guest itself through
+ * the virtual interrupt controller.
+ */
+void interrupts_vm_disable(struct vm *vm)
+{
+    for (irqid_t id = 0; id < MAX_INTERRUPTS; id++) {
+        if (vm_has_interrupt(vm, id) && !interrupts_is_shared(id) &&
+            !interrupt_is_reserved(id)) {
+            interrupts_cpu_enable(id, false);
+        }
+    }
+}
+
 void interrupts_reserve(irqid_t int_id, irq_handler_t handler)
 {
     if (int_id < MAX_INTERRUPTS) {
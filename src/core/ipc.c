@@ -19,6 +19,7 @@
 #include <cpu.h>
 #include <vmm.h>
 #include <hypercall.h>
+#include <lu.h>
 
 enum {IPC_NOTIFY};
 
@@ -73,6 +74,28 @@ static void ipc_handler(uint32_t event, uint64_t data){
 }
 CPU_MSG_HANDLER(ipc_handler, IPC_CPUSMG_ID);
 
+void ipc_notify_event(size_t shmem_id, size_t event_id, cpumap_t exclude)
+{
+    struct shmem *shmem = ipc_get_shmem(shmem_id);
+    if(shmem == NULL) {
+        return;
+    }
+
+    cpumap_t ipc_cpu_masters = shmem->cpu_masters & ~exclude;
+
+    union ipc_msg_data data = {
+        .shmem_id = shmem_id,
+        .event_id = event_id,
+    };
+    struct cpu_msg msg = {IPC_CPUSMG_ID, IPC_NOTIFY, data.raw};
+
+    for (size_t i = 0; i < platform.cpu_num; i++) {
+        if (ipc_cpu_masters & (1ULL << i)) {
+            cpu_send_msg(i, &msg);
+        }
+    }
+}
+
 unsigned long ipc_hypercall(struct vcpu *vcpu, unsigned long ipc_id, unsigned long ipc_event,
                                                 unsigned long arg2)
 {
@@ -86,21 +109,8 @@ unsigned long ipc_hypercall(struct vcpu *vcpu, unsigned long ipc_id, unsigned lo
     bool valid_shmem = shmem != NULL;
 
     if(valid_ipc_obj && valid_shmem) {
-
-        cpumap_t ipc_cpu_masters = shmem->cpu_masters & ~vcpu->vm->cpus;
-
-        union ipc_msg_data data = {
-            .shmem_id = vcpu->vm->ipcs[ipc_id].shmem_id,
-            .event_id = ipc_event,
-        };
-        struct cpu_msg msg = {IPC_CPUSMG_ID, IPC_NOTIFY, data.raw};
-
-        for (size_t i = 0; i < platform.cpu_num; i++) {
-            if (ipc_cpu_masters & (1ULL << i)) {
-                cpu_send_msg(i, &msg);
-            }
-        }
-
+        ipc_notify_event(vcpu->vm->ipcs[ipc_id].shmem_id, ipc_event,
+                         vcpu->vm->cpus);
     } else {
         ret = -HC_E_INVAL_ARGS;
     }
@@ -108,12 +118,33 @@ unsigned long ipc_hypercall(struct vcpu *vcpu, unsigned long ipc_id, unsigned lo
     return ret;
 }
 
+/* Largest stage-2 granule, in pages, of config's VM and those it hosts */
+static size_t ipc_granule_pages(const struct vm_config* config) {
+    size_t align = max(config->stage2_granule / PAGE_SIZE, 1);
+    for (size_t i = 0; i < config->children_num; i++) {
+        size_t child = ipc_granule_pages(config->children[i]);
+        align = max(align, child);
+    }
+    return align;
+}
+
 static void ipc_alloc_shmem() {
+    /* Shared memory must be mappable with any VM's stage-2 granule */
+    size_t align = 1;
+    for (size_t i = 0; i < vm_config_ptr->vmlist_size; i++) {
+        size_t granule = ipc_granule_pages(vm_config_ptr->vmlist[i]);
+        align = max(align, granule);
+    }
+
     for (size_t i = 0; i < shmem_table_size; i++) {
         struct shmem *shmem = &shmem_table[i];
         if(!shmem->place_phys) {
+            if (lu_shmem_phys(i, &shmem->phys)) {
+                continue;
+            }
             size_t n_pg = NUM_PAGES(shmem->size);
-            struct ppages ppages = mem_alloc_ppages(shmem->colors, n_pg, false);
+            struct ppages ppages =
+                mem_alloc_ppages_align(shmem->colors, n_pg, align);
             if(ppages.size < n_pg) {
                 ERROR("failed to allocate shared memory");
             }
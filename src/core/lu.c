@@ -0,0 +1,738 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#include <lu.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <cache.h>
+#include <config.h>
+#include <string.h>
+#include <timer.h>
+#include <fences.h>
+#include <hypercall.h>
+
+/**
+ * Live update. The manager VM hands over a new hypervisor image, which is
+ * staged in free memory. Every cpu then stops its vcpu and the cpu running
+ * each VM's vcpu 0 writes the VM's state to the new image: where its memory
+ * is, its interrupt controller and each vcpu's registers. All cpus but the
+ * one the request came from power off and that one jumps to the new image,
+ * which boots as usual but, instead of setting up the VMs afresh, keeps
+ * their memory and resumes them where they were stopped.
+ *
+ * The new image must be built for the same configuration, as VMs are told
+ * apart by their index in it and everything not in the handed over state,
+ * such as devices and shared memory mappings, is set up again from it. It
+ * must also come with its HMAC-SHA256 under the attestation key, as the
+ * manager VM is not trusted to run code at the hypervisor's privilege.
+ */
+
+#if LU_STATE_SIZE > 0
+static uint8_t lu_state_buf[LU_STATE_SIZE]
+    __attribute__((section(".lu_state"), aligned(PAGE_SIZE)));
+#else
+static uint8_t* const lu_state_buf = NULL;
+#endif
+
+static paddr_t lu_load_addr;
+static paddr_t lu_config_addr;
+
+/* State handed over to this image, NULL if it booted normally */
+static struct lu_state* lu_resume;
+static bool lu_resume_checked;
+static size_t lu_resume_cpus;
+static size_t lu_resumed_cpus;
+
+static spinlock_t lu_lock = SPINLOCK_INITVAL;
+
+/* Update in progress, written under lu_lock until the cpus are stopped */
+static struct {
+    volatile bool pending;
+    volatile bool failed;
+    cpuid_t master;
+    paddr_t entry;
+    vaddr_t staged;
+    size_t staged_pages;
+    struct lu_state* state;
+    size_t capacity;
+    size_t used;
+} lu;
+
+static void lu_msg_handler(uint32_t event, uint64_t data);
+CPU_MSG_HANDLER(lu_msg_handler, LU_CPUMSG_ID);
+
+static bool lu_digest_equal(const uint8_t* a, const uint8_t* b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+static void lu_state_digest(struct lu_state* state,
+                            uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    size_t off = offsetof(struct lu_state, config);
+    struct sha256 ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, (uint8_t*)state + off, state->size - off);
+    sha256_final(&ctx, digest);
+}
+
+static inline struct lu_shmem* lu_state_shmem(struct lu_state* state)
+{
+    return (struct lu_shmem*)state->data;
+}
+
+static inline struct lu_vm* lu_state_vm(struct lu_state* state)
+{
+    return (struct lu_vm*)(state->data +
+                           state->shmem_num * sizeof(struct lu_shmem));
+}
+
+static inline struct lu_vm* lu_vm_next(struct lu_vm* rec)
+{
+    return (struct lu_vm*)((uint8_t*)rec + rec->size);
+}
+
+static inline struct lu_extent* lu_vm_extents(struct lu_vm* rec)
+{
+    return (struct lu_extent*)rec->data;
+}
+
+static inline uint8_t* lu_vm_arch(struct lu_vm* rec)
+{
+    return rec->data + rec->extent_num * sizeof(struct lu_extent);
+}
+
+static inline size_t lu_vcpu_rec_size(size_t arch_size)
+{
+    return sizeof(uint64_t) + arch_size;
+}
+
+static struct lu_state* lu_state_get()
+{
+    if (!lu_resume_checked) {
+        struct lu_state* state = (struct lu_state*)lu_state_buf;
+        uint8_t digest[SHA256_DIGEST_SIZE];
+
+        lu_resume_checked = true;
+        if (state != NULL && state->magic == LU_STATE_MAGIC && state->version == LU_VERSION &&
+            state->size >= sizeof(struct lu_state) &&
+            state->size <= LU_STATE_SIZE) {
+            lu_state_digest(state, digest);
+            if (lu_digest_equal(digest, state->digest)) {
+                lu_resume = state;
+            }
+        }
+    }
+
+    return lu_resume;
+}
+
+static size_t lu_config_idx(const struct vm_config* config)
+{
+    size_t i;
+    for (i = 0; i < vm_config_ptr->vmlist_size; i++) {
+        if (vm_config_ptr->vmlist[i] == config) break;
+    }
+    return i;
+}
+
+static struct lu_vm* lu_vm_find(struct vm* vm)
+{
+    struct lu_state* state = lu_state_get();
+    if (state == NULL) return NULL;
+
+    size_t idx = lu_config_idx(vm->config);
+    struct lu_vm* rec = lu_state_vm(state);
+    for (size_t i = 0; i < state->vm_num; i++, rec = lu_vm_next(rec)) {
+        if (rec->config_idx == idx) return rec;
+    }
+
+    return NULL;
+}
+
+void lu_init(paddr_t load_addr, paddr_t config_addr)
+{
+    if (cpu.id != CPU_MASTER) return;
+
+    lu_load_addr = load_addr;
+    lu_config_addr = config_addr;
+
+    struct lu_state* state = lu_state_get();
+    if (state == NULL) return;
+
+    uint8_t config[SHA256_DIGEST_SIZE];
+    attest_get_root_config(config);
+    if (!lu_digest_equal(config, state->config)) {
+        ERROR("live update to a different configuration");
+    }
+
+    struct lu_vm* rec = lu_state_vm(state);
+    for (size_t i = 0; i < state->vm_num; i++, rec = lu_vm_next(rec)) {
+        lu_resume_cpus += rec->vcpu_num;
+    }
+
+    INFO("Live update: resuming %d VMs", state->vm_num);
+}
+
+/**
+ * Iterates over the memory the VMs handed over to this image already hold,
+ * which must be kept out of the page pools. Memory placed by the
+ * configuration is reserved along with it and left out.
+ */
+bool lu_reserved_ppages(size_t index, struct ppages* ppages)
+{
+    struct lu_state* state = lu_state_get();
+    if (state == NULL) return false;
+
+    struct lu_shmem* shmem = lu_state_shmem(state);
+    for (size_t i = 0; i < state->shmem_num; i++) {
+        if (shmem[i].size != 0 && index-- == 0) {
+            *ppages = mem_ppages_get(shmem[i].pa, NUM_PAGES(shmem[i].size));
+            return true;
+        }
+    }
+
+    struct lu_vm* rec = lu_state_vm(state);
+    for (size_t i = 0; i < state->vm_num; i++, rec = lu_vm_next(rec)) {
+        struct lu_extent* ext = lu_vm_extents(rec);
+        for (size_t j = 0; j < rec->extent_num; j++) {
+            if (!ext[j].fixed && index-- == 0) {
+                *ppages = mem_ppages_get(ext[j].pa, NUM_PAGES(ext[j].size));
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool lu_shmem_phys(size_t shmem_id, paddr_t* pa)
+{
+    struct lu_state* state = lu_state_get();
+    if (state == NULL || shmem_id >= state->shmem_num) return false;
+
+    struct lu_shmem* shmem = &lu_state_shmem(state)[shmem_id];
+    if (shmem->size == 0) return false;
+
+    *pa = shmem->pa;
+    return true;
+}
+
+/**
+ * Maps the memory a VM handed over to this image as it was, instead of
+ * setting it up from the configuration. Returns false if the VM was not
+ * handed over.
+ */
+bool lu_vm_map(struct vm* vm)
+{
+    struct lu_vm* rec = lu_vm_find(vm);
+    if (rec == NULL) return false;
+
+    struct lu_extent* ext = lu_vm_extents(rec);
+    for (size_t i = 0; i < rec->extent_num; i++) {
+        size_t n = NUM_PAGES(ext[i].size);
+        struct ppages ppages = mem_ppages_get(ext[i].pa, n);
+        vaddr_t va = mem_alloc_vpage(&vm->as, SEC_VM_ANY, ext[i].va, n);
+        if (va != ext[i].va ||
+            !mem_map(&vm->as, va, &ppages, n, vm->as.vm_flags)) {
+            ERROR("failed to restore VM %d memory at 0x%lx", vm->id,
+                  ext[i].va);
+        }
+    }
+    vm->measurement = rec->measurement;
+
+    INFO("VM %d keeps its memory across the live update", vm->id);
+
+    return true;
+}
+
+/**
+ * Resumes the vcpu, and its VM if it is vcpu 0, from the state handed over
+ * to this image. Must be called on every cpu of the VM once all of its vcpus
+ * exist and before any of them runs.
+ */
+void lu_vcpu_restore(struct vcpu* vcpu)
+{
+    struct vm* vm = vcpu->vm;
+    struct lu_vm* rec = lu_vm_find(vm);
+    if (rec == NULL) return;
+
+    if (rec->vcpu_num != vm->cpu_num ||
+        rec->arch_size != ALIGN(lu_arch_vm_size(vm), sizeof(uint64_t)) ||
+        rec->vcpu_arch_size != ALIGN(lu_arch_vcpu_size(), sizeof(uint64_t))) {
+        ERROR("VM %d state does not fit this hypervisor", vm->id);
+    }
+
+    if (vcpu->id == 0) {
+        lu_arch_vm_restore(vm, lu_vm_arch(rec));
+        spin_lock(&vm->lock);
+        vm->state = rec->state;
+        spin_unlock(&vm->lock);
+        if (vm->state != VM_RUNNING) {
+            interrupts_vm_disable(vm);
+        }
+    }
+
+    uint8_t* vcpu_rec = lu_vm_arch(rec) + rec->arch_size;
+    for (size_t i = 0; i < rec->vcpu_num; i++) {
+        if (*(uint64_t*)vcpu_rec == vcpu->id) {
+            lu_arch_vcpu_restore(vcpu, vcpu_rec + sizeof(uint64_t));
+        }
+        vcpu_rec += lu_vcpu_rec_size(rec->vcpu_arch_size);
+    }
+
+    cpu_sync_barrier(&vm->sync);
+
+    bool last;
+    spin_lock(&lu_lock);
+    last = ++lu_resumed_cpus == lu_resume_cpus;
+    spin_unlock(&lu_lock);
+
+    if (last) {
+        uint64_t downtime = timer_get_counter() - lu_resume->quiesced;
+        INFO("Live update done, VMs were stopped for %d us",
+             (downtime * 1000000) / timer_get_freq());
+        lu_resume->magic = 0;
+    }
+}
+
+static bool lu_translate(struct addr_space* as, vaddr_t va, paddr_t* pa,
+                         size_t* size)
+{
+    for (size_t lvl = 0; lvl < as->pt.dscr->lvls; lvl++) {
+        pte_t* pte = pt_get_pte(&as->pt, lvl, va);
+        if (!pte_valid(pte)) break;
+        if (pte_page(&as->pt, pte, lvl)) {
+            size_t lvl_size = pt_lvlsize(&as->pt, lvl);
+            size_t off = va - ALIGN_FLOOR(va, lvl_size);
+            *pa = pte_addr(pte) + off;
+            *size = lvl_size - off;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Looks up where the VM's memory regions are mapped, merging physically
+ * contiguous ranges. An image mapped in place is kept apart from the rest of
+ * its region, as it is part of the configuration. Returns more than max if
+ * the extents do not fit.
+ */
+static size_t lu_save_extents(struct vm* vm, struct lu_extent* ext, size_t max)
+{
+    const struct vm_config* config = vm->config;
+    vaddr_t img_beg = config->image.base_addr;
+    vaddr_t img_end = img_beg + ALIGN(config->image.size, PAGE_SIZE);
+    size_t num = 0;
+
+    for (size_t i = 0; i < config->platform.region_num; i++) {
+        struct mem_region* reg = &config->platform.regions[i];
+        vaddr_t va = reg->base;
+        vaddr_t end = reg->base + ALIGN(reg->size, PAGE_SIZE);
+
+        while (va < end) {
+            paddr_t pa;
+            size_t size;
+
+            if (!lu_translate(&vm->as, va, &pa, &size)) {
+                va += PAGE_SIZE;
+                continue;
+            }
+
+            size = min(size, end - va);
+            if (va < img_beg && va + size > img_beg) {
+                size = img_beg - va;
+            } else if (va < img_end && va + size > img_end) {
+                size = img_end - va;
+            }
+
+            bool fixed = reg->place_phys ||
+                         range_in_range(pa, size, config->image.load_addr,
+                                        img_end - img_beg);
+
+            struct lu_extent* prev = num > 0 ? &ext[num - 1] : NULL;
+            if (prev != NULL && prev->va + prev->size == va &&
+                prev->pa + prev->size == pa && prev->fixed == fixed) {
+                prev->size += size;
+            } else if (num < max) {
+                ext[num++] = (struct lu_extent){va, pa, size, fixed};
+            } else {
+                return max + 1;
+            }
+
+            va += size;
+        }
+    }
+
+    return num;
+}
+
+static void lu_save_vm(struct vm* vm)
+{
+    size_t idx = lu_config_idx(vm->config);
+    if (idx >= vm_config_ptr->vmlist_size) return;
+
+    size_t arch_size = ALIGN(lu_arch_vm_size(vm), sizeof(uint64_t));
+    size_t vcpu_arch_size = ALIGN(lu_arch_vcpu_size(), sizeof(uint64_t));
+    size_t fixed_size = sizeof(struct lu_vm) + arch_size +
+                        vm->cpu_num * lu_vcpu_rec_size(vcpu_arch_size);
+
+    spin_lock(&lu_lock);
+
+    struct lu_vm* rec = (struct lu_vm*)((uint8_t*)lu.state + lu.used);
+    size_t avail = lu.capacity - lu.used;
+    size_t max = avail > fixed_size
+                     ? (avail - fixed_size) / sizeof(struct lu_extent)
+                     : 0;
+    size_t extent_num = lu_save_extents(vm, lu_vm_extents(rec), max);
+
+    if (avail < fixed_size || extent_num > max) {
+        WARNING("Live update: no room for VM %d state", vm->id);
+        lu.failed = true;
+    } else {
+        rec->config_idx = idx;
+        rec->state = vm->state;
+        rec->measurement = vm->measurement;
+        rec->extent_num = extent_num;
+        rec->arch_size = arch_size;
+        rec->vcpu_num = vm->cpu_num;
+        rec->vcpu_arch_size = vcpu_arch_size;
+
+        uint8_t* data = lu_vm_arch(rec);
+        lu_arch_vm_save(vm, data);
+        data += arch_size;
+        for (vcpuid_t i = 0; i < vm->cpu_num; i++) {
+            struct vcpu* vcpu = vm_get_vcpu(vm, i);
+            *(uint64_t*)data = vcpu->id;
+            lu_arch_vcpu_save(vcpu, data + sizeof(uint64_t));
+            data += lu_vcpu_rec_size(vcpu_arch_size);
+        }
+
+        rec->size = (size_t)(data - (uint8_t*)rec);
+        lu.used += rec->size;
+        lu.state->vm_num++;
+    }
+
+    spin_unlock(&lu_lock);
+}
+
+static void lu_finish()
+{
+    struct lu_state* state = lu.state;
+
+    state->version = LU_VERSION;
+    state->size = lu.used;
+    lu_state_digest(state, state->digest);
+    state->magic = LU_STATE_MAGIC;
+    cache_flush_range(lu.staged, lu.staged_pages * PAGE_SIZE);
+
+    /* The new image sets the configuration up again, from where it is */
+    size_t config_size = vm_config_ptr->config_header_size;
+    config_adjust_from_va(vm_config_ptr, lu_config_addr);
+    cache_flush_range((vaddr_t)vm_config_ptr, config_size);
+
+    INFO("Live update: handing %d VMs over to the new image", state->vm_num);
+
+    lu_arch_jump(lu_load_addr, lu.entry, lu_config_addr);
+}
+
+/**
+ * Stops the local cpu for the update. Every cpu saves the state of the vcpu
+ * it runs, along with any it holds lazily in its registers, and, once all
+ * have, the cpus running a vcpu 0 write their VMs to the new image. If one does not fit, the update is called off and the vcpus
+ * resume, as nothing but their saved state was touched.
+ */
+static void lu_quiesce()
+{
+    struct vcpu* vcpu = cpu.vcpu;
+
+    if (vcpu != NULL) {
+        vcpu_save_state(vcpu);
+    }
+    lu_arch_cpu_quiesce();
+
+    cpu_sync_barrier(&cpu_glb_sync);
+
+    if (vcpu != NULL && vcpu->id == 0) {
+        lu_save_vm(vcpu->vm);
+    }
+
+    cpu_sync_barrier(&cpu_glb_sync);
+
+    if (lu.failed) {
+        if (cpu.id == lu.master) {
+            vcpu_writereg(vcpu, 0, -HC_E_FAILURE);
+            mem_free_vpage(&cpu.as, lu.staged, lu.staged_pages, true);
+            lu.pending = false;
+        }
+        cpu_sync_barrier(&cpu_glb_sync);
+        if (vcpu != NULL) {
+            vcpu_restore_state(vcpu);
+        }
+        return;
+    }
+
+    if (cpu.id != lu.master) {
+        lu_arch_cpu_off();
+    }
+
+    lu_finish();
+}
+
+static void lu_msg_handler(uint32_t event, uint64_t data)
+{
+    /**
+     * Nothing to do here, the message only gets the cpu out of the VM. The
+     * update runs from lu_cpu_exit, once the message's interrupt is
+     * completed, as the new image would never complete it.
+     */
+}
+
+void lu_cpu_exit()
+{
+    if (lu.pending) {
+        lu_quiesce();
+    }
+}
+
+static bool lu_vm_supported(const struct vm_config* config)
+{
+    return config->children_num == 0 && config->platform.pci.func_num == 0 &&
+           !config->debug.enable && config->replay.mode == VM_REPLAY_NONE;
+}
+
+static bool lu_image_valid(const struct lu_image_header* hdr, size_t size)
+{
+    if (hdr->magic != LU_IMAGE_MAGIC || hdr->version != LU_VERSION ||
+        hdr->dmem_phys_beg <= hdr->image_start ||
+        hdr->state_start < hdr->image_start ||
+        hdr->state_size < sizeof(struct lu_state)) {
+        return false;
+    }
+
+    size_t footprint = hdr->dmem_phys_beg - hdr->image_start;
+    size_t state_off = hdr->state_start - hdr->image_start + hdr->extra;
+
+    return size <= state_off && state_off + hdr->state_size <= footprint;
+}
+
+/* Size of the root page pool's bitmap, which the image places after itself */
+static size_t lu_bitmap_pages()
+{
+    size_t pages = 0;
+
+    for (size_t i = 0; i < platform.region_num; i++) {
+        size_t n = NUM_PAGES(platform.regions[i].size);
+        pages = max(pages, NUM_PAGES(ALIGN(n, 8) / 8));
+    }
+
+    return pages;
+}
+
+/**
+ * Checks the staged image against the MAC the caller gave along with it,
+ * which must not cross a page boundary. The MAC is read into the
+ * hypervisor's memory before the comparison and the image is only hashed
+ * once copied, so the caller cannot change either after the check.
+ */
+static bool lu_image_authentic(struct vm* caller, unsigned long mac_ipa,
+                               const void* image, size_t size)
+{
+    uint8_t mac[SHA256_DIGEST_SIZE];
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    size_t off = mac_ipa & PAGE_OFFSET_MASK;
+
+    if (off + sizeof(mac) > PAGE_SIZE ||
+        !vm_ipa_in_mem(caller, mac_ipa, sizeof(mac))) {
+        return false;
+    }
+
+    vaddr_t va = mem_map_cpy(&caller->as, &cpu.as, mac_ipa & PAGE_FRAME_MASK,
+                             NULL_VA, 1);
+    memcpy(mac, (void*)(va + off), sizeof(mac));
+    mem_free_vpage(&cpu.as, va, 1, false);
+
+    sha256_hmac(vm_config_ptr->attestation.key,
+                sizeof(vm_config_ptr->attestation.key), image, size, expected);
+
+    return lu_digest_equal(mac, expected);
+}
+
+/**
+ * Stages the image of size bytes at image_ipa in the calling VM's memory and
+ * starts the update, if the image's HMAC-SHA256 under the attestation key
+ * matches the one at mac_ipa. The update happens as the call returns, so the
+ * caller only resumes once the new image is running. Only the manager VM may
+ * call it.
+ */
+unsigned long lu_hypercall(unsigned long image_ipa, unsigned long size,
+                           unsigned long mac_ipa)
+{
+    struct vm* caller = cpu.vcpu->vm;
+    struct lu_image_header hdr;
+
+    if (!vm_config_ptr->live_update.enable ||
+        !vm_config_ptr->attestation.enable || !lu_arch_supported() ||
+        !all_clrs(vm_config_ptr->hyp_colors)) {
+        return -HC_E_FAILURE;
+    }
+
+    if (!vm_is_manager(caller)) {
+        return -HC_E_INVAL_ID;
+    }
+
+    for (size_t i = 0; i < vm_config_ptr->vmlist_size; i++) {
+        if (!lu_vm_supported(vm_config_ptr->vmlist[i])) {
+            return -HC_E_FAILURE;
+        }
+    }
+
+    if (size < LU_IMAGE_HEADER_OFF + sizeof(hdr) ||
+        !vm_ipa_in_mem(caller, image_ipa, size)) {
+        return -HC_E_INVAL_ARGS;
+    }
+
+    size_t off = image_ipa & PAGE_OFFSET_MASK;
+    size_t n = NUM_PAGES(off + size);
+    vaddr_t va = mem_map_cpy(&caller->as, &cpu.as, image_ipa & PAGE_FRAME_MASK,
+                             NULL_VA, n);
+    void* image = (void*)(va + off);
+
+    memcpy(&hdr, (uint8_t*)image + LU_IMAGE_HEADER_OFF, sizeof(hdr));
+    if (!lu_image_valid(&hdr, size)) {
+        mem_free_vpage(&cpu.as, va, n, false);
+        return -HC_E_INVAL_ARGS;
+    }
+
+    spin_lock(&lu_lock);
+    if (lu.pending) {
+        spin_unlock(&lu_lock);
+        mem_free_vpage(&cpu.as, va, n, false);
+        return -HC_E_FAILURE;
+    }
+
+    /**
+     * The image, its cpus' memory and the root page pool's bitmap. It is
+     * aligned to its size, rounded up to a power of two, so that it does not
+     * cross the boundary of the block the image's boot code maps it with.
+     */
+    size_t footprint = NUM_PAGES(hdr.dmem_phys_beg - hdr.image_start);
+    size_t pages = footprint + platform.cpu_num * NUM_PAGES(hdr.cpu_size) +
+                   lu_bitmap_pages();
+    size_t staged_pages = 1;
+    while (staged_pages < pages) {
+        staged_pages <<= 1;
+    }
+
+    struct ppages ppages = mem_alloc_ppages(cpu.as.colors, staged_pages, true);
+    if (ppages.size != staged_pages) {
+        spin_unlock(&lu_lock);
+        mem_free_vpage(&cpu.as, va, n, false);
+        return -HC_E_FAILURE;
+    }
+
+    lu.staged = mem_alloc_vpage(&cpu.as, SEC_HYP_GLOBAL, NULL_VA, staged_pages);
+    mem_map(&cpu.as, lu.staged, &ppages, staged_pages, PTE_HYP_FLAGS);
+    memcpy((void*)lu.staged, image, size);
+    mem_free_vpage(&cpu.as, va, n, false);
+
+    if (!lu_image_authentic(caller, mac_ipa, (void*)lu.staged, size)) {
+        mem_free_vpage(&cpu.as, lu.staged, staged_pages, true);
+        spin_unlock(&lu_lock);
+        WARNING("Live update: image MAC does not match");
+        return -HC_E_INVAL_ARGS;
+    }
+
+    lu.staged_pages = staged_pages;
+    lu.entry = ppages.base;
+    lu.master = cpu.id;
+    lu.failed = false;
+    lu.state = (struct lu_state*)(lu.staged + hdr.state_start -
+                                  hdr.image_start + hdr.extra);
+    lu.capacity = hdr.state_size;
+
+    struct lu_state* state = lu.state;
+    memset(state, 0, sizeof(struct lu_state));
+    attest_get_root_config(state->config);
+    state->shmem_num = vm_config_ptr->shmemlist_size;
+    struct lu_shmem* shmem = lu_state_shmem(state);
+    for (size_t i = 0; i < state->shmem_num; i++) {
+        struct shmem* cfg = &vm_config_ptr->shmemlist[i];
+        shmem[i].pa = cfg->phys;
+        shmem[i].size = cfg->place_phys ? 0 : cfg->size;
+    }
+    lu.used = (size_t)((uint8_t*)lu_state_vm(state) - (uint8_t*)state);
+
+    INFO("Live update: staged %d byte image at 0x%lx", size, ppages.base);
+
+    state->quiesced = timer_get_counter();
+    fence_sync_write();
+    lu.pending = true;
+
+    spin_unlock(&lu_lock);
+
+    struct cpu_msg msg = {LU_CPUMSG_ID, 0, 0};
+    for (cpuid_t id = 0; id < platform.cpu_num; id++) {
+        cpu_send_msg(id, &msg);
+    }
+
+    return HC_E_SUCCESS;
+}
+
+__attribute__((weak)) bool lu_arch_supported()
+{
+    return false;
+}
+
+__attribute__((weak)) size_t lu_arch_vm_size(struct vm* vm)
+{
+    return 0;
+}
+
+__attribute__((weak)) void lu_arch_vm_save(struct vm* vm, void* buf) {}
+
+__attribute__((weak)) void lu_arch_vm_restore(struct vm* vm, const void* buf)
+{
+}
+
+__attribute__((weak)) size_t lu_arch_vcpu_size()
+{
+    return 0;
+}
+
+__attribute__((weak)) void lu_arch_vcpu_save(struct vcpu* vcpu, void* buf) {}
+
+__attribute__((weak)) void lu_arch_vcpu_restore(struct vcpu* vcpu,
+                                                const void* buf)
+{
+}
+
+__attribute__((weak)) void lu_arch_cpu_quiesce() {}
+
+__attribute__((weak)) void lu_arch_cpu_off()
+{
+    ERROR("live update not supported");
+}
+
+__attribute__((weak)) void lu_arch_jump(paddr_t load_addr, paddr_t entry,
+                                        paddr_t config_addr)
+{
+    ERROR("live update not supported");
+}
@@ -27,8 +27,10 @@
 #include <vm.h>
 #include <fences.h>
 #include <tlb.h>
+#include <lu.h>
 
-extern uint8_t _image_start, _image_load_end, _image_end, _dmem_phys_beg,
+extern uint8_t _image_start, _image_ro_end, _image_load_end, _image_end,
+     _devices_beg, _dmem_phys_beg,
      _dmem_beg, _cpu_private_beg, _cpu_private_end, _vm_beg, _vm_end,
      _config_start,  _config_end;
 
@@ -50,7 +52,7 @@ struct section hyp_secs[] = {
     [SEC_HYP_GLOBAL] = {(vaddr_t)&_dmem_beg, (vaddr_t)&_cpu_private_beg - 1, true,
                         SPINLOCK_INITVAL},
     [SEC_HYP_IMAGE] = {(vaddr_t)&_image_start, (vaddr_t)&_image_end - 1, true, SPINLOCK_INITVAL},
-    [SEC_HYP_DEVICE] = {(vaddr_t)&_image_end, (vaddr_t)&_dmem_beg - 1, true, SPINLOCK_INITVAL},
+    [SEC_HYP_DEVICE] = {(vaddr_t)&_devices_beg, (vaddr_t)&_dmem_beg - 1, true, SPINLOCK_INITVAL},
     [SEC_HYP_PRIVATE] = {(vaddr_t)&_cpu_private_beg, (vaddr_t)&_cpu_private_end - 1, false,
                          SPINLOCK_INITVAL},
     [SEC_HYP_VM] = {(vaddr_t)&_vm_beg, (vaddr_t)&_vm_end - 1, true, SPINLOCK_INITVAL},
@@ -95,6 +97,39 @@ static inline size_t pp_next_clr(paddr_t base, size_t from, colormap_t colors)
     return index;
 }
 
+/**
+ * The colored pages of ppages past its first n, which are not contiguous
+ * with them unless ppages has all colors.
+ */
+static struct ppages pp_skip(struct ppages ppages, size_t n)
+{
+    size_t index = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        index = pp_next_clr(ppages.base, index, ppages.colors) + 1;
+    }
+    index = pp_next_clr(ppages.base, index, ppages.colors);
+
+    ppages.base += index * PAGE_SIZE;
+    ppages.size -= n;
+    return ppages;
+}
+
+/* Whether the n pages from index on are all colored, starting at paddr */
+static bool pp_clr_run(struct ppages *ppages, paddr_t paddr, size_t index,
+                       size_t n)
+{
+    if ((paddr % (n * PAGE_SIZE)) != 0) return false;
+
+    for (size_t i = 0; i < n; i++) {
+        if (pp_next_clr(ppages->base, index + i, ppages->colors) != index + i) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static void mem_free_ppages(struct ppages *ppages)
 {
     list_foreach(page_pool_list, struct page_pool, pool)
@@ -116,8 +151,19 @@ static void mem_free_ppages(struct ppages *ppages)
     }
 }
 
+static inline bool pp_aligned(struct page_pool *pool, size_t index,
+                              size_t align)
+{
+    return ((pool->base / PAGE_SIZE) + index) % align == 0;
+}
+
+/**
+ * Allocates n pages of the given colors, the first aligned to align pages.
+ * With colors that cover whole aligned blocks of align pages, the pages
+ * then come in such blocks.
+ */
 static bool pp_alloc_clr(struct page_pool *pool, size_t n, colormap_t colors,
-                         struct ppages *ppages)
+                         size_t align, struct ppages *ppages)
 {
     size_t allocated = 0;
 
@@ -145,8 +191,9 @@ static bool pp_alloc_clr(struct page_pool *pool, size_t n, colormap_t colors,
         while ((allocated < n) && (index < top)) {
             allocated = 0;
 
-            /* Find first free page on the target colors */
-            while ((index < top) && bitmap_get(pool->bitmap, index)) {
+            /* Find first free, aligned page on the target colors */
+            while ((index < top) && (bitmap_get(pool->bitmap, index) ||
+                                     !pp_aligned(pool, index, align))) {
                 index = pp_next_clr(pool->base, ++index, colors);
             }
             first_index = index;
@@ -197,7 +244,8 @@ static bool pp_alloc_clr(struct page_pool *pool, size_t n, colormap_t colors,
     return ok;
 }
 
-static bool pp_alloc(struct page_pool *pool, size_t n, bool aligned,
+/* Allocates n contiguous pages, aligned to align pages */
+static bool pp_alloc(struct page_pool *pool, size_t n, size_t align,
                      struct ppages *ppages)
 {
     ppages->colors = 0;
@@ -210,11 +258,11 @@ static bool pp_alloc(struct page_pool *pool, size_t n, bool aligned,
     spin_lock(&pool->lock);
 
     /**
-     *  If we need a contigous segment aligned to its size, lets start
-     * at an already aligned index.
+     *  If we need an aligned contigous segment, lets start at an already
+     * aligned index.
      */
-    size_t start = aligned ? pool->base / PAGE_SIZE % n : 0;
-    size_t curr = pool->last + ((pool->last + start) % n);
+    size_t start = pool->base / PAGE_SIZE % align;
+    size_t curr = pool->last + ((pool->last + start) % align);
 
     /**
      * Lets make two searches:
@@ -231,15 +279,15 @@ static bool pp_alloc(struct page_pool *pool, size_t n, bool aligned,
                  * No n page sement was found. If this is the first iteration
                  * set position to 0 to start next search from index 0.
                  */
-                curr = aligned ? (n - ((pool->base / PAGE_SIZE) % n)) % n : 0;
+                curr = (align - ((pool->base / PAGE_SIZE) % align)) % align;
                 break;
-            } else if (aligned && (((bit + start) % n) != 0)) {
+            } else if (((bit + start) % align) != 0) {
                 /**
                  *  If we're looking for an aligned segment and the found
                  * contigous segment is not aligned, start the search again
                  * from the last aligned index
                  */
-                curr = bit + ((bit + start) % n);
+                curr = bit + ((bit + start) % align);
             } else {
                 /**
                  * We've found our pages. Fill output argument info, mark
@@ -267,8 +315,28 @@ struct ppages mem_alloc_ppages(colormap_t colors, size_t n, bool aligned)
     list_foreach(page_pool_list, struct page_pool, pool)
     {
         bool ok = (!all_clrs(colors) && !aligned)
-                      ? pp_alloc_clr(pool, n, colors, &pages)
-                      : pp_alloc(pool, n, aligned, &pages);
+                      ? pp_alloc_clr(pool, n, colors, 1, &pages)
+                      : pp_alloc(pool, n, aligned ? n : 1, &pages);
+        if (ok) break;
+    }
+
+    return pages;
+}
+
+/**
+ * Allocates n pages to be mapped with pages of align * PAGE_SIZE, i.e., in
+ * blocks of align contiguous pages aligned to their size. Colored pages need
+ * colors covering whole blocks.
+ */
+struct ppages mem_alloc_ppages_align(colormap_t colors, size_t n, size_t align)
+{
+    struct ppages pages = {.size = 0};
+
+    list_foreach(page_pool_list, struct page_pool, pool)
+    {
+        bool ok = !all_clrs(colors)
+                      ? pp_alloc_clr(pool, n, colors, align, &pages)
+                      : pp_alloc(pool, n, align, &pages);
         if (ok) break;
     }
 
@@ -287,6 +355,144 @@ static struct section *mem_find_sec(struct addr_space *as, vaddr_t va)
     return NULL;
 }
 
+static void mem_pt_clean_ranges(struct addr_space *as)
+{
+    for (size_t i = 0; i < as->pt_dirty.num; i++) {
+        cache_clean_range(as->pt_dirty.range[i].base,
+                          as->pt_dirty.range[i].top -
+                              as->pt_dirty.range[i].base);
+    }
+    as->pt_dirty.num = 0;
+}
+
+/**
+ * Record a page table update to be cleaned at the next mem_pt_sync. Adjacent
+ * or overlapping updates are coalesced in a single range.
+ */
+static void mem_pt_dirty(struct addr_space *as, void *ptr, size_t size)
+{
+    /* Must have lock on as and va section to call */
+    if (!as->pt_clean) return;
+
+    vaddr_t base = (vaddr_t)ptr;
+    vaddr_t top = base + size;
+
+    for (size_t i = 0; i < as->pt_dirty.num; i++) {
+        if (base <= as->pt_dirty.range[i].top &&
+            top >= as->pt_dirty.range[i].base) {
+            if (base < as->pt_dirty.range[i].base) {
+                as->pt_dirty.range[i].base = base;
+            }
+            if (top > as->pt_dirty.range[i].top) {
+                as->pt_dirty.range[i].top = top;
+            }
+            return;
+        }
+    }
+
+    if (as->pt_dirty.num >= MEM_PT_DIRTY_RANGES) {
+        mem_pt_clean_ranges(as);
+    }
+
+    as->pt_dirty.range[as->pt_dirty.num].base = base;
+    as->pt_dirty.range[as->pt_dirty.num].top = top;
+    as->pt_dirty.num++;
+}
+
+/**
+ * Invalidate the tlb entries for a range of the address space, mapped by
+ * entries of the given size. This is deferred to the next mem_pt_sync, which
+ * issues all the invalidations of an operation as a single batch and, if the
+ * page tables must be cleaned, only after they reach memory.
+ */
+static void mem_tlb_inv(struct addr_space *as, vaddr_t va, size_t size)
+{
+    va = ALIGN_FLOOR(va, size);
+
+    if (as->pt_dirty.inv_top <= as->pt_dirty.inv_base) {
+        as->pt_dirty.inv_base = va;
+        as->pt_dirty.inv_top = va + size;
+        as->pt_dirty.inv_step = size;
+    } else {
+        if (va < as->pt_dirty.inv_base) as->pt_dirty.inv_base = va;
+        if (va + size > as->pt_dirty.inv_top) as->pt_dirty.inv_top = va + size;
+        if (size < as->pt_dirty.inv_step) as->pt_dirty.inv_step = size;
+    }
+}
+
+static void mem_pt_sync(struct addr_space *as)
+{
+    /* Must have lock on as and va section to call */
+    if (as->pt_clean) {
+        mem_pt_clean_ranges(as);
+    }
+
+    if (as->pt_dirty.inv_top > as->pt_dirty.inv_base) {
+        /* One invalidation per entry of the smallest size changed */
+        size_t step = as->pt_dirty.inv_step;
+        vaddr_t base = ALIGN_FLOOR(as->pt_dirty.inv_base, step);
+        size_t size = ALIGN(as->pt_dirty.inv_top - base, step);
+        fence_sync_write();
+        if (size / step > MEM_PT_INV_MAX_PAGES) {
+            tlb_inv_all(as);
+        } else {
+            tlb_inv_range(as, base, size, step);
+        }
+        as->pt_dirty.inv_base = as->pt_dirty.inv_top = 0;
+    }
+}
+
+/**
+ * Turns the contiguous run pte is part of back into separate entries, each
+ * keeping its own page, before one of them changes.
+ */
+static void mem_pte_uncontig(struct addr_space *as, pte_t *pte, size_t lvl,
+                             vaddr_t va)
+{
+    size_t contig = pt_contig_ptes(&as->pt, lvl);
+    if (contig <= 1 || !pte_valid(pte) || !pte_contig(pte)) return;
+
+    pte_t *first = (pte_t *)ALIGN_FLOOR((vaddr_t)pte, contig * sizeof(pte_t));
+    for (size_t i = 0; i < contig; i++) {
+        pte_uncontig(&first[i]);
+    }
+    mem_pt_dirty(as, first, contig * sizeof(pte_t));
+
+    /* Each entry of the run may be cached on its own */
+    size_t lvlsz = pt_lvlsize(&as->pt, lvl);
+    vaddr_t base = ALIGN_FLOOR(va, contig * lvlsz);
+    for (size_t i = 0; i < contig; i++) {
+        mem_tlb_inv(as, base + (i * lvlsz), lvlsz);
+    }
+}
+
+static void mem_pt_clean_tbl(struct addr_space *as, size_t lvl, vaddr_t va)
+{
+    pte_t *pt = pt_get(&as->pt, lvl, va);
+    cache_clean_range((vaddr_t)pt, pt_size(&as->pt, lvl));
+
+    if (lvl + 1 >= as->pt.dscr->lvls) return;
+
+    size_t lvlsz = pt_lvlsize(&as->pt, lvl);
+    for (size_t i = 0; i < pt_nentries(&as->pt, lvl); i++) {
+        if (pte_valid(&pt[i]) && pte_table(&as->pt, &pt[i], lvl)) {
+            mem_pt_clean_tbl(as, lvl + 1, va + (i * lvlsz));
+        }
+    }
+}
+
+void mem_pt_clean_enable(struct addr_space *as)
+{
+    spin_lock(&as->lock);
+    if (!as->pt_clean) {
+        /* Clean everything mapped up to this point */
+        mem_pt_clean_tbl(as, 0, 0);
+        tlb_inv_all(as);
+        as->pt_clean = true;
+    }
+    spin_unlock(&as->lock);
+}
+
 static inline bool pte_allocable(struct addr_space *as, pte_t *pte, size_t lvl,
                                  size_t left, vaddr_t addr)
 {
@@ -296,10 +502,75 @@ static inline bool pte_allocable(struct addr_space *as, pte_t *pte, size_t lvl,
             ((addr % pt_lvlsize(&as->pt, lvl)) == 0));
 }
 
+/* Virtual address of the pooled table at pa, NULL if not in the pool */
+static pte_t *pt_pool_tbl(struct pt_pool *pool, paddr_t pa)
+{
+    size_t chunk_size = pool->tbl_size * PT_POOL_CHUNK_TBLS;
+
+    for (size_t i = 0; i < pool->chunk_num; i++) {
+        if (in_range(pa, pool->chunks[i].pa, chunk_size)) {
+            return (pte_t *)(pool->chunks[i].va + (pa - pool->chunks[i].pa));
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Walks a pooled page table down to the table of level lvl covering va.
+ * Returns NULL if an upper level entry is not a table.
+ */
+pte_t *pt_pool_get(struct page_table *pt, size_t lvl, vaddr_t va)
+{
+    pte_t *tbl = pt->root;
+
+    for (size_t i = 0; i < lvl && tbl != NULL; i++) {
+        pte_t *pte = &tbl[pt_getpteindex_by_va(pt, va, i)];
+        if (!pte_valid(pte) || !pte_table(pt, pte, i)) return NULL;
+        tbl = pt_pool_tbl(pt->pool, pte_addr(pte));
+    }
+
+    return tbl;
+}
+
+static pte_t *mem_pt_pool_alloc(struct page_table *pt, paddr_t *pa)
+{
+    struct pt_pool *pool = pt->pool;
+
+    if (pool->chunk_num == 0 || pool->used >= PT_POOL_CHUNK_TBLS) {
+        if (pool->chunk_num >= PT_POOL_CHUNKS) return NULL;
+
+        size_t n = NUM_PAGES(pool->tbl_size * PT_POOL_CHUNK_TBLS);
+        void *chunk = mem_alloc_page(n, SEC_HYP_VM, true);
+        if (chunk == NULL) return NULL;
+        pool->chunks[pool->chunk_num].va = (vaddr_t)chunk;
+        mem_translate(&cpu.as, (vaddr_t)chunk,
+                      &pool->chunks[pool->chunk_num].pa);
+        pool->chunk_num++;
+        pool->used = 0;
+    }
+
+    size_t off = pool->used++ * pool->tbl_size;
+    *pa = pool->chunks[pool->chunk_num - 1].pa + off;
+    return (pte_t *)(pool->chunks[pool->chunk_num - 1].va + off);
+}
+
 static inline pte_t *mem_alloc_pt(struct addr_space *as, pte_t *parent, size_t lvl,
                                   vaddr_t addr)
 {
     /* Must have lock on as and va section to call */
+    if (as->pt.pool != NULL) {
+        paddr_t pa;
+        pte_t *tbl = mem_pt_pool_alloc(&as->pt, &pa);
+        if (tbl == NULL) return NULL;
+        memset(tbl, 0, as->pt.pool->tbl_size);
+        fence_sync_write();
+        pte_set(parent, pa, PTE_TABLE, PTE_HYP_FLAGS);
+        mem_pt_dirty(as, parent, sizeof(pte_t));
+        mem_pt_dirty(as, tbl, as->pt.pool->tbl_size);
+        return tbl;
+    }
+
     size_t ptsize = pt_size(&as->pt, lvl) / PAGE_SIZE;
     struct ppages ppage = mem_alloc_ppages(as->colors, ptsize, ptsize > 1 ? true : false);
     if (ppage.size == 0) return NULL;
@@ -307,6 +578,8 @@ static inline pte_t *mem_alloc_pt(struct addr_space *as, pte_t *parent, size_t l
     fence_sync_write();
     pte_t *temp_pt = pt_get(&as->pt, lvl + 1, addr);
     memset(temp_pt, 0, PAGE_SIZE);
+    mem_pt_dirty(as, parent, sizeof(pte_t));
+    mem_pt_dirty(as, temp_pt, PAGE_SIZE);
     return temp_pt;
 }
 
@@ -359,8 +632,10 @@ static void mem_expand_pte(struct addr_space *as, vaddr_t va, size_t lvl)
              * the original spaced mapped by the entry will be unmaped.
              * Therefore this function cannot be call on the entry mapping
              * hypervisor code or data used in it (including stack).
+             * Any address the superpage maps invalidates it, so only the
+             * one next level entry around va is recorded.
              */
-            tlb_inv_va(&cpu.as, va);
+            mem_tlb_inv(as, va, pt_lvlsize(&as->pt, lvl + 1));
 
             /**
              *  Now traverse the new next level page table to replicate the
@@ -369,13 +644,14 @@ static void mem_expand_pte(struct addr_space *as, vaddr_t va, size_t lvl)
 
             lvl++;
             paddr_t paddr = pte_addr(&pte_val);
-            size_t entry = pt_getpteindex(&as->pt, pte, lvl);
+            size_t entry = 0;
             size_t nentries = pt_nentries(&as->pt, lvl);
             size_t lvlsz = pt_lvlsize(&as->pt, lvl);
             pte_type_t type = pt_page_type(&as->pt, lvl);
             pte_flags_t flags =
-                (as->type == AS_HYP ? PTE_HYP_FLAGS : PTE_VM_FLAGS);
+                (as->type == AS_HYP ? PTE_HYP_FLAGS : as->vm_flags);
 
+            mem_pt_dirty(as, pte, (nentries - entry) * sizeof(pte_t));
             while (entry < nentries) {
                 if (vld)
                     pte_set(pte, paddr, type, flags);
@@ -409,6 +685,14 @@ static void mem_inflate_pt(struct addr_space *as, vaddr_t va, size_t length)
     }
 }
 
+/* Whether n pages at va can be mapped with the as' smallest pages */
+static inline bool mem_granule_aligned(struct addr_space *as, vaddr_t va,
+                                       size_t n)
+{
+    size_t granule = pt_granule(&as->pt);
+    return (va % granule) == 0 && ((n * PAGE_SIZE) % granule) == 0;
+}
+
 vaddr_t mem_alloc_vpage(struct addr_space *as, enum AS_SEC section,
                             vaddr_t at, size_t n)
 {
@@ -424,6 +708,8 @@ vaddr_t mem_alloc_vpage(struct addr_space *as, enum AS_SEC section,
     bool failed = false;
 
     // TODO: maybe some bound checking here would be nice
+    if (at != NULL_VA && !mem_granule_aligned(as, at, n)) return NULL_VA;
+
     struct section *sec = &sections[as->type].sec[section];
     if (at != NULL_VA) {
         if (sec != mem_find_sec(as, at)) return NULL_VA;
@@ -446,7 +732,7 @@ vaddr_t mem_alloc_vpage(struct addr_space *as, enum AS_SEC section,
         }
 
         pte = pt_get_pte(&as->pt, lvl, addr);
-        entry = pt_getpteindex(&as->pt, pte, lvl);
+        entry = pt_getpteindex_by_va(&as->pt, addr, lvl);
         nentries = pt_nentries(&as->pt, lvl);
         lvlsze = pt_lvlsize(&as->pt, lvl);
 
@@ -500,6 +786,8 @@ vaddr_t mem_alloc_vpage(struct addr_space *as, enum AS_SEC section,
         }
     }
 
+    mem_pt_sync(as);
+
     if (sec->shared) spin_unlock(&sec->lock);
 
     spin_unlock(&as->lock);
@@ -507,12 +795,56 @@ vaddr_t mem_alloc_vpage(struct addr_space *as, enum AS_SEC section,
     return vpage;
 }
 
+/**
+ * Physical pages unmapped by mem_free_vpage, which can only be reused once no
+ * walker can reach them anymore, i.e. after the next mem_pt_sync. Contiguous
+ * pages are merged in a single entry.
+ */
+struct mem_free_batch {
+    size_t num;
+    struct ppages ppages[MEM_FREE_BATCH_MAX];
+};
+
+static void mem_free_batch_release(struct mem_free_batch *batch)
+{
+    for (size_t i = 0; i < batch->num; i++) {
+        mem_free_ppages(&batch->ppages[i]);
+    }
+    batch->num = 0;
+}
+
+static void mem_free_batch_add(struct addr_space *as,
+                               struct mem_free_batch *batch, paddr_t paddr,
+                               size_t n)
+{
+    if (batch->num > 0) {
+        struct ppages *last = &batch->ppages[batch->num - 1];
+        if (last->base + last->size * PAGE_SIZE == paddr) {
+            last->size += n;
+            return;
+        }
+    }
+
+    if (batch->num >= MEM_FREE_BATCH_MAX) {
+        mem_pt_sync(as);
+        mem_free_batch_release(batch);
+    }
+
+    batch->ppages[batch->num++] = mem_ppages_get(paddr, n);
+}
+
 void mem_free_vpage(struct addr_space *as, vaddr_t at, size_t n,
                     bool free_ppages)
 {
     vaddr_t vaddr = at;
     vaddr_t top = at + (n * PAGE_SIZE);
     size_t lvl = 0;
+    struct mem_free_batch batch = {.num = 0};
+
+    if (!mem_granule_aligned(as, at, n)) {
+        WARNING("freeing pages not aligned to the address space's granule");
+        return;
+    }
 
     spin_lock(&as->lock);
 
@@ -529,7 +861,7 @@ void mem_free_vpage(struct addr_space *as, vaddr_t at, size_t n,
         } else if (pte_table(&as->pt, pte, lvl)) {
             lvl++;
         } else {
-            size_t entry = pt_getpteindex(&as->pt, pte, lvl);
+            size_t entry = pt_getpteindex_by_va(&as->pt, vaddr, lvl);
             size_t nentries = pt_nentries(&as->pt, lvl);
             size_t lvlsz = pt_lvlsize(&as->pt, lvl);
 
@@ -543,16 +875,17 @@ void mem_free_vpage(struct addr_space *as, vaddr_t at, size_t n,
                         break;
                     }
 
+                    mem_pte_uncontig(as, pte, lvl, vaddr);
+                    paddr_t paddr = pte_addr(pte);
+                    *pte = 0;
+                    mem_pt_dirty(as, pte, sizeof(pte_t));
+                    mem_tlb_inv(as, vaddr, lvlsz);
+
                     if (free_ppages) {
-                        paddr_t paddr = pte_addr(pte);
-                        struct ppages ppages =
-                            mem_ppages_get(paddr, lvlsz / PAGE_SIZE);
-                        mem_free_ppages(&ppages);
+                        mem_free_batch_add(as, &batch, paddr,
+                                           lvlsz / PAGE_SIZE);
                     }
 
-                    *pte = 0;
-                    tlb_inv_va(&cpu.as, vaddr);
-
                 } else {
                     break;
                 }
@@ -572,6 +905,9 @@ void mem_free_vpage(struct addr_space *as, vaddr_t at, size_t n,
         }
     }
 
+    mem_pt_sync(as);
+    mem_free_batch_release(&batch);
+
     if (sec->shared) spin_unlock(&sec->lock);
 
     spin_unlock(&as->lock);
@@ -589,6 +925,13 @@ bool mem_map(struct addr_space *as, vaddr_t va, struct ppages *ppages,
     if ((sec == NULL) || (sec != mem_find_sec(as, vaddr + n * PAGE_SIZE - 1)))
         return false;
 
+    /* Pages larger than PAGE_SIZE are mapped whole */
+    size_t granule = pt_granule(&as->pt);
+    if (!mem_granule_aligned(as, vaddr, n) ||
+        (ppages != NULL && (ppages->base % granule) != 0)) {
+        return false;
+    }
+
     spin_lock(&as->lock);
     if (sec->shared) spin_lock(&sec->lock);
 
@@ -598,21 +941,36 @@ bool mem_map(struct addr_space *as, vaddr_t va, struct ppages *ppages,
      */
 
     if (ppages == NULL && !all_clrs(as->colors)) {
-        struct ppages temp = mem_alloc_ppages(as->colors, n, false);
+        struct ppages temp =
+            mem_alloc_ppages_align(as->colors, n, granule / PAGE_SIZE);
         if (temp.size < n) ERROR("failed to alloc colored physical pages");
         ppages = &temp;
     }
 
     if (ppages && !all_clrs(ppages->colors)) {
         size_t index = 0;
+        size_t lvl = as->pt.dscr->lvls - 1;
+        size_t gp = granule / PAGE_SIZE;
+        size_t contig = pt_contig_ptes(&as->pt, lvl);
         mem_inflate_pt(as, vaddr, n * PAGE_SIZE);
-        for (size_t i = 0; i < ppages->size; i++) {
-            pte = pt_get_pte(&as->pt, as->pt.dscr->lvls - 1, vaddr);
+        for (size_t i = 0; i < ppages->size;) {
+            pte = pt_get_pte(&as->pt, lvl, vaddr);
             index = pp_next_clr(ppages->base, index, ppages->colors);
             paddr_t paddr = ppages->base + (index * PAGE_SIZE);
-            pte_set(pte, paddr, PTE_PAGE, flags);
-            vaddr += PAGE_SIZE;
-            index++;
+            size_t num = 1;
+            if (contig > 1 && ppages->size - i >= contig * gp &&
+                (vaddr % (contig * granule)) == 0 &&
+                pp_clr_run(ppages, paddr, index, contig * gp)) {
+                num = contig;
+                pte_set_contig(&as->pt, pte, lvl, paddr, PTE_PAGE, flags);
+            } else {
+                mem_pte_uncontig(as, pte, lvl, vaddr);
+                pte_set(pte, paddr, PTE_PAGE, flags);
+            }
+            mem_pt_dirty(as, pte, num * sizeof(pte_t));
+            i += num * gp;
+            vaddr += num * granule;
+            index += num * gp;
         }
     } else {
         paddr_t paddr = ppages ? ppages->base : 0;
@@ -632,21 +990,33 @@ bool mem_map(struct addr_space *as, vaddr_t va, struct ppages *ppages,
 			 * zeroying process */
 			/* since we are overriding we need to invalidate this
 			 * TLB */
-			tlb_inv_va(as, va);
+			mem_tlb_inv(as, vaddr, pt_lvlsize(&as->pt, lvl));
 			break;
                     }
                 }
             }
 
-            size_t entry = pt_getpteindex(&as->pt, pte, lvl);
+            size_t entry = pt_getpteindex_by_va(&as->pt, vaddr, lvl);
             size_t nentries = pt_nentries(&as->pt, lvl);
             size_t lvlsz = pt_lvlsize(&as->pt, lvl);
+            size_t contig = pt_contig_ptes(&as->pt, lvl);
 
             while ((entry < nentries) && (count < n) &&
                    (n - count >= lvlsz / PAGE_SIZE)) {
+                size_t num = 1;
+                if (contig > 1 && (entry % contig) == 0 &&
+                    (n - count) >= contig * (lvlsz / PAGE_SIZE) &&
+                    (ppages == NULL || (paddr % (contig * lvlsz)) == 0)) {
+                    num = contig;
+                }
                 if (ppages == NULL) {
-                    struct ppages temp =
-                        mem_alloc_ppages(as->colors, lvlsz / PAGE_SIZE, true);
+                    struct ppages temp = mem_alloc_ppages(
+                        as->colors, num * (lvlsz / PAGE_SIZE), true);
+                    if (num > 1 && temp.size < num * (lvlsz / PAGE_SIZE)) {
+                        num = 1;
+                        temp = mem_alloc_ppages(as->colors, lvlsz / PAGE_SIZE,
+                                                true);
+                    }
                     if (temp.size < lvlsz / PAGE_SIZE) {
                         if (lvl == (as->pt.dscr->lvls - 1)) {
                             // TODO: free previously allocated pages
@@ -661,17 +1031,25 @@ bool mem_map(struct addr_space *as, vaddr_t va, struct ppages *ppages,
                     }
                     paddr = temp.base;
                 }
-                pte_set(pte, paddr, pt_page_type(&as->pt, lvl), flags);
-                vaddr += lvlsz;
-                paddr += lvlsz;
-                count += lvlsz / PAGE_SIZE;
-                pte++;
-                entry++;
+                if (num > 1) {
+                    pte_set_contig(&as->pt, pte, lvl, paddr,
+                                   pt_page_type(&as->pt, lvl), flags);
+                } else {
+                    mem_pte_uncontig(as, pte, lvl, vaddr);
+                    pte_set(pte, paddr, pt_page_type(&as->pt, lvl), flags);
+                }
+                mem_pt_dirty(as, pte, num * sizeof(pte_t));
+                vaddr += num * lvlsz;
+                paddr += num * lvlsz;
+                count += num * (lvlsz / PAGE_SIZE);
+                pte += num;
+                entry += num;
             }
         }
     }
 
     fence_sync();
+    mem_pt_sync(as);
 
     if (sec->shared) {
         spin_unlock(&sec->lock);
@@ -779,12 +1157,14 @@ bool mem_map_reclr(struct addr_space *as, vaddr_t va, struct ppages *ppages,
         if (bitmap_get((bitmap_t*)&as->colors,
                        ((i + clr_offset) / COLOR_SIZE % COLOR_NUM))) {
             pte_set(pte, paddr, PTE_PAGE, flags);
+            mem_pt_dirty(as, pte, sizeof(pte_t));
 
         } else {
             memcpy((void*)clrd_vaddr, (void*)phys_va, PAGE_SIZE);
             index = pp_next_clr(reclrd_ppages.base, index, as->colors);
             paddr_t clrd_paddr = reclrd_ppages.base + (index * PAGE_SIZE);
             pte_set(pte, clrd_paddr, PTE_PAGE, flags);
+            mem_pt_dirty(as, pte, sizeof(pte_t));
 
             clrd_vaddr += PAGE_SIZE;
             index++;
@@ -799,6 +1179,7 @@ bool mem_map_reclr(struct addr_space *as, vaddr_t va, struct ppages *ppages,
      * image was copied, and might stayed in the cache system.
      */
     cache_flush_range(reclrd_va_base, reclrd_num * PAGE_SIZE);
+    mem_pt_sync(as);
 
     /**
      * Free the uncolored pages of the original image.
@@ -979,6 +1360,22 @@ bool pp_root_reserve_hyp_mem(paddr_t load_addr)
     return image_load_reserved && image_noload_reserved && cpu_reserved;
 }
 
+/* Keeps the memory VMs hold across a live update out of the pool */
+static bool mem_reserve_lu(struct page_pool *pool)
+{
+    struct ppages ppages;
+
+    for (size_t i = 0; lu_reserved_ppages(i, &ppages); i++) {
+        if (range_in_range(ppages.base, ppages.size * PAGE_SIZE, pool->base,
+                           pool->size * PAGE_SIZE) &&
+            !mem_reserve_ppool_ppages(pool, &ppages)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static bool pp_root_init(paddr_t load_addr, struct mem_region *root_region)
 {
     memset((void*)&root_pool, 0, sizeof(struct page_pool));
@@ -994,6 +1391,9 @@ static bool pp_root_init(paddr_t load_addr, struct mem_region *root_region)
     if (!pp_root_reserve_hyp_mem(load_addr)) {
         return false;
     }
+    if (!mem_reserve_lu(&root_pool)) {
+        return false;
+    }
 
     root_pool.last = 0;
     return true;
@@ -1114,7 +1514,8 @@ bool mem_create_ppools(paddr_t config_addr, struct mem_region *root_mem_region)
             struct page_pool *pool = objcache_alloc(&pagepool_cache);
             if (pool != NULL) {
                 pp_init(pool, reg->base, reg->size);
-                if (!mem_reserve_physical_memory(config_addr, pool)) {
+                if (!mem_reserve_physical_memory(config_addr, pool) ||
+                    !mem_reserve_lu(pool)) {
                     return false;
                 }
                 list_push(&page_pool_list, &pool->node);
@@ -1143,6 +1544,8 @@ bool mem_map_vm_config(paddr_t config_addr)
         pages = mem_ppages_get(config_addr + PAGE_SIZE, n);
         mem_map(&cpu.as, va, &pages, n, PTE_HYP_FLAGS);
     }
+    /* Measured while its pointers are still independent of where it is */
+    attest_measure_root_config();
     config_adjust_to_va(vm_config_ptr, config_addr);
 
     return true;
@@ -1192,6 +1595,55 @@ bool mem_setup_root_pool(paddr_t load_addr,
     return pp_root_init(load_addr, *root_mem_region);
 }
 
+/* Copies of the hypervisor's code and read-only data, see hyp_replica */
+#define HYP_REPLICAS_MAX (16)
+
+/**
+ * Index of the copy of the hypervisor's code and read-only data cpu id maps.
+ * Copy 0 is the one CPU_MASTER makes of the whole image, the only one unless
+ * replication is enabled. Otherwise, each other cluster has its own, indexed
+ * by cluster number, with the master's cluster and cluster 0 swapped.
+ * Each copy is mapped under its own root page table entry, so there is only
+ * one if the devices and the global dynamic memory share the image's.
+ */
+static size_t hyp_replica(cpuid_t id)
+{
+    if (!vm_config_ptr->hyp_replication.enable ||
+        pt_get_pte(&cpu.as.pt, 0, (vaddr_t)&_image_start) ==
+            pt_get_pte(&cpu.as.pt, 0, (vaddr_t)&_dmem_beg)) {
+        return 0;
+    }
+
+    size_t cluster = platform_arch_cpu_cluster(&platform, id);
+    size_t master_cluster = platform_arch_cpu_cluster(&platform, CPU_MASTER);
+
+    if (cluster == master_cluster || cluster >= HYP_REPLICAS_MAX) {
+        return 0;
+    } else if (cluster == 0) {
+        return master_cluster < HYP_REPLICAS_MAX ? master_cluster : 0;
+    }
+
+    return cluster;
+}
+
+/* The cpu making a copy is the first of the cpus mapping it */
+static bool hyp_replica_leader(cpuid_t id)
+{
+    size_t replica = hyp_replica(id);
+
+    if (replica == 0) {
+        return id == CPU_MASTER;
+    }
+
+    for (cpuid_t i = 0; i < id; i++) {
+        if (hyp_replica(i) == replica) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void *copy_space(void *base, const size_t size, struct ppages *pages)
 {
     *pages = mem_alloc_ppages(cpu.as.colors, NUM_PAGES(size), false);
@@ -1216,7 +1668,9 @@ void *copy_space(void *base, const size_t size, struct ppages *pages)
  */
 void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
 {
-    volatile static pte_t shared_pte;
+    volatile static pte_t shared_pte[HYP_REPLICAS_MAX];
+    volatile static pte_t shared_dmem_pte;
+    volatile static struct ppages image_ppages;
     vaddr_t va = NULL_VA;
     struct cpu *cpu_new;
     struct ppages p_cpu;
@@ -1227,6 +1681,8 @@ void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
     size_t image_load_size = (size_t)(&_image_load_end - &_image_start);
     size_t image_noload_size = (size_t)(&_image_end - &_image_load_end);
     size_t image_size = image_load_size + image_noload_size;
+    size_t image_ro_size = (size_t)(&_image_ro_end - &_image_start);
+    size_t replica = hyp_replica(cpu.id);
     size_t cpu_boot_size = cpu_boot_alloc_size();
     size_t config_size = (size_t)(&_config_end - &_config_start);
     size_t bitmap_size = (root_pool.size / (8 * PAGE_SIZE) +
@@ -1265,6 +1721,11 @@ void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
      * CPU_MASTER allocates, copies and maps the image and the root page pool
      * bitmap on a shared space, whilst other CPUs only have to copy the image
      * from the CPU_MASTER in order to be able to access it.
+     *
+     * With replication, the first CPU of each other cluster copies the code
+     * and read-only data again and maps it along with the master's copy of
+     * the rest of the image. The other CPUs of the cluster take the
+     * cluster's image page table entry instead.
      */
     if (cpu.id == CPU_MASTER) {
         copy_space(&_image_start, image_size, &p_image);
@@ -1276,15 +1737,64 @@ void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
 
         mem_map(&cpu_new->as, va, &p_image,
                 NUM_PAGES(image_size), PTE_HYP_FLAGS);
-        shared_pte = pte_addr(pt_get_pte(&cpu_new->as.pt, 0,
+        image_ppages.base = p_image.base;
+        image_ppages.size = p_image.size;
+        image_ppages.colors = p_image.colors;
+        fence_sync_write();
+        shared_pte[0] = pte_addr(pt_get_pte(&cpu_new->as.pt, 0,
+            (vaddr_t)&_image_start));
+    } else if (hyp_replica_leader(cpu.id)) {
+        size_t ro_pages = NUM_PAGES(image_ro_size);
+
+        /* Wait for CPU_MASTER to copy the image */
+        while (shared_pte[0] == 0);
+
+        copy_space(&_image_start, image_ro_size, &p_image);
+        va = mem_alloc_vpage(&cpu_new->as, SEC_HYP_IMAGE,
+                            (vaddr_t) &_image_start, NUM_PAGES(image_size));
+
+        if (va != (vaddr_t)&_image_start)
+            ERROR("Can't allocate virtual address for CROSSCONHyp Image");
+
+        mem_map(&cpu_new->as, va, &p_image, ro_pages, PTE_HYP_FLAGS);
+        p_image = pp_skip((struct ppages){image_ppages.base, image_ppages.size,
+                                          image_ppages.colors},
+                          ro_pages);
+        mem_map(&cpu_new->as, va + image_ro_size, &p_image, p_image.size,
+                PTE_HYP_FLAGS);
+        fence_sync_write();
+        shared_pte[replica] = pte_addr(pt_get_pte(&cpu_new->as.pt, 0,
             (vaddr_t)&_image_start));
     } else {
         pte_t *image_pte = pt_get_pte(&cpu_new->as.pt, 0,
                                     (vaddr_t)&_image_start);
 
-        /* Wait for CPU_MASTER to get image page table entry */
-        while (shared_pte == 0);
-        pte_set(image_pte, (paddr_t)shared_pte, PTE_TABLE, PTE_HYP_FLAGS);
+        /* Wait for the copy's leader to get image page table entry */
+        while (shared_pte[replica] == 0);
+        pte_set(image_pte, (paddr_t)shared_pte[replica], PTE_TABLE,
+                PTE_HYP_FLAGS);
+    }
+
+    /*
+     * The devices and the global dynamic memory may be mapped under a root
+     * page table entry of their own. CPU_MASTER allocates the table it points
+     * to, which is then shared by all CPUs, replicas or not.
+     */
+    pte_t *dmem_pte = pt_get_pte(&cpu_new->as.pt, 0, (vaddr_t)&_dmem_beg);
+    if (dmem_pte != pt_get_pte(&cpu_new->as.pt, 0, (vaddr_t)&_image_start)) {
+        if (cpu.id == CPU_MASTER) {
+            if (mem_alloc_pt(&cpu_new->as, dmem_pte, 0,
+                             (vaddr_t)&_dmem_beg) == NULL) {
+                ERROR("Can't allocate CROSSCONHyp global page table");
+            }
+            fence_sync_write();
+            shared_dmem_pte = pte_addr(dmem_pte);
+        } else {
+            /* Wait for CPU_MASTER to allocate the global page table */
+            while (shared_dmem_pte == 0);
+            pte_set(dmem_pte, (paddr_t)shared_dmem_pte, PTE_TABLE,
+                    PTE_HYP_FLAGS);
+        }
     }
 
     /*
@@ -1361,9 +1871,14 @@ void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
      */
     if (cpu.id == CPU_MASTER) {
         cpu_sync_init(&cpu_glb_sync, platform.cpu_num);
-        shared_pte = 0;
+        for (size_t i = 1; i < HYP_REPLICAS_MAX; i++) {
+            shared_pte[i] = 0;
+        }
+        shared_dmem_pte = 0;
+        fence_sync_write();
+        shared_pte[0] = 0;
     } else {
-        while (shared_pte != 0);
+        while (shared_pte[0] != 0);
     }
 
     as_init(&cpu.as, AS_HYP, HYP_ASID, cpu.root_pt, colors);
@@ -1407,18 +1922,24 @@ void color_hypervisor(const paddr_t load_addr, const paddr_t config_addr)
     mem_free_vpage(&cpu.as, va, p_cpu.size, false);
 }
 
-void as_init(struct addr_space *as, enum AS_TYPE type, asid_t id,
-            pte_t *root_pt, colormap_t colors)
+static void as_init_dscr(struct addr_space *as, enum AS_TYPE type, asid_t id,
+                         pte_t *root_pt, colormap_t colors,
+                         struct page_table_dscr *dscr)
 {
     as->type = type;
-    as->pt.dscr =
-        type == AS_HYP || type == AS_HYP_CPY ? hyp_pt_dscr : vm_pt_dscr;
+    as->pt.dscr = dscr;
+    as->pt.pool = NULL;
     as->colors = colors;
     as->lock = SPINLOCK_INITVAL;
     as->id = id;
+    as->pt_clean = false;
+    as->cpus = 0;
+    as->vm_flags = PTE_VM_FLAGS;
+    as->pt_dirty.num = 0;
+    as->pt_dirty.inv_base = as->pt_dirty.inv_top = 0;
 
     if (root_pt == NULL) {
-        size_t n = pt_size(&as->pt, 0) / PAGE_SIZE;
+        size_t n = NUM_PAGES(pt_size(&as->pt, 0));
         root_pt = (pte_t*) mem_alloc_page(n,
             type == AS_HYP || type == AS_HYP_CPY ? SEC_HYP_PRIVATE : SEC_HYP_VM,
             true);
@@ -1427,14 +1948,51 @@ void as_init(struct addr_space *as, enum AS_TYPE type, asid_t id,
     as->pt.root_flags = 0;
     as->pt.root = root_pt;
 
+    if (pt_granule(&as->pt) != PAGE_SIZE) {
+        as->pt.pool = mem_alloc_page(NUM_PAGES(sizeof(struct pt_pool)),
+                                     SEC_HYP_VM, false);
+        memset(as->pt.pool, 0, sizeof(struct pt_pool));
+        as->pt.pool->tbl_size = pt_granule(&as->pt);
+    }
+
     as_arch_init(as);
 }
 
+void as_init(struct addr_space *as, enum AS_TYPE type, asid_t id,
+            pte_t *root_pt, colormap_t colors)
+{
+    as_init_dscr(as, type, id, root_pt, colors,
+                 type == AS_HYP || type == AS_HYP_CPY ? hyp_pt_dscr
+                                                      : vm_pt_dscr);
+}
+
+bool as_vm_init(struct addr_space *as, asid_t id, colormap_t colors,
+                size_t granule, size_t ipa_bits)
+{
+    struct page_table_dscr *dscr = pt_vm_dscr(granule, ipa_bits);
+
+    if (dscr == NULL) return false;
+
+    as_init_dscr(as, AS_VM, id, NULL, colors, dscr);
+    return true;
+}
+
 void as_destroy(struct addr_space *as)
 {
-    size_t n = pt_size(&as->pt, 0) / PAGE_SIZE;
+    size_t n = NUM_PAGES(pt_size(&as->pt, 0));
     memset((void*)as->pt.root, 0, n * PAGE_SIZE);
     mem_free_vpage(as, (vaddr_t)as->pt.root, n, true);
+
+    if (as->pt.pool != NULL) {
+        struct pt_pool *pool = as->pt.pool;
+        size_t chunk_n = NUM_PAGES(pool->tbl_size * PT_POOL_CHUNK_TBLS);
+        for (size_t i = 0; i < pool->chunk_num; i++) {
+            mem_free_vpage(&cpu.as, pool->chunks[i].va, chunk_n, true);
+        }
+        mem_free_vpage(&cpu.as, (vaddr_t)pool,
+                       NUM_PAGES(sizeof(struct pt_pool)), true);
+        as->pt.pool = NULL;
+    }
     /* we trust that any other allocations have been undone */
 }
 
@@ -1467,7 +2025,8 @@ void mem_init(paddr_t load_addr, paddr_t config_addr)
 
     cpu_sync_barrier(&cpu_glb_sync);
 
-    if (!all_clrs(vm_config_ptr->hyp_colors)) {
+    if (!all_clrs(vm_config_ptr->hyp_colors) ||
+        vm_config_ptr->hyp_replication.enable) {
         color_hypervisor(load_addr, config_addr);
     }
 
@@ -1483,3 +2042,30 @@ void mem_init(paddr_t load_addr, paddr_t config_addr)
     /* Wait for master core to initialize memory management */
     cpu_sync_barrier(&cpu_glb_sync);
 }
+
+__attribute__((weak)) struct page_table_dscr *pt_vm_dscr(size_t granule,
+                                                         size_t ipa_bits)
+{
+    return (granule == 0 || granule == PAGE_SIZE) ? vm_pt_dscr : NULL;
+}
+
+__attribute__((weak)) size_t pt_contig_ptes(struct page_table *pt, size_t lvl)
+{
+    return 1;
+}
+
+__attribute__((weak)) bool pte_contig(pte_t *pte)
+{
+    return false;
+}
+
+__attribute__((weak)) void pte_set_contig(struct page_table *pt, pte_t *pte,
+                                          size_t lvl, paddr_t addr,
+                                          pte_type_t type, pte_flags_t flags)
+{
+    for (size_t i = 0; i < pt_contig_ptes(pt, lvl); i++) {
+        pte_set(&pte[i], addr + (i * pt_lvlsize(pt, lvl)), type, flags);
+    }
+}
+
+__attribute__((weak)) void pte_uncontig(pte_t *pte) {}
@@ -26,3 +26,15 @@ core-objs-y+=console.o
 core-objs-y+=iommu.o
 core-objs-y+=ipc.o
 core-objs-y+=vmstack.o
+core-objs-y+=timer.o
+core-objs-y+=vwdt.o
+core-objs-y+=idle.o
+core-objs-y+=attest.o
+core-objs-y+=vpci.o
+core-objs-y+=vcons.o
+core-objs-y+=vdbg.o
+core-objs-y+=vrr.o
+core-objs-y+=lu.o
+core-objs-y+=wss.o
+core-objs-y+=coredump.o
+core-objs-y+=vec.o
@@ -0,0 +1,260 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#include <timer.h>
+#include <cpu.h>
+
+static inline uint64_t timer_event_latest(struct timer_event* event)
+{
+    uint64_t latest = event->deadline + event->slack;
+    return latest < event->deadline ? TIMER_DEADLINE_NONE : latest;
+}
+
+static inline bool timer_event_before(struct timer_event* a,
+                                      struct timer_event* b)
+{
+    return timer_event_latest(a) < timer_event_latest(b);
+}
+
+static inline void timer_heap_set(struct timer_queue* queue, size_t i,
+                                  struct timer_event* event)
+{
+    queue->heap[i] = event;
+    event->index = i;
+}
+
+static void timer_heap_up(struct timer_queue* queue, size_t i)
+{
+    struct timer_event* event = queue->heap[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!timer_event_before(event, queue->heap[parent])) break;
+        timer_heap_set(queue, i, queue->heap[parent]);
+        i = parent;
+    }
+    timer_heap_set(queue, i, event);
+}
+
+static void timer_heap_down(struct timer_queue* queue, size_t i)
+{
+    struct timer_event* event = queue->heap[i];
+
+    while (true) {
+        size_t child = (2 * i) + 1;
+        if (child >= queue->num) break;
+        if (child + 1 < queue->num &&
+            timer_event_before(queue->heap[child + 1], queue->heap[child])) {
+            child++;
+        }
+        if (!timer_event_before(queue->heap[child], event)) break;
+        timer_heap_set(queue, i, queue->heap[child]);
+        i = child;
+    }
+    timer_heap_set(queue, i, event);
+}
+
+/* Must be called with the queue's lock held */
+static bool timer_queue_insert(struct timer_queue* queue,
+                               struct timer_event* event)
+{
+    if (queue->num >= TIMER_EVENTS_MAX) {
+        return false;
+    }
+
+    event->queued = true;
+    event->cpu = cpu.id;
+    queue->heap[queue->num] = event;
+    timer_heap_up(queue, queue->num++);
+
+    return true;
+}
+
+/* Must be called with the queue's lock held */
+static void timer_queue_remove(struct timer_queue* queue,
+                               struct timer_event* event)
+{
+    size_t i = event->index;
+
+    event->queued = false;
+    if (--queue->num == i) return;
+
+    timer_heap_set(queue, i, queue->heap[queue->num]);
+    if (i > 0 && timer_event_before(queue->heap[i], queue->heap[(i - 1) / 2])) {
+        timer_heap_up(queue, i);
+    } else {
+        timer_heap_down(queue, i);
+    }
+}
+
+/**
+ * Programs the local hardware timer for the queue's top. Only the cpu owning
+ * the queue does, so an event stopped from another cpu may leave the timer
+ * early, which is only a spurious interrupt. Must be called with the queue's
+ * lock held.
+ */
+static void timer_queue_program(struct timer_queue* queue)
+{
+    uint64_t next =
+        queue->num > 0 ? timer_event_latest(queue->heap[0]) : TIMER_DEADLINE_NONE;
+
+    if (next != queue->programmed) {
+        queue->programmed = next;
+        timer_arch_set(next);
+    }
+}
+
+void timer_init()
+{
+    struct timer_queue* queue = &cpu.interface.timers;
+
+    queue->lock = SPINLOCK_INITVAL;
+    queue->num = 0;
+    queue->programmed = TIMER_DEADLINE_NONE;
+    timer_arch_init();
+}
+
+void timer_event_init(struct timer_event* event, timer_event_handler_t handler)
+{
+    event->deadline = TIMER_DEADLINE_NONE;
+    event->slack = 0;
+    event->period = 0;
+    event->handler = handler;
+    event->queued = false;
+}
+
+/**
+ * Starts the event on the local cpu, moving it from wherever it was queued.
+ * Returns false if the local queue is full.
+ */
+bool timer_event_start(struct timer_event* event, uint64_t deadline,
+                       uint64_t slack, uint64_t period)
+{
+    struct timer_queue* queue = &cpu.interface.timers;
+    bool started;
+
+    timer_event_stop(event);
+
+    spin_lock(&queue->lock);
+    event->deadline = deadline;
+    event->slack = slack;
+    event->period = period;
+    started = timer_queue_insert(queue, event);
+    timer_queue_program(queue);
+    spin_unlock(&queue->lock);
+
+    if (!started) {
+        WARNING("cpu %d timer event queue full", cpu.id);
+    }
+
+    return started;
+}
+
+/* Stops the event wherever it is queued, a periodic one included */
+void timer_event_stop(struct timer_event* event)
+{
+    event->period = 0;
+
+    /* The event may move between the read and the lock, so check again */
+    while (event->queued) {
+        cpuid_t id = event->cpu;
+        struct timer_queue* queue =
+            id == cpu.id ? &cpu.interface.timers : &cpu_if(id)->timers;
+
+        spin_lock(&queue->lock);
+        if (event->queued && event->cpu == id) {
+            timer_queue_remove(queue, event);
+            if (id == cpu.id) {
+                timer_queue_program(queue);
+            }
+        }
+        spin_unlock(&queue->lock);
+    }
+}
+
+bool timer_event_pending(struct timer_event* event)
+{
+    return event->queued;
+}
+
+/* The time by which the local cpu has to handle its next event */
+uint64_t timer_next_deadline()
+{
+    return cpu.interface.timers.programmed;
+}
+
+/* Programs the hardware timer again, after the cpu lost its state */
+void timer_restore()
+{
+    struct timer_queue* queue = &cpu.interface.timers;
+
+    spin_lock(&queue->lock);
+    timer_arch_set(queue->programmed);
+    spin_unlock(&queue->lock);
+}
+
+uint64_t timer_get_counter()
+{
+    return timer_arch_get_counter();
+}
+
+uint64_t timer_get_freq()
+{
+    return timer_arch_get_freq();
+}
+
+uint64_t timer_us_to_ticks(uint64_t us)
+{
+    return (us * timer_get_freq()) / 1000000;
+}
+
+uint64_t timer_ticks_to_us(uint64_t ticks)
+{
+    uint64_t freq = timer_get_freq();
+    if (freq == 0) return 0;
+    return ((ticks / freq) * 1000000) + (((ticks % freq) * 1000000) / freq);
+}
+
+/**
+ * Runs every event whose deadline passed, as long as it is next in line. An
+ * event further down the queue may have to wait for its latest time, but
+ * none is left behind past it.
+ */
+void timer_handle()
+{
+    struct timer_queue* queue = &cpu.interface.timers;
+    uint64_t now = timer_get_counter();
+
+    spin_lock(&queue->lock);
+    queue->programmed = TIMER_DEADLINE_NONE;
+    while (queue->num > 0 && queue->heap[0]->deadline <= now) {
+        struct timer_event* event = queue->heap[0];
+        timer_queue_remove(queue, event);
+        spin_unlock(&queue->lock);
+
+        if (event->handler != NULL) {
+            event->handler(event);
+        }
+
+        spin_lock(&queue->lock);
+        if (event->period != 0 && !event->queued) {
+            event->deadline += event->period;
+            if (event->deadline <= now) {
+                event->deadline = now + event->period;
+            }
+            timer_queue_insert(queue, event);
+        }
+        now = timer_get_counter();
+    }
+    timer_queue_program(queue);
+    spin_unlock(&queue->lock);
+}
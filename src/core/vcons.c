@@ -0,0 +1,528 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vcons.h>
+#include <vdbg.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <console.h>
+#include <interrupts.h>
+#include <hypercall.h>
+#include <fences.h>
+#include <string.h>
+
+#define VCONS_MAX_VMS (16)
+/* Ctrl-A */
+#define VCONS_ESCAPE ('\x01')
+/* Escaped, hands the uart to the GDB stub */
+#define VCONS_DBG_KEY ('g')
+
+enum { VCONS_INPUT, VCONS_OUTPUT };
+
+static spinlock_t vcons_lock = SPINLOCK_INITVAL;
+static struct vm* vcons_vms[VCONS_MAX_VMS];
+static size_t vcons_vm_num;
+
+/* Output multiplexing state, protected by vcons_lock */
+static struct vm* vcons_owner;
+static size_t vcons_next;
+static bool vcons_line_open;
+static const char* vcons_text;
+static bool vcons_tx_armed;
+
+/* Input state, protected by vcons_lock */
+static struct vm* vcons_focus;
+static bool vcons_escape;
+/* While the GDB stub owns the uart, the VMs' output is held back */
+static enum { VCONS_DBG_OFF, VCONS_DBG_ATTACH, VCONS_DBG_ON } vcons_dbg;
+
+static inline bool vcons_buf_empty(struct vcons* vc)
+{
+    return vc->buf_head == vc->buf_tail;
+}
+
+static inline bool vcons_buf_full(struct vcons* vc)
+{
+    return vc->buf_head - vc->buf_tail >= VCONS_BUF_SIZE;
+}
+
+static inline bool vcons_block()
+{
+    /* Without an interrupt to resume from, output is drained synchronously */
+    return platform.console.interrupt == 0;
+}
+
+static void vcons_msg_handler(uint32_t event, uint64_t data)
+{
+    struct vcpu* vcpu = cpu_get_vcpu(data);
+    if (vcpu == NULL) return;
+
+    const struct vm_config* config = vcpu->vm->config;
+    if (event == VCONS_INPUT && vcpu->vm->vcons.ring != NULL &&
+        config->console.interrupt != 0) {
+        vcpu_inject_irq(vcpu, config->console.interrupt);
+    }
+
+    vcons_arch_update(vcpu);
+}
+CPU_MSG_HANDLER(vcons_msg_handler, VCONS_CPUMSG_ID);
+
+static void vcons_notify(struct vm* vm, uint32_t event)
+{
+    struct cpu_msg msg = {VCONS_CPUMSG_ID, event, vm->id};
+
+    /* Any of the VM's cpus will do */
+    for (cpuid_t i = 0; i < platform.cpu_num; i++) {
+        if (vm->cpus & (1UL << i)) {
+            cpu_send_msg(i, &msg);
+            break;
+        }
+    }
+}
+
+/**
+ * Moves the output the guest queued on its ring to the VM's buffer. The ring
+ * indexes are guest controlled and only trusted up to the ring's size. Must be
+ * called with vcons_lock held.
+ */
+static void vcons_pull(struct vcons* vc)
+{
+    struct vcons_ring* ring = vc->ring;
+    if (ring == NULL) return;
+
+    uint32_t prod = ring->out_prod;
+    uint32_t cons = ring->out_cons;
+    fence_ord_read();
+
+    if ((uint32_t)(prod - cons) > VCONS_RING_OUT_SIZE) {
+        cons = prod - VCONS_RING_OUT_SIZE;
+    }
+
+    while (cons != prod && !vcons_buf_full(vc)) {
+        vc->buf[vc->buf_head++ % VCONS_BUF_SIZE] =
+            ring->out[cons++ % VCONS_RING_OUT_SIZE];
+    }
+
+    fence_ord();
+    ring->out_cons = cons;
+}
+
+/* Must be called with vcons_lock held */
+static struct vm* vcons_pick()
+{
+    if (vcons_owner != NULL && !vcons_buf_empty(&vcons_owner->vcons)) {
+        return vcons_owner;
+    }
+
+    for (size_t i = 0; i < vcons_vm_num; i++) {
+        size_t idx = (vcons_next + i) % vcons_vm_num;
+        struct vm* vm = vcons_vms[idx];
+        vcons_pull(&vm->vcons);
+        if (!vcons_buf_empty(&vm->vcons)) {
+            vcons_next = idx + 1;
+            return vm;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes the VMs' output to the uart until it fills up or there is nothing
+ * left. Output goes out a line at a time: a VM keeps the uart until it ends
+ * its line or runs out of output, and every line is prefixed with the VM's
+ * id. Must be called with vcons_lock held. Returns true if all output was
+ * written.
+ */
+static bool vcons_drain_locked()
+{
+    if (vcons_dbg != VCONS_DBG_OFF) return true;
+
+    while (true) {
+        while (vcons_text != NULL && *vcons_text != '\0') {
+            if (!console_putc(*vcons_text, vcons_block())) return false;
+            vcons_text++;
+        }
+
+        struct vm* vm = vcons_pick();
+        if (vm == NULL) return true;
+        struct vcons* vc = &vm->vcons;
+
+        if (vm != vcons_owner) {
+            vcons_owner = vm;
+            if (vcons_line_open) {
+                /* Another VM left its line unfinished */
+                vcons_line_open = false;
+                vcons_text = "\r\n";
+                continue;
+            }
+        }
+
+        if (!vcons_line_open) {
+            vcons_line_open = true;
+            vcons_text = vc->prefix;
+            continue;
+        }
+
+        char c = vc->buf[vc->buf_tail % VCONS_BUF_SIZE];
+        if (!console_putc(c, vcons_block())) return false;
+        vc->buf_tail++;
+
+        if (c == '\n') {
+            vcons_line_open = false;
+            vcons_owner = NULL;
+        }
+    }
+}
+
+static void vcons_drain()
+{
+    struct vm* stalled[VCONS_MAX_VMS];
+    size_t stalled_num = 0;
+
+    spin_lock(&vcons_lock);
+
+    bool done = vcons_drain_locked();
+
+    /* The uart's transmit interrupt resumes draining once the fifo empties */
+    if (platform.console.interrupt != 0 && done == vcons_tx_armed) {
+        vcons_tx_armed = !done;
+        console_set_irqs(true, vcons_tx_armed);
+    }
+
+    for (size_t i = 0; i < vcons_vm_num; i++) {
+        struct vcons* vc = &vcons_vms[i]->vcons;
+        if (vc->tx_stalled && !vcons_buf_full(vc)) {
+            vc->tx_stalled = false;
+            stalled[stalled_num++] = vcons_vms[i];
+        }
+    }
+
+    spin_unlock(&vcons_lock);
+
+    for (size_t i = 0; i < stalled_num; i++) {
+        vcons_notify(stalled[i], VCONS_OUTPUT);
+    }
+}
+
+/* Must be called with vcons_lock held */
+static void vcons_switch_focus(char key)
+{
+    struct vm* focus = NULL;
+
+    if (key >= '0' && key <= '9') {
+        for (size_t i = 0; i < vcons_vm_num; i++) {
+            if (vcons_vms[i]->id == (vmid_t)(key - '0')) {
+                focus = vcons_vms[i];
+            }
+        }
+    } else if (vcons_vm_num > 0) {
+        size_t i = 0;
+        while (i < vcons_vm_num && vcons_vms[i] != vcons_focus) i++;
+        focus = vcons_vms[(i + 1) % vcons_vm_num];
+    }
+
+    if (focus != NULL && focus != vcons_focus) {
+        vcons_focus = focus;
+        INFO("Console input switched to VM %d", focus->id);
+    }
+}
+
+/**
+ * Hands a character typed on the uart to the VM with the input focus.
+ * Returns that VM, or NULL if the character was consumed or dropped. Must be
+ * called with vcons_lock held.
+ */
+static struct vm* vcons_input(char c)
+{
+    if (vcons_escape) {
+        vcons_escape = false;
+        if (c == VCONS_DBG_KEY) {
+            if (vcons_focus != NULL) vcons_dbg = VCONS_DBG_ATTACH;
+            return NULL;
+        } else if (c != VCONS_ESCAPE) {
+            vcons_switch_focus(c);
+            return NULL;
+        }
+    } else if (c == VCONS_ESCAPE) {
+        vcons_escape = true;
+        return NULL;
+    }
+
+    if (vcons_focus == NULL) return NULL;
+    struct vcons* vc = &vcons_focus->vcons;
+
+    if (vc->ring != NULL) {
+        struct vcons_ring* ring = vc->ring;
+        uint32_t prod = ring->in_prod;
+        if ((uint32_t)(prod - ring->in_cons) >= VCONS_RING_IN_SIZE) {
+            return NULL;
+        }
+        ring->in[prod % VCONS_RING_IN_SIZE] = c;
+        fence_ord_write();
+        ring->in_prod = prod + 1;
+    } else {
+        if (vc->in_head - vc->in_tail >= VCONS_IN_SIZE) {
+            return NULL;
+        }
+        vc->in[vc->in_head++ % VCONS_IN_SIZE] = c;
+    }
+
+    return vcons_focus;
+}
+
+static void vcons_poll_input()
+{
+    struct vm* target = NULL;
+    struct vm* attach = NULL;
+    char dbg[VCONS_IN_SIZE];
+    size_t dbg_num = 0;
+    char c;
+
+    spin_lock(&vcons_lock);
+    while (dbg_num < VCONS_IN_SIZE && console_getc(&c)) {
+        if (vcons_dbg != VCONS_DBG_OFF) {
+            dbg[dbg_num++] = c;
+            continue;
+        }
+        struct vm* vm = vcons_input(c);
+        if (vm != NULL) target = vm;
+    }
+    if (vcons_dbg == VCONS_DBG_ATTACH) {
+        vcons_dbg = VCONS_DBG_ON;
+        attach = vcons_focus;
+    }
+    spin_unlock(&vcons_lock);
+
+    if (target != NULL) {
+        vcons_notify(target, VCONS_INPUT);
+    }
+
+    /* The stub writes to the uart, so it is fed without holding the lock */
+    if (attach != NULL && !vdbg_attach(attach)) {
+        vcons_dbg_detach();
+        dbg_num = 0;
+    }
+    if (dbg_num > 0) {
+        vdbg_input(dbg, dbg_num);
+    }
+}
+
+static void vcons_irq_handler(irqid_t int_id)
+{
+    vcons_poll_input();
+    vcons_drain();
+}
+
+static void vcons_set_prefix(struct vcons* vc, vmid_t id)
+{
+    char digits[8];
+    size_t n = 0;
+    size_t i = 0;
+
+    do {
+        digits[n++] = '0' + (id % 10);
+        id /= 10;
+    } while (id != 0 && n < sizeof(digits));
+
+    vc->prefix[i++] = '[';
+    vc->prefix[i++] = 'V';
+    vc->prefix[i++] = 'M';
+    while (n > 0) vc->prefix[i++] = digits[--n];
+    vc->prefix[i++] = ']';
+    vc->prefix[i++] = ' ';
+    vc->prefix[i] = '\0';
+}
+
+void vcons_init()
+{
+    if (cpu.id == CPU_MASTER && platform.console.interrupt != 0) {
+        interrupts_reserve(platform.console.interrupt, vcons_irq_handler);
+        interrupts_cpu_enable(platform.console.interrupt, true);
+        console_set_irqs(true, false);
+    }
+}
+
+void vcons_vm_init(struct vm* vm)
+{
+    struct vcons* vc = &vm->vcons;
+    const struct vm_config* config = vm->config;
+
+    memset(vc, 0, sizeof(*vc));
+
+    if (!config->console.enable) {
+        return;
+    }
+
+    if (config->console.ring != 0) {
+        bool valid = (config->console.ring & PAGE_OFFSET_MASK) == 0 &&
+                     sizeof(struct vcons_ring) <= PAGE_SIZE;
+        bool in_mem = false;
+        for (size_t i = 0; i < config->platform.region_num; i++) {
+            struct mem_region* reg = &config->platform.regions[i];
+            if (range_in_range(config->console.ring, PAGE_SIZE, reg->base,
+                               reg->size)) {
+                in_mem = true;
+            }
+        }
+
+        if (!valid || !in_mem) {
+            WARNING("VM %d console ring must be a page of its memory",
+                    vm->id);
+        } else {
+            vc->ring = (struct vcons_ring*)mem_map_cpy(
+                &vm->as, &cpu.as, config->console.ring, NULL_VA, 1);
+        }
+    }
+
+    vcons_set_prefix(vc, vm->id);
+    vc->enabled = true;
+
+    spin_lock(&vcons_lock);
+    if (vcons_vm_num < VCONS_MAX_VMS) {
+        vcons_vms[vcons_vm_num++] = vm;
+        if (vcons_focus == NULL) {
+            vcons_focus = vm;
+        }
+    } else {
+        WARNING("VM %d console not multiplexed, too many consoles", vm->id);
+        vc->enabled = false;
+    }
+    spin_unlock(&vcons_lock);
+
+    if (vc->enabled) {
+        vcons_arch_init(vm);
+    }
+}
+
+/**
+ * Queues a character the VM wrote to its emulated uart. Returns false if the
+ * VM's buffer is full, in which case the VM is notified once it drains.
+ */
+bool vcons_putc(struct vm* vm, char c)
+{
+    struct vcons* vc = &vm->vcons;
+    bool queued = false;
+
+    spin_lock(&vcons_lock);
+    if (vcons_buf_full(vc)) {
+        vc->tx_stalled = true;
+    } else {
+        vc->buf[vc->buf_head++ % VCONS_BUF_SIZE] = c;
+        queued = true;
+    }
+    spin_unlock(&vcons_lock);
+
+    vcons_drain();
+
+    return queued;
+}
+
+bool vcons_getc(struct vm* vm, char* c)
+{
+    struct vcons* vc = &vm->vcons;
+    bool read = false;
+
+    spin_lock(&vcons_lock);
+    if (vc->in_head != vc->in_tail) {
+        *c = vc->in[vc->in_tail++ % VCONS_IN_SIZE];
+        read = true;
+    }
+    spin_unlock(&vcons_lock);
+
+    return read;
+}
+
+bool vcons_tx_full(struct vm* vm)
+{
+    spin_lock(&vcons_lock);
+    bool full = vcons_buf_full(&vm->vcons);
+    spin_unlock(&vcons_lock);
+    return full;
+}
+
+bool vcons_rx_empty(struct vm* vm)
+{
+    spin_lock(&vcons_lock);
+    bool empty = vm->vcons.in_head == vm->vcons.in_tail;
+    spin_unlock(&vcons_lock);
+    return empty;
+}
+
+/**
+ * Catches up with the uart when there is no interrupt to do it in the
+ * background.
+ */
+void vcons_poll()
+{
+    if (platform.console.interrupt == 0) {
+        vcons_poll_input();
+    }
+    vcons_drain();
+}
+
+/**
+ * Services the uart from a cpu that can not take its interrupt, because it is
+ * held by the debugger with interrupts masked.
+ */
+void vcons_service()
+{
+    vcons_poll_input();
+    vcons_drain();
+}
+
+/* Writes the GDB stub's output, which has the uart to itself */
+void vcons_dbg_write(const char* buf, size_t len)
+{
+    spin_lock(&vcons_lock);
+    for (size_t i = 0; i < len; i++) {
+        console_putc(buf[i], true);
+    }
+    spin_unlock(&vcons_lock);
+}
+
+/* Gives the uart back to the VMs once the GDB stub detaches */
+void vcons_dbg_detach()
+{
+    spin_lock(&vcons_lock);
+    vcons_dbg = VCONS_DBG_OFF;
+    spin_unlock(&vcons_lock);
+
+    vcons_drain();
+}
+
+/**
+ * Doorbell for the VM's console ring. Output is drained up to what the uart
+ * takes right away, the rest in the background.
+ */
+unsigned long vcons_hypercall(unsigned long arg0, unsigned long arg1,
+                              unsigned long arg2)
+{
+    struct vm* vm = cpu.vcpu->vm;
+
+    if (!vm->vcons.enabled || vm->vcons.ring == NULL) {
+        return -HC_E_FAILURE;
+    }
+
+    vcons_poll();
+
+    return HC_E_SUCCESS;
+}
+
+__attribute__((weak)) void vcons_arch_init(struct vm* vm)
+{
+    /* No uart emulation */
+}
+
+__attribute__((weak)) void vcons_arch_update(struct vcpu* vcpu)
+{
+}
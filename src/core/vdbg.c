@@ -0,0 +1,879 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+#include <vdbg.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <cache.h>
+#include <vcons.h>
+#include <string.h>
+
+/**
+ * GDB remote serial protocol stub. It is reached through the console uart,
+ * which vcons hands over to it for as long as the debugger is attached. A
+ * single VM may be debugged at a time, in all-stop mode: every vcpu of the VM
+ * is paused when it stops and resumed when it continues, while the other VMs
+ * keep running. Each vcpu is reported as a thread with id vcpu id + 1.
+ * Memory addresses are the guest's virtual addresses, translated through the
+ * selected vcpu's stage 1 and the VM's stage 2.
+ */
+
+#define VDBG_PKT_SIZE (1024)
+/* Ctrl-C, sent by the debugger out of band to interrupt the VM */
+#define VDBG_INTERRUPT ('\x03')
+
+enum { VDBG_MSG_PAUSE, VDBG_MSG_RESUME };
+
+static void vdbg_msg_handler(uint32_t event, uint64_t data);
+CPU_MSG_HANDLER(vdbg_msg_handler, VDBG_CPUMSG_ID);
+
+enum {
+    VDBG_PKT_IDLE,
+    VDBG_PKT_DATA,
+    VDBG_PKT_CSUM_HI,
+    VDBG_PKT_CSUM_LO,
+};
+
+/* Stub state, protected by vdbg_lock */
+static spinlock_t vdbg_lock = SPINLOCK_INITVAL;
+static struct vm* vdbg_vm;
+static int vdbg_pkt_state;
+static char vdbg_pkt[VDBG_PKT_SIZE];
+static size_t vdbg_pkt_len;
+static uint8_t vdbg_pkt_csum;
+static char vdbg_reply[VDBG_PKT_SIZE];
+static size_t vdbg_reply_len = 1;
+static uint8_t vdbg_buf[VDBG_PKT_SIZE / 2];
+/* The debugger waits for a stop reply */
+static bool vdbg_waiting;
+
+static const char vdbg_hex[] = "0123456789abcdef";
+
+static int vdbg_hex_val(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool vdbg_prefix(const char* str, const char* prefix)
+{
+    while (*prefix != '\0') {
+        if (*str++ != *prefix++) return false;
+    }
+    return true;
+}
+
+static bool vdbg_parse_num(const char** str, uint64_t* val)
+{
+    const char* p = *str;
+    uint64_t v = 0;
+    int d;
+
+    while ((d = vdbg_hex_val(*p)) >= 0) {
+        v = (v << 4) | d;
+        p++;
+    }
+
+    *val = v;
+    if (p == *str) return false;
+    *str = p;
+    return true;
+}
+
+static size_t vdbg_parse_bytes(const char* str, uint8_t* buf, size_t max)
+{
+    size_t n = 0;
+    int hi, lo;
+
+    while (n < max && (hi = vdbg_hex_val(str[0])) >= 0 &&
+           (lo = vdbg_hex_val(str[1])) >= 0) {
+        buf[n++] = (hi << 4) | lo;
+        str += 2;
+    }
+
+    return n;
+}
+
+/* The reply is built after the leading '$' */
+static void vdbg_reply_start()
+{
+    vdbg_reply_len = 1;
+}
+
+static void vdbg_put_char(char c)
+{
+    /* Leave room for the checksum */
+    if (vdbg_reply_len < VDBG_PKT_SIZE - 3) {
+        vdbg_reply[vdbg_reply_len++] = c;
+    }
+}
+
+static void vdbg_put_str(const char* str)
+{
+    while (*str != '\0') vdbg_put_char(*str++);
+}
+
+static void vdbg_put_byte(uint8_t b)
+{
+    vdbg_put_char(vdbg_hex[b >> 4]);
+    vdbg_put_char(vdbg_hex[b & 0xf]);
+}
+
+static void vdbg_put_num(uint64_t val)
+{
+    size_t shift = 60;
+
+    while (shift > 0 && ((val >> shift) & 0xf) == 0) shift -= 4;
+    while (true) {
+        vdbg_put_char(vdbg_hex[(val >> shift) & 0xf]);
+        if (shift == 0) break;
+        shift -= 4;
+    }
+}
+
+/* Register contents go out in the target's byte order, little-endian */
+static void vdbg_put_le(uint64_t val, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        vdbg_put_byte((val >> (i * 8)) & 0xff);
+    }
+}
+
+static uint64_t vdbg_get_le(const uint8_t* buf, size_t size)
+{
+    uint64_t val = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        val |= (uint64_t)buf[i] << (i * 8);
+    }
+
+    return val;
+}
+
+/* Frames and sends the reply built so far. Must be called with vdbg_lock held */
+static void vdbg_send()
+{
+    uint8_t csum = 0;
+
+    for (size_t i = 1; i < vdbg_reply_len; i++) {
+        csum += (uint8_t)vdbg_reply[i];
+    }
+
+    vdbg_reply[0] = '$';
+    vdbg_reply[vdbg_reply_len++] = '#';
+    vdbg_reply[vdbg_reply_len++] = vdbg_hex[csum >> 4];
+    vdbg_reply[vdbg_reply_len++] = vdbg_hex[csum & 0xf];
+
+    vcons_dbg_write(vdbg_reply, vdbg_reply_len);
+    vdbg_reply_start();
+}
+
+static void vdbg_send_str(const char* str)
+{
+    vdbg_reply_start();
+    vdbg_put_str(str);
+    vdbg_send();
+}
+
+static struct vcpu* vdbg_vcpu(struct vm* vm)
+{
+    return vm_get_vcpu(vm, vm->dbg.vcpu);
+}
+
+/* Must be called with vdbg_lock held */
+static void vdbg_send_stop(struct vm* vm)
+{
+    struct vdbg* dbg = &vm->dbg;
+
+    vdbg_reply_start();
+    vdbg_put_char('T');
+    vdbg_put_byte(dbg->stop_signal);
+    vdbg_put_str("thread:");
+    vdbg_put_num(dbg->stop_vcpu + 1);
+    vdbg_put_char(';');
+
+    if (dbg->stop_watch) {
+        const char* kind = "awatch:";
+        for (size_t i = 0; i < dbg->wp_num; i++) {
+            struct vdbg_wp* wp = &dbg->wps[i];
+            if (dbg->stop_addr >= wp->addr &&
+                dbg->stop_addr < wp->addr + wp->len) {
+                if (wp->type == VDBG_WP_WRITE) kind = "watch:";
+                if (wp->type == VDBG_WP_READ) kind = "rwatch:";
+                break;
+            }
+        }
+        vdbg_put_str(kind);
+        vdbg_put_num(dbg->stop_addr);
+        vdbg_put_char(';');
+    }
+
+    vdbg_send();
+}
+
+static void vdbg_msg_all(struct vm* vm, uint32_t event, bool local)
+{
+    struct cpu_msg msg = {VDBG_CPUMSG_ID, event, vm->id};
+
+    for (cpuid_t i = 0; i < platform.cpu_num; i++) {
+        if ((vm->cpus & (1UL << i)) && (local || i != cpu.id)) {
+            cpu_send_msg(i, &msg);
+        }
+    }
+}
+
+/* Called once the last of the VM's vcpus has paused */
+static void vdbg_stopped(struct vm* vm)
+{
+    spin_lock(&vdbg_lock);
+    if (vdbg_vm == vm) {
+        vm->dbg.vcpu = vm->dbg.stop_vcpu;
+        vm->dbg.step_vcpu = INVALID_CPUID;
+        if (vdbg_waiting) {
+            vdbg_waiting = false;
+            vdbg_send_stop(vm);
+        }
+    }
+    spin_unlock(&vdbg_lock);
+}
+
+/**
+ * Pauses vcpu, which must run on the local cpu. Its state is saved so that
+ * the stub can access it from any cpu.
+ */
+static void vdbg_pause(struct vcpu* vcpu)
+{
+    struct vm* vm = vcpu->vm;
+    bool done;
+
+    spin_lock(&vm->dbg.lock);
+    if (vm->dbg.state != VDBG_STOPPING || vcpu->dbg.paused) {
+        spin_unlock(&vm->dbg.lock);
+        return;
+    }
+    spin_unlock(&vm->dbg.lock);
+
+    if (vcpu == cpu.vcpu) vcpu_save_state(vcpu);
+    vdbg_arch_pause(vcpu);
+    vcpu->dbg.paused = true;
+
+    spin_lock(&vm->dbg.lock);
+    done = --vm->dbg.running == 0;
+    if (done) vm->dbg.state = VDBG_STOPPED;
+    spin_unlock(&vm->dbg.lock);
+
+    if (done) vdbg_stopped(vm);
+}
+
+static void vdbg_msg_handler(uint32_t event, uint64_t data)
+{
+    struct vcpu* vcpu = cpu_get_vcpu(data);
+    if (vcpu == NULL) return;
+
+    switch (event) {
+        case VDBG_MSG_PAUSE:
+            vdbg_pause(vcpu);
+            if (vcpu->dbg.paused && vcpu == cpu.vcpu) cpu_defer_idle();
+            break;
+        case VDBG_MSG_RESUME:
+            if (vcpu->dbg.paused) {
+                vdbg_arch_resume(vcpu);
+                vcpu->dbg.paused = false;
+            }
+            break;
+    }
+}
+
+/**
+ * Starts stopping the VM, if it is running, recording why. Returns false if it
+ * was already stopping or stopped.
+ */
+static bool vdbg_stop(struct vm* vm, int signal, vcpuid_t vcpu, bool watch,
+                      vaddr_t addr)
+{
+    struct vdbg* dbg = &vm->dbg;
+    bool stop;
+
+    spin_lock(&dbg->lock);
+    stop = dbg->attached && dbg->state == VDBG_RUNNING;
+    if (stop) {
+        dbg->state = VDBG_STOPPING;
+        dbg->running = vm->cpu_num;
+        dbg->stop_signal = signal;
+        dbg->stop_vcpu = vcpu;
+        dbg->stop_watch = watch;
+        dbg->stop_addr = addr;
+    }
+    spin_unlock(&dbg->lock);
+
+    return stop;
+}
+
+static void vdbg_resume(struct vm* vm)
+{
+    spin_lock(&vm->dbg.lock);
+    vm->dbg.state = VDBG_RUNNING;
+    spin_unlock(&vm->dbg.lock);
+
+    vdbg_msg_all(vm, VDBG_MSG_RESUME, true);
+}
+
+/* Must be called with vdbg_lock held */
+static void vdbg_detach(struct vm* vm)
+{
+    struct vdbg* dbg = &vm->dbg;
+
+    spin_lock(&dbg->lock);
+    dbg->attached = false;
+    dbg->bp_num = 0;
+    dbg->wp_num = 0;
+    dbg->step_vcpu = INVALID_CPUID;
+    spin_unlock(&dbg->lock);
+
+    /* Resuming with the stub detached also releases the debug hardware */
+    vdbg_resume(vm);
+
+    vdbg_vm = NULL;
+    vdbg_waiting = false;
+    vdbg_pkt_state = VDBG_PKT_IDLE;
+    vcons_dbg_detach();
+    INFO("GDB stub detached from VM %d", vm->id);
+}
+
+/**
+ * Copies between buf and the memory the vcpu sees at guest virtual address
+ * addr, a page at a time through a temporary hypervisor mapping.
+ */
+static bool vdbg_mem(struct vcpu* vcpu, vaddr_t addr, uint8_t* buf,
+                     size_t len, bool write)
+{
+    while (len > 0) {
+        size_t off = addr & (PAGE_SIZE - 1);
+        size_t n = min(len, PAGE_SIZE - off);
+        paddr_t pa;
+
+        if (!vdbg_arch_translate(vcpu, addr, write, &pa)) return false;
+
+        struct ppages pages = mem_ppages_get(pa & ~(PAGE_SIZE - 1), 1);
+        vaddr_t va = mem_alloc_vpage(&cpu.as, SEC_HYP_PRIVATE, NULL_VA, 1);
+        if (va == NULL_VA) return false;
+        mem_map(&cpu.as, va, &pages, 1, PTE_HYP_FLAGS);
+
+        /* The guest might be accessing it through a non-cacheable mapping */
+        cache_flush_range(va + off, n);
+        if (write) {
+            memcpy((void*)(va + off), buf, n);
+            cache_flush_range(va + off, n);
+        } else {
+            memcpy(buf, (void*)(va + off), n);
+        }
+
+        mem_free_vpage(&cpu.as, va, 1, false);
+
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+
+    if (write) vdbg_arch_sync_icache();
+
+    return true;
+}
+
+static void vdbg_read_regs(struct vm* vm)
+{
+    struct vcpu* vcpu = vdbg_vcpu(vm);
+    uint64_t val;
+    size_t size;
+
+    vdbg_reply_start();
+    for (size_t reg = 0; vdbg_arch_get_reg(vcpu, reg, &val, &size); reg++) {
+        vdbg_put_le(val, size);
+    }
+
+    if (vdbg_reply_len == 1) {
+        vdbg_put_str("E01");
+    }
+    vdbg_send();
+}
+
+static void vdbg_write_regs(struct vm* vm, const char* args)
+{
+    struct vcpu* vcpu = vdbg_vcpu(vm);
+    size_t len = vdbg_parse_bytes(args, vdbg_buf, sizeof(vdbg_buf));
+    size_t off = 0;
+    uint64_t val;
+    size_t size;
+
+    for (size_t reg = 0; vdbg_arch_get_reg(vcpu, reg, &val, &size); reg++) {
+        if (off + size > len) break;
+        vdbg_arch_set_reg(vcpu, reg, vdbg_get_le(&vdbg_buf[off], size));
+        off += size;
+    }
+
+    vdbg_send_str("OK");
+}
+
+static void vdbg_read_reg(struct vm* vm, const char* args)
+{
+    struct vcpu* vcpu = vdbg_vcpu(vm);
+    uint64_t reg, val;
+    size_t size;
+
+    if (!vdbg_parse_num(&args, &reg) ||
+        !vdbg_arch_get_reg(vcpu, reg, &val, &size)) {
+        vdbg_send_str("E01");
+        return;
+    }
+
+    vdbg_reply_start();
+    vdbg_put_le(val, size);
+    vdbg_send();
+}
+
+static void vdbg_write_reg(struct vm* vm, const char* args)
+{
+    struct vcpu* vcpu = vdbg_vcpu(vm);
+    uint64_t reg, val;
+    size_t size;
+
+    if (!vdbg_parse_num(&args, &reg) || *args++ != '=' ||
+        !vdbg_arch_get_reg(vcpu, reg, &val, &size) ||
+        vdbg_parse_bytes(args, vdbg_buf, size) != size ||
+        !vdbg_arch_set_reg(vcpu, reg, vdbg_get_le(vdbg_buf, size))) {
+        vdbg_send_str("E01");
+        return;
+    }
+
+    vdbg_send_str("OK");
+}
+
+static void vdbg_read_mem(struct vm* vm, const char* args)
+{
+    uint64_t addr, len;
+
+    if (!vdbg_parse_num(&args, &addr) || *args++ != ',' ||
+        !vdbg_parse_num(&args, &len)) {
+        vdbg_send_str("E01");
+        return;
+    }
+
+    /* Reply with as much as fits, the debugger asks again for the rest */
+    len = min(len, (VDBG_PKT_SIZE - 4) / 2);
+    if (!vdbg_mem(vdbg_vcpu(vm), addr, vdbg_buf, len, false)) {
+        vdbg_send_str("E14");
+        return;
+    }
+
+    vdbg_reply_start();
+    for (size_t i = 0; i < len; i++) {
+        vdbg_put_byte(vdbg_buf[i]);
+    }
+    vdbg_send();
+}
+
+static void vdbg_write_mem(struct vm* vm, const char* args)
+{
+    uint64_t addr, len;
+
+    if (!vdbg_parse_num(&args, &addr) || *args++ != ',' ||
+        !vdbg_parse_num(&args, &len) || *args++ != ':' ||
+        len > sizeof(vdbg_buf) ||
+        vdbg_parse_bytes(args, vdbg_buf, len) != len) {
+        vdbg_send_str("E01");
+        return;
+    }
+
+    if (!vdbg_mem(vdbg_vcpu(vm), addr, vdbg_buf, len, true)) {
+        vdbg_send_str("E14");
+        return;
+    }
+
+    vdbg_send_str("OK");
+}
+
+/**
+ * Inserts or removes a breakpoint or watchpoint. Software breakpoints are
+ * also backed by hardware ones, which keeps the guest's memory untouched.
+ */
+static void vdbg_point(struct vm* vm, const char* args, bool insert)
+{
+    struct vdbg* dbg = &vm->dbg;
+    uint64_t type, addr, len;
+    const char* reply = "OK";
+
+    if (!vdbg_parse_num(&args, &type) || *args++ != ',' ||
+        !vdbg_parse_num(&args, &addr) || *args++ != ',' ||
+        !vdbg_parse_num(&args, &len)) {
+        vdbg_send_str("E01");
+        return;
+    }
+
+    spin_lock(&dbg->lock);
+    if (type <= 1) {
+        size_t i = 0;
+        while (i < dbg->bp_num && dbg->bps[i] != addr) i++;
+        if (insert && i == dbg->bp_num) {
+            if (dbg->bp_num < min(vdbg_arch_bp_num(), VDBG_MAX_BPS)) {
+                dbg->bps[dbg->bp_num++] = addr;
+            } else {
+                reply = "E28";
+            }
+        } else if (!insert && i < dbg->bp_num) {
+            dbg->bps[i] = dbg->bps[--dbg->bp_num];
+        }
+    } else if (type <= 4) {
+        enum vdbg_wp_type wp_type = type == 2   ? VDBG_WP_WRITE
+                                    : type == 3 ? VDBG_WP_READ
+                                                : VDBG_WP_ACCESS;
+        size_t i = 0;
+        while (i < dbg->wp_num &&
+               (dbg->wps[i].addr != addr || dbg->wps[i].len != len ||
+                dbg->wps[i].type != wp_type)) {
+            i++;
+        }
+        if (insert && i == dbg->wp_num) {
+            if (!vdbg_arch_wp_fits(addr, len)) {
+                reply = "E22";
+            } else if (dbg->wp_num < min(vdbg_arch_wp_num(), VDBG_MAX_WPS)) {
+                dbg->wps[dbg->wp_num++] =
+                    (struct vdbg_wp){.addr = addr, .len = len, .type = wp_type};
+            } else {
+                reply = "E28";
+            }
+        } else if (!insert && i < dbg->wp_num) {
+            dbg->wps[i] = dbg->wps[--dbg->wp_num];
+        }
+    } else {
+        reply = "";
+    }
+    spin_unlock(&dbg->lock);
+
+    vdbg_send_str(reply);
+}
+
+static void vdbg_continue(struct vm* vm, const char* args, bool step)
+{
+    struct vcpu* vcpu = vdbg_vcpu(vm);
+    uint64_t addr;
+
+    /* Resuming at another address is done by writing the pc, register 32 */
+    if (vdbg_parse_num(&args, &addr)) {
+        vdbg_arch_set_reg(vcpu, 32, addr);
+    }
+
+    vm->dbg.step_vcpu = step ? vcpu->id : INVALID_CPUID;
+    vdbg_waiting = true;
+    vdbg_resume(vm);
+}
+
+static bool vdbg_thread(struct vm* vm, const char** args, vcpuid_t* vcpuid)
+{
+    uint64_t tid;
+
+    /* -1 and 0 stand for all and any thread */
+    if (**args == '-' || !vdbg_parse_num(args, &tid) || tid == 0) {
+        *vcpuid = vm->dbg.vcpu;
+        return true;
+    }
+    if (tid > vm->cpu_num) return false;
+    *vcpuid = tid - 1;
+    return true;
+}
+
+static void vdbg_query(struct vm* vm, const char* args)
+{
+    vdbg_reply_start();
+
+    if (vdbg_prefix(args, "Supported")) {
+        vdbg_put_str("PacketSize=");
+        vdbg_put_num(VDBG_PKT_SIZE - 4);
+    } else if (vdbg_prefix(args, "Attached")) {
+        vdbg_put_char('1');
+    } else if (args[0] == 'C' && args[1] == '\0') {
+        vdbg_put_str("QC");
+        vdbg_put_num(vm->dbg.vcpu + 1);
+    } else if (vdbg_prefix(args, "fThreadInfo")) {
+        vdbg_put_char('m');
+        for (size_t i = 0; i < vm->cpu_num; i++) {
+            if (i > 0) vdbg_put_char(',');
+            vdbg_put_num(i + 1);
+        }
+    } else if (vdbg_prefix(args, "sThreadInfo")) {
+        vdbg_put_char('l');
+    }
+
+    vdbg_send();
+}
+
+/* Must be called with vdbg_lock held */
+static void vdbg_handle(struct vm* vm)
+{
+    const char* args = &vdbg_pkt[1];
+    bool stopped = vm->dbg.state == VDBG_STOPPED;
+    vcpuid_t vcpuid;
+
+    /* Only queries, the stop reason and detaching do not need the VM stopped */
+    if (!stopped && vdbg_pkt[0] != '?' && vdbg_pkt[0] != 'q' &&
+        vdbg_pkt[0] != 'v' && vdbg_pkt[0] != 'D' && vdbg_pkt[0] != 'k') {
+        vdbg_send_str("E16");
+        return;
+    }
+
+    switch (vdbg_pkt[0]) {
+        case '?':
+            if (stopped) {
+                vdbg_send_stop(vm);
+            } else {
+                vdbg_waiting = true;
+            }
+            break;
+        case 'g':
+            vdbg_read_regs(vm);
+            break;
+        case 'G':
+            vdbg_write_regs(vm, args);
+            break;
+        case 'p':
+            vdbg_read_reg(vm, args);
+            break;
+        case 'P':
+            vdbg_write_reg(vm, args);
+            break;
+        case 'm':
+            vdbg_read_mem(vm, args);
+            break;
+        case 'M':
+            vdbg_write_mem(vm, args);
+            break;
+        case 'c':
+            vdbg_continue(vm, args, false);
+            break;
+        case 's':
+            vdbg_continue(vm, args, true);
+            break;
+        case 'Z':
+            vdbg_point(vm, args, true);
+            break;
+        case 'z':
+            vdbg_point(vm, args, false);
+            break;
+        case 'H':
+            args++;
+            if (!vdbg_thread(vm, &args, &vcpuid)) {
+                vdbg_send_str("E01");
+            } else {
+                if (vdbg_pkt[1] == 'g') vm->dbg.vcpu = vcpuid;
+                vdbg_send_str("OK");
+            }
+            break;
+        case 'T':
+            vdbg_send_str(vdbg_thread(vm, &args, &vcpuid) ? "OK" : "E01");
+            break;
+        case 'q':
+            vdbg_query(vm, args);
+            break;
+        case 'D':
+            vdbg_send_str("OK");
+            vdbg_detach(vm);
+            break;
+        case 'k':
+            /* The VM is left running, only the debugger goes away */
+            vdbg_detach(vm);
+            break;
+        default:
+            vdbg_send_str("");
+            break;
+    }
+}
+
+/**
+ * Takes the VM with the console input focus for the debugger. Its vcpus are
+ * stopped right away, as the debugger expects when it connects.
+ */
+bool vdbg_attach(struct vm* vm)
+{
+    bool attached = false;
+
+    if (!vm->config->debug.enable) {
+        WARNING("VM %d does not allow debugging", vm->id);
+        return false;
+    }
+
+    /* Replay owns the VM's single step and its inputs */
+    if (vm->vrr.mode == VM_REPLAY_REPLAY) {
+        WARNING("VM %d is replaying", vm->id);
+        return false;
+    }
+
+    spin_lock(&vdbg_lock);
+    if (vdbg_vm == NULL) {
+        spin_lock(&vm->dbg.lock);
+        vm->dbg.attached = true;
+        vm->dbg.state = VDBG_RUNNING;
+        vm->dbg.vcpu = 0;
+        vm->dbg.step_vcpu = INVALID_CPUID;
+        spin_unlock(&vm->dbg.lock);
+
+        vdbg_vm = vm;
+        vdbg_waiting = false;
+        vdbg_pkt_state = VDBG_PKT_IDLE;
+        attached = true;
+    }
+    spin_unlock(&vdbg_lock);
+
+    if (attached) {
+        INFO("GDB stub attached to VM %d", vm->id);
+        if (vdbg_stop(vm, VDBG_SIGINT, 0, false, 0)) {
+            vdbg_msg_all(vm, VDBG_MSG_PAUSE, true);
+        }
+    }
+
+    return attached;
+}
+
+/* Feeds the stub with the bytes the debugger sent over the uart */
+void vdbg_input(const char* buf, size_t len)
+{
+    spin_lock(&vdbg_lock);
+
+    for (size_t i = 0; i < len && vdbg_vm != NULL; i++) {
+        struct vm* vm = vdbg_vm;
+        char c = buf[i];
+        int d;
+
+        switch (vdbg_pkt_state) {
+            case VDBG_PKT_IDLE:
+                if (c == '$') {
+                    vdbg_pkt_len = 0;
+                    vdbg_pkt_state = VDBG_PKT_DATA;
+                } else if (c == VDBG_INTERRUPT) {
+                    if (vdbg_stop(vm, VDBG_SIGINT, vm->dbg.vcpu, false, 0)) {
+                        vdbg_msg_all(vm, VDBG_MSG_PAUSE, true);
+                    }
+                }
+                /* Acks and anything else between packets are ignored */
+                break;
+            case VDBG_PKT_DATA:
+                if (c == '#') {
+                    vdbg_pkt_state = VDBG_PKT_CSUM_HI;
+                } else if (vdbg_pkt_len < VDBG_PKT_SIZE - 1) {
+                    vdbg_pkt[vdbg_pkt_len++] = c;
+                }
+                break;
+            case VDBG_PKT_CSUM_HI:
+                d = vdbg_hex_val(c);
+                vdbg_pkt_csum = d < 0 ? 0 : d << 4;
+                vdbg_pkt_state = VDBG_PKT_CSUM_LO;
+                break;
+            case VDBG_PKT_CSUM_LO:
+                d = vdbg_hex_val(c);
+                vdbg_pkt_csum |= d < 0 ? 0 : d;
+                vdbg_pkt_state = VDBG_PKT_IDLE;
+
+                uint8_t csum = 0;
+                for (size_t j = 0; j < vdbg_pkt_len; j++) {
+                    csum += (uint8_t)vdbg_pkt[j];
+                }
+                if (csum != vdbg_pkt_csum || vdbg_pkt_len == 0) {
+                    vcons_dbg_write("-", 1);
+                    break;
+                }
+
+                vcons_dbg_write("+", 1);
+                vdbg_pkt[vdbg_pkt_len] = '\0';
+                vdbg_handle(vm);
+                break;
+        }
+    }
+
+    spin_unlock(&vdbg_lock);
+}
+
+/**
+ * Called on the cpu running vcpu when it hits a breakpoint or watchpoint or
+ * completes a single step. The vcpu pauses right away and the VM's other
+ * vcpus are asked to follow.
+ */
+void vdbg_trap(struct vcpu* vcpu, bool watch, vaddr_t addr)
+{
+    struct vm* vm = vcpu->vm;
+
+    if (vdbg_stop(vm, VDBG_SIGTRAP, vcpu->id, watch, addr)) {
+        vdbg_msg_all(vm, VDBG_MSG_PAUSE, false);
+    }
+
+    vdbg_pause(vcpu);
+    if (vcpu->dbg.paused) {
+        cpu_idle();
+    } else {
+        /* A leftover from a session that ended, make sure it is released */
+        vdbg_arch_load(vcpu);
+    }
+}
+
+/**
+ * Keeps the cpu of a paused vcpu serving the debugger until the vcpu is
+ * resumed. The console's interrupt might be routed here, so the uart is
+ * serviced before idling.
+ */
+void vdbg_wait(struct vcpu* vcpu)
+{
+    if (vcpu->dbg.paused) {
+        vcons_service();
+        cpu_idle();
+    }
+}
+
+__attribute__((weak)) size_t vdbg_arch_bp_num()
+{
+    return 0;
+}
+
+__attribute__((weak)) size_t vdbg_arch_wp_num()
+{
+    return 0;
+}
+
+__attribute__((weak)) bool vdbg_arch_wp_fits(vaddr_t addr, size_t len)
+{
+    return false;
+}
+
+__attribute__((weak)) bool vdbg_arch_get_reg(struct vcpu* vcpu, size_t reg,
+                                             uint64_t* val, size_t* size)
+{
+    return false;
+}
+
+__attribute__((weak)) bool vdbg_arch_set_reg(struct vcpu* vcpu, size_t reg,
+                                             uint64_t val)
+{
+    return false;
+}
+
+__attribute__((weak)) bool vdbg_arch_translate(struct vcpu* vcpu, vaddr_t va,
+                                               bool write, paddr_t* pa)
+{
+    return false;
+}
+
+__attribute__((weak)) void vdbg_arch_sync_icache() {}
+
+__attribute__((weak)) void vdbg_arch_pause(struct vcpu* vcpu) {}
+
+__attribute__((weak)) void vdbg_arch_resume(struct vcpu* vcpu) {}
+
+__attribute__((weak)) void vdbg_arch_load(struct vcpu* vcpu) {}
@@ -0,0 +1,255 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vec.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <config.h>
+#include <string.h>
+
+/**
+ * Vector registers are switched lazily. Each cpu's registers belong to one
+ * of its vcpus, their owner, and every other vcpu runs with vector
+ * instructions trapped. On its first vector instruction, the owner's
+ * registers are saved, if it changed them, and the trapping vcpu's loaded.
+ * A vcpu that has a cpu to itself only ever traps once.
+ */
+
+/* Largest state of any VM, the size of the stacked activations' buffers */
+static size_t vec_max_size;
+
+static inline size_t vec_size(struct vm* vm)
+{
+    return vec_arch_size(vm->vec.vl);
+}
+
+static void* vec_alloc(size_t size)
+{
+    return mem_alloc_page(NUM_PAGES(size), SEC_HYP_PRIVATE, false);
+}
+
+/* Largest state of the VM set up from config and of those it hosts */
+static size_t vec_config_size(const struct vm_config* config)
+{
+    size_t vl = config->vector.enable ? vec_arch_vl(config->vector.max_vl) : 0;
+    size_t size = vec_arch_size(vl);
+
+    for (size_t i = 0; i < config->children_num; i++) {
+        size_t child = vec_config_size(config->children[i]);
+        size = max(size, child);
+    }
+
+    return size;
+}
+
+void vec_init()
+{
+    vec_arch_init();
+
+    vec_max_size = 0;
+    for (size_t i = 0; i < vm_config_ptr->vmlist_size; i++) {
+        size_t size = vec_config_size(vm_config_ptr->vmlist[i]);
+        if (size > vec_max_size) {
+            vec_max_size = size;
+        }
+    }
+}
+
+void vec_vm_init(struct vm* vm)
+{
+    const struct vm_config* config = vm->config;
+
+    vm->vec.enable = config->vector.enable;
+    vm->vec.vl = vm->vec.enable ? vec_arch_vl(config->vector.max_vl) : 0;
+
+    if (vm->vec.enable && vm->vec.vl == 0) {
+        WARNING("VM %d vectors disabled, not supported with a length of at "
+                "most %d bytes", vm->id, config->vector.max_vl);
+        vm->vec.enable = false;
+    }
+}
+
+void vec_vcpu_reset(struct vcpu* vcpu)
+{
+    vcpu->vec.valid = false;
+
+    if (cpu.vec.owner == vcpu) {
+        cpu.vec.owner = NULL;
+        vec_arch_enable(vcpu, false);
+    }
+}
+
+void vec_vcpu_destroy(struct vcpu* vcpu)
+{
+    vec_vcpu_reset(vcpu);
+
+    if (vcpu->vec.regs != NULL) {
+        mem_free_vpage(&cpu.as, (vaddr_t)vcpu->vec.regs,
+                       NUM_PAGES(vec_size(vcpu->vm)), true);
+        vcpu->vec.regs = NULL;
+    }
+}
+
+/* Must be called whenever vcpu becomes the cpu's running vcpu */
+void vec_vcpu_resume(struct vcpu* vcpu)
+{
+    vec_arch_enable(vcpu, cpu.vec.owner == vcpu);
+}
+
+/* Saves the owner's registers to memory, leaving the cpu without one */
+void vec_flush()
+{
+    struct vcpu* owner = cpu.vec.owner;
+
+    if (owner == NULL) return;
+
+    if (vec_arch_dirty(owner)) {
+        vec_arch_save(owner, owner->vec.regs);
+    }
+    cpu.vec.owner = NULL;
+    vec_arch_enable(owner, false);
+}
+
+/**
+ * Handles vcpu trapping on a vector instruction. Returns false if the trap
+ * was not due to the lazy switch, i.e., vcpu already owns the registers or
+ * can not use them at all.
+ */
+bool vec_trap(struct vcpu* vcpu)
+{
+    size_t size = vec_size(vcpu->vm);
+
+    if (size == 0 || cpu.vec.owner == vcpu) {
+        return false;
+    }
+
+    if (vcpu->vec.regs == NULL) {
+        vcpu->vec.regs = vec_alloc(size);
+        if (vcpu->vec.regs == NULL) {
+            WARNING("VM %d vcpu %d has no memory for its vector registers",
+                    vcpu->vm->id, vcpu->id);
+            return false;
+        }
+    }
+
+    vec_flush();
+
+    /**
+     * Until a vcpu first owned them, the registers hold no VM's state and
+     * are taken as vcpu's own. This is also what a vcpu carried over by a
+     * live update expects.
+     */
+    if (!vcpu->vec.valid && !cpu.vec.used) {
+        vec_arch_save(vcpu, vcpu->vec.regs);
+        vcpu->vec.valid = true;
+    } else if (!vcpu->vec.valid) {
+        memset(vcpu->vec.regs, 0, size);
+    }
+
+    vec_arch_restore(vcpu, vcpu->vec.regs);
+    vcpu->vec.valid = true;
+    cpu.vec.owner = vcpu;
+    cpu.vec.used = true;
+    vec_arch_enable(vcpu, true);
+
+    return true;
+}
+
+/**
+ * Sets the vector registers of vcpu's stacked activation aside in ctx, as
+ * it is re-entered. The re-entered activation starts off with the same
+ * registers.
+ */
+void vec_save_ctx(struct vcpu* vcpu, struct vec_state* ctx)
+{
+    ctx->valid = false;
+
+    if (cpu.vec.owner == vcpu) {
+        vec_flush();
+    }
+
+    if (!vcpu->vec.valid) return;
+
+    if (ctx->regs == NULL) {
+        ctx->regs = vec_alloc(vec_max_size);
+        if (ctx->regs == NULL) {
+            WARNING("no memory to stack VM %d vector registers",
+                    vcpu->vm->id);
+            return;
+        }
+    }
+
+    memcpy(ctx->regs, vcpu->vec.regs, vec_size(vcpu->vm));
+    ctx->valid = true;
+}
+
+/* Gives back vcpu's stacked activation the registers it had */
+void vec_restore_ctx(struct vcpu* vcpu, struct vec_state* ctx)
+{
+    /* The loaded registers are the popped activation's */
+    if (cpu.vec.owner == vcpu) {
+        cpu.vec.owner = NULL;
+        vec_arch_enable(vcpu, false);
+    }
+
+    vcpu->vec.valid = ctx->valid;
+    if (ctx->valid) {
+        memcpy(vcpu->vec.regs, ctx->regs, vec_size(vcpu->vm));
+    }
+}
+
+/**
+ * Lets the hypervisor itself use the vector registers until vec_hyp_put.
+ * The owner's registers are saved first, and whatever the hypervisor leaves
+ * in them is never taken as a vcpu's.
+ */
+void vec_hyp_get()
+{
+    /* Registers no vcpu owned yet may still be the running vcpu's */
+    if (!cpu.vec.used && cpu.vcpu != NULL) {
+        vec_trap(cpu.vcpu);
+    }
+    vec_flush();
+    cpu.vec.used = true;
+    vec_arch_hyp_access(true);
+}
+
+void vec_hyp_put()
+{
+    vec_arch_hyp_access(false);
+}
+
+__attribute__((weak)) void vec_arch_init() {}
+
+__attribute__((weak)) size_t vec_arch_vl(size_t max_vl)
+{
+    return 0;
+}
+
+__attribute__((weak)) size_t vec_arch_size(size_t vl)
+{
+    return 0;
+}
+
+__attribute__((weak)) void vec_arch_save(struct vcpu* vcpu, void* regs) {}
+
+__attribute__((weak)) void vec_arch_restore(struct vcpu* vcpu,
+                                            const void* regs) {}
+
+__attribute__((weak)) bool vec_arch_dirty(struct vcpu* vcpu)
+{
+    return true;
+}
+
+__attribute__((weak)) void vec_arch_enable(struct vcpu* vcpu, bool owner) {}
+
+__attribute__((weak)) void vec_arch_hyp_access(bool enable) {}
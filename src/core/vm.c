@@ -19,13 +19,16 @@
 #include <string.h>
 #include <mem.h>
 #include <cache.h>
+#include <tlb.h>
 #include "inc/ipc.h"
+#include <interrupts.h>
 #include "list.h"
 
 #include <sdtz.h>
 #include <sdgpos.h>
 #include <sdsgx.h>
 #include <vmstack.h>
+#include <lu.h>
 
 enum emul_type {EMUL_MEM, EMUL_REG};
 struct emul_node {
@@ -37,7 +40,70 @@ struct emul_node {
     };
 };
 
-static void vm_master_init(struct vm* vm, const struct vm_config* config, vmid_t vm_id)
+/* Everything mapped in a VM must be aligned to its stage-2 granule */
+static void vm_check_granule(const struct vm_config* config, vmid_t vm_id)
+{
+    size_t granule = config->stage2_granule;
+    const struct platform_desc* platform = &config->platform;
+
+    if (granule == 0 || granule == PAGE_SIZE) {
+        return;
+    }
+
+    for (size_t i = 0; i < platform->region_num; i++) {
+        struct mem_region* reg = &platform->regions[i];
+        if (reg->base % granule || reg->size % granule ||
+            (reg->place_phys && reg->phys % granule)) {
+            ERROR("VM %d memory region %d not aligned to its stage-2 granule",
+                  vm_id, i);
+        }
+    }
+
+    for (size_t i = 0; i < platform->dev_num; i++) {
+        struct dev_region* dev = &platform->devs[i];
+        if (dev->pa % granule || dev->va % granule || dev->size % granule) {
+            ERROR("VM %d device %d not aligned to its stage-2 granule", vm_id,
+                  i);
+        }
+    }
+
+    for (size_t i = 0; i < platform->ipc_num; i++) {
+        struct ipc* ipc = &platform->ipcs[i];
+        if (ipc->base % granule || ipc->size % granule) {
+            ERROR("VM %d ipc %d not aligned to its stage-2 granule", vm_id, i);
+        }
+    }
+}
+
+/* Number of address bits spanning everything mapped in the VM */
+static size_t vm_ipa_bits(const struct vm_config* config)
+{
+    const struct platform_desc* platform = &config->platform;
+    vaddr_t top = 0;
+    size_t bits = 0;
+
+    for (size_t i = 0; i < platform->region_num; i++) {
+        struct mem_region* reg = &platform->regions[i];
+        if (reg->base + reg->size > top) top = reg->base + reg->size;
+    }
+    for (size_t i = 0; i < platform->dev_num; i++) {
+        struct dev_region* dev = &platform->devs[i];
+        if (dev->va + dev->size > top) top = dev->va + dev->size;
+    }
+    for (size_t i = 0; i < platform->ipc_num; i++) {
+        struct ipc* ipc = &platform->ipcs[i];
+        if (ipc->base + ipc->size > top) top = ipc->base + ipc->size;
+    }
+
+    for (vaddr_t last = top - 1; top != 0 && last != 0; last >>= 1) {
+        bits++;
+    }
+
+    return bits;
+}
+
+static void vm_master_init(struct vm* vm, const struct vm_config* config,
+                           vmid_t vm_id, size_t granule)
 {
     vm->master = cpu.id;
     vm->config = config;
@@ -46,7 +112,11 @@ static void vm_master_init(struct vm* vm, const struct vm_config* config, vmid_t
 
     cpu_sync_init(&vm->sync, vm->cpu_num);
 
-    as_init(&vm->as, AS_VM, vm->id, NULL, config->colors);
+    if (!as_vm_init(&vm->as, vm->id, cache_vm_colors(config), granule,
+                    vm_ipa_bits(config))) {
+        ERROR("VM %d stage-2 granule 0x%lx or address span not supported",
+              vm->id, granule);
+    }
 
     vm->type = config->type;
 
@@ -57,6 +127,17 @@ static void vm_master_init(struct vm* vm, const struct vm_config* config, vmid_t
     objcache_init(&vm->hvc_oc, sizeof(struct hndl_hvc_node), SEC_HYP_VM, false);
     objcache_init(&vm->irq_oc, sizeof(struct hndl_irq_node), SEC_HYP_VM, false);
     objcache_init(&vm->mem_abort_oc, sizeof(struct hndl_mem_abort_node), SEC_HYP_VM, false);
+
+    vm->fault.lock = SPINLOCK_INITVAL;
+    vm->fault.count = 0;
+    vm->fault.reports = 0;
+    vm->fault.window = timer_get_counter();
+    vm->img_copied = false;
+
+    vm->dbg.lock = SPINLOCK_INITVAL;
+    vm->dbg.attached = false;
+
+    vm->state = VM_RUNNING;
 }
 
 static void vm_master_destroy(struct vm* vm)
@@ -75,6 +156,17 @@ void vm_cpu_init(struct vm* vm)
     spin_unlock(&vm->lock);
 }
 
+/**
+ * Called once the VM is set up, before any of its vcpus runs. From then on,
+ * the tlb invalidations of its address space target all of its cpus, which
+ * first drop whatever they hold for its VMID.
+ */
+static void vm_as_ready(struct vm* vm)
+{
+    vm->as.cpus = vm->cpus;
+    tlb_inv_all(&vm->as);
+}
+
 void vm_add_vcpu(struct vm* vm, struct vcpu* vcpu)
 {
     struct node_data* node = objcache_alloc(&partition->nodes);
@@ -143,6 +235,8 @@ struct vcpu* vm_vcpu_destroy(struct vm* vm, struct vcpu* vcpu)
     cpu_remove_vcpu(vcpu);
 
     list_rm(&vm->vcpu_list, (node_t*)vcpu);
+    vec_vcpu_destroy(vcpu);
+    vcpu_arch_destroy(vcpu);
 
     memset(vcpu->stack, 0, sizeof(vcpu->stack));
 
@@ -175,8 +269,15 @@ void vm_copy_img_to_rgn(struct vm* vm, const struct vm_config* config,
         ERROR("mem_map failed %s", __func__);
     }
 
-    memcpy((void*)dst_va, (void*)src_va, n_img * PAGE_SIZE);
+    struct sha256 sha;
+    size_t img_size = config->image.size;
+    sha256_init(&sha);
+    sha256_update_copy(&sha, (void*)dst_va, (void*)src_va, img_size);
+    memcpy((void*)(dst_va + img_size), (void*)(src_va + img_size),
+           (n_img * PAGE_SIZE) - img_size);
+    attest_image_final(vm, &sha);
     cache_flush_range((vaddr_t)dst_va, n_img * PAGE_SIZE);
+    vm->img_copied = true;
     /* TODO: unmap */
 }
 
@@ -192,9 +293,9 @@ void vm_map_mem_region(struct vm* vm, struct mem_region* reg)
 
     if (reg->place_phys) {
         struct ppages pa_reg = mem_ppages_get(reg->phys, n);
-        mem_map(&vm->as, va, &pa_reg, n, PTE_VM_FLAGS);
+        mem_map(&vm->as, va, &pa_reg, n, vm->as.vm_flags);
     } else {
-        mem_map(&vm->as, va, NULL, n, PTE_VM_FLAGS);
+        mem_map(&vm->as, va, NULL, n, vm->as.vm_flags);
     }
 }
 
@@ -218,22 +319,22 @@ static void vm_map_img_rgn_inplace(struct vm* vm, const struct vm_config* config
                                     (vaddr_t)reg->base, n_total);
 
     /* map pages before img */
-    mem_map(&vm->as, va, NULL, n_before, PTE_VM_FLAGS);
+    mem_map(&vm->as, va, NULL, n_before, vm->as.vm_flags);
 
     if (all_clrs(vm->as.colors)) {
         /* map img in place */
         mem_map(&vm->as, va + n_before * PAGE_SIZE, &pa_img, n_img,
-                PTE_VM_FLAGS);
+                vm->as.vm_flags);
         /* we are mapping in place, config is already reserved */
     } else {
         /* recolour img */
         mem_map_reclr(&vm->as, va + n_before * PAGE_SIZE, &pa_img, n_img,
-                      PTE_VM_FLAGS);
+                      vm->as.vm_flags);
         /* TODO: reserve phys mem? */
     }
     /* map pages after img */
     mem_map(&vm->as, va + (n_before + n_img) * PAGE_SIZE, NULL, n_aft,
-            PTE_VM_FLAGS);
+            vm->as.vm_flags);
 }
 
 static void vm_install_image(struct vm* vm) {
@@ -245,10 +346,15 @@ static void vm_install_image(struct vm* vm) {
     mem_map(&cpu.as, src_va, &img_ppages, img_num_pages, PTE_HYP_FLAGS);
     vaddr_t dst_va = mem_map_cpy(&vm->as, &cpu.as, vm->config->image.base_addr,
                                 NULL_VA, img_num_pages);
-    memcpy((void*)dst_va, (void*)src_va, vm->config->image.size);
+    struct sha256 sha;
+    sha256_init(&sha);
+    sha256_update_copy(&sha, (void*)dst_va, (void*)src_va,
+                       vm->config->image.size);
+    attest_image_final(vm, &sha);
     cache_flush_range((vaddr_t)dst_va, vm->config->image.size);
     mem_free_vpage(&cpu.as, src_va, img_num_pages, false);
     mem_free_vpage(&cpu.as, dst_va, img_num_pages, false);
+    vm->img_copied = true;
 }
 
 void vm_map_img_rgn(struct vm* vm, const struct vm_config* config,
@@ -257,8 +363,9 @@ void vm_map_img_rgn(struct vm* vm, const struct vm_config* config,
     if (reg->place_phys) {
         vm_copy_img_to_rgn(vm, config, reg);
         vm_map_mem_region(vm, reg);
-    } else if(config->image.inplace) {
+    } else if(config->image.inplace && pt_granule(&vm->as.pt) == PAGE_SIZE) {
         vm_map_img_rgn_inplace(vm, config, reg);
+        attest_measure_image(vm);
     } else {
         vm_map_mem_region(vm, reg);
         vm_install_image(vm);
@@ -267,6 +374,11 @@ void vm_map_img_rgn(struct vm* vm, const struct vm_config* config,
 
 static void vm_init_mem_regions(struct vm* vm, const struct vm_config* config)
 {
+    /* Resuming from a live update, guest memory is left as it was */
+    if (lu_vm_map(vm)) {
+        return;
+    }
+
     for (size_t i = 0; i < config->platform.region_num; i++) {
         struct mem_region* reg = &config->platform.regions[i];
 
@@ -337,7 +449,8 @@ static void vm_init_dev(struct vm* vm, const struct vm_config* vm_cfg)
     }
 
     /* iommu */
-    if (iommu_vm_init(vm, vm->config)) {
+    bool iommu = iommu_vm_init(vm, vm->config);
+    if (iommu) {
         for (size_t i = 0; i < vm->config->platform.dev_num; i++) {
             struct dev_region* dev = &vm->config->platform.devs[i];
             if (dev->id) {
@@ -347,6 +460,8 @@ static void vm_init_dev(struct vm* vm, const struct vm_config* vm_cfg)
             }
         }
     }
+
+    vpci_init(vm, iommu);
 }
 
 static void vm_destroy_dev(struct vm* vm, const struct vm_config* config)
@@ -446,7 +561,11 @@ static void vm_dynamic_donate(struct vm* newvm, struct config* config, uint64_t
 void vm_init_dynamic(struct vm* vm, struct config* config, uint64_t vm_addr, vmid_t vmid)
 {
     INFO("Creating dynamic VM %d", vmid);
-    vm_master_init(vm, config->vmlist[0], vmid);
+    /* Enclaves are built from pages of their host */
+    if (config->vmlist[0]->stage2_granule != 0) {
+        WARNING("Dynamic VM %d stage-2 granule ignored", vmid);
+    }
+    vm_master_init(vm, config->vmlist[0], vmid, 0);
     vm_cpu_init(vm);
 
     vm_vcpu_init(vm, config->vmlist[0]);
@@ -454,20 +573,32 @@ void vm_init_dynamic(struct vm* vm, struct config* config, uint64_t vm_addr, vmi
 
     /* TODO: init dynamic from config not like this */
     vm_dynamic_donate(vm, config, vm_addr);
+    if (config->vmlist[0]->image.size > 0) {
+        attest_measure_image(vm);
+    }
 
     vm_init_dev(vm, config->vmlist[0]);
     vm_init_ipc(vm, config->vmlist[0]);
+    vwdt_init(vm);
 
     sdsgx_handler_setup(vm);
+    vm_as_ready(vm);
 
     vm->vmdyn_house_keeping.donor_va = vm_addr;
     vm->vmdyn_house_keeping.config = config;
     INFO("Dynamic VM %d created", vmid);
 }
 
-void vm_dynamic_reclaim(struct vcpu* host, struct vcpu* newvm)
+/**
+ * Gives the memory of the dynamic VM newvm back to its host. The VM is
+ * stacked over the host meanwhile, which fails, leaving everything as it
+ * was, if the VM stack does not allow it.
+ */
+bool vm_dynamic_reclaim(struct vcpu* host, struct vcpu* newvm)
 {
-    vmstack_push(newvm);
+    if (!vmstack_push(newvm)) {
+        return false;
+    }
 
     struct config* config = newvm->vm->vmdyn_house_keeping.config;
     struct vm_config* newvm_cfg = config->vmlist[0];
@@ -560,23 +691,31 @@ void vm_dynamic_reclaim(struct vcpu* host, struct vcpu* newvm)
         mem_free_vpage(&cpu.as, (vaddr_t)config, NUM_PAGES(hdr_sz), false);
     }
     vmstack_pop();
+
+    return true;
 }
 
 
-void vm_destroy_dynamic(struct vm* vm)
+bool vm_destroy_dynamic(struct vm* vm)
 {
     INFO("Destroying dynamic VM %d", vm->id);
-    vm_destroy_ipc(vm);
-    vm_destroy_dev(vm, vm->config);
 
     /* TODO: This is not making much sense right now. We need to reclaim
      * resources from the vm, not from the cpu */
-    vm_dynamic_reclaim(cpu.vcpu, vm_get_vcpu(vm, 0));
+    if (!vm_dynamic_reclaim(cpu.vcpu, vm_get_vcpu(vm, 0))) {
+        WARNING("Dynamic VM %d can not be destroyed while stacked", vm->id);
+        return false;
+    }
+
+    vm_destroy_ipc(vm);
+    vm_destroy_dev(vm, vm->config);
 
     vm_vcpu_destroy(vm, vm_get_vcpu(vm, 0));
     /* vm_arch_destroy(vm, vm->config); */
 
     vm_master_destroy(vm);
+
+    return true;
 }
 
 #include <sdtz.h>
@@ -588,7 +727,8 @@ struct vcpu* vm_init(struct vm* vm, const struct vm_config* config, bool master,
      */
     if (master) {
         INFO("Initializing VM %d", vm_id);
-        vm_master_init(vm, config, vm_id);
+        vm_check_granule(config, vm_id);
+        vm_master_init(vm, config, vm_id, config->stage2_granule);
     }
 
     /*
@@ -617,18 +757,25 @@ struct vcpu* vm_init(struct vm* vm, const struct vm_config* config, bool master,
      * its image was loaded.
      */
     if (master) {
+        attest_set_config(vm, NULL);
         vm_init_mem_regions(vm, config);
         vm_init_dev(vm, config);
         vm_init_ipc(vm, config);
+        vwdt_init(vm);
+        vcons_vm_init(vm);
+        vrr_vm_init(vm, vcpu);
+        wss_init(vm);
+        coredump_vm_init(vm);
+        vec_vm_init(vm);
     }
 
     if(master){
         switch(vm->type){
-            case 0:
+            case VM_TYPE_GPOS:
                 INFO("VM %d is sdGPOS (normal VM)", vm->id);
                 break;
-            case 1:
-            case 2:
+            case VM_TYPE_TEE_HOST:
+            case VM_TYPE_TEE_GUEST:
                 INFO("VM %d is sdTZ (OP-TEE)", vm->id);
                 break;
         }
@@ -637,6 +784,8 @@ struct vcpu* vm_init(struct vm* vm, const struct vm_config* config, bool master,
         sdtz_handler_setup(vm);
         sdgpos_handler_setup(vm);
         sdsgx_handler_setup(vm);
+
+        vm_as_ready(vm);
     }
 
     cpu_sync_barrier(&vm->sync);
@@ -783,8 +932,27 @@ __attribute__((weak)) cpumap_t vm_translate_to_vcpu_mask(struct vm* vm,
     return pmask;
 }
 
+/**
+ * Keeps the cpu idle while vcpu's VM is being reset, until the cpu that
+ * finishes the reset wakes it up.
+ */
+static void vm_reset_wait(struct vcpu* vcpu)
+{
+    bool resetting;
+
+    spin_lock(&vcpu->vm->lock);
+    resetting = vcpu->vm->state == VM_RESETTING;
+    spin_unlock(&vcpu->vm->lock);
+
+    if (resetting) {
+        cpu_idle();
+    }
+}
+
 void vcpu_run(struct vcpu* vcpu)
 {
+    vdbg_wait(vcpu);
+    vm_reset_wait(vcpu);
     cpu.vcpu->active = true;
     vcpu_arch_run(vcpu);
 }
@@ -802,3 +970,290 @@ struct vcpu* vcpu_get_child(struct vcpu* vcpu, int index)
     }
     return child;
 }
+
+enum { VM_MSG_QUIESCE, VM_MSG_RESET, VM_MSG_RESUME };
+
+static const char* const vm_state_name[] = {
+    [VM_RUNNING] = "running",
+    [VM_HALTED] = "halted",
+    [VM_CRASHED] = "crashed",
+    [VM_RESETTING] = "resetting",
+};
+
+/**
+ * Raises an event on the manager VM's shared memory channel, if one is
+ * configured. The event id is the id of the VM that needs attention. Only
+ * the local cpu is left out, as the manager may share the VM's other cpus.
+ */
+void vm_notify_manager(struct vm* vm)
+{
+    if (vm_config_ptr->vm_manager.enable) {
+        ipc_notify_event(vm_config_ptr->vm_manager.shmem_id, vm->id,
+                         1UL << cpu.id);
+    }
+}
+
+/* The manager VM is the one with access to the manager's channel */
+bool vm_is_manager(struct vm* vm)
+{
+    if (!vm_config_ptr->vm_manager.enable) return false;
+
+    for (size_t i = 0; i < vm->ipc_num; i++) {
+        if (vm->ipcs[i].shmem_id == vm_config_ptr->vm_manager.shmem_id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Whether [ipa, ipa + size) is within one of the VM's memory regions */
+bool vm_ipa_in_mem(struct vm* vm, vaddr_t ipa, size_t size)
+{
+    const struct platform_desc* platform = &vm->config->platform;
+
+    for (size_t i = 0; i < platform->region_num; i++) {
+        struct mem_region* reg = &platform->regions[i];
+        if (range_in_range(ipa, size, reg->base, reg->size)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool vm_state_valid_transition(enum vm_state from, enum vm_state to)
+{
+    switch (to) {
+        case VM_HALTED:
+        case VM_CRASHED:
+            return from == VM_RUNNING;
+        case VM_RESETTING:
+            return from != VM_RESETTING;
+        case VM_RUNNING:
+            return from == VM_RESETTING;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Moves the VM to a new state. Returns false, leaving the state untouched, if
+ * the transition is not allowed from the current state. This makes concurrent
+ * requests to halt, crash or reset the same VM collapse into a single one.
+ */
+bool vm_set_state(struct vm* vm, enum vm_state state)
+{
+    bool valid;
+
+    spin_lock(&vm->lock);
+    valid = vm_state_valid_transition(vm->state, state);
+    if (valid) {
+        vm->state = state;
+        if (state == VM_RESETTING) {
+            vm->reset_pending = vm->cpu_num;
+        }
+    }
+    spin_unlock(&vm->lock);
+
+    if (valid) {
+        INFO("VM %d is %s", vm->id, vm_state_name[state]);
+        vm_notify_manager(vm);
+        if (state == VM_CRASHED) {
+            coredump_vm_crashed(vm);
+        }
+    }
+
+    return valid;
+}
+
+static void vm_msg_all(struct vm* vm, uint32_t event);
+
+/**
+ * Quiesces or resets the vcpu of the VM with id vmid that runs on the local
+ * cpu. Must be executed on every cpu the VM runs on. A quiesced vcpu has its
+ * passthrough interrupts masked and is powered off, releasing the cpu to the
+ * vcpu stacked below it or to idle. On reset, the cpu that resets the last
+ * vcpu, and so knows none of them runs, restores the VM's image and wakes
+ * the VM's cpus up, which have been kept idle meanwhile.
+ */
+static void vm_vcpu_stop(vmid_t vmid, bool reset)
+{
+    struct vcpu* vcpu = cpu_get_vcpu(vmid);
+    if (vcpu == NULL) return;
+
+    struct vm* vm = vcpu->vm;
+    bool on = reset && vcpu->id == 0;
+
+    if (reset) {
+        /**
+         * The arch reset might touch live registers. Make sure the state of
+         * the vcpu currently running on this cpu is not lost if it is not
+         * the one being reset.
+         */
+        if (vcpu != cpu.vcpu) vcpu_save_state(cpu.vcpu);
+        vcpu_arch_reset(vcpu, vm->config->entry);
+        vcpu_restore_state(cpu.vcpu);
+        vcpu->tee_data.online = false;
+        vcpu->tee_data.call_pending = false;
+
+        bool done;
+        spin_lock(&vm->lock);
+        done = --vm->reset_pending == 0;
+        spin_unlock(&vm->lock);
+        if (done) {
+            vm_install_image(vm);
+            vm_set_state(vm, VM_RUNNING);
+            vm_msg_all(vm, VM_MSG_RESUME);
+        } else if (vcpu == cpu.vcpu && on) {
+            cpu_defer_idle();
+        }
+    } else {
+        interrupts_vm_disable(vm);
+    }
+    vcpu_arch_set_power(vcpu, on);
+
+    if (vcpu == cpu.vcpu && !on && vmstack_pop() == NULL) {
+        cpu_defer_idle();
+    }
+}
+
+static void vm_msg_handler(uint32_t event, uint64_t data)
+{
+    switch (event) {
+        case VM_MSG_QUIESCE:
+            vm_vcpu_stop(data, false);
+            break;
+        case VM_MSG_RESET:
+            vm_vcpu_stop(data, true);
+            break;
+        case VM_MSG_RESUME:
+            /* Only wakes the cpu up, which then resumes its vcpu */
+            break;
+    }
+}
+
+CPU_MSG_HANDLER(vm_msg_handler, VM_CPUMSG_ID);
+
+/**
+ * Sends event for vm to all of the VM's cpus, including the local one. The
+ * local cpu handles its own message as any other, from the cpu message
+ * interrupt, which is taken as soon as the trap or interrupt that got us here
+ * returns. This way the handler that called us never steps over or clobbers
+ * the state of a vcpu that was just reset or powered off.
+ */
+static void vm_msg_all(struct vm* vm, uint32_t event)
+{
+    struct cpu_msg msg = {VM_CPUMSG_ID, event, vm->id};
+    vm_msg_broadcast(vm, &msg);
+    if (vm->cpus & (1UL << cpu.id)) {
+        cpu_send_msg(cpu.id, &msg);
+    }
+}
+
+void vm_halt(struct vm* vm)
+{
+    if (vm_set_state(vm, VM_HALTED)) {
+        vwdt_reset(vm);
+        vpci_reset(vm);
+        vm_msg_all(vm, VM_MSG_QUIESCE);
+    }
+}
+
+void vm_crash(struct vm* vm)
+{
+    if (vm_set_state(vm, VM_CRASHED)) {
+        vpci_reset(vm);
+        vm_msg_all(vm, VM_MSG_QUIESCE);
+    }
+}
+
+/**
+ * Restarts the VM from its entry point, with its image copied again from
+ * where it was loaded. VMs running their image in place, or from memory
+ * handed over by a live update or a host VM, have no pristine copy left to
+ * restore, so they are stopped instead.
+ */
+void vm_reset(struct vm* vm)
+{
+    if (!vm->img_copied) {
+        WARNING("VM %d image can not be restored, stopping it", vm->id);
+        vm_crash(vm);
+        return;
+    }
+
+    if (vm_set_state(vm, VM_RESETTING)) {
+        /* The image copy would overwrite the memory still being dumped */
+        coredump_vm_cancel(vm);
+        spin_lock(&vm->fault.lock);
+        vm->fault.count = 0;
+        vm->fault.reports = 0;
+        vm->fault.window = timer_get_counter();
+        spin_unlock(&vm->fault.lock);
+        vwdt_reset(vm);
+        vpci_reset(vm);
+        vm_msg_all(vm, VM_MSG_RESET);
+    }
+}
+
+/**
+ * Handles a guest fault the hypervisor could not resolve on behalf of the
+ * guest. Must be called on the cpu running vcpu, while handling the trap that
+ * caused the fault. The fault is reflected back into the guest until the VM's
+ * configured fault limit is reached, after which the VM's fault policy is
+ * applied.
+ */
+void vcpu_fault(struct vcpu* vcpu, enum vcpu_fault fault, vaddr_t addr,
+                bool write, const char* reason)
+{
+    struct vm* vm = vcpu->vm;
+    const struct vm_config* config = vm->config;
+    size_t count;
+
+    size_t reports;
+    size_t suppressed = 0;
+    uint64_t now = timer_get_counter();
+
+    spin_lock(&vm->fault.lock);
+    count = ++vm->fault.count;
+    if (now - vm->fault.window >=
+        timer_us_to_ticks(VM_FAULT_REPORT_PERIOD_US)) {
+        if (vm->fault.reports > VM_FAULT_REPORT_MAX) {
+            suppressed = vm->fault.reports - VM_FAULT_REPORT_MAX;
+        }
+        vm->fault.reports = 0;
+        vm->fault.window = now;
+    }
+    reports = ++vm->fault.reports;
+    spin_unlock(&vm->fault.lock);
+
+    if (suppressed > 0) {
+        WARNING("VM %d: %lu fault reports suppressed", vm->id, suppressed);
+    }
+    if (reports <= VM_FAULT_REPORT_MAX) {
+        WARNING("VM %d vcpu %d: %s (0x%lx at 0x%lx)", vm->id, vcpu->id, reason,
+                addr, vcpu_readpc(vcpu));
+        if (reports == VM_FAULT_REPORT_MAX) {
+            WARNING("VM %d: suppressing further fault reports", vm->id);
+        }
+    }
+
+    if (config->fault.limit == 0 || count < config->fault.limit) {
+        vcpu_arch_inject_fault(vcpu, fault, write);
+        return;
+    }
+
+    switch (config->fault.policy) {
+        case VM_FAULT_STOP:
+            vm_crash(vm);
+            break;
+        case VM_FAULT_RESET:
+            vm_reset(vm);
+            break;
+        default:
+            vcpu_arch_inject_fault(vcpu, fault, write);
+            break;
+    }
+}
+
+__attribute__((weak)) void vcpu_arch_destroy(struct vcpu* vcpu) {}
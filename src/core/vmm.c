@@ -24,6 +24,7 @@
 #include <string.h>
 #include <ipc.h>
 #include <vmstack.h>
+#include <lu.h>
 #include "list.h"
 #include "objcache.h"
 #include "util.h"
@@ -142,8 +143,12 @@ struct vm* vmm_init_dynamic(struct config* ptr_vm_config, uint64_t vm_addr)
     return vm;
 }
 
-void vmm_destroy_dynamic(struct vm *vm)
+bool vmm_destroy_dynamic(struct vm *vm)
 {
+    if (!vm_destroy_dynamic(vm)) {
+        return false;
+    }
+
     list_foreach(cpu.vcpu->vmstack_children, struct node_data, node){
 	struct vcpu* child = node->data;
 	if(child->vm == vm){
@@ -153,8 +158,9 @@ void vmm_destroy_dynamic(struct vm *vm)
 	}
     }
 
-    vm_destroy_dynamic(vm);
     vmm_free_vm_struct(vm);
+
+    return true;
 }
 
 void vmm_init()
@@ -166,6 +172,8 @@ void vmm_init()
     }
 
     vmm_arch_init();
+    vmstack_init();
+    vec_init();
 
     static struct vm_assignment {
         spinlock_t lock;
@@ -289,7 +297,10 @@ void vmm_init()
     if (assigned) {
         root = vmm_create_vms(vm_config_ptr->vmlist[vm_id], NULL);
         cpu_sync_barrier(&partition->sync);
-        vmstack_push(root);
+        lu_vcpu_restore(root);
+        if (!vmstack_push(root)) {
+            ERROR("failed to start VM %d", root->vm->id);
+        }
         vcpu_run(root);
     }
 
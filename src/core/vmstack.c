@@ -18,20 +18,89 @@
 #include <hypercall.h>
 #include <vm.h>
 #include <cpu.h>
+#include <mem.h>
 #include <string.h>
 #include "list.h"
 
-void vmstack_push(struct vcpu* vcpu){
+void vmstack_init(){
 
-    if(cpu.vcpu != NULL && vcpu->state != VCPU_INACTIVE){
-        return;
+    size_t n = NUM_PAGES(sizeof(struct vmstack));
+    cpu.vmstack = mem_alloc_page(n, SEC_HYP_PRIVATE, false);
+    if(cpu.vmstack == NULL){ ERROR("failed to allocate vm stack"); }
+    memset(cpu.vmstack, 0, n * PAGE_SIZE);
+}
+
+/**
+ * Checks the bounds of pushing vcpu over the current one. A vcpu already on
+ * the stack closes a cycle, which is only allowed as many times as its VM
+ * may be re-entered.
+ */
+static bool vmstack_push_allowed(struct vcpu* vcpu){
+
+    const struct vm_config* config = vcpu->vm->config;
+    size_t depth = config->vmstack.depth;
+
+    if(depth == 0 || depth > VMSTACK_DEPTH_MAX){
+        depth = VMSTACK_DEPTH_MAX;
+    }
+
+    if(cpu.vmstack->depth >= depth){
+        return false;
+    }
+
+    if(vcpu->state == VCPU_STACKED){
+        return vcpu->vmstack.stacked <= config->vmstack.reentry;
+    }
+
+    return vcpu->state == VCPU_INACTIVE;
+}
+
+/**
+ * Ends the activation of vcpu pushed over frame. A re-entered vcpu gets
+ * back the context of its activation further down the stack.
+ */
+static void vmstack_leave(struct vcpu* vcpu, struct vmstack_frame* frame){
+
+    if(frame->reentry){
+        *vcpu->regs = frame->regs;
+        vcpu_arch_restore_ctx(vcpu, &frame->ctx);
+        vec_restore_ctx(vcpu, &frame->vec);
+        vcpu->state = VCPU_STACKED;
+    } else {
+        vcpu->state = VCPU_INACTIVE;
     }
+    vcpu->parent = frame->parent;
+
+    frame->vcpu->vmstack.stacked--;
+    frame->vcpu->vmstack.top = frame->prev;
+}
+
+bool vmstack_push(struct vcpu* vcpu){
 
     if(cpu.vcpu != NULL){
-        vcpu_save_state(cpu.vcpu);
-        cpu.vcpu->state = VCPU_STACKED;
-        list_push_front(&cpu.vcpu_stack, &cpu.vcpu->node);
-        vcpu->parent = cpu.vcpu;
+        if(!vmstack_push_allowed(vcpu)){
+            return false;
+        }
+
+        struct vcpu* top = cpu.vcpu;
+        struct vmstack_frame* frame = &cpu.vmstack->frames[cpu.vmstack->depth];
+
+        vcpu_save_state(top);
+        top->state = VCPU_STACKED;
+        frame->vcpu = top;
+        frame->prev = top->vmstack.top;
+        frame->parent = vcpu->parent;
+        frame->reentry = vcpu->state == VCPU_STACKED;
+        if(frame->reentry){
+            frame->regs = *vcpu->regs;
+            vcpu_arch_save_ctx(vcpu, &frame->ctx);
+            vec_save_ctx(vcpu, &frame->vec);
+        }
+
+        cpu.vmstack->depth++;
+        top->vmstack.stacked++;
+        top->vmstack.top = cpu.vmstack->depth;
+        vcpu->parent = top;
     }
 
     vcpu_restore_state(vcpu);
@@ -39,46 +108,52 @@ void vmstack_push(struct vcpu* vcpu){
     cpu.vcpu = vcpu;
 
     /* INFO("Current VM on pCPU %d is VM %d", cpu.id, cpu.vcpu->vm->id); */
+
+    return true;
 }
 
 struct vcpu* vmstack_pop(){
 
-    /* TODO: our nodes do not allow the same vcpu to be in the stack more than
-     * once */
-    struct vcpu* vcpu = (struct vcpu*) list_pop(&cpu.vcpu_stack);
-
-    if(vcpu != NULL){
-        vcpu->parent = NULL;
-        struct vcpu *temp = vcpu;
-        vcpu = cpu.vcpu;
-        cpu.vcpu = temp;
-        vcpu_save_state(vcpu);
-        vcpu->state = VCPU_INACTIVE;
-        vcpu_restore_state(cpu.vcpu);
-        cpu.vcpu->state = VCPU_ACTIVE;
+    if(cpu.vmstack->depth == 0){
+        return NULL;
     }
 
+    struct vmstack_frame* frame = &cpu.vmstack->frames[--cpu.vmstack->depth];
+    struct vcpu* vcpu = cpu.vcpu;
+
+    vcpu_save_state(vcpu);
+    vmstack_leave(vcpu, frame);
+
+    cpu.vcpu = frame->vcpu;
+    vcpu_restore_state(cpu.vcpu);
+    cpu.vcpu->state = VCPU_ACTIVE;
+
     /* INFO("Current VM on pCPU %d is VM %d", cpu.id, cpu.vcpu->vm->id); */
 
     return vcpu;
 }
 
+/**
+ * Pops every vcpu above the topmost activation of vcpu, which resumes. Only
+ * the frames dropped are visited.
+ */
 void vmstack_unwind(struct vcpu* vcpu){
 
     if(vcpu->state != VCPU_STACKED){
         return;
     }
 
-    struct vcpu* temp_vcpu = NULL;
+    size_t target = vcpu->vmstack.top - 1;
+    struct vcpu* top = cpu.vcpu;
 
-    do {
-        temp_vcpu = (struct vcpu*) list_pop(&cpu.vcpu_stack);
-        temp_vcpu->state = VCPU_INACTIVE;
-        temp_vcpu->parent = NULL;
-    } while(temp_vcpu != vcpu);
+    vcpu_save_state(top);
+    while(cpu.vmstack->depth > target){
+        struct vmstack_frame* frame =
+            &cpu.vmstack->frames[--cpu.vmstack->depth];
+        vmstack_leave(top, frame);
+        top = frame->vcpu;
+    }
 
-    vcpu_save_state(cpu.vcpu);
-    cpu.vcpu->state = VCPU_INACTIVE;
     cpu.vcpu = vcpu;
     vcpu_restore_state(cpu.vcpu);
     cpu.vcpu->state = VCPU_ACTIVE;
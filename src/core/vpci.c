@@ -0,0 +1,587 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vpci.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <emul.h>
+#include <interrupts.h>
+#include <string.h>
+#include <iommu.h>
+
+#define PCI_COMMAND (0x04)
+#define PCI_STATUS (0x06)
+#define PCI_HEADER_TYPE (0x0e)
+#define PCI_BAR0 (0x10)
+#define PCI_ROM (0x30)
+#define PCI_CAP_PTR (0x34)
+#define PCI_INT_LINE (0x3c)
+#define PCI_INT_PIN (0x3d)
+#define PCI_CAP_START (0x40)
+#define PCI_CFG_LEGACY_SIZE (0x100)
+
+#define PCI_COMMAND_IO (1U << 0)
+#define PCI_COMMAND_MEM (1U << 1)
+#define PCI_COMMAND_MASTER (1U << 2)
+#define PCI_COMMAND_PARITY (1U << 6)
+#define PCI_COMMAND_SERR (1U << 8)
+#define PCI_COMMAND_INTX_DIS (1U << 10)
+#define PCI_COMMAND_MASK                                             \
+    (PCI_COMMAND_MEM | PCI_COMMAND_MASTER | PCI_COMMAND_PARITY |     \
+     PCI_COMMAND_SERR | PCI_COMMAND_INTX_DIS)
+
+#define PCI_STATUS_CAP_LIST (1U << 4)
+#define PCI_HEADER_TYPE_MASK (0x7f)
+#define PCI_HEADER_TYPE_NORMAL (0x00)
+
+#define PCI_BAR_IO (1U << 0)
+#define PCI_BAR_TYPE_64 (0x2U << 1)
+#define PCI_BAR_TYPE_MASK (0x3U << 1)
+#define PCI_BAR_MEM_FLAGS (0xfU)
+
+#define PCI_CAP_ID_MSI (0x05)
+#define PCI_CAP_ID_PCIE (0x10)
+#define PCI_CAP_ID_MSIX (0x11)
+
+/* Registers in the PCI Express capability */
+#define PCI_EXP_DEVCTL (0x08)
+#define PCI_EXP_LNKCTL (0x10)
+#define PCI_EXP_DEVCTL_FLR (1U << 15)
+
+#define PCI_CAPS_MAX (48)
+
+static inline uint32_t vpci_hw_read(struct vpci_func* func, size_t off,
+                                    size_t width)
+{
+    volatile void* reg = (volatile void*)(func->cfg + off);
+    switch (width) {
+        case 1:
+            return *(volatile uint8_t*)reg;
+        case 2:
+            return *(volatile uint16_t*)reg;
+        default:
+            return *(volatile uint32_t*)reg;
+    }
+}
+
+static inline void vpci_hw_write(struct vpci_func* func, size_t off,
+                                 size_t width, uint32_t val)
+{
+    volatile void* reg = (volatile void*)(func->cfg + off);
+    switch (width) {
+        case 1:
+            *(volatile uint8_t*)reg = val;
+            break;
+        case 2:
+            *(volatile uint16_t*)reg = val;
+            break;
+        default:
+            *(volatile uint32_t*)reg = val;
+            break;
+    }
+}
+
+static inline bool vpci_cap_hidden(struct vpci_func* func, size_t off)
+{
+    return off >= PCI_CAP_START && off < PCI_CFG_LEGACY_SIZE &&
+           (func->cap_hidden & (1ULL << (off / 4)));
+}
+
+static inline bool vpci_cap_visible(struct vpci_func* func, size_t off)
+{
+    return off >= PCI_CAP_START && off < PCI_CFG_LEGACY_SIZE &&
+           (func->cap_visible & (1ULL << (off / 4)));
+}
+
+/**
+ * Sizes the function's BARs. Decoding is turned off while the BARs are
+ * probed so the function never responds at the all ones address.
+ */
+static void vpci_probe_bars(struct vpci_func* func)
+{
+    uint16_t cmd = vpci_hw_read(func, PCI_COMMAND, 2);
+    vpci_hw_write(func, PCI_COMMAND, 2,
+                  cmd & ~(PCI_COMMAND_MEM | PCI_COMMAND_IO));
+
+    for (size_t i = 0; i < PCI_NUM_BARS; i++) {
+        size_t off = PCI_BAR0 + (i * 4);
+        uint32_t lo = vpci_hw_read(func, off, 4);
+        uint64_t addr = lo & ~PCI_BAR_MEM_FLAGS;
+        uint64_t mask = 0;
+        bool is64 = !(lo & PCI_BAR_IO) &&
+                    (lo & PCI_BAR_TYPE_MASK) == PCI_BAR_TYPE_64 &&
+                    i + 1 < PCI_NUM_BARS;
+
+        vpci_hw_write(func, off, 4, ~0U);
+        mask = vpci_hw_read(func, off, 4) & ~PCI_BAR_MEM_FLAGS;
+        vpci_hw_write(func, off, 4, lo);
+
+        if (is64) {
+            uint32_t hi = vpci_hw_read(func, off + 4, 4);
+            addr |= (uint64_t)hi << 32;
+            vpci_hw_write(func, off + 4, 4, ~0U);
+            mask |= (uint64_t)vpci_hw_read(func, off + 4, 4) << 32;
+            vpci_hw_write(func, off + 4, 4, hi);
+        } else {
+            mask |= ~0ULL << 32;
+        }
+
+        struct vpci_bar* bar = &func->bars[i];
+        bar->mapped = NULL_VA;
+        bar->is64 = is64;
+        bar->size = (mask == (~0ULL << 32)) ? 0 : (size_t)(~mask + 1);
+        bar->pa = addr;
+
+        if (bar->size == 0) {
+            func->vbar[i] = 0;
+        } else if (lo & PCI_BAR_IO) {
+            WARNING("PCI %04x BAR%d: I/O BARs are not supported",
+                    func->config->bdf, i);
+            bar->size = 0;
+            func->vbar[i] = 0;
+        } else if (bar->size < PAGE_SIZE || addr == 0) {
+            /**
+             * Sub-page BARs may share a page with other functions' BARs, so
+             * they can not be safely mapped into the VM.
+             */
+            WARNING("PCI %04x BAR%d: %s, not assigned", func->config->bdf, i,
+                    addr == 0 ? "not set up by firmware" : "smaller than a page");
+            bar->size = 0;
+            func->vbar[i] = 0;
+        } else {
+            /* Until the VM moves it, the BAR sits at its physical address */
+            func->vbar[i] = lo;
+        }
+
+        if (is64) {
+            func->vbar[i + 1] = bar->size ? (uint32_t)(addr >> 32) : 0;
+            func->bars[i + 1] = (struct vpci_bar){.mapped = NULL_VA};
+            i++;
+        }
+    }
+
+    vpci_hw_write(func, PCI_COMMAND, 2, cmd);
+}
+
+/**
+ * Builds the capability list the VM sees, leaving out the MSI and MSI-X
+ * capabilities unless the function is configured to expose them.
+ */
+static void vpci_probe_caps(struct vpci_func* func)
+{
+    uint8_t caps[PCI_CAPS_MAX];
+    size_t cap_num = 0;
+
+    func->cap_ptr = 0;
+    func->cap_visible = 0;
+    func->cap_hidden = 0;
+    func->pcie_cap = 0;
+
+    if (!(vpci_hw_read(func, PCI_STATUS, 2) & PCI_STATUS_CAP_LIST)) {
+        return;
+    }
+
+    uint8_t off = vpci_hw_read(func, PCI_CAP_PTR, 1) & ~0x3;
+    while (off >= PCI_CAP_START && cap_num < PCI_CAPS_MAX) {
+        caps[cap_num++] = off;
+        off = vpci_hw_read(func, off + 1, 1) & ~0x3;
+    }
+
+    uint8_t* prev_next = &func->cap_ptr;
+    for (size_t i = 0; i < cap_num; i++) {
+        uint8_t id = vpci_hw_read(func, caps[i], 1);
+        bool hide = !func->config->msi &&
+                    (id == PCI_CAP_ID_MSI || id == PCI_CAP_ID_MSIX);
+
+        if (id == PCI_CAP_ID_PCIE) {
+            func->pcie_cap = caps[i];
+        }
+
+        if (hide) {
+            /* A capability ends where the next one up in the space begins */
+            size_t end = PCI_CFG_LEGACY_SIZE;
+            for (size_t j = 0; j < cap_num; j++) {
+                if (caps[j] > caps[i] && caps[j] < end) {
+                    end = caps[j];
+                }
+            }
+            for (size_t dw = caps[i] / 4; dw < end / 4; dw++) {
+                func->cap_hidden |= 1ULL << dw;
+            }
+        } else {
+            *prev_next = caps[i];
+            prev_next = &func->cap_next[caps[i] / 4];
+            func->cap_visible |= 1ULL << (caps[i] / 4);
+        }
+    }
+    *prev_next = 0;
+}
+
+/**
+ * Maps or unmaps the function's BARs in the VM so they follow the memory
+ * decode bit and the addresses the VM programmed. Must be called with the
+ * vpci lock held.
+ */
+static void vpci_update_bars(struct vm* vm, struct vpci_func* func)
+{
+    bool decode = vpci_hw_read(func, PCI_COMMAND, 2) & PCI_COMMAND_MEM;
+
+    for (size_t i = 0; i < PCI_NUM_BARS; i++) {
+        struct vpci_bar* bar = &func->bars[i];
+        if (bar->size == 0) {
+            continue;
+        }
+
+        vaddr_t va = func->vbar[i] & ~PCI_BAR_MEM_FLAGS;
+        if (bar->is64) {
+            va |= (vaddr_t)func->vbar[i + 1] << 32;
+        }
+        if (!decode || va == 0) {
+            va = NULL_VA;
+        }
+
+        if (va != bar->mapped) {
+            size_t n = NUM_PAGES(bar->size);
+            if (bar->mapped != NULL_VA) {
+                mem_free_vpage(&vm->as, bar->mapped, n, false);
+                bar->mapped = NULL_VA;
+            }
+            if (va != NULL_VA) {
+                if (vm_emul_get_mem(vm, va) == NULL &&
+                    mem_alloc_vpage(&vm->as, SEC_VM_ANY, va, n) == va) {
+                    mem_map_dev(&vm->as, va, bar->pa, n);
+                    bar->mapped = va;
+                } else {
+                    WARNING("VM %d PCI %04x BAR%d at 0x%lx overlaps its "
+                            "address space", vm->id, func->config->vbdf, i,
+                            va);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Quiesces the function, so it stops issuing DMA and interrupts, and moves
+ * its BARs back to their physical addresses, as the VM found them at boot.
+ * Must be called with the vpci lock held.
+ */
+static void vpci_func_reset(struct vm* vm, struct vpci_func* func)
+{
+    uint16_t cmd = vpci_hw_read(func, PCI_COMMAND, 2);
+
+    vpci_hw_write(func, PCI_COMMAND, 2,
+                  (cmd & ~(PCI_COMMAND_MASTER | PCI_COMMAND_MEM)) |
+                      PCI_COMMAND_INTX_DIS);
+    for (size_t j = 0; j < PCI_NUM_BARS; j++) {
+        struct vpci_bar* bar = &func->bars[j];
+        if (bar->size != 0) {
+            uint32_t flags = func->vbar[j] & PCI_BAR_MEM_FLAGS;
+            func->vbar[j] = ((uint32_t)bar->pa & ~PCI_BAR_MEM_FLAGS) | flags;
+            if (bar->is64) {
+                func->vbar[j + 1] = (uint32_t)((uint64_t)bar->pa >> 32);
+            }
+        }
+    }
+    func->intline = 0;
+    vpci_update_bars(vm, func);
+}
+
+static uint32_t vpci_read_dword(struct vpci_func* func, size_t off)
+{
+    uint32_t val = 0;
+
+    if (off >= PCI_CFG_LEGACY_SIZE) {
+        return vpci_hw_read(func, off, 4);
+    } else if (vpci_cap_hidden(func, off)) {
+        return 0;
+    }
+
+    switch (off) {
+        case (PCI_HEADER_TYPE & ~0x3):
+            /* The function is presented on its own */
+            val = vpci_hw_read(func, off, 4);
+            val &= ~((~PCI_HEADER_TYPE_MASK & 0xffU) << 16);
+            break;
+        case PCI_BAR0 ... (PCI_BAR0 + (PCI_NUM_BARS - 1) * 4):
+            val = func->vbar[(off - PCI_BAR0) / 4];
+            break;
+        case PCI_ROM:
+            break;
+        case PCI_CAP_PTR:
+            val = func->cap_ptr;
+            break;
+        case PCI_INT_LINE:
+            val = vpci_hw_read(func, off, 4) & ~0xffffU;
+            if (func->config->intx != 0) {
+                val |= vpci_hw_read(func, PCI_INT_PIN, 1) << 8;
+            }
+            val |= func->intline;
+            break;
+        default:
+            val = vpci_hw_read(func, off, 4);
+            if (vpci_cap_visible(func, off)) {
+                val = (val & ~0xff00U) | (func->cap_next[off / 4] << 8);
+            }
+            break;
+    }
+
+    return val;
+}
+
+static void vpci_write_bar(struct vpci_func* func, size_t idx, uint32_t val)
+{
+    struct vpci_bar* bar = &func->bars[idx];
+    bool hi = false;
+
+    if (bar->size == 0 && idx > 0 && func->bars[idx - 1].is64) {
+        bar = &func->bars[idx - 1];
+        hi = true;
+    }
+
+    if (bar->size == 0) {
+        func->vbar[idx] = 0;
+    } else if (hi) {
+        func->vbar[idx] = val & (uint32_t)(~((uint64_t)bar->size - 1) >> 32);
+    } else {
+        uint32_t flags = func->vbar[idx] & PCI_BAR_MEM_FLAGS;
+        func->vbar[idx] = (val & ~(uint32_t)(bar->size - 1) &
+                           ~PCI_BAR_MEM_FLAGS) | flags;
+    }
+}
+
+static void vpci_write(struct vm* vm, struct vpci_func* func, size_t off,
+                       size_t width, uint32_t val)
+{
+    size_t dword = off & ~0x3;
+    size_t shift = (off & 0x3) * 8;
+    uint32_t mask = width == 4 ? ~0U : ((1U << (width * 8)) - 1) << shift;
+
+    if (off >= PCI_CFG_LEGACY_SIZE) {
+        /* Extended capabilities are read-only to the VM */
+        return;
+    }
+
+    switch (dword) {
+        case PCI_COMMAND:
+            if (off < PCI_STATUS) {
+                uint16_t allowed = PCI_COMMAND_MASK;
+                if (!func->dma) allowed &= ~PCI_COMMAND_MASTER;
+                uint16_t cmd = vpci_hw_read(func, PCI_COMMAND, 2);
+                uint16_t new = (val << shift) & mask;
+                new = (cmd & ~(mask & allowed)) | (new & allowed);
+                vpci_hw_write(func, PCI_COMMAND, 2, new);
+                if ((cmd ^ new) & PCI_COMMAND_MEM) {
+                    vpci_update_bars(vm, func);
+                }
+            }
+            if (off + width > PCI_STATUS) {
+                /* Status bits are write-one-to-clear */
+                vpci_hw_write(func, PCI_STATUS, 2,
+                              ((val << shift) & mask) >> 16);
+            }
+            break;
+        case PCI_BAR0 ... (PCI_BAR0 + (PCI_NUM_BARS - 1) * 4): {
+            size_t idx = (dword - PCI_BAR0) / 4;
+            uint32_t bar = (func->vbar[idx] & ~mask) | ((val << shift) & mask);
+            vpci_write_bar(func, idx, bar);
+            vpci_update_bars(vm, func);
+            break;
+        }
+        case PCI_INT_LINE:
+            if (off == PCI_INT_LINE) {
+                func->intline = val;
+            }
+            break;
+        default:
+            if (dword < PCI_CAP_START || vpci_cap_hidden(func, dword)) {
+                break;
+            } else if (func->pcie_cap != 0 &&
+                       dword == func->pcie_cap + PCI_EXP_LNKCTL) {
+                /* The link is shared with the other functions of the device */
+                break;
+            } else if (func->pcie_cap != 0 &&
+                       dword == func->pcie_cap + PCI_EXP_DEVCTL &&
+                       ((val << shift) & mask & PCI_EXP_DEVCTL_FLR)) {
+                /**
+                 * A real FLR would clear the BARs the VM's mappings point
+                 * to. It is emulated by resetting the function as vpci sees
+                 * it instead.
+                 */
+                vpci_hw_write(func, off, width,
+                              val & ~(PCI_EXP_DEVCTL_FLR >> shift));
+                vpci_func_reset(vm, func);
+                break;
+            }
+            vpci_hw_write(func, off, width, val);
+            break;
+    }
+}
+
+static struct vpci_func* vpci_find_func(struct vm* vm, uint16_t vbdf)
+{
+    for (size_t i = 0; i < vm->vpci.func_num; i++) {
+        if (vm->vpci.funcs[i].config->vbdf == vbdf) {
+            return &vm->vpci.funcs[i];
+        }
+    }
+    return NULL;
+}
+
+static bool vpci_emul_handler(struct emul_access* acc)
+{
+    struct vm* vm = cpu.vcpu->vm;
+    size_t off = acc->addr - vm->config->platform.pci.ecam_base;
+    size_t reg = off & (PCI_CFG_SIZE - 1);
+
+    if (acc->width > 4) {
+        return false;
+    }
+
+    spin_lock(&vm->vpci.lock);
+
+    struct vpci_func* func = vpci_find_func(vm, off / PCI_CFG_SIZE);
+    if (acc->write) {
+        if (func != NULL) {
+            uint32_t val = vcpu_readreg(cpu.vcpu, acc->reg);
+            vpci_write(vm, func, reg, acc->width, val);
+        }
+    } else {
+        /* Absent functions read as all ones */
+        uint32_t val = ~0U;
+        if (func != NULL) {
+            val = vpci_read_dword(func, reg & ~0x3) >> ((reg & 0x3) * 8);
+        }
+        if (acc->width < 4) {
+            val &= (1U << (acc->width * 8)) - 1;
+        }
+        vcpu_writereg(cpu.vcpu, acc->reg, val);
+    }
+
+    spin_unlock(&vm->vpci.lock);
+
+    return true;
+}
+
+/**
+ * Sets up the VM's assigned PCI functions. Must be called after the VM's
+ * iommu context is set up, if iommu is set, as the functions' streams are
+ * added to it here.
+ */
+void vpci_init(struct vm* vm, bool iommu)
+{
+    const struct platform_desc* vplat = &vm->config->platform;
+
+    vm->vpci.lock = SPINLOCK_INITVAL;
+    vm->vpci.func_num = 0;
+
+    if (vplat->pci.func_num == 0) {
+        return;
+    }
+
+    if (platform.pci.ecam_base == 0) {
+        WARNING("VM %d assigned PCI functions but the platform has no host "
+                "bridge", vm->id);
+        return;
+    }
+
+    size_t funcs_size = vplat->pci.func_num * sizeof(struct vpci_func);
+    vm->vpci.funcs = mem_alloc_page(NUM_PAGES(funcs_size), SEC_HYP_VM, false);
+    if (vm->vpci.funcs == NULL) {
+        ERROR("failed to allocate vpci functions");
+    }
+
+    for (size_t i = 0; i < vplat->pci.func_num; i++) {
+        const struct pci_func_config* fcfg = &vplat->pci.funcs[i];
+        struct vpci_func* func = &vm->vpci.funcs[vm->vpci.func_num];
+
+        if ((fcfg->bdf >> 8) >= platform.pci.bus_num ||
+            (fcfg->vbdf >> 8) >= vplat->pci.bus_num) {
+            WARNING("VM %d PCI function %04x out of the host bridge's bus "
+                    "range. Ignored.", vm->id, fcfg->bdf);
+            continue;
+        }
+
+        memset(func, 0, sizeof(*func));
+        func->config = fcfg;
+
+        paddr_t cfg_pa = platform.pci.ecam_base + fcfg->bdf * PCI_CFG_SIZE;
+        vaddr_t cfg_va = mem_alloc_vpage(&cpu.as, SEC_HYP_GLOBAL, NULL_VA, 1);
+        if (cfg_va == NULL_VA || !mem_map_dev(&cpu.as, cfg_va, cfg_pa, 1)) {
+            ERROR("failed to map PCI configuration space");
+        }
+        func->cfg = (volatile uint8_t*)cfg_va;
+
+        if (vpci_hw_read(func, 0, 2) == 0xffff) {
+            WARNING("VM %d PCI function %04x not present. Ignored.", vm->id,
+                    fcfg->bdf);
+            mem_free_vpage(&cpu.as, cfg_va, 1, false);
+            continue;
+        }
+
+        if ((vpci_hw_read(func, PCI_HEADER_TYPE, 1) & PCI_HEADER_TYPE_MASK) !=
+            PCI_HEADER_TYPE_NORMAL) {
+            WARNING("VM %d PCI function %04x is a bridge. Ignored.", vm->id,
+                    fcfg->bdf);
+            mem_free_vpage(&cpu.as, cfg_va, 1, false);
+            continue;
+        }
+
+        INFO("VM %d assigning PCI function %04x as %04x", vm->id, fcfg->bdf,
+             fcfg->vbdf);
+
+        vpci_probe_bars(func);
+        vpci_probe_caps(func);
+
+        if (iommu && fcfg->has_stream) {
+            if (!iommu_vm_add_device(vm, fcfg->id)) {
+                ERROR("Failed to add PCI function to iommu");
+            }
+            func->dma = true;
+        } else {
+            WARNING("VM %d PCI function %04x has no iommu stream, bus "
+                    "mastering disabled", vm->id, fcfg->bdf);
+            uint16_t cmd = vpci_hw_read(func, PCI_COMMAND, 2);
+            vpci_hw_write(func, PCI_COMMAND, 2, cmd & ~PCI_COMMAND_MASTER);
+        }
+
+        if (fcfg->intx != 0) {
+            INFO("VM %d assigning interrupt %u", vm->id, fcfg->intx);
+            interrupts_vm_assign(vm, fcfg->intx);
+        }
+
+        vm->vpci.func_num++;
+    }
+
+    spin_lock(&vm->vpci.lock);
+    for (size_t i = 0; i < vm->vpci.func_num; i++) {
+        vpci_update_bars(vm, &vm->vpci.funcs[i]);
+    }
+    spin_unlock(&vm->vpci.lock);
+
+    struct emul_mem emu = {
+        .va_base = vplat->pci.ecam_base,
+        .size = vplat->pci.bus_num * PCI_ECAM_BUS_SIZE,
+        .handler = vpci_emul_handler,
+    };
+    vm_emul_add_mem(vm, &emu);
+}
+
+/* Resets each of the VM's functions, see vpci_func_reset */
+void vpci_reset(struct vm* vm)
+{
+    spin_lock(&vm->vpci.lock);
+    for (size_t i = 0; i < vm->vpci.func_num; i++) {
+        vpci_func_reset(vm, &vm->vpci.funcs[i]);
+    }
+    spin_unlock(&vm->vpci.lock);
+}
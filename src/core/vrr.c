@@ -0,0 +1,271 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <vrr.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <ipc.h>
+#include <fences.h>
+
+/**
+ * Deterministic record and replay. While recording, every nondeterministic
+ * input the VM observes is appended to the log along with the number of
+ * instructions the VM had retired when it got it. While replaying, live
+ * interrupts are dropped and the ones in the log are injected once the VM
+ * reaches the same instruction count, while emulated reads and call results
+ * are overwritten with the logged values. The first mismatch ends the replay
+ * and the VM carries on with live inputs.
+ */
+
+static void vrr_record(struct vrr* rr, enum vrr_event_type type, uint64_t id,
+                       uint64_t value)
+{
+    struct vrr_log* log = rr->log;
+
+    /* Without the VM's cpu, the instruction count can't be read */
+    if (log->num >= rr->max || cpu.vcpu != rr->vcpu) {
+        log->lost++;
+        return;
+    }
+
+    struct vrr_event* ev = &log->events[log->num];
+    ev->icount = vrr_arch_icount(rr->vcpu);
+    ev->pc = vcpu_readpc(rr->vcpu);
+    ev->type = type;
+    ev->reserved = 0;
+    ev->id = id;
+    ev->value = value;
+
+    /* Whoever reads the log only looks at num */
+    fence_ord_write();
+    log->num++;
+}
+
+static void vrr_diverged(struct vcpu* vcpu, const char* reason)
+{
+    struct vrr* rr = &vcpu->vm->vrr;
+
+    WARNING("VM %d replay diverged at event %d (%s), continuing live",
+            vcpu->vm->id, rr->next, reason);
+
+    rr->mode = VM_REPLAY_NONE;
+    rr->stepping = false;
+    vrr_arch_step(vcpu, false);
+}
+
+static void vrr_inject(struct vcpu* vcpu, struct vrr_event* ev)
+{
+    switch (ev->value) {
+        case VRR_IRQ_VIRT:
+            vcpu_arch_inject_irq(vcpu, ev->id);
+            break;
+        case VRR_IRQ_HW:
+            vcpu_arch_inject_hw_irq(vcpu, ev->id);
+            break;
+        case VRR_IRQ_PASSTHROUGH:
+            interrupts_arch_vm_inject(vcpu, ev->id);
+            break;
+    }
+}
+
+/**
+ * Injects the interrupts due at the current instruction count and sets up
+ * the VM to stop again in time for the next one.
+ */
+static void vrr_replay_async(struct vcpu* vcpu)
+{
+    struct vrr* rr = &vcpu->vm->vrr;
+    struct vrr_log* log = rr->log;
+    uint64_t now = vrr_arch_icount(vcpu);
+    bool step = false;
+
+    while (rr->next < log->num) {
+        struct vrr_event* ev = &log->events[rr->next];
+
+        /* Synchronous events are consumed when the VM traps for them */
+        if (ev->type != VRR_EV_IRQ) break;
+
+        if (ev->icount > now) {
+            step = ev->icount - now <= VRR_STEP_MARGIN;
+            if (!step) {
+                vrr_arch_arm(vcpu, ev->icount - VRR_STEP_MARGIN);
+            }
+            break;
+        } else if (ev->icount < now) {
+            vrr_diverged(vcpu, "interrupt overrun");
+            return;
+        } else if (ev->pc != vcpu_readpc(vcpu)) {
+            vrr_diverged(vcpu, "interrupt pc mismatch");
+            return;
+        }
+
+        vrr_inject(vcpu, ev);
+        rr->next++;
+    }
+
+    if (rr->next >= log->num) {
+        INFO("VM %d replay complete, continuing live", vcpu->vm->id);
+        rr->mode = VM_REPLAY_NONE;
+        step = false;
+    }
+
+    /* Stepping must be rearmed after every step */
+    if (step || rr->stepping) {
+        vrr_arch_step(vcpu, step);
+    }
+    rr->stepping = step;
+}
+
+void vrr_vm_init(struct vm* vm, struct vcpu* vcpu)
+{
+    const struct vm_config* config = vm->config;
+    struct vrr* rr = &vm->vrr;
+
+    rr->mode = VM_REPLAY_NONE;
+    if (config->replay.mode == VM_REPLAY_NONE) return;
+
+    if (vm->cpu_num != 1) {
+        WARNING("VM %d: record/replay needs a single vcpu", vm->id);
+        return;
+    }
+
+    struct shmem* shmem = ipc_get_shmem(config->replay.shmem_id);
+    if (shmem == NULL ||
+        shmem->size < sizeof(struct vrr_log) + sizeof(struct vrr_event)) {
+        WARNING("VM %d: invalid record/replay shared memory", vm->id);
+        return;
+    }
+
+    size_t n = NUM_PAGES(shmem->size);
+    struct ppages pages = mem_ppages_get(shmem->phys, n);
+    vaddr_t va = mem_alloc_vpage(&cpu.as, SEC_HYP_PRIVATE, NULL_VA, n);
+    if (va == NULL_VA || !mem_map(&cpu.as, va, &pages, n, PTE_HYP_FLAGS)) {
+        ERROR("failed mapping VM %d record/replay log", vm->id);
+    }
+
+    rr->vcpu = vcpu;
+    rr->log = (struct vrr_log*)va;
+    rr->max = (shmem->size - sizeof(struct vrr_log)) / sizeof(struct vrr_event);
+    rr->next = 0;
+    rr->stepping = false;
+
+    if (config->replay.mode == VM_REPLAY_RECORD) {
+        rr->log->magic = VRR_LOG_MAGIC;
+        rr->log->vm_id = vm->id;
+        rr->log->num = 0;
+        rr->log->lost = 0;
+        rr->log->reserved = 0;
+    } else if (rr->log->magic != VRR_LOG_MAGIC || rr->log->vm_id != vm->id ||
+               rr->log->num > rr->max) {
+        WARNING("VM %d: no log to replay", vm->id);
+        return;
+    } else if (rr->log->lost != 0) {
+        WARNING("VM %d: replay log lost %d events, replay will diverge",
+                vm->id, rr->log->lost);
+    }
+
+    if (!vrr_arch_init(vcpu)) {
+        WARNING("VM %d: record/replay not supported", vm->id);
+        return;
+    }
+
+    rr->mode = config->replay.mode;
+    INFO("VM %d %s", vm->id,
+         rr->mode == VM_REPLAY_RECORD ? "recording" : "replaying");
+
+    if (rr->mode == VM_REPLAY_REPLAY) {
+        vrr_replay_async(vcpu);
+    }
+}
+
+bool vrr_irq(struct vcpu* vcpu, irqid_t id, enum vrr_irq_kind kind)
+{
+    struct vrr* rr = &vcpu->vm->vrr;
+
+    if (rr->mode == VM_REPLAY_RECORD) {
+        vrr_record(rr, VRR_EV_IRQ, id, kind);
+    }
+
+    /* When replaying, interrupts only come from the log */
+    return rr->mode != VM_REPLAY_REPLAY;
+}
+
+void vrr_reg(struct vcpu* vcpu, enum vrr_event_type type, uint64_t id,
+             unsigned long reg)
+{
+    struct vrr* rr = &vcpu->vm->vrr;
+
+    if (rr->mode == VM_REPLAY_RECORD) {
+        vrr_record(rr, type, id, vcpu_readreg(vcpu, reg));
+    } else if (rr->mode == VM_REPLAY_REPLAY) {
+        /* Interrupts logged at the same point went in first */
+        vrr_replay_async(vcpu);
+        if (rr->mode != VM_REPLAY_REPLAY) return;
+
+        struct vrr_event* ev = &rr->log->events[rr->next];
+        if (ev->type != type || ev->id != id ||
+            ev->icount != vrr_arch_icount(vcpu)) {
+            vrr_diverged(vcpu, "input mismatch");
+            return;
+        }
+
+        vcpu_writereg(vcpu, reg, ev->value);
+        rr->next++;
+        vrr_replay_async(vcpu);
+    }
+}
+
+void vrr_wfi(struct vcpu* vcpu)
+{
+    /**
+     * A replayed VM doesn't wait, the interrupt that woke it up is the next
+     * one in the log, if it was woken up by one at all.
+     */
+    if (vcpu->vm->vrr.mode == VM_REPLAY_REPLAY) {
+        vrr_replay_async(vcpu);
+    } else {
+        vrr_arch_wfi(vcpu);
+    }
+}
+
+void vrr_overflow(struct vcpu* vcpu)
+{
+    if (vcpu->vm->vrr.mode == VM_REPLAY_REPLAY) {
+        vrr_replay_async(vcpu);
+    }
+}
+
+bool vrr_step(struct vcpu* vcpu)
+{
+    if (!vcpu->vm->vrr.stepping) return false;
+
+    vrr_replay_async(vcpu);
+    return true;
+}
+
+__attribute__((weak)) bool vrr_arch_init(struct vcpu* vcpu)
+{
+    return false;
+}
+
+__attribute__((weak)) uint64_t vrr_arch_icount(struct vcpu* vcpu)
+{
+    return 0;
+}
+
+__attribute__((weak)) void vrr_arch_arm(struct vcpu* vcpu, uint64_t icount) {}
+
+__attribute__((weak)) void vrr_arch_step(struct vcpu* vcpu, bool enable) {}
+
+__attribute__((weak)) void vrr_arch_wfi(struct vcpu* vcpu) {}
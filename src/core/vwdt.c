@@ -0,0 +1,196 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <vwdt.h>
+#include <vm.h>
+#include <cpu.h>
+#include <timer.h>
+
+/* Watchdogs are not precise, they may expire a little late to share an irq */
+#define VWDT_SLACK_DIV (64)
+
+/**
+ * Starts the watchdog's timer event on the local cpu for its deadline, or
+ * stops it if the watchdog is disabled. Refreshes only ever postpone a
+ * deadline, so they do not restart the event: the handler finds the new
+ * deadline on the old expiry and restarts it. This keeps refreshes cheap and
+ * local to the caller.
+ */
+static void vwdt_timer_update(struct vwdt* wdt)
+{
+    uint64_t deadline = TIMER_DEADLINE_NONE;
+    uint64_t slack = 0;
+
+    spin_lock(&wdt->lock);
+    if (wdt->enabled) {
+        deadline = wdt->deadline;
+        slack = wdt->offset / VWDT_SLACK_DIV;
+    }
+    spin_unlock(&wdt->lock);
+
+    if (deadline != TIMER_DEADLINE_NONE) {
+        timer_event_start(&wdt->event, deadline, slack, 0);
+    } else {
+        timer_event_stop(&wdt->event);
+    }
+}
+
+static void vwdt_expire(struct vm* vm)
+{
+    WARNING("VM %d watchdog expired", vm->id);
+
+    switch (vm->config->watchdog.action) {
+        case VM_WATCHDOG_RESET:
+            vm_reset(vm);
+            break;
+        case VM_WATCHDOG_HALT:
+            vm_halt(vm);
+            break;
+        default:
+            vm_notify_manager(vm);
+            break;
+    }
+}
+
+static void vwdt_timer_handler(struct timer_event* event)
+{
+    struct vm* vm =
+        (struct vm*)((uint8_t*)event - offsetof(struct vm, wdt.event));
+    struct vwdt* wdt = &vm->wdt;
+    uint64_t now = timer_get_counter();
+    bool signal = false;
+    bool expired = false;
+
+    spin_lock(&wdt->lock);
+    if (wdt->enabled && wdt->deadline <= now) {
+        if (!wdt->ws0) {
+            wdt->ws0 = true;
+            wdt->deadline = now + wdt->offset;
+            signal = true;
+        } else {
+            wdt->ws1 = true;
+            wdt->enabled = false;
+            expired = true;
+        }
+    }
+    spin_unlock(&wdt->lock);
+
+    if (signal && vm->config->watchdog.interrupt != 0) {
+        list_foreach(cpu.vcpus, struct node_data, node)
+        {
+            struct vcpu* vcpu = node->data;
+            if (vcpu->vm == vm) {
+                vcpu_inject_irq(vcpu, vm->config->watchdog.interrupt);
+                break;
+            }
+        }
+    }
+    if (expired) {
+        vwdt_expire(vm);
+    }
+
+    vwdt_timer_update(wdt);
+}
+
+void vwdt_reset(struct vm* vm)
+{
+    struct vwdt* wdt = &vm->wdt;
+
+    spin_lock(&wdt->lock);
+    wdt->enabled = false;
+    wdt->ws0 = false;
+    wdt->ws1 = false;
+    wdt->offset = timer_us_to_ticks(vm->config->watchdog.timeout_us);
+    wdt->deadline = 0;
+    spin_unlock(&wdt->lock);
+
+    timer_event_stop(&wdt->event);
+}
+
+void vwdt_init(struct vm* vm)
+{
+    vm->wdt.lock = SPINLOCK_INITVAL;
+    timer_event_init(&vm->wdt.event, vwdt_timer_handler);
+    vwdt_reset(vm);
+
+    if (!vm->config->watchdog.enable) {
+        return;
+    }
+
+    if (timer_get_freq() == 0) {
+        WARNING("VM %d watchdog disabled, unknown timer frequency", vm->id);
+        return;
+    }
+
+    vwdt_arch_init(vm);
+}
+
+void vwdt_enable(struct vm* vm, bool en)
+{
+    struct vwdt* wdt = &vm->wdt;
+
+    spin_lock(&wdt->lock);
+    if (en && !wdt->enabled) {
+        wdt->deadline = timer_get_counter() + wdt->offset;
+    }
+    wdt->enabled = en;
+    wdt->ws0 = false;
+    wdt->ws1 = false;
+    spin_unlock(&wdt->lock);
+
+    vwdt_timer_update(wdt);
+}
+
+void vwdt_refresh(struct vm* vm)
+{
+    struct vwdt* wdt = &vm->wdt;
+
+    spin_lock(&wdt->lock);
+    wdt->ws0 = false;
+    wdt->ws1 = false;
+    if (wdt->enabled) {
+        wdt->deadline = timer_get_counter() + wdt->offset;
+    }
+    spin_unlock(&wdt->lock);
+}
+
+void vwdt_set_offset(struct vm* vm, uint64_t offset)
+{
+    struct vwdt* wdt = &vm->wdt;
+
+    /* Writing the offset is an explicit refresh */
+    spin_lock(&wdt->lock);
+    wdt->offset = offset;
+    wdt->ws0 = false;
+    wdt->ws1 = false;
+    if (wdt->enabled) {
+        wdt->deadline = timer_get_counter() + offset;
+    }
+    spin_unlock(&wdt->lock);
+
+    vwdt_timer_update(wdt);
+}
+
+void vwdt_set_deadline(struct vm* vm, uint64_t deadline)
+{
+    struct vwdt* wdt = &vm->wdt;
+
+    spin_lock(&wdt->lock);
+    wdt->deadline = deadline;
+    spin_unlock(&wdt->lock);
+
+    vwdt_timer_update(wdt);
+}
+
+__attribute__((weak)) void vwdt_arch_init(struct vm* vm)
+{
+    /* Nothing to set up when the watchdog is not memory mapped */
+}
@@ -0,0 +1,354 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+#include <wss.h>
+#include <vm.h>
+#include <cpu.h>
+#include <mem.h>
+#include <tlb.h>
+#include <config.h>
+#include <hypercall.h>
+#include <fences.h>
+#include <string.h>
+
+#define WSS_MAX_VMS (16)
+#define WSS_INTERVAL_DFLT_US (1000000)
+#define WSS_INTERVAL_MIN_US (10000)
+/* Pages a chunk of a sweep visits, and how long the VM runs between chunks */
+#define WSS_SCAN_PAGES (4096)
+#define WSS_CHUNK_US (1000)
+
+static spinlock_t wss_lock = SPINLOCK_INITVAL;
+static struct vm* wss_vms[WSS_MAX_VMS];
+static size_t wss_vm_num;
+
+static inline size_t wss_weight(uint8_t history)
+{
+    size_t weight = 0;
+    for (; history != 0; history &= history - 1) {
+        weight++;
+    }
+    return weight;
+}
+
+/**
+ * Returns the leaf entry mapping va, or NULL if va is not mapped. In both
+ * cases lvl_size is the size of the range the entry covers.
+ */
+static pte_t* wss_leaf(struct page_table* pt, vaddr_t va, size_t* lvl_size)
+{
+    for (size_t lvl = 0; lvl < pt->dscr->lvls; lvl++) {
+        pte_t* pte = pt_get_pte(pt, lvl, va);
+        *lvl_size = pt_lvlsize(pt, lvl);
+        if (!pte_valid(pte)) break;
+        if (pte_page(pt, pte, lvl)) {
+            /* A contiguous run shares its access flags */
+            if (pte_contig(pte)) *lvl_size *= pt_contig_ptes(pt, lvl);
+            return pte;
+        }
+    }
+
+    return NULL;
+}
+
+static void wss_sweep_start(struct vwss* wss)
+{
+    wss->region = 0;
+    wss->cursor = wss->acc[0].base;
+    wss->cursor_page = 0;
+    wss->accessed = 0;
+    for (size_t i = 0; i < wss->region_num; i++) {
+        memset(wss->acc[i].hist, 0, sizeof(wss->acc[i].hist));
+    }
+}
+
+static void wss_sweep_done(struct vm* vm)
+{
+    struct vwss* wss = &vm->wss;
+
+    spin_lock(&wss->lock);
+    memcpy(wss->stats, wss->acc, sizeof(wss->stats));
+    wss->wss_pages = wss->accessed;
+    wss->sweeps++;
+    spin_unlock(&wss->lock);
+
+    wss_sweep_start(wss);
+}
+
+/**
+ * Visits up to WSS_SCAN_PAGES pages from the cursor on, a block mapping
+ * counting as all its pages. Returns true once the sweep wraps. The access
+ * flags cleared are flushed from the TLBs in a single invalidation, so that
+ * the next access to those pages sets them again.
+ */
+static bool wss_sweep_chunk(struct vm* vm)
+{
+    struct vwss* wss = &vm->wss;
+    struct page_table* pt = &vm->as.pt;
+    size_t budget = WSS_SCAN_PAGES;
+    bool flush = false;
+
+    while (budget > 0 && wss->region < wss->region_num) {
+        struct wss_region_stats* acc = &wss->acc[wss->region];
+        vaddr_t end = acc->base + acc->pages * PAGE_SIZE;
+
+        if (wss->cursor >= end) {
+            if (++wss->region < wss->region_num) {
+                wss->cursor = wss->acc[wss->region].base;
+            }
+            continue;
+        }
+
+        size_t lvl_size;
+        pte_t* pte = wss_leaf(pt, wss->cursor, &lvl_size);
+        vaddr_t next = ALIGN_FLOOR(wss->cursor, lvl_size) + lvl_size;
+        if (next > end || next < wss->cursor) {
+            next = end;
+        }
+        size_t n = (next - wss->cursor) / PAGE_SIZE;
+
+        /* Unmapped pages age as if they were never accessed */
+        bool accessed = pte != NULL && wss_arch_test_and_clear(pte);
+        for (size_t i = 0; i < n; i++) {
+            uint8_t* history = &wss->history[wss->cursor_page + i];
+            *history = (*history << 1) | (accessed ? 1 : 0);
+            acc->hist[wss_weight(*history)]++;
+        }
+        if (accessed) {
+            wss->accessed += n;
+            flush = true;
+        }
+
+        wss->cursor = next;
+        wss->cursor_page += n;
+        budget -= n < budget ? n : budget;
+    }
+
+    if (flush) {
+        fence_sync_write();
+        tlb_inv_all(&vm->as);
+    }
+
+    return wss->region >= wss->region_num;
+}
+
+static void wss_timer_handler(struct timer_event* event)
+{
+    struct vm* vm =
+        (struct vm*)((uint8_t*)event - offsetof(struct vm, wss.event));
+    struct vwss* wss = &vm->wss;
+    uint64_t now = timer_get_counter();
+
+    if (wss_sweep_chunk(vm)) {
+        wss_sweep_done(vm);
+        timer_event_start(event, now + wss->interval, wss->interval / 16, 0);
+    } else {
+        uint64_t gap = timer_us_to_ticks(WSS_CHUNK_US);
+        timer_event_start(event, now + gap, gap / 2, 0);
+    }
+}
+
+void wss_init(struct vm* vm)
+{
+    const struct vm_config* config = vm->config;
+    struct vwss* wss = &vm->wss;
+    size_t pages = 0;
+
+    memset(wss, 0, sizeof(*wss));
+    wss->lock = SPINLOCK_INITVAL;
+    timer_event_init(&wss->event, wss_timer_handler);
+
+    if (!config->working_set.enable) {
+        return;
+    }
+
+    if (timer_get_freq() == 0) {
+        WARNING("VM %d working-set estimation disabled, unknown timer "
+                "frequency", vm->id);
+        return;
+    }
+
+    wss->region_num = config->platform.region_num;
+    if (wss->region_num > WSS_REGIONS_MAX) {
+        WARNING("VM %d working set only covers its first %d memory regions",
+                vm->id, WSS_REGIONS_MAX);
+        wss->region_num = WSS_REGIONS_MAX;
+    }
+
+    for (size_t i = 0; i < wss->region_num; i++) {
+        struct mem_region* reg = &config->platform.regions[i];
+        wss->acc[i].base = reg->base;
+        wss->acc[i].pages = NUM_PAGES(reg->size);
+        pages += wss->acc[i].pages;
+    }
+    memcpy(wss->stats, wss->acc, sizeof(wss->stats));
+
+    if (pages == 0) {
+        return;
+    }
+
+    wss->history = mem_alloc_page(NUM_PAGES(pages), SEC_HYP_VM, false);
+    if (wss->history == NULL) {
+        WARNING("VM %d working-set estimation disabled, no memory for the "
+                "access history", vm->id);
+        return;
+    }
+    memset(wss->history, 0, pages);
+
+    uint64_t interval_us = config->working_set.interval_us;
+    if (interval_us == 0) {
+        interval_us = WSS_INTERVAL_DFLT_US;
+    } else if (interval_us < WSS_INTERVAL_MIN_US) {
+        interval_us = WSS_INTERVAL_MIN_US;
+    }
+    wss->interval = timer_us_to_ticks(interval_us);
+
+    spin_lock(&wss_lock);
+    if (wss_vm_num < WSS_MAX_VMS) {
+        wss_vms[wss_vm_num++] = vm;
+        wss->enabled = true;
+    }
+    spin_unlock(&wss_lock);
+
+    if (!wss->enabled) {
+        WARNING("VM %d working-set estimation disabled, too many VMs",
+                vm->id);
+        return;
+    }
+
+    /* Sweeps run on the master cpu, where the access history is mapped */
+    wss_sweep_start(wss);
+    timer_event_start(&wss->event, timer_get_counter() + wss->interval,
+                      wss->interval / 16, 0);
+}
+
+/**
+ * Handles a stage-2 access flag fault at addr, setting the flag the last
+ * sweep cleared. The flag may already be set if another vcpu faulted on the
+ * same page first, in which case the access only needs to be retried.
+ */
+bool wss_access_fault(struct vm* vm, vaddr_t addr)
+{
+    size_t lvl_size;
+
+    if (!vm->wss.enabled) {
+        return false;
+    }
+
+    pte_t* pte = wss_leaf(&vm->as.pt, addr, &lvl_size);
+    if (pte == NULL || !wss_arch_access_fault(pte)) {
+        return false;
+    }
+
+    wss_arch_set_accessed(pte);
+    return true;
+}
+
+static struct vm* wss_get_vm(vmid_t vm_id)
+{
+    struct vm* vm = NULL;
+
+    spin_lock(&wss_lock);
+    for (size_t i = 0; i < wss_vm_num; i++) {
+        if (wss_vms[i]->id == vm_id) {
+            vm = wss_vms[i];
+            break;
+        }
+    }
+    spin_unlock(&wss_lock);
+
+    return vm;
+}
+
+/* VMs may query themselves and the VMs they host, the manager any VM */
+static bool wss_may_query(struct vcpu* vcpu, struct vm* vm)
+{
+    if (vcpu->vm == vm || vm_is_manager(vcpu->vm)) {
+        return true;
+    }
+
+    list_foreach(vcpu->vmstack_children, struct node_data, node)
+    {
+        struct vcpu* child = node->data;
+        if (child->vm == vm) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Writes the working-set report of VM vm_id, as of its last full sweep, to
+ * the caller's memory at report_ipa, which must not cross a page boundary.
+ */
+unsigned long wss_hypercall(unsigned long vm_id, unsigned long report_ipa,
+                            unsigned long arg2)
+{
+    struct vm* caller = cpu.vcpu->vm;
+    struct vm* vm = wss_get_vm(vm_id);
+    struct wss_report* report;
+    size_t off = report_ipa & PAGE_OFFSET_MASK;
+
+    if (vm == NULL || !wss_may_query(cpu.vcpu, vm)) {
+        return -HC_E_INVAL_ID;
+    }
+
+    if (off + sizeof(struct wss_report) > PAGE_SIZE ||
+        !vm_ipa_in_mem(caller, report_ipa, sizeof(struct wss_report))) {
+        return -HC_E_INVAL_ARGS;
+    }
+
+    vaddr_t va = mem_map_cpy(&caller->as, &cpu.as,
+                             report_ipa & PAGE_FRAME_MASK, NULL_VA, 1);
+    report = (struct wss_report*)(va + off);
+
+    struct vwss* wss = &vm->wss;
+    report->version = WSS_REPORT_VERSION;
+    report->vm_id = vm->id;
+    report->page_size = PAGE_SIZE;
+    report->interval_us = (wss->interval * 1000000) / timer_get_freq();
+    report->total_pages = 0;
+    report->active_pages = 0;
+
+    spin_lock(&wss->lock);
+    report->sweeps = wss->sweeps;
+    report->wss_pages = wss->wss_pages;
+    report->region_num = wss->region_num;
+    for (size_t i = 0; i < WSS_REGIONS_MAX; i++) {
+        report->regions[i] = wss->stats[i];
+        if (i < wss->region_num) {
+            report->total_pages += wss->stats[i].pages;
+            report->active_pages +=
+                wss->sweeps > 0 ? wss->stats[i].pages - wss->stats[i].hist[0]
+                                : 0;
+        }
+    }
+    spin_unlock(&wss->lock);
+
+    mem_free_vpage(&cpu.as, va, 1, false);
+
+    return HC_E_SUCCESS;
+}
+
+__attribute__((weak)) bool wss_arch_test_and_clear(pte_t* pte)
+{
+    /* Without access flags every page looks idle */
+    return false;
+}
+
+__attribute__((weak)) void wss_arch_set_accessed(pte_t* pte) {}
+
+/* Access flag faults are told apart by their syndrome */
+__attribute__((weak)) bool wss_arch_access_fault(pte_t* pte)
+{
+    return true;
+}
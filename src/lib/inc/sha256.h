@@ -0,0 +1,50 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <crossconhyp.h>
+
+#define SHA256_DIGEST_SIZE  (32)
+#define SHA256_BLOCK_SIZE   (64)
+
+struct sha256 {
+    uint32_t state[8];
+    uint64_t size;
+    uint8_t buf[SHA256_BLOCK_SIZE];
+};
+
+void sha256_init(struct sha256* ctx);
+void sha256_update(struct sha256* ctx, const void* data, size_t size);
+void sha256_final(struct sha256* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Copies size bytes from src to dst and hashes them in the same pass. The
+ * copy is done in chunks small enough to still be in the cache when hashed.
+ */
+void sha256_update_copy(struct sha256* ctx, void* dst, const void* src,
+                        size_t size);
+
+void sha256_hmac(const uint8_t* key, size_t key_size, const void* data,
+                 size_t size, uint8_t mac[SHA256_DIGEST_SIZE]);
+
+/**
+ * Compresses nblocks consecutive blocks into state. The portable version is
+ * weak, architectures replace it when they have hardware support.
+ */
+void sha256_blocks(uint32_t state[8], const uint8_t* data, size_t nblocks);
+void sha256_blocks_generic(uint32_t state[8], const uint8_t* data,
+                           size_t nblocks);
+
+#endif /* __SHA256_H__ */
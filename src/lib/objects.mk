@@ -16,3 +16,4 @@
 lib-objs-y+=string.o
 lib-objs-y+=printk.o
 lib-objs-y+=bitmap.o
+lib-objs-y+=sha256.o
@@ -0,0 +1,218 @@
+/**
+ * CROSSCONHyp, a Lightweight Static Partitioning Hypervisor
+ *
+ * Copyright (c) CROSSCONHyp Project (www.crossconhyp-project.org), 2019-
+ *
+ * CROSSCONHyp is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 2 as published by the Free
+ * Software Foundation, with a special exception exempting guest code from such
+ * license. See the COPYING file in the top-level directory for details.
+ *
+ */
+
+
+#include <sha256.h>
+#include <string.h>
+
+#define SHA256_COPY_CHUNK   (0x1000)
+#define SHA256_HMAC_IPAD    (0x36)
+#define SHA256_HMAC_OPAD    (0x5c)
+
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror32(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t* p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+void sha256_blocks_generic(uint32_t state[8], const uint8_t* data,
+                           size_t nblocks)
+{
+    uint32_t w[64];
+
+    while (nblocks-- > 0) {
+        for (size_t i = 0; i < 16; i++) {
+            w[i] = load_be32(&data[i * 4]);
+        }
+        for (size_t i = 16; i < 64; i++) {
+            uint32_t s0 = ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^
+                          (w[i - 15] >> 3);
+            uint32_t s1 = ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^
+                          (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (size_t i = 0; i < 64; i++) {
+            uint32_t s1 = ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+            uint32_t s0 = ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += SHA256_BLOCK_SIZE;
+    }
+}
+
+__attribute__((weak)) void sha256_blocks(uint32_t state[8],
+                                         const uint8_t* data, size_t nblocks)
+{
+    sha256_blocks_generic(state, data, nblocks);
+}
+
+void sha256_init(struct sha256* ctx)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->size = 0;
+}
+
+void sha256_update(struct sha256* ctx, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    size_t used = ctx->size % SHA256_BLOCK_SIZE;
+
+    ctx->size += size;
+
+    if (used > 0) {
+        size_t n = SHA256_BLOCK_SIZE - used;
+        if (n > size) n = size;
+        memcpy(&ctx->buf[used], p, n);
+        p += n;
+        size -= n;
+        if (used + n < SHA256_BLOCK_SIZE) return;
+        sha256_blocks(ctx->state, ctx->buf, 1);
+    }
+
+    if (size >= SHA256_BLOCK_SIZE) {
+        size_t nblocks = size / SHA256_BLOCK_SIZE;
+        sha256_blocks(ctx->state, p, nblocks);
+        p += nblocks * SHA256_BLOCK_SIZE;
+        size -= nblocks * SHA256_BLOCK_SIZE;
+    }
+
+    if (size > 0) {
+        memcpy(ctx->buf, p, size);
+    }
+}
+
+void sha256_update_copy(struct sha256* ctx, void* dst, const void* src,
+                        size_t size)
+{
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+
+    while (size > 0) {
+        size_t n = size < SHA256_COPY_CHUNK ? size : SHA256_COPY_CHUNK;
+        memcpy(d, s, n);
+        sha256_update(ctx, d, n);
+        d += n;
+        s += n;
+        size -= n;
+    }
+}
+
+void sha256_final(struct sha256* ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    size_t used = ctx->size % SHA256_BLOCK_SIZE;
+    uint64_t bits = ctx->size * 8;
+
+    ctx->buf[used++] = 0x80;
+    if (used > SHA256_BLOCK_SIZE - 8) {
+        memset(&ctx->buf[used], 0, SHA256_BLOCK_SIZE - used);
+        sha256_blocks(ctx->state, ctx->buf, 1);
+        used = 0;
+    }
+    memset(&ctx->buf[used], 0, SHA256_BLOCK_SIZE - 8 - used);
+    store_be32(&ctx->buf[SHA256_BLOCK_SIZE - 8], bits >> 32);
+    store_be32(&ctx->buf[SHA256_BLOCK_SIZE - 4], bits);
+    sha256_blocks(ctx->state, ctx->buf, 1);
+
+    for (size_t i = 0; i < 8; i++) {
+        store_be32(&digest[i * 4], ctx->state[i]);
+    }
+}
+
+void sha256_hmac(const uint8_t* key, size_t key_size, const void* data,
+                 size_t size, uint8_t mac[SHA256_DIGEST_SIZE])
+{
+    uint8_t pad[SHA256_BLOCK_SIZE] = {0};
+    uint8_t inner[SHA256_DIGEST_SIZE];
+    struct sha256 ctx;
+
+    if (key_size > SHA256_BLOCK_SIZE) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, key, key_size);
+        sha256_final(&ctx, pad);
+    } else {
+        memcpy(pad, key, key_size);
+    }
+
+    for (size_t i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] ^= SHA256_HMAC_IPAD;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, pad, SHA256_BLOCK_SIZE);
+    sha256_update(&ctx, data, size);
+    sha256_final(&ctx, inner);
+
+    for (size_t i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] ^= SHA256_HMAC_IPAD ^ SHA256_HMAC_OPAD;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, pad, SHA256_BLOCK_SIZE);
+    sha256_update(&ctx, inner, SHA256_DIGEST_SIZE);
+    sha256_final(&ctx, mac);
+}
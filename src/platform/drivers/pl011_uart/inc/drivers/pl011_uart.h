@@ -18,6 +18,7 @@
 #define __PL011_UART_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /* UART Base Address (PL011) */
 
@@ -218,5 +219,8 @@ void uart_init(volatile struct Pl011_Uart_hw * ptr_uart);
 uint32_t uart_getc(volatile struct Pl011_Uart_hw * ptr_uart);
 void uart_putc(volatile struct Pl011_Uart_hw * ptr_uart,int8_t c);
 void uart_puts(volatile struct Pl011_Uart_hw * ptr_uart,const char *s);
+bool uart_try_putc(volatile struct Pl011_Uart_hw * ptr_uart, char c);
+bool uart_try_getc(volatile struct Pl011_Uart_hw * ptr_uart, char *c);
+void uart_set_irqs(volatile struct Pl011_Uart_hw * ptr_uart, bool rx, bool tx);
 
 #endif /* __PL011_UART_H_ */
@@ -131,3 +131,47 @@ void uart_puts(volatile struct Pl011_Uart_hw * ptr_uart,const char *s){
 	}
 
 }
+
+
+bool uart_try_putc(volatile struct Pl011_Uart_hw * ptr_uart, char c){
+
+	if(ptr_uart->flag & UART_FR_TXFF){
+		return false;
+	}
+
+	ptr_uart->data = c;
+	return true;
+
+}
+
+
+bool uart_try_getc(volatile struct Pl011_Uart_hw * ptr_uart, char *c){
+
+	if(ptr_uart->flag & UART_FR_RXFE){
+		return false;
+	}
+
+	*c = ptr_uart->data;
+	return true;
+
+}
+
+
+void uart_set_irqs(volatile struct Pl011_Uart_hw * ptr_uart, bool rx, bool tx){
+
+	uint32_t mask = 0;
+
+	if(rx){
+		mask |= (UART_MIS_RXMIS | UART_MIS_RTMIS);
+	}
+
+	/* The transmit interrupt fires when the FIFO drains below its level */
+	if(tx){
+		mask |= UART_MIS_TXMIS;
+	} else {
+		ptr_uart->isr_clear = UART_ICR_TXIC;
+	}
+
+	ptr_uart->isr_mask = mask;
+
+}
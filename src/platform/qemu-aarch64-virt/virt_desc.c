@@ -27,7 +27,13 @@ struct platform_desc platform = {
     },
 
     .console = {
-        .base = 0x9000000
+        .base = 0x9000000,
+        .interrupt = 33
+    },
+
+    .pci = {
+        .ecam_base = 0x4010000000,
+        .bus_num = 256
     },
 
     .arch = {
@@ -42,9 +48,14 @@ struct platform_desc platform = {
 
         .generic_timer = {
             .irqs = {
-                .virtual = 27
+                .virtual = 27,
+                .hyp = 26
             }
         },
+
+        .pmu = {
+            .interrupt = 23
+        },
     }
 
 };
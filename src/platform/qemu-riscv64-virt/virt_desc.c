@@ -12,8 +12,23 @@ struct platform_desc platform = {
         }
     },
 
+    .pci = {
+        .ecam_base = 0x30000000,
+        .bus_num = 256
+    },
+
     .arch = {
         .plic_base = 0xc000000,
+        .timer_freq = 10000000,
+        /**
+         * Off by default, as not all QEMU versions and cpu models have them.
+         * Set them if the machine runs with e.g. -cpu rv64,svnapot=on,
+         * svinval=on and its dts riscv,isa lists them.
+         */
+        .ext = {
+            .svnapot = false,
+            .svinval = false,
+        },
     }
 
 };
@@ -40,7 +40,8 @@ struct platform_desc platform = {
         },
         .generic_timer = {
             .irqs = {
-                .virtual = 27
+                .virtual = 27,
+                .hyp = 26
             }
         },
     }
@@ -1,6 +1,8 @@
 #include <hypercall.h>
 #include <vmstack.h>
 #include <config.h>
+#include <lu.h>
+#include <wss.h>
 #include "types.h"
 #include "vmm.h"
 #include "arch/sdgpos.h"
@@ -14,7 +16,7 @@
 
 int64_t sdgpos_smc_handler(struct vcpu* vcpu, uint64_t smc_fid)
 {
-    if(vcpu->vm->type != 0)
+    if(vcpu->vm->type != VM_TYPE_GPOS)
         return 0;
     int64_t ret = -HC_E_FAILURE;
     uint64_t x1 = vcpu->regs->x[1];
@@ -35,7 +37,7 @@ int64_t sdgpos_smc_handler(struct vcpu* vcpu, uint64_t smc_fid)
 
 int64_t sdgpos_hvc_handler(struct vcpu* vcpu, uint64_t smc_fid)
 {
-    if(vcpu->vm->type != 0)
+    if(vcpu->vm->type != VM_TYPE_GPOS)
         return 0;
 
     unsigned long ret;
@@ -50,6 +52,26 @@ int64_t sdgpos_hvc_handler(struct vcpu* vcpu, uint64_t smc_fid)
             ret = ipc_hypercall(vcpu, ipc_id, arg1, arg2);
             vcpu_writereg(vcpu, 0, ret);
         break;
+        case HC_IDLE:
+            ret = idle_hypercall(ipc_id, arg1, arg2);
+            vcpu_writereg(vcpu, 0, ret);
+        break;
+        case HC_ATTEST:
+            ret = attest_hypercall(ipc_id, arg1, arg2);
+            vcpu_writereg(vcpu, 0, ret);
+        break;
+        case HC_CONSOLE:
+            ret = vcons_hypercall(ipc_id, arg1, arg2);
+            vcpu_writereg(vcpu, 0, ret);
+        break;
+        case HC_LIVE_UPDATE:
+            ret = lu_hypercall(ipc_id, arg1, arg2);
+            vcpu_writereg(vcpu, 0, ret);
+        break;
+        case HC_WSS:
+            ret = wss_hypercall(ipc_id, arg1, arg2);
+            vcpu_writereg(vcpu, 0, ret);
+        break;
         default:
             /* WARNING("Unknown hypercall id %x", fid); */
             ret = -1;
@@ -80,7 +102,7 @@ bool sdgpos_arch_setup(struct vm *vm)
 
     /* TODO: check config structure or something to check if this VMs wants tz
      * to handle its events */
-    if(vm->type == 0){
+    if(vm->type == VM_TYPE_GPOS){
         vm_hndl_smc_add(vm, &smc);
         vm_hndl_hvc_add(vm, &hvc);
     }
@@ -1,6 +1,8 @@
 #include <hypercall.h>
 #include <vmstack.h>
 #include <config.h>
+#include <lu.h>
+#include <wss.h>
 #include "types.h"
 #include <hypercall.h>
 #include "vm.h"
@@ -25,7 +27,7 @@ static int64_t sdgpos_smc_handler(struct vcpu* vcpu, uint64_t smc_fid)
 
 int64_t sdgpos_hvc_handler(struct vcpu* vcpu, uint64_t fid)
 {
-    if(vcpu->vm->type != 0)
+    if(vcpu->vm->type != VM_TYPE_GPOS)
         return 0;
 
     int64_t ret;
@@ -40,6 +42,21 @@ int64_t sdgpos_hvc_handler(struct vcpu* vcpu, uint64_t fid)
         case HC_IPC:
             ret = ipc_hypercall(vcpu, arg0, arg1, arg2);
             break;
+        case HC_IDLE:
+            ret = idle_hypercall(arg0, arg1, arg2);
+            break;
+        case HC_ATTEST:
+            ret = attest_hypercall(arg0, arg1, arg2);
+            break;
+        case HC_CONSOLE:
+            ret = vcons_hypercall(arg0, arg1, arg2);
+            break;
+        case HC_LIVE_UPDATE:
+            ret = lu_hypercall(arg0, arg1, arg2);
+            break;
+        case HC_WSS:
+            ret = wss_hypercall(arg0, arg1, arg2);
+            break;
         default:
             /* WARNING("Unknown hypercall id %x", fid); */
             ret = -1;
@@ -69,7 +86,7 @@ bool sdgpos_arch_setup(struct vm *vm)
 
     /* TODO: check config structure or something to check if this VMs wants tz
      * to handle its events */
-    if(vm->type == 0){
+    if(vm->type == VM_TYPE_GPOS){
         vm_hndl_smc_add(vm, &smc);
         vm_hndl_hvc_add(vm, &hvc);
     }
@@ -40,7 +40,7 @@ int64_t sdgpos_handler_setup(struct vm *vm)
 
     /* TODO: check config structure or something to check if this VMs wants tz
      * to handle its events */
-    if(vm->type == 0){
+    if(vm->type == VM_TYPE_GPOS){
         vm_hndl_irq_add(vm, &irq);
     }
 
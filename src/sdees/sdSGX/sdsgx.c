@@ -42,7 +42,8 @@ static struct vcpu* sdsgx_get_nclv(struct vcpu* vcpu, int nclv_id)
     return child;
 }
 
-struct config* sdsgx_get_cfg_from_host(struct vm* host, vaddr_t host_ipa)
+struct config* sdsgx_get_cfg_from_host(struct vm* host, vaddr_t host_ipa,
+                                       uint8_t digest[SHA256_DIGEST_SIZE])
 {
     uint64_t paddr = 0;
     vaddr_t nclv_cfg_va = (vaddr_t)NULL;
@@ -79,6 +80,7 @@ struct config* sdsgx_get_cfg_from_host(struct vm* host, vaddr_t host_ipa)
     /* Assumes the last of the page of the config does not map anything other
      * than the config */
     mem_free_vpage(&host->as, host_ipa, NUM_PAGES(cfg_size), false);
+    attest_config_digest(nclv_cfg, digest);
     config_adjust_to_va(nclv_cfg, paddr);
 
     return nclv_cfg;
@@ -86,10 +88,13 @@ struct config* sdsgx_get_cfg_from_host(struct vm* host, vaddr_t host_ipa)
 
 void sdsgx_create(uint64_t host_ipa)
 {
-    struct config* nclv_cfg = sdsgx_get_cfg_from_host(cpu.vcpu->vm, host_ipa);
+    uint8_t cfg_digest[SHA256_DIGEST_SIZE];
+    struct config* nclv_cfg =
+        sdsgx_get_cfg_from_host(cpu.vcpu->vm, host_ipa, cfg_digest);
 
     /* Create enclave */
     struct vm* enclave = vmm_init_dynamic(nclv_cfg, host_ipa);
+    attest_set_config(enclave, cfg_digest);
     /* return the enclave id to the creator */
     vcpu_writereg(cpu.vcpu, 1, enclave->id);
     cpu.vcpu->nclv_data.initialized = false;
@@ -98,7 +103,10 @@ void sdsgx_create(uint64_t host_ipa)
     /* TODO use parent vm.vcpu.id*/
     struct vcpu* enclave_vcpu = vm_get_vcpu(enclave, 0);
     enclave_vcpu->nclv_data.id = enclave->id;
-    vmstack_push(enclave_vcpu);
+    if (!vmstack_push(enclave_vcpu)) {
+        vcpu_writereg(cpu.vcpu, 0, -HC_E_FAILURE);
+        return;
+    }
     enclave_vcpu->nclv_data.initialized = false;
     vcpu_writereg(cpu.vcpu, 0, 0);
 }
@@ -121,7 +129,8 @@ void sdsgx_add_rgn(uint64_t enclave_id, uint64_t donor_ipa, uint64_t enclave_va)
     if (!va) {
         ERROR("mem_alloc_vpage failed %s", __func__);
     }
-    if (!mem_map(&child->vm->as, va, &ppages, 1, PTE_VM_FLAGS)) {
+    if (!mem_map(&child->vm->as, va, &ppages, 1,
+                 child->vm->as.vm_flags)) {
         ERROR("mem_map failed %s", __func__);
     }
 
@@ -138,7 +147,10 @@ void sdsgx_delete(uint64_t enclave_id, uint64_t arg1)
         ERROR("non host invoked enclaved destruction");
     }
 
-    vmm_destroy_dynamic(nclv->vm);
+    if (!vmm_destroy_dynamic(nclv->vm)) {
+        vcpu_writereg(cpu.vcpu, 0, -HC_E_FAILURE);
+        return;
+    }
 
     vcpu_writereg(cpu.vcpu, 0, 0);
 }
@@ -151,9 +163,13 @@ void sdsgx_ecall(uint64_t enclave_id, uint64_t args_addr, uint64_t sp_el0)
     if ((child = sdsgx_get_nclv(cpu.vcpu, enclave_id)) != NULL) {
         /* TODO separate architecture specific details. only works for Arm */
         /* child->arch.sysregs.vm.sp_el0 = sp_el0; */
-        vmstack_push(child);
-        vcpu_writereg(cpu.vcpu, 1, args_addr);
-        vcpu_writereg(cpu.vcpu, 2, sp_el0);
+        if (vmstack_push(child)) {
+            vcpu_writereg(cpu.vcpu, 1, args_addr);
+            vcpu_writereg(cpu.vcpu, 2, sp_el0);
+        } else {
+            res = -HC_E_FAILURE;
+            vcpu_writereg(cpu.vcpu, 0, res);
+        }
     } else {
         res = -HC_E_INVAL_ARGS;
         vcpu_writereg(cpu.vcpu, 0, res);
@@ -183,7 +199,10 @@ void sdsgx_resume(uint64_t enclave_id)
     int64_t res = HC_E_SUCCESS;
     struct vcpu* enclave = NULL;
     if ((enclave = sdsgx_get_nclv(cpu.vcpu, enclave_id)) != NULL) {
-        vmstack_push(enclave);
+        if (!vmstack_push(enclave)) {
+            res = -HC_E_FAILURE;
+            vcpu_writereg(cpu.vcpu, 0, res);
+        }
     } else {
         res = -HC_E_INVAL_ARGS;
         vcpu_writereg(cpu.vcpu, 0, res);
@@ -282,7 +301,7 @@ int64_t sdsgx_handle_abort(struct vcpu* vcpu, uint64_t addr)
     int64_t res = HC_E_SUCCESS;
     struct vcpu* enclave = NULL;
 
-    if(vcpu->vm->type != 3)
+    if(vcpu->vm->type != VM_TYPE_ENCLAVE)
         return 0;
 
     enclv_aborts++;
@@ -311,7 +330,7 @@ uint64_t irqs = 0;
 void sdsgx_handle_interrupt(struct vcpu* vcpu, irqid_t int_id)
 {
     if (vcpu != cpu.vcpu && vcpu->state == VCPU_STACKED) {
-        if (cpu.vcpu->vm->type == 3) { /* currently running enclave */
+        if (cpu.vcpu->vm->type == VM_TYPE_ENCLAVE) { /* currently running enclave */
             if (cpu.vcpu->nclv_data.initialized == false) return;
             vmstack_pop(); /* transition to normal world */
             irqs++;
@@ -347,13 +366,16 @@ int64_t sdsgx_handler_setup(struct vm* vm)
 
     if (vm == NULL) return -1;
 
+    /* Enclave pages are donated and reclaimed one PAGE_SIZE page at a time */
+    if (pt_granule(&vm->as.pt) != PAGE_SIZE) return 0;
+
     /* TODO: check config structure or something to check if this VMs wants tz
      * to handle its events */
     vm_hndl_hvc_add(vm, &hvc);
     vm_hndl_irq_add(vm, &irq);
 
     /* TODO */
-    if(vm->type == 3)
+    if(vm->type == VM_TYPE_ENCLAVE)
         vm_hndl_mem_abort_add(vm, &mem_abort);
 
     return ret;
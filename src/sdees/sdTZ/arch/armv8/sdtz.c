@@ -33,7 +33,7 @@ int64_t sdtz_smc_handler(struct vcpu* vcpu, uint64_t smc_fid) {
 
     struct vcpu *calling_vcpu = cpu.vcpu;
 
-    if (calling_vcpu->vm->type == 0) { /* normal world */
+    if (calling_vcpu->vm->type == VM_TYPE_GPOS) { /* normal world */
         if (is_psci_fid(smc_fid)) {
             /* TODO: signal trusted OS a PSCI event is comming up */
             /* potentially handle core going to sleep */
@@ -58,6 +58,18 @@ static struct hndl_smc smc = {
 };
 
 
+static void sdtz_psci_hook(struct vcpu* vcpu, enum psci_event event)
+{
+    switch (event) {
+        case PSCI_EVENT_CPU_ON:
+            sdtz_tee_cpu_on(vcpu);
+            break;
+        case PSCI_EVENT_CPU_OFF:
+            sdtz_tee_cpu_off(vcpu);
+            break;
+    }
+}
+
 int64_t sdtz_arch_handler_setup(struct vm *vm)
 {
     int64_t ret = 0;
@@ -69,6 +81,10 @@ int64_t sdtz_arch_handler_setup(struct vm *vm)
      * to handle its events */
     vm_hndl_smc_add(vm, &smc);
 
+    if(vm->type == VM_TYPE_TEE_HOST || vm->type == VM_TYPE_TEE_GUEST){
+        psci_hook_add(vm, sdtz_psci_hook);
+    }
+
     return ret;
 }
 
@@ -7,4 +7,12 @@
 
 int64_t sdtz_handler_setup(struct vm *vm);
 
+/**
+ * Bring up or take down a TEE's vcpu on the current cpu, following its boot
+ * descriptor. The TEE reports it is done through the matching RETURN_*_DONE
+ * call. A TEE vcpu not running on this cpu is brought up on its next use.
+ */
+bool sdtz_tee_cpu_on(struct vcpu* tee_vcpu);
+void sdtz_tee_cpu_off(struct vcpu* tee_vcpu);
+
 #endif /* TEE_H_ */
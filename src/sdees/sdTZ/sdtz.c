@@ -8,8 +8,10 @@
 #include "vmm.h"
 #include <arch/sdtz.h>
 
-static int optee_crash = 0;
-static int optee2_crash = 0;
+static inline bool sdtz_tee_crashed(struct vcpu* tee_vcpu)
+{
+    return tee_vcpu != NULL && tee_vcpu->vm->state == VM_CRASHED;
+}
 
 static inline void sdtz_copy_args(struct vcpu *vcpu_dst, struct vcpu *vcpu_src,
         size_t num_args) {
@@ -27,6 +29,82 @@ static inline void sdtz_copy_args_call_done(struct vcpu *vcpu_dst, struct vcpu
     }
 }
 
+/**
+ * OP-TEE's thread_vector_table, reported on ENTRY_DONE, holds one branch
+ * instruction per entry.
+ */
+#define TEE_VECTOR_CPU_ON   (2)
+#define TEE_VECTOR_CPU_OFF  (3)
+#define TEE_VECTOR_SIZE     (4)
+
+static vaddr_t sdtz_tee_entry(struct vm* vm, vaddr_t entry, size_t vector)
+{
+    if (entry == 0 && vm->tee_vectors != 0) {
+        entry = vm->tee_vectors + (vector * TEE_VECTOR_SIZE);
+    }
+    return entry;
+}
+
+static void sdtz_tee_reset(struct vcpu* tee_vcpu, vaddr_t entry)
+{
+    vcpu_arch_reset(tee_vcpu, entry);
+    vcpu_restore_state(tee_vcpu);
+    vcpu_arch_set_power(tee_vcpu, true);
+}
+
+bool sdtz_tee_cpu_on(struct vcpu* tee_vcpu)
+{
+    struct vm* vm = tee_vcpu->vm;
+    vaddr_t entry =
+        sdtz_tee_entry(vm, vm->config->tee.cpu_on_entry, TEE_VECTOR_CPU_ON);
+
+    tee_vcpu->tee_data.online = false;
+    tee_vcpu->tee_data.call_pending = false;
+
+    if (entry != 0) {
+        sdtz_tee_reset(tee_vcpu, entry);
+    } else if (tee_vcpu->id == 0) {
+        /* The TEE never ran. This is its cold boot. */
+        sdtz_tee_reset(tee_vcpu, vm->config->entry);
+    } else {
+        WARNING("TEE vm %d has no cpu_on entry", vm->id);
+        return false;
+    }
+
+    return true;
+}
+
+void sdtz_tee_cpu_off(struct vcpu* tee_vcpu)
+{
+    struct vm* vm = tee_vcpu->vm;
+    vaddr_t entry =
+        sdtz_tee_entry(vm, vm->config->tee.cpu_off_entry, TEE_VECTOR_CPU_OFF);
+
+    tee_vcpu->tee_data.online = false;
+    tee_vcpu->tee_data.call_pending = false;
+
+    if (tee_vcpu != cpu.vcpu) {
+        /* It is brought up again on this cpu on its next use */
+        return;
+    }
+
+    if (entry != 0) {
+        sdtz_tee_reset(tee_vcpu, entry);
+    } else {
+        vcpu_arch_set_power(tee_vcpu, false);
+        cpu_defer_idle();
+    }
+}
+
+static void sdtz_tee_entry_done(struct vcpu* optee_vcpu)
+{
+    if (optee_vcpu->vm->tee_vectors == 0) {
+        optee_vcpu->vm->tee_vectors =
+            vcpu_readreg(optee_vcpu, HYPCALL_ARG_REG(1));
+    }
+    optee_vcpu->tee_data.online = true;
+}
+
 int64_t optee_handle_nw(struct vcpu* ree_vcpu)
 {
     int64_t ret = -HC_E_FAILURE;
@@ -52,8 +130,25 @@ int64_t optee2_handle_nw(struct vcpu* ree_vcpu)
     }
 
     tee_arch_interrupt_disable();
-    if(optee_vcpu->vm->type == 2){
-        vmstack_push(optee_vcpu);
+    if(optee_vcpu->vm->type == VM_TYPE_TEE_GUEST){
+        if(!vmstack_push(optee_vcpu)){
+            tee_arch_interrupt_enable();
+            return -HC_E_FAILURE;
+        }
+        if(!optee_vcpu->tee_data.online){
+            /**
+             * The TEE is brought up on this cpu on its first use. The call is
+             * replayed once it is done booting.
+             */
+            if(!sdtz_tee_cpu_on(optee_vcpu)){
+                vmstack_pop();
+                tee_arch_interrupt_enable();
+                vcpu_writereg(ree_vcpu, 0, -1);
+                return HC_E_SUCCESS;
+            }
+            optee_vcpu->tee_data.call_pending = true;
+            return HC_E_SUCCESS;
+        }
         sdtz_copy_args(cpu.vcpu, ree_vcpu, 7);
         /* TODO: more generic stepping */
         /* in arm steeping is done here, but in RISC-V it is done outside */
@@ -69,13 +164,22 @@ int64_t optee_handle_sw(struct vcpu* optee_vcpu, uint64_t fid)
     int64_t ret = -HC_E_FAILURE;
     struct vcpu *ree_vcpu = vcpu_get_child(optee_vcpu, 0);
     if (ree_vcpu != NULL) {
+        bool pushed = true;
         /* There is bulshit when copying regsiters */
         switch (ID_TO_FUNCID(fid)) {
-            case TEEHC_FUNCID_RETURN_SUSPEND_DONE:
             case TEEHC_FUNCID_RETURN_ON_DONE:
+                optee_vcpu->tee_data.online = true;
+                /* fallthrough */
+            case TEEHC_FUNCID_RETURN_SUSPEND_DONE:
                 sdtz_copy_args(ree_vcpu, cpu.vcpu, 1);
-                vmstack_push(ree_vcpu);
+                pushed = vmstack_push(ree_vcpu);
+                tee_arch_interrupt_enable();
+                break;
+            case TEEHC_FUNCID_RETURN_OFF_DONE:
+                /* The normal world is off, so is this cpu until it is back */
+                vcpu_arch_set_power(optee_vcpu, false);
                 tee_arch_interrupt_enable();
+                cpu_defer_idle();
                 break;
             case TEEHC_FUNCID_RETURN_CALL_DONE:
                 if(vcpu_readreg(cpu.vcpu, 1) == 0xffff0004){
@@ -84,20 +188,21 @@ int64_t optee_handle_sw(struct vcpu* optee_vcpu, uint64_t fid)
                     sdtz_copy_args_call_done(ree_vcpu, cpu.vcpu, 4);
                 } else
                     sdtz_copy_args_call_done(ree_vcpu, cpu.vcpu, 6);
-                vmstack_push(ree_vcpu);
+                pushed = vmstack_push(ree_vcpu);
                 tee_arch_interrupt_enable();
                 break;
             case TEEHC_FUNCID_RETURN_ENTRY_DONE:
-                vmstack_push(ree_vcpu);
+                sdtz_tee_entry_done(optee_vcpu);
+                pushed = vmstack_push(ree_vcpu);
                 struct vcpu *guest_vcpu = vcpu_get_child(ree_vcpu, 0);
-                if(guest_vcpu != NULL)
-                    vmstack_push(guest_vcpu);
+                if(pushed && guest_vcpu != NULL)
+                    pushed = vmstack_push(guest_vcpu);
 
                 break;
             default:
                 ERROR("unknown tee call %0lx by vm %d", fid, cpu.vcpu->vm->id);
         }
-        ret = HC_E_SUCCESS;
+        ret = pushed ? HC_E_SUCCESS : -HC_E_FAILURE;
     }
 
     return ret;
@@ -111,8 +216,16 @@ int64_t optee2_handle_sw(struct vcpu* optee_vcpu, uint64_t fid)
     struct vcpu *ree_vcpu = cpu.vcpu;
     if (ree_vcpu != NULL) {
         switch (ID_TO_FUNCID(fid)) {
-            case TEEHC_FUNCID_RETURN_SUSPEND_DONE:
             case TEEHC_FUNCID_RETURN_ON_DONE:
+                optee_vcpu->tee_data.online = true;
+                if (optee_vcpu->tee_data.call_pending) {
+                    /* Brought up on first use, now serve that call */
+                    optee_vcpu->tee_data.call_pending = false;
+                    optee2_handle_nw(ree_vcpu);
+                    break;
+                }
+                /* fallthrough */
+            case TEEHC_FUNCID_RETURN_SUSPEND_DONE:
                 sdtz_copy_args(ree_vcpu, optee_vcpu, 1);
                 tee_arch_interrupt_enable();
                 break;
@@ -123,7 +236,15 @@ int64_t optee2_handle_sw(struct vcpu* optee_vcpu, uint64_t fid)
                     sdtz_copy_args_call_done(ree_vcpu, optee_vcpu, 4);
                 } else
                     sdtz_copy_args_call_done(ree_vcpu, optee_vcpu, 6);
+                tee_arch_interrupt_enable();
+                break;
             case TEEHC_FUNCID_RETURN_ENTRY_DONE:
+                sdtz_tee_entry_done(optee_vcpu);
+                if (optee_vcpu->tee_data.call_pending) {
+                    optee_vcpu->tee_data.call_pending = false;
+                    optee2_handle_nw(ree_vcpu);
+                    break;
+                }
                 tee_arch_interrupt_enable();
                 break;
             default:
@@ -145,17 +266,17 @@ int64_t optee2_handle_sw(struct vcpu* optee_vcpu, uint64_t fid)
 int64_t sdtz_handler(struct vcpu* vcpu, uint64_t fid) {
     int64_t ret = -HC_E_FAILURE;
 
-    if (vcpu->vm->type == 0) {
+    if (vcpu->vm->type == VM_TYPE_GPOS) {
 	/* normal world */
         if(IS_OPTEE(fid)) {
-            if(!optee_crash){
+            if(!sdtz_tee_crashed(vcpu->parent)){
                 ret = optee_handle_nw(vcpu);
             } else {
                 /* TODO: arch specific */
                 vcpu_writereg(cpu.vcpu, 10, 0x7);
             }
         } else if(IS_OPTEE2(fid)) {
-            if(!optee2_crash){
+            if(!sdtz_tee_crashed(vcpu_get_child(vcpu, 0))){
                 ret = optee2_handle_nw(vcpu);
             } else {
                 /* TODO: arch specific */
@@ -165,9 +286,9 @@ int64_t sdtz_handler(struct vcpu* vcpu, uint64_t fid) {
     } else {
         /* secure world */
         /* TODO: get parent */
-        if(cpu.vcpu->vm->type == 1){ /* host secure world */
+        if(cpu.vcpu->vm->type == VM_TYPE_TEE_HOST){ /* host secure world */
             ret = optee_handle_sw(vcpu, fid);
-        } else if (cpu.vcpu->vm->type == 2){ /* guest secure world */
+        } else if (cpu.vcpu->vm->type == VM_TYPE_TEE_GUEST){ /* guest secure world */
             ret = optee2_handle_sw(vcpu, fid);
         }
     }
@@ -186,7 +307,7 @@ void sdtz_handle_interrupt(struct vcpu* vcpu, irqid_t int_id)
     /* TODO: check current active handler */
 
    if(vcpu != cpu.vcpu && vcpu->state == VCPU_INACTIVE){
-       if (cpu.vcpu->vm->type == 1) {
+       if (cpu.vcpu->vm->type == VM_TYPE_TEE_HOST) {
            /* TODO */
            /* interrupts_vm_inject(cpu.vcpu, 40); */
        }
@@ -197,19 +318,19 @@ int64_t sdtz_handle_abort(struct vcpu* vcpu, uint64_t addr)
 {
     int64_t res = HC_E_SUCCESS;
 
-    if(vcpu->vm->type == 1){
+    if(vcpu->vm->type == VM_TYPE_TEE_HOST){
         struct vcpu *ree_vcpu = vcpu_get_child(vcpu, 0);
-        if (ree_vcpu != NULL) {
-            vmstack_push(ree_vcpu);
+        if (ree_vcpu != NULL && !vmstack_push(ree_vcpu)) {
+            res = -HC_E_FAILURE;
         }
-        optee_crash = 1;
         INFO("VM %d performed illegal access. Disabling.", vcpu->vm->id);
+        vm_crash(vcpu->vm);
         tee_arch_interrupt_enable();
-    } else if(vcpu->vm->type == 2){
+    } else if(vcpu->vm->type == VM_TYPE_TEE_GUEST){
         vmstack_pop();
         tee_arch_interrupt_enable();
-        optee2_crash = 1;
         INFO("VM %d performed illegal access. Disabling.", vcpu->vm->id);
+        vm_crash(vcpu->vm);
     }
 
     /* TODO: arch specific */